@@ -0,0 +1,123 @@
+#include "AVSyncMonitor.hpp"
+
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#define MODULE "AVSyncMonitor"
+
+// Smoothing of the measured offset, in updates (~2s with 40ms frames)
+#define AV_SYNC_FILTER 64
+// Consecutive deviating updates before the timeline is re-anchored
+#define AV_SYNC_RESYNC_UPDATES 10
+// Interval the drift rate is estimated over
+#define AV_SYNC_DRIFT_WINDOW_S 10
+
+AVSyncMonitor::AVSyncMonitor(int sampleRate, int64_t resyncUs, bool correct)
+    : rate(std::max(1, sampleRate))
+    , resyncUs(resyncUs)
+    , correct(correct)
+    , resyncCount(0)
+{
+    reset();
+}
+
+void AVSyncMonitor::reset()
+{
+    anchored = false;
+    anchorSample = 0;
+    anchorUs = 0;
+    filteredUs = 0;
+    appliedUs = 0;
+    lastSample = 0;
+    outliers = 0;
+    windowSample = 0;
+    windowOffsetUs = 0;
+    drift = 0;
+    haveDrift = false;
+}
+
+void AVSyncMonitor::anchor(uint64_t sample, int64_t systemUs)
+{
+    anchored = true;
+    anchorSample = sample;
+    anchorUs = systemUs;
+    filteredUs = 0;
+    appliedUs = 0;
+    lastSample = sample;
+    outliers = 0;
+    windowSample = sample;
+    windowOffsetUs = 0;
+}
+
+int64_t AVSyncMonitor::nominalUs(uint64_t sample) const
+{
+    int64_t samples = static_cast<int64_t>(sample - anchorSample);
+    return anchorUs + samples * 1000000 / rate;
+}
+
+void AVSyncMonitor::update(uint64_t sample, int64_t systemUs)
+{
+    if (!anchored)
+    {
+        anchor(sample, systemUs);
+        return;
+    }
+
+    if (sample <= lastSample)
+        return;
+
+    double error = static_cast<double>(systemUs - nominalUs(sample));
+
+    // Single late frames are capture scheduling, only a lasting step is real
+    if (std::fabs(error - filteredUs) > resyncUs)
+    {
+        if (++outliers < AV_SYNC_RESYNC_UPDATES)
+            return;
+
+        LOG_WARN("Audio timeline off by " << static_cast<int64_t>(error - appliedUs) / 1000
+                                          << "ms, re-anchoring to the system clock.");
+        resyncCount++;
+
+        // Jump ahead right away but never back, a backward step is held and
+        // slewed out like a correction
+        int64_t previousUs = timestampUs(sample);
+        anchor(sample, systemUs);
+        if (previousUs > systemUs)
+            appliedUs = static_cast<double>(previousUs - systemUs);
+        return;
+    }
+    outliers = 0;
+
+    filteredUs += (error - filteredUs) / AV_SYNC_FILTER;
+
+    // Without correction only a step held back at a re-anchor is slewed out
+    double targetUs = correct ? filteredUs : 0;
+    if (appliedUs != targetUs)
+    {
+        double elapsedUs = static_cast<double>(sample - lastSample) * 1000000 / rate;
+        double maxStep = elapsedUs * AV_SYNC_MAX_SLEW_PPM / 1000000;
+        appliedUs += std::clamp(targetUs - appliedUs, -maxStep, maxStep);
+    }
+    lastSample = sample;
+
+    uint64_t windowSamples = sample - windowSample;
+    if (windowSamples >= static_cast<uint64_t>(rate) * AV_SYNC_DRIFT_WINDOW_S)
+    {
+        double windowUs = static_cast<double>(windowSamples) * 1000000 / rate;
+        double ppm = (windowOffsetUs - filteredUs) * 1000000 / windowUs;
+        drift = haveDrift ? drift + (ppm - drift) / 4 : ppm;
+        haveDrift = true;
+        windowSample = sample;
+        windowOffsetUs = filteredUs;
+
+        LOG_DEBUG("Audio clock drift " << drift << "ppm, offset " << sampleClockOffsetUs()
+                                       << "us, A/V " << avOffsetUs() << "us");
+    }
+}
+
+int64_t AVSyncMonitor::timestampUs(uint64_t sample) const
+{
+    return nominalUs(sample) + static_cast<int64_t>(appliedUs);
+}
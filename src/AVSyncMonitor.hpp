@@ -0,0 +1,69 @@
+#ifndef AV_SYNC_MONITOR_HPP
+#define AV_SYNC_MONITOR_HPP
+
+// Maps audio sample positions to presentation timestamps on the
+// TimestampManager clock, which video is stamped with as well.
+//
+// Counting samples alone drifts away from the video clock whenever the audio
+// codec clock is off its nominal rate. The monitor compares the sample clock
+// with the system time each captured frame was seen at, filters out
+// scheduling jitter and slews a correction into the audio timestamps, at most
+// AV_SYNC_MAX_SLEW_PPM of the elapsed audio time so timestamps stay monotonic.
+// A persistent step (lost samples, stalled capture) re-anchors the timeline.
+// A re-anchor may move the timestamps forward, a step back is held instead
+// and slewed out, so timestamps never go backwards.
+
+#include <cstdint>
+
+// Maximum rate the applied correction may change at
+#define AV_SYNC_MAX_SLEW_PPM 1000
+
+class AVSyncMonitor
+{
+public:
+    // resyncUs: deviation that re-anchors the timeline once it persists
+    // correct: false keeps pure sample counting but still measures
+    AVSyncMonitor(int sampleRate, int64_t resyncUs, bool correct);
+
+    void reset();
+
+    // The sample at position sample was captured at systemUs
+    void update(uint64_t sample, int64_t systemUs);
+
+    // Presentation time of the sample at position sample
+    int64_t timestampUs(uint64_t sample) const;
+
+    // Corrected audio timeline minus system clock, what's left after correction
+    int64_t avOffsetUs() const { return static_cast<int64_t>(appliedUs - filteredUs); }
+    // Plain sample counting minus system clock since the last anchor
+    int64_t sampleClockOffsetUs() const { return static_cast<int64_t>(-filteredUs); }
+    // Sample clock rate error, positive when the audio clock runs fast
+    double driftPpm() const { return drift; }
+    uint32_t resyncs() const { return resyncCount; }
+
+private:
+    int64_t nominalUs(uint64_t sample) const;
+    void anchor(uint64_t sample, int64_t systemUs);
+
+    int rate;
+    int64_t resyncUs;
+    bool correct;
+
+    bool anchored;
+    uint64_t anchorSample;
+    int64_t anchorUs;
+
+    double filteredUs;      // smoothed system minus nominal time
+    double appliedUs;       // correction added to the timestamps
+    uint64_t lastSample;
+    int outliers;
+
+    uint64_t windowSample;
+    double windowOffsetUs;
+    double drift;
+    bool haveDrift;
+
+    uint32_t resyncCount;
+};
+
+#endif // AV_SYNC_MONITOR_HPP
@@ -0,0 +1,224 @@
+#include "AdaptiveBitrate.hpp"
+
+#include "IMPEncoder.hpp"
+#include "Logger.hpp"
+#include "RTSPStatus.hpp"
+#include "WorkerUtils.hpp"
+#include "globals.hpp"
+
+#include "RTPSink.hh"
+
+#include <algorithm>
+#include <cstring>
+
+#define MODULE "ABR"
+
+// Receivers without a report for this long have left or are stuck
+#define ABR_RECEIVER_TIMEOUT_S 15
+// Rise per interval once the path is clean
+#define ABR_INCREASE_PERCENT 10
+
+AdaptiveBitrate::AdaptiveBitrate(int encChn)
+    : encChn(encChn)
+    , stream(cfg->streams[encChn])
+    , targetBitrate(0)
+    , targetFps(0)
+    , lastJitterMs(0)
+    , minRttMs(0)
+    , lastDecision()
+    , decision("none")
+    , decisions(0)
+{
+}
+
+void AdaptiveBitrate::onReceiverReport(RTPSink *sink)
+{
+    if (!cfg->rtsp.adaptive_bitrate_enabled || sink == nullptr)
+        return;
+
+    if (targetBitrate != 0
+        && WorkerUtils::getMonotonicTimeDiffInMs(&lastDecision) < cfg->rtsp.adaptation_interval_seconds * 1000ULL)
+        return;
+
+    std::vector<Receiver> receivers;
+    if (!collect(sink, receivers))
+        return;
+
+    Receiver viewer = select(receivers);
+    decide(viewer, receivers.size());
+    WorkerUtils::getMonotonicTimeOfDay(&lastDecision);
+    writeStats(viewer, receivers.size());
+}
+
+bool AdaptiveBitrate::collect(RTPSink *sink, std::vector<Receiver> &receivers)
+{
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+
+    RTPTransmissionStatsDB::Iterator iter(sink->transmissionStats());
+    RTPTransmissionStats *stats;
+    while ((stats = iter.next()) != nullptr)
+    {
+        if (now.tv_sec - stats->lastTimeReceived().tv_sec > ABR_RECEIVER_TIMEOUT_S)
+            continue;
+
+        Receiver receiver;
+        receiver.ssrc = stats->SSRC();
+        receiver.loss = stats->packetLossRatio() / 256.0f;
+        // 90 kHz RTP clock for video, round trip in 1/65536 s
+        receiver.jitterMs = stats->jitter() / 90;
+        receiver.rttMs = static_cast<int>((static_cast<uint64_t>(stats->roundTripDelay()) * 1000) >> 16);
+        receivers.push_back(receiver);
+    }
+
+    return !receivers.empty();
+}
+
+AdaptiveBitrate::Receiver AdaptiveBitrate::select(std::vector<Receiver> &receivers) const
+{
+    if (strcmp(cfg->rtsp.adaptive_policy, "median") == 0)
+    {
+        // One viewer on a bad link doesn't pull everybody down
+        auto mid = receivers.begin() + receivers.size() / 2;
+        std::nth_element(receivers.begin(), mid, receivers.end(),
+                         [](const Receiver &a, const Receiver &b) { return a.loss < b.loss; });
+        return *mid;
+    }
+
+    // worst: every viewer has to keep up
+    Receiver worst = receivers.front();
+    for (const Receiver &r : receivers)
+    {
+        worst.loss = std::max(worst.loss, r.loss);
+        worst.jitterMs = std::max(worst.jitterMs, r.jitterMs);
+        worst.rttMs = std::max(worst.rttMs, r.rttMs);
+    }
+    return worst;
+}
+
+void AdaptiveBitrate::decide(const Receiver &viewer, int viewers)
+{
+    int maxBitrate = stream.bitrate;
+    int maxFps = stream.fps;
+    int minBitrate = std::min(cfg->rtsp.adaptive_min_bitrate, maxBitrate);
+    int minFps = std::min(cfg->rtsp.adaptive_min_fps, maxFps);
+
+    // Follow configuration changes of the stream
+    if (targetBitrate == 0 || targetBitrate > maxBitrate)
+        targetBitrate = maxBitrate;
+    if (targetFps == 0 || targetFps > maxFps)
+        targetFps = maxFps;
+
+    int bitrate = targetBitrate;
+    int fps = targetFps;
+    float threshold = cfg->rtsp.packet_loss_threshold;
+
+    bool rttGrowing = minRttMs > 0 && viewer.rttMs > minRttMs * 2 && viewer.rttMs - minRttMs > 50;
+    bool jitterGrowing = lastJitterMs > 0 && viewer.jitterMs > lastJitterMs * 3 / 2 && viewer.jitterMs > 30;
+
+    if (viewer.loss > threshold)
+    {
+        int available = static_cast<int>(targetBitrate * (1.0f - viewer.loss));
+        int next = static_cast<int>(available / cfg->rtsp.bandwidth_margin);
+        if (targetBitrate > minBitrate)
+        {
+            bitrate = std::max(next, minBitrate);
+            decision = "decrease";
+        }
+        else if (targetFps > minFps)
+        {
+            fps = std::max(targetFps * 3 / 4, minFps);
+            decision = "fps_down";
+        }
+        else
+        {
+            decision = "floor";
+        }
+    }
+    else if (rttGrowing || jitterGrowing)
+    {
+        decision = "hold";
+    }
+    else if (viewer.loss < threshold / 2)
+    {
+        if (targetFps < maxFps)
+        {
+            fps = std::min(targetFps * 4 / 3 + 1, maxFps);
+            decision = "fps_up";
+        }
+        else if (targetBitrate < maxBitrate)
+        {
+            bitrate = std::min(targetBitrate + targetBitrate * ABR_INCREASE_PERCENT / 100 + 1, maxBitrate);
+            decision = "increase";
+        }
+        else
+        {
+            decision = "steady";
+        }
+    }
+    else
+    {
+        decision = "hold";
+    }
+
+    lastJitterMs = viewer.jitterMs;
+    if (viewer.rttMs > 0 && (minRttMs == 0 || viewer.rttMs < minRttMs))
+        minRttMs = viewer.rttMs;
+
+    if (bitrate != targetBitrate || fps != targetFps)
+    {
+        LOG_DEBUG("stream" << encChn << " " << decision << ": " << bitrate << " kbps, " << fps
+                           << " fps (viewers: " << viewers << ", loss: " << static_cast<int>(viewer.loss * 100)
+                           << "%, jitter: " << viewer.jitterMs << " ms, rtt: " << viewer.rttMs << " ms)");
+        apply(bitrate, fps);
+        decisions++;
+    }
+}
+
+void AdaptiveBitrate::apply(int bitrate, int fps)
+{
+    if (global_restart || !global_video[encChn])
+        return;
+
+    video_stream::LockedEncoder encoder = global_video[encChn]->lock_encoder();
+    if (!encoder)
+        return;
+    if (bitrate != targetBitrate && encoder->setBitrate(bitrate))
+        targetBitrate = bitrate;
+    if (fps != targetFps && encoder->setFps(fps))
+        targetFps = fps;
+}
+
+void AdaptiveBitrate::reset()
+{
+    if (targetBitrate != 0 && (targetBitrate != stream.bitrate || targetFps != stream.fps))
+    {
+        LOG_DEBUG("stream" << encChn << " back to " << stream.bitrate << " kbps, " << stream.fps << " fps");
+        apply(stream.bitrate, stream.fps);
+    }
+
+    targetBitrate = 0;
+    targetFps = 0;
+    lastJitterMs = 0;
+    minRttMs = 0;
+    decision = "none";
+
+    std::string streamName = CFG::streamName(encChn);
+    RTSPStatus::writeCustomParameter(streamName, "abr_decision", decision);
+    RTSPStatus::writeCustomParameter(streamName, "abr_viewers", "0");
+}
+
+void AdaptiveBitrate::writeStats(const Receiver &viewer, int viewers)
+{
+    std::string streamName = CFG::streamName(encChn);
+    RTSPStatus::writeCustomParameter(streamName, "abr_target_bitrate", std::to_string(targetBitrate));
+    RTSPStatus::writeCustomParameter(streamName, "abr_target_fps", std::to_string(targetFps));
+    RTSPStatus::writeCustomParameter(streamName, "abr_decision", decision);
+    RTSPStatus::writeCustomParameter(streamName, "abr_decisions", std::to_string(decisions));
+    RTSPStatus::writeCustomParameter(streamName, "abr_viewers", std::to_string(viewers));
+    RTSPStatus::writeCustomParameter(streamName, "abr_loss_percent", std::to_string(static_cast<int>(viewer.loss * 100)));
+    RTSPStatus::writeCustomParameter(streamName, "abr_jitter_ms", std::to_string(viewer.jitterMs));
+    RTSPStatus::writeCustomParameter(streamName, "abr_rtt_ms", std::to_string(viewer.rttMs));
+    RTSPStatus::writeCustomParameter(streamName, "abr_measured_kbps",
+                                     std::to_string(stream.stats.bps * 8 / 1000));
+}
@@ -0,0 +1,71 @@
+#ifndef ADAPTIVE_BITRATE_HPP
+#define ADAPTIVE_BITRATE_HPP
+
+// RTCP driven rate control of one video stream. Every RTCP receiver report of
+// a viewer of the stream (fraction lost, jitter, round trip time) is fed in,
+// at most every rtsp.adaptation_interval_seconds the reports of all viewers
+// are reduced to one (rtsp.adaptive_policy) and the encoder is steered:
+//
+//  - loss above rtsp.packet_loss_threshold: the available bandwidth is
+//    estimated as target * (1 - loss), the bitrate drops to that divided by
+//    rtsp.bandwidth_margin. Already at rtsp.adaptive_min_bitrate, the frame
+//    rate is lowered instead, down to rtsp.adaptive_min_fps.
+//  - growing jitter or round trip time: queues build up, hold.
+//  - loss below half the threshold: the frame rate comes back first, then the
+//    bitrate rises by 10% per interval up to the configured stream bitrate.
+//
+// Lives on the live555 thread, the RR handlers and session callbacks of the
+// subsession call in, nothing here is locked.
+
+#include "Config.hpp"
+
+#include <cstdint>
+#include <string>
+#include <sys/time.h>
+#include <vector>
+
+class RTPSink;
+
+class AdaptiveBitrate
+{
+public:
+    explicit AdaptiveBitrate(int encChn);
+
+    // A receiver report arrived on the sink of the stream
+    void onReceiverReport(RTPSink *sink);
+
+    // The last viewer left, the encoder goes back to the configured values
+    void reset();
+
+private:
+    struct Receiver
+    {
+        uint32_t ssrc;
+        float loss;         // fraction lost, 0..1
+        int jitterMs;
+        int rttMs;
+    };
+
+    bool collect(RTPSink *sink, std::vector<Receiver> &receivers);
+    Receiver select(std::vector<Receiver> &receivers) const;
+    void decide(const Receiver &viewer, int viewers);
+    void apply(int bitrate, int fps);
+    void writeStats(const Receiver &viewer, int viewers);
+
+    int encChn;
+    _stream &stream;
+
+    // Current targets, 0 until the first decision
+    int targetBitrate;
+    int targetFps;
+
+    // Baseline to tell growing queues from a steady path
+    int lastJitterMs;
+    int minRttMs;
+
+    struct timeval lastDecision;
+    const char *decision;
+    uint32_t decisions;
+};
+
+#endif // ADAPTIVE_BITRATE_HPP
@@ -0,0 +1,446 @@
+#include "AudioOutputSink.hpp"
+
+#include "IMPAudioOutputSink.hpp"
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MODULE "AudioOutputSink"
+
+#define DEFAULT_PIPE_COMMAND "/bin/iac -s"
+#define DEFAULT_FILE_PATH "/dev/null"
+
+extern char **environ;
+
+AudioOutputSink *AudioOutputSink::createNew(const char *type, const char *path)
+{
+    bool hasPath = path != nullptr && path[0] != '\0';
+
+    if (strcmp(type, "pipe") == 0)
+    {
+        return PipeAudioOutputSink::createNew(hasPath ? path : DEFAULT_PIPE_COMMAND);
+    }
+    if (strcmp(type, "file") == 0)
+    {
+        return FileAudioOutputSink::createNew(hasPath ? path : DEFAULT_FILE_PATH);
+    }
+    if (strcmp(type, "imp") != 0)
+    {
+        LOG_WARN("Unknown audio output sink '" << type << "', using imp.");
+    }
+    return IMPAudioOutputSink::createNew();
+}
+
+AudioOutputSink::AudioOutputSink()
+    : ring(nullptr)
+    , running(false)
+    , failed(false)
+    , overrunCount(0)
+    , underrunCount(0)
+    , rate(0)
+    , periodSamples(0)
+{}
+
+AudioOutputSink::~AudioOutputSink()
+{
+    // Derived sinks call close() in their destructor, the device is gone by now
+    delete ring;
+}
+
+bool AudioOutputSink::open(int sampleRate)
+{
+    if (running)
+    {
+        return true;
+    }
+
+    rate = sampleRate;
+    periodSamples = static_cast<size_t>(sampleRate) * AUDIO_OUTPUT_PERIOD_MS / 1000;
+
+    if (!openDevice(rate, periodSamples))
+    {
+        LOG_ERROR("Failed to open " << name() << " output at " << rate << " Hz.");
+        return false;
+    }
+
+    delete ring;
+    ring = new RingBuffer(periodSamples * sizeof(int16_t) * AUDIO_OUTPUT_PERIODS);
+    failed = false;
+    running = true;
+
+    int ret = pthread_create(&writerThread, nullptr, writer_entry, this);
+    if (ret != 0)
+    {
+        LOG_ERROR("Failed to create " << name() << " output writer thread: " << ret);
+        running = false;
+        closeDevice();
+        return false;
+    }
+
+    LOG_INFO("Opened " << name() << " output, " << rate << " Hz, " << AUDIO_OUTPUT_PERIODS
+                       << " x " << periodSamples << " samples ring.");
+    return true;
+}
+
+void AudioOutputSink::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running)
+        {
+            return;
+        }
+        running = false;
+    }
+    cv.notify_all();
+
+    int ret = pthread_join(writerThread, nullptr);
+    LOG_DEBUG_OR_ERROR(ret, "join " << name() << " output writer thread");
+
+    closeDevice();
+    LOG_INFO("Closed " << name() << " output.");
+}
+
+bool AudioOutputSink::write(const int16_t *samples, size_t count)
+{
+    if (hasFailed())
+    {
+        return false;
+    }
+
+    size_t bytes = count * sizeof(int16_t);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running || ring == nullptr)
+        {
+            return false;
+        }
+
+        size_t capacity = periodSamples * sizeof(int16_t) * AUDIO_OUTPUT_PERIODS;
+        size_t space = capacity - ring->getSize();
+        if (bytes > space)
+        {
+            overrunCount.fetch_add((bytes - space) / sizeof(int16_t), std::memory_order_relaxed);
+            bytes = space & ~(sizeof(int16_t) - 1);
+        }
+        if (bytes > 0)
+        {
+            ring->push(reinterpret_cast<const uint8_t *>(samples), bytes);
+        }
+    }
+    cv.notify_one();
+
+    return true;
+}
+
+int AudioOutputSink::latencyMs()
+{
+    if (rate <= 0)
+    {
+        return 0;
+    }
+
+    size_t queued = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ring != nullptr)
+        {
+            queued = ring->getSize() / sizeof(int16_t);
+        }
+    }
+    queued += deviceQueuedSamples();
+
+    return static_cast<int>(queued * 1000 / rate);
+}
+
+void *AudioOutputSink::writer_entry(void *arg)
+{
+    static_cast<AudioOutputSink *>(arg)->writerLoop();
+    return nullptr;
+}
+
+void AudioOutputSink::writerLoop()
+{
+    // A pipe reader that went away has to surface as EPIPE, not kill us
+    sigset_t sigpipe;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe, nullptr);
+
+    const size_t periodBytes = periodSamples * sizeof(int16_t);
+    std::vector<int16_t> period(periodSamples);
+    bool started = false;
+
+    while (true)
+    {
+        size_t bytes = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (running && ring->getSize() < periodBytes && started && deviceQueuedSamples() == 0)
+            {
+                // Device has played everything we gave it and nothing is queued
+                underrunCount.fetch_add(1, std::memory_order_relaxed);
+                started = false;
+            }
+            cv.wait(lock, [&] { return !running || ring->getSize() >= periodBytes; });
+
+            // On close, write out whatever is left, padded to a full period
+            bytes = std::min(ring->getSize(), periodBytes);
+            if (bytes == 0)
+            {
+                break;
+            }
+            ring->fetch(reinterpret_cast<uint8_t *>(period.data()), bytes);
+        }
+
+        if (bytes < periodBytes)
+        {
+            memset(reinterpret_cast<uint8_t *>(period.data()) + bytes, 0, periodBytes - bytes);
+        }
+
+        if (!writePeriod(period.data(), periodSamples))
+        {
+            LOG_ERROR(name() << " output write failed, stopping writer.");
+            failed = true;
+            break;
+        }
+        started = true;
+    }
+}
+
+/* Pipe sink, kept as fallback for systems where IMP AO is not usable by
+ * prudynt itself. The writer thread owns the pipe so it can block.
+ *
+ * The command is run directly, not through /bin/sh: it is split at blanks
+ * into the program, which has to be an absolute path, and its arguments. */
+
+PipeAudioOutputSink *PipeAudioOutputSink::createNew(const char *command)
+{
+    return new PipeAudioOutputSink(command);
+}
+
+PipeAudioOutputSink::PipeAudioOutputSink(const char *command) : command(command)
+{
+    size_t pos = 0;
+    while ((pos = this->command.find_first_not_of(" \t", pos)) != std::string::npos)
+    {
+        size_t end = this->command.find_first_of(" \t", pos);
+        args.push_back(this->command.substr(pos, end - pos));
+        pos = end;
+    }
+}
+
+PipeAudioOutputSink::~PipeAudioOutputSink()
+{
+    close();
+}
+
+bool PipeAudioOutputSink::openDevice(int sampleRate, size_t periodSamples)
+{
+    if (args.empty() || args[0][0] != '/' || access(args[0].c_str(), X_OK) != 0)
+    {
+        LOG_ERROR("Pipe sink needs the absolute path of an executable, not: " << command);
+        return false;
+    }
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0)
+    {
+        LOG_ERROR("pipe2() failed: " << strerror(errno));
+        return false;
+    }
+
+    std::vector<char *> argv;
+    for (auto &arg : args)
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+
+    // The player starts with the default SIGPIPE handling and nothing blocked
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigaddset(&mask, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    LOG_DEBUG("Starting pipe sink: " << command);
+    int ret = posix_spawn(&pid, argv[0], &actions, &attr, argv.data(), environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    ::close(fds[0]);
+
+    if (ret != 0)
+    {
+        LOG_ERROR("posix_spawn(" << args[0] << ") failed: " << strerror(ret));
+        ::close(fds[1]);
+        pid = -1;
+        return false;
+    }
+
+    fPipeFd = fds[1];
+    LOG_DEBUG("Pipe opened successfully (fd=" << fPipeFd << ", pid=" << pid << ").");
+    return true;
+}
+
+bool PipeAudioOutputSink::writePeriod(const int16_t *samples, size_t count)
+{
+    const uint8_t *dataPtr = reinterpret_cast<const uint8_t *>(samples);
+    size_t bytesToWrite = count * sizeof(int16_t);
+
+    while (bytesToWrite > 0)
+    {
+        ssize_t bytesWritten = ::write(fPipeFd, dataPtr, bytesToWrite);
+        if (bytesWritten < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EPIPE)
+            {
+                LOG_ERROR("write() failed: Broken pipe (EPIPE). Assuming pipe closed by reader.");
+
+                // Discard the SIGPIPE left pending on this thread
+                sigset_t sigpipe;
+                sigemptyset(&sigpipe);
+                sigaddset(&sigpipe, SIGPIPE);
+                struct timespec zero = {0, 0};
+                sigtimedwait(&sigpipe, nullptr, &zero);
+            }
+            else
+            {
+                LOG_ERROR("write() failed: errno=" << errno << ": " << strerror(errno));
+            }
+            return false;
+        }
+        dataPtr += bytesWritten;
+        bytesToWrite -= bytesWritten;
+    }
+
+    return true;
+}
+
+// Whether the player exited within timeoutMs, its status is left in status
+static bool wait_exit(pid_t pid, int timeoutMs, int &status)
+{
+    for (int waited = 0;; waited += 10)
+    {
+        pid_t ret = waitpid(pid, &status, WNOHANG);
+        if (ret == pid || (ret < 0 && errno != EINTR))
+            return true;
+        if (waited >= timeoutMs)
+            return false;
+        usleep(10000);
+    }
+}
+
+void PipeAudioOutputSink::closeDevice()
+{
+    if (fPipeFd != -1)
+    {
+        LOG_DEBUG("Closing pipe (fd=" << fPipeFd << ").");
+        ::close(fPipeFd);
+        fPipeFd = -1;
+    }
+
+    if (pid > 0)
+    {
+        /* EOF on stdin asks the player to finish, one that doesn't must not
+         * hold up the shutdown of the backchannel */
+        int status = 0;
+        if (!wait_exit(pid, AUDIO_OUTPUT_PIPE_EXIT_MS, status))
+        {
+            LOG_WARN("Pipe process " << pid << " did not exit, terminating it.");
+            kill(pid, SIGTERM);
+            if (!wait_exit(pid, AUDIO_OUTPUT_PIPE_EXIT_MS, status))
+            {
+                kill(pid, SIGKILL);
+                while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+                    ;
+            }
+        }
+        pid = -1;
+
+        if (WIFEXITED(status))
+        {
+            LOG_DEBUG("Pipe process exited with status: " << WEXITSTATUS(status));
+        }
+        else if (WIFSIGNALED(status))
+        {
+            LOG_WARN("Pipe process terminated by signal: " << WTERMSIG(status));
+        }
+    }
+}
+
+size_t PipeAudioOutputSink::deviceQueuedSamples()
+{
+    // Bytes sitting in the pipe, the player's own buffer is not visible
+    int bytes = 0;
+    if (fPipeFd == -1 || ioctl(fPipeFd, FIONREAD, &bytes) != 0 || bytes < 0)
+    {
+        return 0;
+    }
+    return static_cast<size_t>(bytes) / sizeof(int16_t);
+}
+
+/* File sink, raw S16LE mono. Pointing it at /dev/null gives a null sink for
+ * testing the backchannel path without audio hardware. */
+
+FileAudioOutputSink *FileAudioOutputSink::createNew(const char *path)
+{
+    return new FileAudioOutputSink(path);
+}
+
+FileAudioOutputSink::~FileAudioOutputSink()
+{
+    close();
+}
+
+bool FileAudioOutputSink::openDevice(int sampleRate, size_t periodSamples)
+{
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        LOG_ERROR("open(" << path << ") failed: " << strerror(errno));
+        return false;
+    }
+    LOG_DEBUG("Writing backchannel PCM to " << path << " (" << sampleRate << " Hz)");
+    return true;
+}
+
+bool FileAudioOutputSink::writePeriod(const int16_t *samples, size_t count)
+{
+    size_t bytes = count * sizeof(int16_t);
+    ssize_t ret = ::write(fd, samples, bytes);
+    if (ret != static_cast<ssize_t>(bytes))
+    {
+        LOG_ERROR("write(" << path << ") failed: " << strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void FileAudioOutputSink::closeDevice()
+{
+    if (fd != -1)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
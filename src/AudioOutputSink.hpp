@@ -0,0 +1,131 @@
+#ifndef AUDIO_OUTPUT_SINK_HPP
+#define AUDIO_OUTPUT_SINK_HPP
+
+// Destination for backchannel PCM (mono, S16). write() only copies into a
+// fixed size ring of output periods; a dedicated writer thread hands complete
+// periods to the device so a slow or blocking device never stalls the caller.
+//
+// Implementations:
+//  - IMPAudioOutputSink: IMP AO on the SoC speaker output (default)
+//  - PipeAudioOutputSink: external player fed through its stdin, e.g. /bin/iac
+//  - FileAudioOutputSink: raw PCM file, /dev/null acts as a null sink
+
+#include "RingBuffer.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <pthread.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+// Output period and ring size, the ring holds AUDIO_OUTPUT_PERIODS periods
+#define AUDIO_OUTPUT_PERIOD_MS 20
+#define AUDIO_OUTPUT_PERIODS 8
+// Time the pipe player gets to exit after EOF, and again after SIGTERM
+#define AUDIO_OUTPUT_PIPE_EXIT_MS 500
+
+class AudioOutputSink
+{
+public:
+    // type is "imp", "pipe" or "file"; path is the pipe command or file name,
+    // empty selects the default of the sink type
+    static AudioOutputSink *createNew(const char *type, const char *path);
+
+    virtual ~AudioOutputSink();
+
+    bool open(int sampleRate);
+    void close();
+    bool isOpen() const { return running; }
+
+    // Device failed (e.g. broken pipe), the sink has to be reopened
+    bool hasFailed() const { return failed.load(std::memory_order_relaxed); }
+
+    // Queue samples for output, never blocks. Samples that don't fit into the
+    // ring are dropped and counted as overrun.
+    bool write(const int16_t *samples, size_t count);
+
+    // Queued in the ring plus still buffered by the device
+    int latencyMs();
+
+    uint64_t overruns() const { return overrunCount.load(std::memory_order_relaxed); }
+    uint64_t underruns() const { return underrunCount.load(std::memory_order_relaxed); }
+
+    virtual const char *name() const = 0;
+
+protected:
+    AudioOutputSink();
+
+    virtual bool openDevice(int sampleRate, size_t periodSamples) = 0;
+    // May block until the device accepted the period
+    virtual bool writePeriod(const int16_t *samples, size_t count) = 0;
+    virtual void closeDevice() = 0;
+    // Samples the device has accepted but not yet played, if known
+    virtual size_t deviceQueuedSamples() { return 0; }
+
+private:
+    static void *writer_entry(void *arg);
+    void writerLoop();
+
+    RingBuffer *ring;
+    std::mutex mutex;
+    std::condition_variable cv;
+    pthread_t writerThread;
+    bool running;
+    std::atomic<bool> failed;
+    std::atomic<uint64_t> overrunCount;
+    std::atomic<uint64_t> underrunCount;
+
+    int rate;
+    size_t periodSamples;
+
+    AudioOutputSink(const AudioOutputSink &) = delete;
+    AudioOutputSink &operator=(const AudioOutputSink &) = delete;
+};
+
+class PipeAudioOutputSink : public AudioOutputSink
+{
+public:
+    static PipeAudioOutputSink *createNew(const char *command);
+    ~PipeAudioOutputSink() override;
+
+    const char *name() const override { return "pipe"; }
+
+protected:
+    PipeAudioOutputSink(const char *command);
+
+    bool openDevice(int sampleRate, size_t periodSamples) override;
+    bool writePeriod(const int16_t *samples, size_t count) override;
+    void closeDevice() override;
+    size_t deviceQueuedSamples() override;
+
+private:
+    std::string command;
+    std::vector<std::string> args; // command split at blanks, no shell
+    pid_t pid{-1};
+    int fPipeFd{-1};
+};
+
+class FileAudioOutputSink : public AudioOutputSink
+{
+public:
+    static FileAudioOutputSink *createNew(const char *path);
+    ~FileAudioOutputSink() override;
+
+    const char *name() const override { return "file"; }
+
+protected:
+    FileAudioOutputSink(const char *path) : path(path) {}
+
+    bool openDevice(int sampleRate, size_t periodSamples) override;
+    bool writePeriod(const int16_t *samples, size_t count) override;
+    void closeDevice() override;
+
+private:
+    std::string path;
+    int fd{-1};
+};
+
+#endif // AUDIO_OUTPUT_SINK_HPP
@@ -1,17 +1,34 @@
 #include "AudioWorker.hpp"
 
 #include "Config.hpp"
+#include "DVR.hpp"
+#include "Recorder.hpp"
+#include "EventBus.hpp"
 #include "Logger.hpp"
 #include "WorkerUtils.hpp"
 #include "TimestampManager.hpp"
 #include "globals.hpp"
 #include "RTSPStatus.hpp"
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <sched.h>
 
 #define MODULE "AudioWorker"
 
 #if defined(AUDIO_SUPPORT)
 
+// Audio follows the video, any stream with an RTSP client wants it
+static bool videoRequested()
+{
+    for (int chn = 0; chn < MAX_VIDEO_STREAMS; chn++)
+    {
+        if (global_video[chn] && global_video[chn]->hasDataCallback)
+            return true;
+    }
+    return false;
+}
+
 AudioWorker::AudioWorker(int chn)
     : encChn(chn)
 {
@@ -51,6 +68,8 @@ void AudioWorker::process_audio_frame_direct(IMPAudioFrame &frame)
     IMPAudioStream stream;
     if (global_audio[encChn]->imp_audio->format != IMPAudioFormat::PCM)
     {
+        auto encodeStart = std::chrono::steady_clock::now();
+
         if (IMP_AENC_SendFrame(global_audio[encChn]->aeChn, &frame) != 0)
         {
             LOG_ERROR("IMP_AENC_SendFrame(" << global_audio[encChn]->devId << ", "
@@ -73,6 +92,9 @@ void AudioWorker::process_audio_frame_direct(IMPAudioFrame &frame)
             start = (uint8_t *) stream.stream;
             end = start + stream.len;
         }
+
+        record_encode_time(std::chrono::duration_cast<std::chrono::microseconds>(
+                               std::chrono::steady_clock::now() - encodeStart).count());
     }
 
     if (end > start)
@@ -80,8 +102,17 @@ void AudioWorker::process_audio_frame_direct(IMPAudioFrame &frame)
         af.data.insert(af.data.end(), start, end);
     }
 
-    if (!af.data.empty() && global_audio[encChn]->hasDataCallback
-        && (global_video[0]->hasDataCallback || global_video[1]->hasDataCallback))
+    if (!af.data.empty() && global_dvr->acceptsAudio())
+    {
+        global_dvr->pushAudio(af);
+    }
+
+    if (!af.data.empty() && global_recorder->acceptsAudio())
+    {
+        global_recorder->pushAudio(af);
+    }
+
+    if (!af.data.empty() && global_audio[encChn]->hasDataCallback && videoRequested())
     {
         if (!global_audio[encChn]->msgChannel->write(af))
         {
@@ -115,10 +146,10 @@ void AudioWorker::process_frame(IMPAudioFrame &frame)
 
         // If this is the first frame in the buffer, save the timestamp
         if (frameBuffer.empty()) {
-            // SINGLE SOURCE OF TRUTH: Use TimestampManager timestamp
-            bufferStartTimestamp = TimestampManager::getInstance().getTimestampUs();
+            // Timestamps follow from the sample position, see AVSyncMonitor
+            bufferStartSample = frameStartSample;
             // AUDIO SYNC DEBUG: Always log frame accumulation start for sync debugging
-            LOG_DEBUG("AUDIO_SYNC_ACCUMULATION_START: " << samplesPerChannel << " samples per channel, timestamp=" << bufferStartTimestamp);
+            LOG_DEBUG("AUDIO_SYNC_ACCUMULATION_START: " << samplesPerChannel << " samples per channel, timestamp=" << avSync->timestampUs(bufferStartSample));
         }
 
         // Buffer safety: bound growth and drop oldest on overflow
@@ -151,7 +182,7 @@ void AudioWorker::process_frame(IMPAudioFrame &frame)
             predictedSamplesPerChannel -= dropSamplesPerChannel;
             bufferDropCount.fetch_add(1);
             // Advance buffer start PTS accordingly
-            bufferStartTimestamp += (int64_t) ( (dropSamplesPerChannel * 1000000LL) / global_audio[encChn]->imp_audio->sample_rate );
+            bufferStartSample += dropSamplesPerChannel;
             // Expose metrics via RTSPStatus
             {
                 std::string streamName = std::string("audio") + std::to_string(encChn);
@@ -176,13 +207,13 @@ void AudioWorker::process_frame(IMPAudioFrame &frame)
             IMPAudioFrame opusFrame = frame;
             opusFrame.virAddr = (uint32_t*)frameBuffer.data();
             opusFrame.len = targetBytes;
-            // Keep original timestamp - the monotonic PTS will be applied in process_audio_frame_direct
-            opusFrame.timeStamp = bufferStartTimestamp;
+            // Drift corrected PTS of the first sample, used by process_audio_frame_direct
+            opusFrame.timeStamp = avSync->timestampUs(bufferStartSample);
 
             // AUDIO SYNC DEBUG: Always log frame ready for sync debugging
             LOG_DEBUG("AUDIO_SYNC_FRAME_READY: accumulated " << currentSamplesPerChannel
                      << " samples per channel, sending " << targetSamplesPerChannel
-                     << ", timestamp=" << bufferStartTimestamp);
+                     << ", timestamp=" << opusFrame.timeStamp);
 
             // Analyze raw PCM data for corruption patterns
             static int analysis_count = 0;
@@ -210,8 +241,8 @@ void AudioWorker::process_frame(IMPAudioFrame &frame)
             // Remove processed samples from buffer
             frameBuffer.erase(frameBuffer.begin(), frameBuffer.begin() + targetTotalSamples);
 
-            // Update timestamp for next frame
-            bufferStartTimestamp += (targetSamplesPerChannel * 1000000LL) / global_audio[encChn]->imp_audio->sample_rate;
+            // Update position for next frame
+            bufferStartSample += targetSamplesPerChannel;
 
             // Recalculate remaining samples for next iteration
             currentSamplesPerChannel = frameBuffer.size() / global_audio[encChn]->imp_audio->outChnCnt;
@@ -250,6 +281,267 @@ void AudioWorker::process_frame(IMPAudioFrame &frame)
     }
 }
 
+void AudioWorker::record_encode_time(uint32_t us)
+{
+    encodeTimesUs[encodeTimesCount++] = us;
+    if (encodeTimesCount < encodeTimesUs.size())
+        return;
+
+    std::array<uint32_t, AUDIO_ENCODE_STATS_WINDOW> sorted = encodeTimesUs;
+    std::sort(sorted.begin(), sorted.end());
+    encodeTimesCount = 0;
+
+    auto percentile = [&](int p) { return sorted[(sorted.size() - 1) * p / 100]; };
+
+    std::string streamName = std::string("audio") + std::to_string(encChn);
+    RTSPStatus::writeCustomParameter(streamName, "encode_time_p50_us", std::to_string(percentile(50)));
+    RTSPStatus::writeCustomParameter(streamName, "encode_time_p95_us", std::to_string(percentile(95)));
+    RTSPStatus::writeCustomParameter(streamName, "encode_time_p99_us", std::to_string(percentile(99)));
+    RTSPStatus::writeCustomParameter(streamName, "encode_time_max_us", std::to_string(sorted.back()));
+}
+
+bool AudioWorker::capture_frame()
+{
+    IMPAudioFrame frame;
+    if (IMP_AI_GetFrame(global_audio[encChn]->devId,
+                        global_audio[encChn]->aiChn,
+                        &frame,
+                        IMPBlock::BLOCK)
+        != 0)
+    {
+        LOG_ERROR("IMP_AI_GetFrame(" << global_audio[encChn]->devId << ", "
+                                     << global_audio[encChn]->aiChn << ") failed");
+        return false;
+    }
+
+    AudioCaptureFrame *slot = captureQueue.acquire();
+    if (slot)
+    {
+        // pcm keeps its capacity across uses, no allocation in steady state
+        uint8_t *data = reinterpret_cast<uint8_t *>(frame.virAddr);
+        slot->pcm.assign(data, data + frame.len);
+        slot->frame = frame;
+        slot->frame.virAddr = reinterpret_cast<uint32_t *>(slot->pcm.data());
+        // SINGLE SOURCE OF TRUTH: Use TimestampManager timestamp
+        slot->captureUs = TimestampManager::getInstance().getTimestampUs();
+        slot->seq = captureSeq;
+        captureQueue.publish();
+        captureReady.release();
+    }
+    else
+    {
+        uint32_t drops = ++captureDropCount;
+        if (drops <= 10 || (drops % 100) == 0)
+        {
+            LOG_WARN("Audio encoder is behind, dropped captured frame (" << drops << " so far)");
+        }
+        std::string streamName = std::string("audio") + std::to_string(encChn);
+        RTSPStatus::writeCustomParameter(streamName, "capture_drop_count", std::to_string(drops));
+    }
+    captureSeq++;
+
+    if (IMP_AI_ReleaseFrame(global_audio[encChn]->devId,
+                            global_audio[encChn]->aiChn,
+                            &frame)
+        < 0)
+    {
+        LOG_ERROR("IMP_AI_ReleaseFrame(" << global_audio[encChn]->devId << ", "
+                                         << global_audio[encChn]->aiChn
+                                         << ", &frame) failed");
+    }
+
+    return true;
+}
+
+void AudioWorker::encode_captured(AudioCaptureFrame &captured)
+{
+    // IMP AI delivers mono frames
+    uint64_t samples = captured.frame.len / sizeof(int16_t);
+
+    if (haveCaptureSeq && captured.seq != nextCaptureSeq)
+    {
+        uint64_t missing = captured.seq - nextCaptureSeq;
+        if (missing <= AUDIO_MAX_SILENCE_FILL)
+        {
+            // Keep the sample timeline continuous, the encoders see silence
+            silencePcm.assign(captured.pcm.size(), 0);
+            IMPAudioFrame silence = captured.frame;
+            silence.virAddr = reinterpret_cast<uint32_t *>(silencePcm.data());
+            for (uint64_t i = 0; i < missing; i++)
+            {
+                encode_pcm(silence);
+            }
+        }
+        else
+        {
+            // Too long to fill, skip ahead and start the Opus frame afresh
+            captureSample += missing * samples;
+            reframeSample += missing * samples;
+            frameBuffer.clear();
+        }
+    }
+    nextCaptureSeq = captured.seq + 1;
+    haveCaptureSeq = true;
+
+    // Measure the sample clock against the time the frame was captured
+    avSync->update(captureSample, captured.captureUs);
+    encode_pcm(captured.frame);
+    measure_level(captured);
+
+    if (captureSample - lastSyncReportSample >= static_cast<uint64_t>(global_audio[encChn]->imp_audio->sample_rate))
+    {
+        lastSyncReportSample = captureSample;
+        report_av_sync();
+    }
+}
+
+void AudioWorker::encode_pcm(IMPAudioFrame &frame)
+{
+    uint64_t samples = frame.len / sizeof(int16_t);
+
+    frameStartSample = captureSample;
+    frame.timeStamp = avSync->timestampUs(frameStartSample);
+
+    if (reframer)
+    {
+        reframer->addFrame(reinterpret_cast<uint8_t *>(frame.virAddr), frame.timeStamp);
+        while (reframer->hasMoreFrames())
+        {
+            size_t frameLen = 1024 * sizeof(uint16_t)
+                              * global_audio[encChn]->imp_audio->outChnCnt;
+            std::vector<uint8_t> frameData(frameLen, 0);
+            int64_t audio_ts;
+            reframer->getReframedFrame(frameData.data(), audio_ts);
+            // The reframer counts samples from its first frame, use the monitor instead
+            audio_ts = avSync->timestampUs(reframeSample);
+            reframeSample += 1024;
+            IMPAudioFrame reframed = {.bitwidth = frame.bitwidth,
+                                      .soundmode = frame.soundmode,
+                                      .virAddr = reinterpret_cast<uint32_t *>(
+                                          frameData.data()),
+                                      .phyAddr = frame.phyAddr,
+                                      .timeStamp = audio_ts,
+                                      .seq = frame.seq,
+                                      .len = static_cast<int>(frameLen)};
+            process_frame(reframed);
+        }
+    }
+    else
+    {
+        process_frame(frame);
+    }
+
+    captureSample += samples;
+}
+
+void AudioWorker::measure_level(const AudioCaptureFrame &captured)
+{
+    if (!global_events->active())
+        return;
+
+    const int16_t *samples = reinterpret_cast<const int16_t *>(captured.pcm.data());
+    size_t count = captured.pcm.size() / sizeof(int16_t);
+    for (size_t i = 0; i < count; i++)
+    {
+        int v = samples[i];
+        levelSumSquares += static_cast<uint64_t>(v * v);
+        levelPeak = std::max(levelPeak, std::abs(v));
+    }
+    levelSamples += count;
+
+    if (levelSamples < static_cast<uint64_t>(global_audio[encChn]->imp_audio->sample_rate))
+        return;
+
+    // dBFS, silence is reported as -96 (the floor of 16 bit samples)
+    auto toDb = [](double v) { return v > 0 ? static_cast<float>(20.0 * std::log10(v / 32768.0)) : -96.0f; };
+    float rmsDb = toDb(std::sqrt(static_cast<double>(levelSumSquares) / levelSamples));
+    float peakDb = toDb(levelPeak);
+    global_events->audioLevel(encChn, std::max(rmsDb, -96.0f), std::max(peakDb, -96.0f));
+
+    levelSumSquares = 0;
+    levelSamples = 0;
+    levelPeak = 0;
+}
+
+void AudioWorker::report_av_sync()
+{
+    std::string streamName = std::string("audio") + std::to_string(encChn);
+    RTSPStatus::writeCustomParameter(streamName, "av_offset_us", std::to_string(avSync->avOffsetUs()));
+    RTSPStatus::writeCustomParameter(streamName, "sample_clock_offset_us", std::to_string(avSync->sampleClockOffsetUs()));
+    RTSPStatus::writeCustomParameter(streamName, "sample_clock_drift_ppm",
+                                     std::to_string(static_cast<int>(std::lround(avSync->driftPpm()))));
+    RTSPStatus::writeCustomParameter(streamName, "av_sync_resyncs", std::to_string(avSync->resyncs()));
+}
+
+void AudioWorker::encode_loop()
+{
+    LOG_DEBUG("Start audio encode loop for channel " << encChn);
+
+    while (encodeRunning)
+    {
+        std::shared_ptr<const ConfigSnapshot> conf = cfg->snapshot();
+        if (!captureReady.try_acquire_for(std::chrono::milliseconds(conf->general.imp_polling_timeout)))
+            continue;
+
+        AudioCaptureFrame *captured = captureQueue.peek();
+        if (!captured)
+            continue;
+
+        encode_captured(*captured);
+        captureQueue.release();
+    }
+
+    LOG_DEBUG("Stop audio encode loop for channel " << encChn);
+}
+
+void *AudioWorker::encode_entry(void *arg)
+{
+    static_cast<AudioWorker *>(arg)->encode_loop();
+    return nullptr;
+}
+
+bool AudioWorker::start_encode_thread()
+{
+    encodeRunning = true;
+    int ret = pthread_create(&encodeThread, nullptr, encode_entry, this);
+    LOG_DEBUG_OR_ERROR(ret, "create audio encode thread");
+    if (ret != 0)
+    {
+        encodeRunning = false;
+        return false;
+    }
+
+    if (cfg->audio.encode_thread_priority > 0)
+    {
+        struct sched_param param = {};
+        param.sched_priority = cfg->audio.encode_thread_priority;
+        ret = pthread_setschedparam(encodeThread, SCHED_FIFO, &param);
+        LOG_DEBUG_OR_ERROR(ret, "pthread_setschedparam(SCHED_FIFO, " << param.sched_priority << ")");
+    }
+
+    if (cfg->audio.encode_thread_cpu >= 0)
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cfg->audio.encode_thread_cpu, &cpuset);
+        ret = pthread_setaffinity_np(encodeThread, sizeof(cpuset), &cpuset);
+        LOG_DEBUG_OR_ERROR(ret, "pthread_setaffinity_np(" << cfg->audio.encode_thread_cpu << ")");
+    }
+
+    return true;
+}
+
+void AudioWorker::stop_encode_thread()
+{
+    if (!encodeRunning)
+        return;
+
+    encodeRunning = false;
+    captureReady.release();
+    int ret = pthread_join(encodeThread, nullptr);
+    LOG_DEBUG_OR_ERROR(ret, "join audio encode thread");
+}
+
 void AudioWorker::run()
 {
     LOG_DEBUG("Start audio processing run loop for channel " << encChn);
@@ -257,6 +549,10 @@ void AudioWorker::run()
     // Using global TimestampManager for unified audio/video timeline
     LOG_DEBUG("AudioWorker using TimestampManager for unified timeline");
 
+    avSync = std::make_unique<AVSyncMonitor>(global_audio[encChn]->imp_audio->sample_rate,
+                                             static_cast<int64_t>(cfg->audio.av_sync_resync_ms) * 1000,
+                                             cfg->audio.av_sync_enabled);
+
     // Initialize AudioReframer only if needed, store in member variable
     if (global_audio[encChn]->imp_audio->format == IMPAudioFormat::AAC)
     {
@@ -303,68 +599,27 @@ void AudioWorker::run()
         }
     }
 
+    if (!start_encode_thread())
+    {
+        LOG_ERROR("Audio encode thread for channel " << encChn << " could not be started");
+        return;
+    }
+
     while (global_audio[encChn]->running)
     {
-        if (global_audio[encChn]->hasDataCallback && cfg->audio.input_enabled
-            && (global_video[0]->hasDataCallback || global_video[1]->hasDataCallback))
+        // one consistent view of the config per pass
+        std::shared_ptr<const ConfigSnapshot> conf = cfg->snapshot();
+
+        if (conf->audio.input_enabled
+            && ((global_audio[encChn]->hasDataCallback && videoRequested())
+                || global_dvr->acceptsAudio() || global_recorder->acceptsAudio()))
         {
             if (IMP_AI_PollingFrame(global_audio[encChn]->devId,
                                     global_audio[encChn]->aiChn,
-                                    cfg->general.imp_polling_timeout)
+                                    conf->general.imp_polling_timeout)
                 == 0)
             {
-                IMPAudioFrame frame;
-                if (IMP_AI_GetFrame(global_audio[encChn]->devId,
-                                    global_audio[encChn]->aiChn,
-                                    &frame,
-                                    IMPBlock::BLOCK)
-                    != 0)
-                {
-                    LOG_ERROR("IMP_AI_GetFrame(" << global_audio[encChn]->devId << ", "
-                                                 << global_audio[encChn]->aiChn << ") failed");
-                }
-
-                // Hardware timestamps are already monotonic (from IMP_System_RebaseTimeStamp)
-                // Use them directly - no conversion needed with 64-bit approach
-                // DeepSeek's recommendation: use hardware timestamps as-is since they're already monotonic
-
-                if (reframer)
-                {
-                    // SINGLE SOURCE OF TRUTH: Use TimestampManager timestamp
-                    uint64_t unified_timestamp = TimestampManager::getInstance().getTimestampUs();
-                    reframer->addFrame(reinterpret_cast<uint8_t *>(frame.virAddr), unified_timestamp);
-                    while (reframer->hasMoreFrames())
-                    {
-                        size_t frameLen = 1024 * sizeof(uint16_t)
-                                          * global_audio[encChn]->imp_audio->outChnCnt;
-                        std::vector<uint8_t> frameData(frameLen, 0);
-                        int64_t audio_ts;
-                        reframer->getReframedFrame(frameData.data(), audio_ts);
-                        IMPAudioFrame reframed = {.bitwidth = frame.bitwidth,
-                                                  .soundmode = frame.soundmode,
-                                                  .virAddr = reinterpret_cast<uint32_t *>(
-                                                      frameData.data()),
-                                                  .phyAddr = frame.phyAddr,
-                                                  .timeStamp = audio_ts,
-                                                  .seq = frame.seq,
-                                                  .len = static_cast<int>(frameLen)};
-                        process_frame(reframed);
-                    }
-                }
-                else
-                {
-                    process_frame(frame);
-                }
-
-                if (IMP_AI_ReleaseFrame(global_audio[encChn]->devId,
-                                        global_audio[encChn]->aiChn,
-                                        &frame)
-                    < 0)
-                {
-                    LOG_ERROR("IMP_AI_ReleaseFrame(" << global_audio[encChn]->devId << ", "
-                                                     << global_audio[encChn]->aiChn
-                                                     << ", &frame) failed");
-                }
+                capture_frame();
             }
             else
             {
@@ -372,7 +627,7 @@ void AudioWorker::run()
                                                       << " POLLING TIMEOUT");
             }
         }
-        else if (cfg->audio.input_enabled && !global_restart)
+        else if (conf->audio.input_enabled && !global_restart)
         {
             std::unique_lock<std::mutex> lock_stream{mutex_main};
             global_audio[encChn]->active = false;
@@ -382,7 +637,8 @@ void AudioWorker::run()
              * we send the audio grabber and encoder to standby when no video is requested.
             */
             while ((global_audio[encChn]->onDataCallback == nullptr
-                    || (!global_video[0]->hasDataCallback && !global_video[1]->hasDataCallback))
+                    || !videoRequested())
+                   && !global_dvr->acceptsAudio() && !global_recorder->acceptsAudio()
                    && !global_restart_audio)
             {
                 global_audio[encChn]->should_grab_frames.wait(lock_stream);
@@ -398,6 +654,8 @@ void AudioWorker::run()
             usleep(250 * 1000);
         }
     }
+
+    stop_encode_thread();
 }
 
 void *AudioWorker::thread_entry(void *arg)
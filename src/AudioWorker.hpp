@@ -1,15 +1,38 @@
 #ifndef AUDIO_WORKER_HPP
 #define AUDIO_WORKER_HPP
 
+#include "AVSyncMonitor.hpp"
 #include "AudioReframer.hpp"
 #include "IMPAudio.hpp"
+#include "SPSCQueue.hpp"
 
+#include <array>
 #include <memory>
 #include <vector>
 #include <atomic>
+#include <semaphore>
+#include <pthread.h>
 
 #if defined(AUDIO_SUPPORT)
 
+// Capture frames queued between IMP_AI_GetFrame and the encoder (~1s at 40ms)
+#define AUDIO_CAPTURE_QUEUE_SIZE 25
+// Encoded frames per encode time percentile report (~5s at 20ms)
+#define AUDIO_ENCODE_STATS_WINDOW 250
+/* Longest run of dropped capture frames that is filled with silence (~200ms
+ * at 40ms). Filling costs an encode per frame on the encode thread, which
+ * has just fallen behind, longer gaps are skipped over instead. */
+#define AUDIO_MAX_SILENCE_FILL 5
+
+// PCM copied out of the IMP AI buffer so the frame can be released right away
+struct AudioCaptureFrame
+{
+    IMPAudioFrame frame;        // virAddr points into pcm
+    std::vector<uint8_t> pcm;
+    int64_t captureUs;          // TimestampManager time at capture
+    uint64_t seq;               // counts dropped frames as well
+};
+
 class AudioWorker
 {
 public:
@@ -23,12 +46,51 @@ private:
     void process_audio_frame_direct(IMPAudioFrame &frame);
     void process_frame(IMPAudioFrame &frame);
 
+    // Capture and encode run in separate threads, connected by captureQueue,
+    // so encoder spikes don't hold IMP AI frames
+    bool capture_frame();
+    bool start_encode_thread();
+    void stop_encode_thread();
+    static void *encode_entry(void *arg);
+    void encode_loop();
+    void encode_captured(AudioCaptureFrame &captured);
+    void encode_pcm(IMPAudioFrame &frame);
+    void report_av_sync();
+    void measure_level(const AudioCaptureFrame &captured);
+    void record_encode_time(uint32_t us);
+
     int encChn;
+
+    SPSCQueue<AudioCaptureFrame> captureQueue{AUDIO_CAPTURE_QUEUE_SIZE};
+    std::counting_semaphore<AUDIO_CAPTURE_QUEUE_SIZE + 1> captureReady{0};
+    pthread_t encodeThread;
+    std::atomic<bool> encodeRunning{false};
+    std::atomic<uint32_t> captureDropCount{0};
+    uint64_t captureSeq = 0;
+
+    // Audio timeline, positions are in samples per channel since start.
+    // Timestamps for all formats come from avSync.
+    std::unique_ptr<AVSyncMonitor> avSync;
+    uint64_t captureSample = 0;         // next sample to be encoded
+    uint64_t frameStartSample = 0;      // first sample of the frame being encoded
+    uint64_t reframeSample = 0;         // first sample of the next reframed frame
+    uint64_t nextCaptureSeq = 0;
+    bool haveCaptureSeq = false;
+    uint64_t lastSyncReportSample = 0;
+    std::vector<uint8_t> silencePcm;
+
+    // Input level, published on the event bus once per second
+    uint64_t levelSumSquares = 0;
+    uint64_t levelSamples = 0;
+    int levelPeak = 0;
+
+    std::array<uint32_t, AUDIO_ENCODE_STATS_WINDOW> encodeTimesUs{};
+    size_t encodeTimesCount = 0;
     std::unique_ptr<AudioReframer> reframer;
 
     // Frame accumulator for Opus
     std::vector<int16_t> frameBuffer;
-    int64_t bufferStartTimestamp = 0;
+    uint64_t bufferStartSample = 0;
     int targetSamplesPerChannel = 0;
 
     // Buffer safety controls (computed from targetSamplesPerChannel)
@@ -0,0 +1,189 @@
+#include "BackchannelJitterBuffer.hpp"
+
+#include "IMPBackchannel.hpp"
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#define MODULE "BackchannelJitterBuffer"
+
+// Assumed packet duration until two consecutive packets have been seen
+#define DEFAULT_FRAME_US 20000
+// Gaps longer than this are treated as a sender restart, not as loss
+#define MAX_CONCEALED_GAP_US 1000000
+
+BackchannelJitterBuffer::BackchannelJitterBuffer(int minDelayMs, int maxDelayMs)
+    : minDelayUs(static_cast<int64_t>(minDelayMs) * 1000)
+    , maxDelayUs(static_cast<int64_t>(std::max(minDelayMs, maxDelayMs)) * 1000)
+{
+    reset();
+}
+
+void BackchannelJitterBuffer::reset()
+{
+    frames.clear();
+    targetDelayUs = minDelayUs;
+    frameUs = DEFAULT_FRAME_US;
+    jitterUs = 0;
+    havePrev = false;
+    prevRtpTs = 0;
+    prevArrivalUs = 0;
+    prevExtSeq = 0;
+    haveHighest = false;
+    highestExtSeq = 0;
+    nextExtSeq = 0;
+    playing = false;
+}
+
+uint32_t BackchannelJitterBuffer::extendSeq(uint16_t seq) const
+{
+    // Start one cycle in so that early reordered packets don't underflow
+    if (!haveHighest)
+        return 0x10000u + seq;
+
+    int16_t delta = static_cast<int16_t>(seq - static_cast<uint16_t>(highestExtSeq));
+    return highestExtSeq + delta;
+}
+
+int64_t BackchannelJitterBuffer::bufferedUs() const
+{
+    if (frames.empty())
+        return 0;
+
+    // Holes count as well, they are played out as concealment
+    uint32_t first = playing ? nextExtSeq : frames.begin()->first;
+    if (highestExtSeq < first)
+        return 0;
+    return static_cast<int64_t>(highestExtSeq - first + 1) * frameUs;
+}
+
+void BackchannelJitterBuffer::updateJitter(const BackchannelFrame &frame, uint32_t extSeq)
+{
+    int rate = IMPBackchannel::getFormatFrequency(frame.format);
+    if (rate <= 0)
+        return;
+
+    if (havePrev)
+    {
+        int64_t arrivalDelta = frame.arrivalUs - prevArrivalUs;
+        int64_t tsDeltaUs = static_cast<int64_t>(static_cast<int32_t>(frame.rtpTimestamp - prevRtpTs))
+                            * 1000000 / rate;
+
+        int64_t d = std::llabs(arrivalDelta - tsDeltaUs);
+        jitterUs += (d - jitterUs) / 16;
+
+        if (extSeq == prevExtSeq + 1 && tsDeltaUs > 0 && tsDeltaUs <= 200000)
+        {
+            frameUs = tsDeltaUs;
+        }
+    }
+
+    havePrev = true;
+    prevRtpTs = frame.rtpTimestamp;
+    prevArrivalUs = frame.arrivalUs;
+    prevExtSeq = extSeq;
+
+    updateTarget();
+}
+
+void BackchannelJitterBuffer::updateTarget()
+{
+    // One packet plus three times the mean deviation covers nearly all arrivals
+    targetDelayUs = std::clamp(frameUs + 3 * jitterUs, minDelayUs, maxDelayUs);
+}
+
+bool BackchannelJitterBuffer::push(BackchannelFrame &&frame)
+{
+    counters.received++;
+
+    uint32_t extSeq = extendSeq(frame.rtpSeqNum);
+    updateJitter(frame, extSeq);
+
+    if (playing && extSeq < nextExtSeq)
+    {
+        counters.late++;
+        return false;
+    }
+
+    if (frames.count(extSeq))
+    {
+        counters.duplicate++;
+        return false;
+    }
+
+    if (!haveHighest || extSeq > highestExtSeq)
+    {
+        haveHighest = true;
+        highestExtSeq = extSeq;
+    }
+
+    frames.emplace(extSeq, std::move(frame));
+
+    // Hard cap, only reached if the consumer stalls
+    while (bufferedUs() > 2 * maxDelayUs && frames.size() > 1)
+    {
+        auto first = frames.begin();
+        if (playing)
+            nextExtSeq = first->first + 1;
+        frames.erase(first);
+        counters.overflowDrops++;
+    }
+
+    return true;
+}
+
+BackchannelJitterBuffer::Result BackchannelJitterBuffer::pop(BackchannelFrame &out)
+{
+    if (!playing)
+    {
+        if (frames.empty() || bufferedUs() < targetDelayUs)
+            return Result::Empty;
+
+        playing = true;
+        nextExtSeq = frames.begin()->first;
+        LOG_DEBUG("Playout started, target " << targetDelayMs() << "ms, jitter " << jitterMs()
+                                             << "ms, frame " << frameUs << "us");
+    }
+
+    if (frames.empty())
+    {
+        // Underrun, prime again up to the (possibly grown) target
+        playing = false;
+        counters.underruns++;
+        return Result::Empty;
+    }
+
+    // Jitter went down, shorten the delay by skipping one frame at a time
+    if (bufferedUs() > targetDelayUs + 2 * frameUs)
+    {
+        auto it = frames.find(nextExtSeq);
+        if (it != frames.end())
+            frames.erase(it);
+        nextExtSeq++;
+        counters.overflowDrops++;
+        if (frames.empty())
+            return Result::Empty;
+    }
+
+    auto it = frames.begin();
+    if (it->first != nextExtSeq)
+    {
+        if (static_cast<int64_t>(it->first - nextExtSeq) * frameUs > MAX_CONCEALED_GAP_US)
+        {
+            LOG_DEBUG("Sequence jump of " << (it->first - nextExtSeq) << " packets, resyncing.");
+            nextExtSeq = it->first;
+        }
+        else
+        {
+            nextExtSeq++;
+            counters.lost++;
+            return Result::Lost;
+        }
+    }
+
+    out = std::move(it->second);
+    frames.erase(it);
+    nextExtSeq++;
+    return Result::Frame;
+}
@@ -0,0 +1,82 @@
+#ifndef BACKCHANNEL_JITTER_BUFFER_HPP
+#define BACKCHANNEL_JITTER_BUFFER_HPP
+
+// Reorders backchannel RTP payloads by sequence number, estimates the
+// interarrival jitter (RFC 3550, 6.4.1) from the RTP timestamps and adapts the
+// playout delay to it. The BackchannelWorker pulls one frame per output period;
+// gaps that are still missing when their turn comes are reported as lost so the
+// worker can conceal them.
+
+#include "globals.hpp"
+
+#include <cstdint>
+#include <map>
+
+class BackchannelJitterBuffer
+{
+public:
+    enum class Result
+    {
+        Frame, // next frame in sequence is returned
+        Lost,  // next frame is missing, conceal one frame period
+        Empty  // nothing to play (priming or underrun)
+    };
+
+    struct Stats
+    {
+        uint64_t received = 0;
+        uint64_t late = 0;
+        uint64_t duplicate = 0;
+        uint64_t lost = 0;
+        uint64_t underruns = 0;
+        uint64_t overflowDrops = 0;
+    };
+
+    BackchannelJitterBuffer(int minDelayMs, int maxDelayMs);
+
+    // Drop all queued frames and restart priming. Counters are kept.
+    void reset();
+
+    // Insert a frame; returns false if it was dropped as late or duplicate.
+    bool push(BackchannelFrame &&frame);
+
+    // Fetch the next frame for playout.
+    Result pop(BackchannelFrame &out);
+
+    bool empty() const { return frames.empty(); }
+    bool isPlaying() const { return playing; }
+
+    int jitterMs() const { return static_cast<int>(jitterUs / 1000); }
+    int targetDelayMs() const { return static_cast<int>(targetDelayUs / 1000); }
+    int bufferedMs() const { return static_cast<int>(bufferedUs() / 1000); }
+    int64_t frameDurationUs() const { return frameUs; }
+    const Stats &stats() const { return counters; }
+
+private:
+    uint32_t extendSeq(uint16_t seq) const;
+    int64_t bufferedUs() const;
+    void updateJitter(const BackchannelFrame &frame, uint32_t extSeq);
+    void updateTarget();
+
+    std::map<uint32_t, BackchannelFrame> frames;
+
+    int64_t minDelayUs;
+    int64_t maxDelayUs;
+    int64_t targetDelayUs;
+    int64_t frameUs;
+    int64_t jitterUs;
+
+    bool havePrev;
+    uint32_t prevRtpTs;
+    int64_t prevArrivalUs;
+    uint32_t prevExtSeq;
+
+    bool haveHighest;
+    uint32_t highestExtSeq;
+    uint32_t nextExtSeq;
+    bool playing;
+
+    Stats counters;
+};
+
+#endif // BACKCHANNEL_JITTER_BUFFER_HPP
@@ -3,6 +3,8 @@
 #include "Logger.hpp"
 #include "globals.hpp"
 
+#include <chrono>
+
 #define MODULE "BackchannelSink"
 
 #define TIMEOUT_MICROSECONDS 500000 // Timeout set to 500ms
@@ -41,7 +43,7 @@ BackchannelSink::~BackchannelSink()
     delete[] fReceiveBuffer;
 }
 
-Boolean BackchannelSink::startPlaying(FramedSource &source,
+Boolean BackchannelSink::startPlaying(RTPSource &source,
                                       MediaSink::afterPlayingFunc *afterFunc,
                                       void *afterClientData)
 {
@@ -205,6 +207,16 @@ void BackchannelSink::sendBackchannelFrame(const uint8_t *payload, unsigned payl
     bcFrame.clientSessionId = fClientSessionId;
     bcFrame.payload.assign(payload, payload + payloadSize);
 
+    // Sequence and timestamp of the packet just delivered, for the jitter buffer
+    if (fRTPSource != nullptr)
+    {
+        bcFrame.rtpSeqNum = fRTPSource->curPacketRTPSeqNum();
+        bcFrame.rtpTimestamp = fRTPSource->curPacketRTPTimestamp();
+    }
+    bcFrame.arrivalUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now().time_since_epoch())
+                            .count();
+
     if (!global_backchannel->inputQueue->write(std::move(bcFrame)))
     {
         LOG_WARN("Input queue full for session " << fClientSessionId << ". Frame dropped.");
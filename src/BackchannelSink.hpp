@@ -17,7 +17,7 @@ public:
                                       unsigned clientSessionId,
                                       IMPBackchannelFormat format);
 
-    Boolean startPlaying(FramedSource &source,
+    Boolean startPlaying(RTPSource &source,
                          MediaSink::afterPlayingFunc *afterFunc,
                          void *afterClientData);
     void stopPlaying();
@@ -45,7 +45,7 @@ private:
     void sendBackchannelFrame(const uint8_t *payload, unsigned payloadSize);
     void sendBackchannelStopFrame();
 
-    FramedSource *fRTPSource;
+    RTPSource *fRTPSource;
     u_int8_t *fReceiveBuffer;
     int fReceiveBufferSize;
 
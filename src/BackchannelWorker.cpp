@@ -2,26 +2,32 @@
 
 #include "IMPBackchannel.hpp"
 #include "Logger.hpp"
+#include "RTSPStatus.hpp"
 
 #include <cassert>
 #include <cmath>
 #include <vector>
 
-#include <fcntl.h>
-#include <unistd.h>
+#include <cstring>
+
 #include <imp/imp_audio.h>
 
 #define MODULE "BackchannelWorker"
 
+#define STATS_INTERVAL_MS 1000
+
 BackchannelWorker::BackchannelWorker()
     : currentSessionId(0)
-    , fPipe(nullptr)
-    , fPipeFd(-1)
+    , stopPending(false)
+    , jitterBuffer(cfg->audio.output_jitter_min_ms, cfg->audio.output_jitter_max_ms)
+    , lossRun(0)
+    , concealedFrames(0)
+    , output(nullptr)
 {}
 
 BackchannelWorker::~BackchannelWorker()
 {
-    closePipe();
+    closeOutput();
 }
 
 std::vector<int16_t> BackchannelWorker::resampleLinear(const std::vector<int16_t> &input_pcm,
@@ -66,76 +72,47 @@ std::vector<int16_t> BackchannelWorker::resampleLinear(const std::vector<int16_t
     return output_pcm;
 }
 
-bool BackchannelWorker::initPipe()
+bool BackchannelWorker::initOutput()
 {
-    if (fPipe)
+    if (output)
     {
-        LOG_DEBUG("Pipe already initialized.");
+        LOG_DEBUG("Output already initialized.");
         return true;
     }
-    LOG_DEBUG("Opening pipe to: /bin/iac -s");
-    fPipe = popen("/bin/iac -s", "w");
-    if (fPipe == nullptr)
-    {
-        LOG_ERROR("popen failed: " << strerror(errno));
-        fPipeFd = -1;
-        return false;
-    }
 
-    fPipeFd = fileno(fPipe);
-    if (fPipeFd == -1)
+    int rate = cfg->audio.output_sample_rate;
+    output = AudioOutputSink::createNew(cfg->audio.output_sink, cfg->audio.output_sink_path);
+    if (output->open(rate))
     {
-        LOG_ERROR("fileno failed: " << strerror(errno));
-        closePipe();
-        return false;
-    }
-
-    int flags = fcntl(fPipeFd, F_GETFL, 0);
-    if (flags == -1)
-    {
-        LOG_ERROR("fcntl(F_GETFL) failed: " << strerror(errno));
-        closePipe();
-        return false;
+        return true;
     }
+    delete output;
+    output = nullptr;
 
-    if (fcntl(fPipeFd, F_SETFL, flags | O_NONBLOCK) == -1)
+    // The external player is the fallback when the device can't be opened
+    if (strcmp(cfg->audio.output_sink, "pipe") != 0)
     {
-        LOG_ERROR("fcntl(F_SETFL, O_NONBLOCK) failed: " << strerror(errno));
-        closePipe();
-        return false;
+        LOG_WARN("Audio output " << cfg->audio.output_sink << " unavailable, falling back to pipe.");
+        output = AudioOutputSink::createNew("pipe", "");
+        if (output->open(rate))
+        {
+            return true;
+        }
+        delete output;
+        output = nullptr;
     }
 
-    LOG_DEBUG("Pipe opened successfully (fd=" << fPipeFd << ").");
-    return true;
+    return false;
 }
 
-void BackchannelWorker::closePipe()
+void BackchannelWorker::closeOutput()
 {
-    if (fPipe)
+    if (output)
     {
-        LOG_DEBUG("Closing pipe (fd=" << fPipeFd << ").");
-        int ret = pclose(fPipe);
-        fPipe = nullptr;
-        fPipeFd = -1;
-        if (ret == -1)
-        {
-            LOG_ERROR("pclose() failed: " << strerror(errno));
-        }
-        else
-        {
-            if (WIFEXITED(ret))
-            {
-                LOG_DEBUG("Pipe process exited with status: " << WEXITSTATUS(ret));
-            }
-            else if (WIFSIGNALED(ret))
-            {
-                LOG_WARN("Pipe process terminated by signal: " << WTERMSIG(ret));
-            }
-            else
-            {
-                LOG_WARN("Pipe process stopped for unknown reason.");
-            }
-        }
+        // Let the sink play out what is queued before it goes away
+        output->close();
+        delete output;
+        output = nullptr;
     }
 }
 
@@ -182,59 +159,22 @@ bool BackchannelWorker::decodeFrame(const uint8_t *payload,
     return true;
 }
 
-bool BackchannelWorker::writePcmToPipe(const std::vector<int16_t> &pcmBuffer)
+bool BackchannelWorker::writePcm(const std::vector<int16_t> &pcmBuffer)
 {
-    if (fPipeFd == -1 || fPipe == nullptr)
+    if (output == nullptr || output->hasFailed())
     {
-        LOG_ERROR("Pipe is closed (fd=" << fPipeFd << "), cannot write PCM data.");
+        LOG_ERROR("Audio output is closed, cannot write PCM data.");
+        closeOutput();
         return false;
     }
     if (pcmBuffer.empty())
     {
-        LOG_DEBUG("Attempted to write empty PCM buffer to pipe.");
+        LOG_DEBUG("Attempted to write empty PCM buffer to output.");
         return true;
     }
 
-    size_t bytesToWrite = pcmBuffer.size() * sizeof(int16_t);
-    const uint8_t *dataPtr = reinterpret_cast<const uint8_t *>(pcmBuffer.data());
-
-    ssize_t bytesWritten = write(fPipeFd, dataPtr, bytesToWrite);
-
-    if (bytesWritten == static_cast<ssize_t>(bytesToWrite))
-    {
-        // Bytes written match expected size
-    }
-    else if (bytesWritten >= 0)
-    {
-        LOG_WARN("Partial write to pipe (" << bytesWritten << "/" << bytesToWrite
-                                           << "). Assuming pipe clogged.");
-        return true;
-    }
-    else
-    {
-        int saved_errno = errno;
-        if (saved_errno == EAGAIN || saved_errno == EWOULDBLOCK)
-        {
-            LOG_WARN("Pipe clogged (EAGAIN/EWOULDBLOCK). Discarding PCM chunk.");
-            return true;
-        }
-        else if (saved_errno == EPIPE)
-        {
-            LOG_ERROR("write() failed: Broken pipe (EPIPE). Assuming pipe closed by "
-                      "reader.");
-            closePipe();
-            return false;
-        }
-        else
-        {
-            LOG_ERROR("write() failed: errno=" << saved_errno << ": " << strerror(saved_errno)
-                                               << ". Assuming pipe closed.");
-            closePipe();
-            return false;
-        }
-    }
-
-    return true;
+    // Never blocks, overruns are counted by the sink
+    return output->write(pcmBuffer.data(), pcmBuffer.size());
 }
 
 bool BackchannelWorker::processFrame(const BackchannelFrame &frame)
@@ -269,12 +209,14 @@ bool BackchannelWorker::processFrame(const BackchannelFrame &frame)
         buffer_to_write = &resampled_pcm;
     }
 
-    // Write the final mono PCM to the pipe
+    // Write the final mono PCM to the output
     if (buffer_to_write != nullptr && !buffer_to_write->empty())
     {
-        if (!writePcmToPipe(*buffer_to_write))
+        lastPcm = *buffer_to_write;
+        lossRun = 0;
+        if (!writePcm(*buffer_to_write))
         {
-            // Error writing to pipe, likely closed. Stop processing loop.
+            // Output failed, likely closed. Stop processing loop.
             return false;
         }
     }
@@ -282,120 +224,256 @@ bool BackchannelWorker::processFrame(const BackchannelFrame &frame)
     return true;
 }
 
-void BackchannelWorker::run()
+bool BackchannelWorker::concealFrame()
 {
-    if (!global_backchannel)
+    if (!cfg->audio.output_enabled)
     {
-        LOG_ERROR("Cannot run BackchannelWorker: global_backchannel is null.");
-        return;
+        return true;
     }
 
-    LOG_INFO("Processor thread running...");
+    size_t samples = lastPcm.size();
+    if (samples == 0)
+    {
+        samples = static_cast<size_t>(jitterBuffer.frameDurationUs() * cfg->audio.output_sample_rate
+                                      / 1000000);
+    }
 
-    global_backchannel->running = true;
-    while (global_backchannel->running)
+    // Repeat the last frame fading out from half level for the first loss,
+    // then play silence until frames arrive again
+    std::vector<int16_t> pcm(samples, 0);
+    if (lossRun == 0 && lastPcm.size() == samples)
     {
-        // Wait for condition: running and at least one sink is sending
+        for (size_t i = 0; i < samples; ++i)
         {
-            std::unique_lock<std::mutex> lock(global_backchannel->mutex);
-            global_backchannel->should_grab_frames.wait(lock, [&] {
-                return !global_backchannel->running
-                       || global_backchannel->is_sending.load(std::memory_order_acquire) > 0;
-            });
+            pcm[i] = static_cast<int16_t>(static_cast<int32_t>(lastPcm[i])
+                                          * static_cast<int32_t>(samples - i)
+                                          / static_cast<int32_t>(2 * samples));
         }
+    }
 
-        if (!global_backchannel->running)
+    lossRun++;
+    concealedFrames++;
+
+    return writePcm(pcm);
+}
+
+void BackchannelWorker::resetSession()
+{
+    updateStats();
+    closeOutput();
+    currentSessionId = 0;
+    stopPending = false;
+    jitterBuffer.reset();
+    lastPcm.clear();
+    lossRun = 0;
+}
+
+void BackchannelWorker::updateStats()
+{
+    const BackchannelJitterBuffer::Stats &stats = jitterBuffer.stats();
+
+    RTSPStatus::writeCustomParameter("backchannel", "jitter_ms", std::to_string(jitterBuffer.jitterMs()));
+    RTSPStatus::writeCustomParameter("backchannel", "target_delay_ms", std::to_string(jitterBuffer.targetDelayMs()));
+    RTSPStatus::writeCustomParameter("backchannel", "buffered_ms", std::to_string(jitterBuffer.bufferedMs()));
+    RTSPStatus::writeCustomParameter("backchannel", "received_packets", std::to_string(stats.received));
+    RTSPStatus::writeCustomParameter("backchannel", "late_packets", std::to_string(stats.late));
+    RTSPStatus::writeCustomParameter("backchannel", "duplicate_packets", std::to_string(stats.duplicate));
+    RTSPStatus::writeCustomParameter("backchannel", "lost_packets", std::to_string(stats.lost));
+    RTSPStatus::writeCustomParameter("backchannel", "concealed_frames", std::to_string(concealedFrames));
+    RTSPStatus::writeCustomParameter("backchannel", "underruns", std::to_string(stats.underruns));
+    RTSPStatus::writeCustomParameter("backchannel", "dropped_frames", std::to_string(stats.overflowDrops));
+    if (output)
+    {
+        RTSPStatus::writeCustomParameter("backchannel", "output_sink", output->name());
+        RTSPStatus::writeCustomParameter("backchannel", "output_latency_ms", std::to_string(output->latencyMs()));
+        RTSPStatus::writeCustomParameter("backchannel", "output_overrun_samples", std::to_string(output->overruns()));
+        RTSPStatus::writeCustomParameter("backchannel", "output_underruns", std::to_string(output->underruns()));
+    }
+
+    lastStatsUpdate = std::chrono::steady_clock::now();
+}
+
+void BackchannelWorker::handleFrame(BackchannelFrame &&frame)
+{
+    // Handle Zero-Payload Frame (Stop Signal)
+    if (frame.payload.empty())
+    {
+        LOG_DEBUG("Received stop signal (zero-payload) from session " << frame.clientSessionId);
+        if (frame.clientSessionId == currentSessionId && currentSessionId != 0)
         {
-            break;
+            // Play out what is still buffered, the output is closed once drained
+            LOG_INFO("Current session " << currentSessionId << " stopped. Draining "
+                                        << jitterBuffer.bufferedMs() << "ms before closing output.");
+            stopPending = true;
+        }
+        else if (currentSessionId == 0)
+        {
+            LOG_DEBUG("Stop signal received but no current session. Ignoring.");
         }
+        else
+        {
+            LOG_WARN("Stop signal from non-current session "
+                     << frame.clientSessionId << " (Current: " << currentSessionId
+                     << "). Ignoring.");
+        }
+        return;
+    }
 
-        BackchannelFrame frame = global_backchannel->inputQueue->wait_read();
+    // Handle Playback Frame (Data)
+    if (currentSessionId == 0)
+    {
+        // No current session, this frame's sender becomes the current one
+        currentSessionId = frame.clientSessionId;
+        LOG_INFO("New current session " << currentSessionId << " playing "
+                                        << IMPBackchannel::getFormatName(frame.format)
+                                        << ". Opening output.");
+        if (!initOutput())
+        {
+            LOG_ERROR("Failed to open output for new session " << currentSessionId
+                                                             << ". Resetting.");
+            currentSessionId = 0;
+            return;
+        }
+        jitterBuffer.reset();
+        stopPending = false;
+        nextPlayout = std::chrono::steady_clock::now();
+        jitterBuffer.push(std::move(frame));
+    }
+    else if (frame.clientSessionId == currentSessionId)
+    {
+        // Frame is from the current session, talking resumed before drain finished
+        stopPending = false;
+        jitterBuffer.push(std::move(frame));
+    }
+    else
+    {
+        // Frame is from a different session, ignore it
+        LOG_DEBUG("Discarding frame from non-current session "
+                  << frame.clientSessionId << " (Current: " << currentSessionId << ")");
+    }
+}
 
-        if (!global_backchannel->running)
+void BackchannelWorker::playout()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now < nextPlayout)
+    {
+        return;
+    }
+
+    auto period = std::chrono::microseconds(jitterBuffer.frameDurationUs());
+
+    if (!output)
+    { // Ensure output is open (it might have closed unexpectedly)
+        LOG_WARN("Output was closed unexpectedly for current session " << currentSessionId
+                                                                       << ". Reopening.");
+        if (!initOutput())
         {
-            break;
+            LOG_ERROR("Failed to reopen output for session " << currentSessionId << ". Resetting.");
+            resetSession();
+            return;
         }
+    }
 
-        // Handle Zero-Payload Frame (Stop Signal)
-        if (frame.payload.empty())
+    BackchannelFrame frame;
+    bool ok = true;
+    switch (jitterBuffer.pop(frame))
+    {
+    case BackchannelJitterBuffer::Result::Frame:
+        ok = processFrame(frame);
+        break;
+    case BackchannelJitterBuffer::Result::Lost:
+        ok = concealFrame();
+        break;
+    case BackchannelJitterBuffer::Result::Empty:
+        if (stopPending && jitterBuffer.empty())
         {
-            LOG_DEBUG("Received stop signal (zero-payload) from session " << frame.clientSessionId);
-            if (frame.clientSessionId == currentSessionId && currentSessionId != 0)
-            {
-                LOG_INFO("Current session " << currentSessionId << " stopped. Closing pipe.");
-                closePipe();
-                currentSessionId = 0;
-            }
-            else if (currentSessionId == 0)
+            LOG_INFO("Session " << currentSessionId << " drained. Closing output.");
+            resetSession();
+            return;
+        }
+        // Priming, check again after one period or when the next frame arrives
+        nextPlayout = now + period;
+        return;
+    }
+
+    if (!ok)
+    {
+        // processFrame returns false if the output failed and was closed
+        LOG_WARN("Playout failed for session " << currentSessionId << ". Output closed.");
+        resetSession();
+        return;
+    }
+
+    // Pace at the output clock, resync if we fell behind by more than a period
+    nextPlayout += period;
+    if (nextPlayout + period < now)
+    {
+        nextPlayout = now + period;
+    }
+}
+
+void BackchannelWorker::run()
+{
+    if (!global_backchannel)
+    {
+        LOG_ERROR("Cannot run BackchannelWorker: global_backchannel is null.");
+        return;
+    }
+
+    LOG_INFO("Processor thread running...");
+
+    global_backchannel->running = true;
+    while (global_backchannel->running)
+    {
+        {
+            std::unique_lock<std::mutex> lock(global_backchannel->mutex);
+            if (currentSessionId == 0)
             {
-                LOG_DEBUG("Stop signal received but no current session. Ignoring.");
+                // Idle: wait for condition: running and at least one sink is sending
+                global_backchannel->should_grab_frames.wait(lock, [&] {
+                    return !global_backchannel->running
+                           || global_backchannel->is_sending.load(std::memory_order_acquire) > 0;
+                });
             }
             else
             {
-                LOG_WARN("Stop signal from non-current session "
-                         << frame.clientSessionId << " (Current: " << currentSessionId
-                         << "). Ignoring.");
+                // Playing: sleep until the next output period or a new frame
+                global_backchannel->should_grab_frames.wait_until(lock, nextPlayout);
             }
-            continue;
         }
 
-        // Handle Playback Frame (Data)
-        if (currentSessionId == 0)
+        if (!global_backchannel->running)
         {
-            // No current session, this frame's sender becomes the current one
-            currentSessionId = frame.clientSessionId;
-            LOG_INFO("New current session " << currentSessionId << " playing "
-                                            << IMPBackchannel::getFormatName(frame.format)
-                                            << ". Opening pipe.");
-            if (!initPipe())
-            {
-                LOG_ERROR("Failed to open pipe for new session " << currentSessionId
-                                                                 << ". Resetting.");
-                currentSessionId = 0;
-                continue;
-            }
-            // Pipe is open
-            if (!processFrame(frame))
-            {
-                // processFrame returns false if pipe write fails and closes pipe
-                LOG_WARN("processFrame failed for initial frame of session " << currentSessionId
-                                                                             << ". Pipe closed.");
-                currentSessionId = 0;
-            }
+            break;
         }
-        else if (frame.clientSessionId == currentSessionId)
+
+        BackchannelFrame frame;
+        while (global_backchannel->inputQueue->read(&frame))
         {
-            // Frame is from the current session
-            if (!fPipe)
-            { // Ensure pipe is open (it might have closed unexpectedly)
-                LOG_WARN("Pipe was closed unexpectedly for current session " << currentSessionId
-                                                                             << ". Reopening.");
-                if (!initPipe())
-                {
-                    LOG_ERROR("Failed to reopen pipe for session " << currentSessionId
-                                                                   << ". Resetting.");
-                    currentSessionId = 0;
-                    continue;
-                }
-            }
-            // Pipe should be open
-            if (!processFrame(frame))
+            handleFrame(std::move(frame));
+        }
+
+        if (currentSessionId != 0)
+        {
+            playout();
+
+            if (std::chrono::steady_clock::now() - lastStatsUpdate
+                >= std::chrono::milliseconds(STATS_INTERVAL_MS))
             {
-                // processFrame returns false if pipe write fails and closes pipe
-                LOG_WARN("processFrame failed for session " << currentSessionId << ". Pipe closed.");
-                currentSessionId = 0;
+                updateStats();
             }
         }
-        else
+        else if (global_backchannel->is_sending.load(std::memory_order_acquire) > 0)
         {
-            // Frame is from a different session, ignore it
-            LOG_DEBUG("Discarding frame from non-current session "
-                      << frame.clientSessionId << " (Current: " << currentSessionId << ")");
+            // Sink is sending but nothing queued yet, don't spin on the predicate
+            std::unique_lock<std::mutex> lock(global_backchannel->mutex);
+            global_backchannel->should_grab_frames.wait_for(lock, std::chrono::milliseconds(20));
         }
     }
 
     LOG_INFO("Processor thread stopping.");
-    closePipe();
+    closeOutput();
 }
 
 void *BackchannelWorker::thread_entry(void *arg)
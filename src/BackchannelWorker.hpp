@@ -2,11 +2,16 @@
 #define BACKCHANNEL_PROCESSOR_HPP
 
 // Processes audio frames, decodes them, handles session management (who is
-// "current"), resamples, and sends PCM data to a pipe.
+// "current"), resamples, and sends PCM data to an AudioOutputSink. Frames of
+// the current session pass through a jitter buffer and are written to the
+// output paced at the output sample rate.
 
+#include "AudioOutputSink.hpp"
+#include "BackchannelJitterBuffer.hpp"
 #include "IMPBackchannel.hpp"
 #include "globals.hpp"
 
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
 
@@ -21,24 +26,39 @@ public:
 private:
     void run();
 
+    void handleFrame(BackchannelFrame &&frame);
+    void playout();
+    void resetSession();
+    void updateStats();
+
     std::vector<int16_t> resampleLinear(const std::vector<int16_t> &input_pcm,
                                         int input_rate,
                                         int output_rate);
 
-    bool initPipe();
-    void closePipe();
+    bool initOutput();
+    void closeOutput();
 
     bool processFrame(const BackchannelFrame &frame);
     bool decodeFrame(const uint8_t *payload,
                      size_t payloadSize,
                      IMPBackchannelFormat format,
                      std::vector<int16_t> &outPcmBuffer);
-    bool writePcmToPipe(const std::vector<int16_t> &pcmBuffer);
+    bool concealFrame();
+    bool writePcm(const std::vector<int16_t> &pcmBuffer);
 
     unsigned int currentSessionId;
+    bool stopPending;
+
+    BackchannelJitterBuffer jitterBuffer;
+    std::chrono::steady_clock::time_point nextPlayout;
+    std::chrono::steady_clock::time_point lastStatsUpdate;
+
+    // Last frame written, source for concealment of the first lost frame
+    std::vector<int16_t> lastPcm;
+    unsigned int lossRun;
+    uint64_t concealedFrames;
 
-    FILE *fPipe;
-    int fPipeFd;
+    AudioOutputSink *output;
 
     BackchannelWorker(const BackchannelWorker &) = delete;
     BackchannelWorker &operator=(const BackchannelWorker &) = delete;
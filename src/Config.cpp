@@ -3,9 +3,12 @@
 #include <iostream>
 #include <vector>
 #include <functional>
+#include <charconv>
+#include <cstring>
 #include <json-c/json.h>
 #include "Config.hpp"
 #include "Logger.hpp"
+#include "SystemSensor.hpp"
 
 #define WEBSOCKET_TOKEN_LENGTH 32
 
@@ -157,15 +160,21 @@ std::vector<ConfigItem<bool>> CFG::getBoolItems()
         {"audio.input_enabled", audio.input_enabled, true, validateBool},
         {"audio.output_enabled", audio.output_enabled, true, validateBool},
         {"audio.force_stereo", audio.force_stereo, false, validateBool},
+        {"audio.av_sync_enabled", audio.av_sync_enabled, true, validateBool},
 #if defined(LIB_AUDIO_PROCESSING)
         {"audio.input_high_pass_filter", audio.input_high_pass_filter, false, validateBool},
         {"audio.input_agc_enabled", audio.input_agc_enabled, false, validateBool},
 #endif
 #endif
+        {"dvr.enabled", dvr.enabled, false, validateBool},
+        {"dvr.audio", dvr.audio, true, validateBool},
         {"image.isp_bypass", image.isp_bypass, true, validateBool},
         {"image.vflip", image.vflip, false, validateBool},
         {"image.hflip", image.hflip, false, validateBool},
         {"motion.enabled", motion.enabled, false, validateBool},
+        {"record.enabled", record.enabled, false, validateBool},
+        {"record.audio", record.audio, true, validateBool},
+        {"rtsp.adaptive_bitrate_enabled", rtsp.adaptive_bitrate_enabled, false, validateBool},
         {"rtsp.auth_required", rtsp.auth_required, true, validateBool},
 #if defined(AUDIO_SUPPORT)
         {"stream0.audio_enabled", stream0.audio_enabled, true, validateBool},
@@ -188,6 +197,7 @@ std::vector<ConfigItem<bool>> CFG::getBoolItems()
         {"stream1.osd.uptime_enabled", stream1.osd.uptime_enabled, true, validateBool},
         {"stream1.osd.user_text_enabled", stream1.osd.user_text_enabled, true, validateBool},
         {"stream2.enabled", stream2.enabled, true, validateBool},
+        {"stream2.jpeg_thumbnail", stream2.jpeg_thumbnail, false, validateBool},
         {"websocket.enabled", websocket.enabled, true, validateBool},
         {"websocket.ws_secured", websocket.ws_secured, true, validateBool},
         {"websocket.http_secured", websocket.http_secured, true, validateBool},
@@ -202,14 +212,39 @@ std::vector<ConfigItem<const char *>> CFG::getCharItems()
             std::set<std::string> a = {"OPUS", "AAC", "PCM", "G711A", "G711U", "G726"};
             return a.count(std::string(v)) == 1;
         }},
+        {"audio.output_sink", audio.output_sink, "imp", [](const char *v) {
+            std::set<std::string> a = {"imp", "pipe", "file"};
+            return a.count(std::string(v)) == 1;
+        }},
+        {"audio.output_sink_path", audio.output_sink_path, "", [](const char *v) { return true; }},
 #endif
+        {"dvr.output_type", dvr.output_type, "file", [](const char *v) {
+            std::set<std::string> a = {"file", "socket"};
+            return a.count(std::string(v)) == 1;
+        }},
+        {"dvr.output_path", dvr.output_path, "/tmp/dvr", validateCharNotEmpty},
+        {"record.path", record.path, "/mnt/mmcblk0p1/record", validateCharNotEmpty},
+        {"events.socket_path", events.socket_path, "/run/prudynt/events.sock", validateCharDummy},
+        {"events.helper_path", events.helper_path, "", validateCharDummy},
         {"general.loglevel", general.loglevel, "INFO", [](const char *v) {
             std::set<std::string> a = {"EMERGENCY", "ALERT", "CRITICAL", "ERROR", "WARN", "NOTICE", "INFO", "DEBUG"};
             return a.count(std::string(v)) == 1;
         }},
+        {"motion.engine", motion.engine, "ivs", [](const char *v) {
+            std::set<std::string> a = {"ivs", "software"};
+            return a.count(std::string(v)) == 1;
+        }},
         {"motion.script_path", motion.script_path, "/usr/sbin/motion", validateCharNotEmpty},
+        {"rtsp.adaptive_policy", rtsp.adaptive_policy, "worst", [](const char *v) {
+            std::set<std::string> a = {"worst", "median"};
+            return a.count(std::string(v)) == 1;
+        }},
         {"rtsp.name", rtsp.name, "thingino prudynt", validateCharNotEmpty},
         {"rtsp.password", rtsp.password, "thingino", validateCharNotEmpty},
+        {"rtsp.slow_client_policy", rtsp.slow_client_policy, "idr", [](const char *v) {
+            std::set<std::string> a = {"none", "idr", "disconnect"};
+            return a.count(std::string(v)) == 1;
+        }},
         {"rtsp.username", rtsp.username, "thingino", validateCharNotEmpty},
         {"sensor.model", sensor.model, "unknown", validateCharNotEmpty, false, "/proc/jz/sensor/name"},
         {"sensor.chip_id", sensor.chip_id, "unknown", validateCharNotEmpty, false, "/proc/jz/sensor/chip_id"},
@@ -239,6 +274,10 @@ std::vector<ConfigItem<const char *>> CFG::getCharItems()
         {"stream1.rtsp_endpoint", stream1.rtsp_endpoint, "ch1", validateCharNotEmpty},
         {"stream1.rtsp_info", stream1.rtsp_info, "stream1", validateCharNotEmpty},
        {"stream2.jpeg_path", stream2.jpeg_path, "/tmp/snapshot.jpg", validateCharNotEmpty},
+        {"stream2.jpeg_sync", stream2.jpeg_sync, "none", [](const char *v) {
+            std::set<std::string> a = {"none", "periodic", "always"};
+            return a.count(std::string(v)) == 1;
+        }},
         {"websocket.name", websocket.name, "wss prudynt", validateCharNotEmpty},
         {"websocket.token", websocket.token, "auto", [](const char *v) {
             std::string token(v);
@@ -254,6 +293,15 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
         {"audio.input_bitrate", audio.input_bitrate, 40, [](const int &v) { return v >= 6 && v <= 256; }},
         {"audio.input_sample_rate", audio.input_sample_rate, 16000, validateSampleRate},
         {"audio.output_sample_rate", audio.output_sample_rate, 16000, validateSampleRate},
+        {"audio.output_jitter_min_ms", audio.output_jitter_min_ms, 40, [](const int &v) { return v >= 0 && v <= 1000; }},
+        {"audio.output_jitter_max_ms", audio.output_jitter_max_ms, 200, [](const int &v) { return v >= 20 && v <= 2000; }},
+        {"audio.output_vol", audio.output_vol, 80, [](const int &v) { return v >= -30 && v <= 120; }},
+        {"audio.output_gain", audio.output_gain, 25, [](const int &v) { return v >= 0 && v <= 31; }},
+        {"audio.encode_thread_priority", audio.encode_thread_priority, 0, [](const int &v) { return v >= 0 && v <= 99; }},
+        {"audio.encode_thread_cpu", audio.encode_thread_cpu, -1, [](const int &v) { return v >= -1 && v <= 31; }},
+        {"audio.opus_complexity", audio.opus_complexity, 10, [](const int &v) { return v >= 0 && v <= 10; }},
+        {"audio.opus_encode_budget_us", audio.opus_encode_budget_us, 10000, [](const int &v) { return v >= 0 && v <= 20000; }},
+        {"audio.av_sync_resync_ms", audio.av_sync_resync_ms, 200, [](const int &v) { return v >= 20 && v <= 5000; }},
         {"audio.input_vol", audio.input_vol, 80, [](const int &v) { return v >= -30 && v <= 120; }},
         {"audio.input_gain", audio.input_gain, 25, [](const int &v) { return v >= -1 && v <= 31; }},
 #if defined(LIB_AUDIO_PROCESSING)
@@ -263,6 +311,7 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
         {"audio.input_noise_suppression", audio.input_noise_suppression, 0, [](const int &v) { return v >= 0 && v <= 3; }},
 #endif
 #endif
+        {"events.queue_size", events.queue_size, 64, [](const int &v) { return v >= 8 && v <= 1024; }},
         {"general.imp_polling_timeout", general.imp_polling_timeout, 500, [](const int &v) { return v >= 1 && v <= 5000; }},
         {"general.osd_pool_size", general.osd_pool_size, 1024, [](const int &v) { return v >= 0 && v <= 65535; }},
         {"image.ae_compensation", image.ae_compensation, 128, validateInt255},
@@ -285,6 +334,17 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
         {"image.temper_strength", image.temper_strength, DEFAULT_TEMPER, DEFAULT_TEMPER_VALIDATE},
         {"image.wb_bgain", image.wb_bgain, 0, [](const int &v) { return v >= 0 && v <= 34464; }},
         {"image.wb_rgain", image.wb_rgain, 0, [](const int &v) { return v >= 0 && v <= 34464; }},
+        {"dvr.stream", dvr.stream, 0, validateInt1},
+        {"dvr.preroll_s", dvr.preroll_s, 5, [](const int &v) { return v >= 1 && v <= 60; }},
+        {"dvr.postroll_s", dvr.postroll_s, 10, [](const int &v) { return v >= 0 && v <= 600; }},
+        {"dvr.max_clip_s", dvr.max_clip_s, 300, [](const int &v) { return v >= 10 && v <= 3600; }},
+        {"dvr.max_memory_kb", dvr.max_memory_kb, 4096, [](const int &v) { return v >= 256 && v <= 65536; }},
+        {"record.stream", record.stream, 0, validateInt1},
+        {"record.segment_s", record.segment_s, 60, [](const int &v) { return v >= 10 && v <= 3600; }},
+        {"record.segment_mb", record.segment_mb, 64, [](const int &v) { return v >= 1 && v <= 2048; }},
+        {"record.max_storage_mb", record.max_storage_mb, 1024, validateIntGe0},
+        {"record.keep_hours", record.keep_hours, 0, [](const int &v) { return v >= 0 && v <= 8760; }},
+        {"record.buffer_kb", record.buffer_kb, 2048, [](const int &v) { return v >= 512 && v <= 16384; }},
         {"motion.debounce_time", motion.debounce_time, 0, validateIntGe0},
         {"motion.post_time", motion.post_time, 0, validateIntGe0},
         {"motion.ivs_polling_timeout", motion.ivs_polling_timeout, 1000, [](const int &v) { return v >= 100 && v <= 10000; }},
@@ -301,11 +361,21 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
         {"motion.roi_1_x", motion.roi_1_x, IVS_AUTO_VALUE, validateIntGe0},
         {"motion.roi_1_y", motion.roi_1_y, IVS_AUTO_VALUE, validateIntGe0},
         {"motion.roi_count", motion.roi_count, 1, [](const int &v) { return v >= 1 && v <= 52; }},
+        {"motion.grid_cols", motion.grid_cols, 16, [](const int &v) { return v >= 1 && v <= 64; }},
+        {"motion.grid_rows", motion.grid_rows, 9, [](const int &v) { return v >= 1 && v <= 64; }},
+        {"motion.analysis_fps", motion.analysis_fps, 5, [](const int &v) { return v >= 1 && v <= 30; }},
+        {"motion.cell_threshold", motion.cell_threshold, 12, [](const int &v) { return v >= 1 && v <= 255; }},
+        {"motion.min_cells", motion.min_cells, 1, [](const int &v) { return v >= 1 && v <= 4096; }},
+        {"motion.max_cpu_percent", motion.max_cpu_percent, 10, [](const int &v) { return v >= 1 && v <= 100; }},
+        {"rtsp.adaptation_interval_seconds", rtsp.adaptation_interval_seconds, 5, [](const int &v) { return v >= 1 && v <= 60; }},
+        {"rtsp.adaptive_min_bitrate", rtsp.adaptive_min_bitrate, 256, [](const int &v) { return v >= 32 && v <= 20000; }},
+        {"rtsp.adaptive_min_fps", rtsp.adaptive_min_fps, 5, [](const int &v) { return v >= 1 && v <= 60; }},
         {"rtsp.est_bitrate", rtsp.est_bitrate, 5000, validateIntGe0},
         {"rtsp.out_buffer_size", rtsp.out_buffer_size, 500000, validateIntGe0},
         {"rtsp.port", rtsp.port, 554, validateInt65535},
         {"rtsp.send_buffer_size", rtsp.send_buffer_size, 307200, validateIntGe0},
         {"rtsp.session_reclaim", rtsp.session_reclaim, 65, validateIntGe0},
+        {"rtsp.slow_client_seconds", rtsp.slow_client_seconds, 5, [](const int &v) { return v >= 1 && v <= 60; }},
         {"sensor.i2c_bus", sensor.i2c_bus, 0, validateIntGe0, false, "/proc/jz/sensor/i2c_bus"},
         {"sensor.fps", sensor.fps, 25, validateInt120, false, "/proc/jz/sensor/max_fps"},
         {"sensor.min_fps", sensor.min_fps, 5, validateInt120, false, "/proc/jz/sensor/min_fps"},
@@ -319,6 +389,7 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
         {"stream0.buffers", stream0.buffers, DEFAULT_BUFFERS_0, [](const int &v) { return v >= 1 && v <= 8; }},
         {"stream0.fps", stream0.fps, 25, validateInt120},
         {"stream0.gop", stream0.gop, 20, validateIntGe0},
+        {"stream0.idle_timeout", stream0.idle_timeout, 0, [](const int &v) { return v >= 0 && v <= 86400; }},
         {"stream0.height", stream0.height, 1080, validateIntGe0},
         {"stream0.max_gop", stream0.max_gop, 60, validateIntGe0},
         {"stream0.osd.font_size", stream0.osd.font_size, OSD_AUTO_VALUE, validateIntGe0},
@@ -342,6 +413,8 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
         {"stream0.osd.time_rotation", stream0.osd.time_rotation, 0, validateInt360},
         {"stream0.osd.uptime_rotation", stream0.osd.uptime_rotation, 0, validateInt360},
         {"stream0.osd.user_text_rotation", stream0.osd.user_text_rotation, 0, validateInt360},
+        {"stream0.standby_encoder_timeout", stream0.standby_encoder_timeout, 0, [](const int &v) { return v >= 0 && v <= 86400; }},
+        {"stream0.standby_framesource_timeout", stream0.standby_framesource_timeout, 0, [](const int &v) { return v >= 0 && v <= 86400; }},
         {"stream0.rotation", stream0.rotation, 0, validateInt2},
         {"stream0.width", stream0.width, 1920, validateIntGe0},
         {"stream0.profile", stream0.profile, 2, validateInt2},
@@ -349,6 +422,7 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
         {"stream1.buffers", stream1.buffers, DEFAULT_BUFFERS_1, [](const int &v) { return v >= 1 && v <= 8; }},
         {"stream1.fps", stream1.fps, 25, validateInt120},
         {"stream1.gop", stream1.gop, 20, validateIntGe0},
+        {"stream1.idle_timeout", stream1.idle_timeout, 0, [](const int &v) { return v >= 0 && v <= 86400; }},
         {"stream1.height", stream1.height, 360, validateIntGe0},
         {"stream1.max_gop", stream1.max_gop, 60, validateIntGe0},
         {"stream1.osd.font_size", stream1.osd.font_size, OSD_AUTO_VALUE, validateIntGe0},
@@ -372,12 +446,16 @@ std::vector<ConfigItem<int>> CFG::getIntItems()
         {"stream1.osd.time_rotation", stream1.osd.time_rotation, 0, validateInt360},
         {"stream1.osd.uptime_rotation", stream1.osd.uptime_rotation, 0, validateInt360},
         {"stream1.osd.user_text_rotation", stream1.osd.user_text_rotation, 0, validateInt360},
+        {"stream1.standby_encoder_timeout", stream1.standby_encoder_timeout, 0, [](const int &v) { return v >= 0 && v <= 86400; }},
+        {"stream1.standby_framesource_timeout", stream1.standby_framesource_timeout, 0, [](const int &v) { return v >= 0 && v <= 86400; }},
         {"stream1.rotation", stream1.rotation, 0, validateInt2},
         {"stream1.width", stream1.width, 640, validateIntGe0},
         {"stream1.profile", stream1.profile, 2, validateInt2},
         {"stream2.jpeg_channel", stream2.jpeg_channel, 0, validateIntGe0},
         {"stream2.jpeg_quality", stream2.jpeg_quality, 75, [](const int &v) { return v > 0 && v <= 100; }},
         {"stream2.jpeg_idle_fps", stream2.jpeg_idle_fps, 1, [](const int &v) { return v >= 0 && v <= 30; }},
+        {"stream2.jpeg_cache_ttl", stream2.jpeg_cache_ttl, 1000, [](const int &v) { return v >= 100 && v <= 60000; }},
+        {"stream2.jpeg_thumbnail_quality", stream2.jpeg_thumbnail_quality, 60, [](const int &v) { return v > 0 && v <= 100; }},
         {"stream2.fps", stream2.fps, 25, [](const int &v) { return v > 1 && v <= 30; }},
         {"websocket.port", websocket.port, 8089, validateInt65535},
         {"websocket.first_image_delay", websocket.first_image_delay, 100, validateInt65535},
@@ -449,199 +527,6 @@ bool CFG::readConfig()
     return true;
 }
 
-template <typename T>
-bool processLine(const std::string &line, T &value)
-{
-    if constexpr (std::is_same_v<T, std::string>)
-    {
-        value = line;
-        return true;
-    }
-    else if constexpr (std::is_same_v<T, const char *>)
-    {
-        value = line.c_str();
-        return true;
-    }
-    else if constexpr (std::is_same_v<T, unsigned int>)
-    {
-        std::istringstream iss(line);
-        if (line.find("0x") == 0)
-        {
-            iss >> std::hex >> value;
-        }
-        else
-        {
-            iss >> value;
-        }
-        return !iss.fail();
-    }
-    else
-    {
-        std::istringstream iss(line);
-        iss >> value;
-        return !iss.fail();
-    }
-}
-
-// Helper function to check if this is a sensor parameter with proc path
-template <typename T>
-bool isSensorProcParameter(const ConfigItem<T> &item) {
-    return item.procPath != nullptr &&
-           item.procPath[0] != '\0' &&
-           std::string(item.procPath).find("/proc/jz/sensor/") == 0;
-}
-
-template <typename T>
-void handleConfigItem(json_object *jsonConfig, ConfigItem<T> &item)
-{
-    bool readFromProc = false;
-    bool readFromConfig = false;
-
-    if (!jsonConfig) return;
-
-    // For sensor parameters with proc paths, prioritize proc files over JSON
-    if (isSensorProcParameter(item)) {
-        // Try proc file first for sensor parameters
-        std::ifstream procFile(item.procPath);
-        if (procFile) {
-            T value;
-            std::string line;
-            if (std::getline(procFile, line)) {
-                if (processLine(line, value)) {
-                    if constexpr (std::is_same_v<T, const char *>) {
-                        item.value = strdup(value);
-                    } else {
-                        item.value = value;
-                    }
-                    readFromProc = true;
-                }
-            }
-        }
-    }
-
-    // Only read from JSON if proc file failed or this is not a sensor proc parameter
-    if (!readFromProc) {
-        // Parse the path to navigate through nested JSON objects
-        std::vector<std::string> pathParts;
-        std::string path = item.path;
-        size_t pos = 0;
-        while ((pos = path.find('.')) != std::string::npos) {
-            pathParts.push_back(path.substr(0, pos));
-            path.erase(0, pos + 1);
-        }
-        pathParts.push_back(path);
-
-        // Navigate through the JSON structure
-        json_object *currentJson = jsonConfig;
-        for (size_t i = 0; i < pathParts.size() - 1; ++i) {
-            json_object *nextObj = nullptr;
-            if (json_object_object_get_ex(currentJson, pathParts[i].c_str(), &nextObj)) {
-                if (json_object_is_type(nextObj, json_type_object)) {
-                    currentJson = nextObj;
-                } else {
-                    return; // Path doesn't exist or not an object
-                }
-            } else {
-                return; // Path doesn't exist
-            }
-        }
-
-        // Try to read the value from JSON
-        const std::string& finalKey = pathParts.back();
-        json_object *valueObj = nullptr;
-        if (json_object_object_get_ex(currentJson, finalKey.c_str(), &valueObj)) {
-            if constexpr (std::is_same_v<T, const char *>) {
-                if (json_object_is_type(valueObj, json_type_string)) {
-                    const char *str = json_object_get_string(valueObj);
-                    item.value = strdup(str);
-                    readFromConfig = true;
-                }
-            } else if constexpr (std::is_same_v<T, bool>) {
-                if (json_object_is_type(valueObj, json_type_boolean)) {
-                    item.value = json_object_get_boolean(valueObj);
-                    readFromConfig = true;
-                }
-            } else if constexpr (std::is_same_v<T, int>) {
-                if (json_object_is_type(valueObj, json_type_int)) {
-                    item.value = json_object_get_int(valueObj);
-                    readFromConfig = true;
-                }
-            } else if constexpr (std::is_same_v<T, unsigned int>) {
-                if (json_object_is_type(valueObj, json_type_int)) {
-                    int64_t val = json_object_get_int64(valueObj);
-                    if (val >= 0) {
-                        item.value = static_cast<unsigned int>(val);
-                        readFromConfig = true;
-                    }
-                } else if (json_object_is_type(valueObj, json_type_string)) {
-                    // Check if this is an OSD color field that might be in hex format
-                    std::string path = item.path;
-                    if (path.find("font_color") != std::string::npos ||
-                        path.find("font_stroke_color") != std::string::npos) {
-                        const char *str = json_object_get_string(valueObj);
-                        if (isValidHexColor(str)) {
-                            item.value = hexColorToUint(str);
-                            readFromConfig = true;
-                        }
-                    }
-                }
-            } else if constexpr (std::is_same_v<T, float>) {
-                if (json_object_is_type(valueObj, json_type_double)) {
-                    item.value = static_cast<float>(json_object_get_double(valueObj));
-                    readFromConfig = true;
-                } else if (json_object_is_type(valueObj, json_type_int)) {
-                    item.value = static_cast<float>(json_object_get_int(valueObj));
-                    readFromConfig = true;
-                }
-            }
-        }
-    }
-
-    // For non-sensor parameters, try proc file as fallback if JSON failed
-    if (!readFromConfig && !readFromProc && !isSensorProcParameter(item) &&
-        item.procPath != nullptr && item.procPath[0] != '\0') {
-        // Attempt to read from the proc filesystem
-        std::ifstream procFile(item.procPath);
-        if (procFile) {
-            T value;
-            std::string line;
-            if (std::getline(procFile, line)) {
-                if (processLine(line, value)) {
-                    if constexpr (std::is_same_v<T, const char *>) {
-                        item.value = strdup(value);
-                    } else {
-                        item.value = value;
-                    }
-                    readFromProc = true;
-                }
-            }
-        }
-    }
-
-    if (!readFromConfig && !readFromProc)
-    {
-        item.value = item.defaultValue; // Assign default value if not found anywhere
-    }
-    else if (!item.validate(item.value))
-    {
-        LOG_ERROR("invalid config value. " << item.path << " = " << item.value);
-        item.value = item.defaultValue; // Revert to default if validation fails
-    }
-
-    if constexpr (std::is_same_v<T, const char *>)
-    {
-        if (!readFromConfig && !readFromProc)
-        {
-            item.value = strdup(item.defaultValue);
-        }
-        else if (!item.validate(item.value))
-        {
-            LOG_ERROR("invalid config value. " << item.path << " = " << item.value);
-            item.value = strdup(item.defaultValue);
-        }
-    }
-}
-
 template <typename T>
 void handleConfigItem2(json_object *jsonConfig, ConfigItem<T> &item)
 {
@@ -756,6 +641,52 @@ std::vector<ConfigItem<float>> CFG::getFloatItems()
     };
 };
 
+const char *CFG::streamName(int chn)
+{
+    static const char *names[] = {"stream0", "stream1", "stream3", "stream4"};
+    static_assert(sizeof(names) / sizeof(names[0]) == MAX_VIDEO_STREAMS);
+    return names[chn];
+}
+
+// The derived streams have the same few keys each. Size and OSD come from the
+// source stream, the framesource channel is the one of the source.
+void CFG::addDerivedStreamItems()
+{
+    auto keep = [this](std::string str) { return derivedStrings.emplace_back(std::move(str)).c_str(); };
+    auto validateFormat = [](const char *v) { return strcmp(v, "H264") == 0 || strcmp(v, "H265") == 0; };
+    auto validateMode = [](const char *v) {
+        std::set<std::string> a = {"CBR", "VBR", "SMART", "FIXQP", "CAPPED_VBR", "CAPPED_QUALITY"};
+        return a.count(std::string(v)) == 1;
+    };
+    auto validateTimeout = [](const int &v) { return v >= 0 && v <= 86400; };
+
+    for (int chn = NUM_SOURCE_STREAMS; chn < MAX_VIDEO_STREAMS; chn++)
+    {
+        _stream &stream = streams[chn];
+        std::string name = streamName(chn);
+
+        boolItems.push_back({keep(name + ".enabled"), stream.enabled, false, validateBool});
+#if defined(AUDIO_SUPPORT)
+        boolItems.push_back({keep(name + ".audio_enabled"), stream.audio_enabled, true, validateBool});
+#endif
+        charItems.push_back({keep(name + ".format"), stream.format, "H264", validateFormat});
+        charItems.push_back({keep(name + ".mode"), stream.mode, DEFAULT_ENC_MODE_1, validateMode});
+        charItems.push_back({keep(name + ".rtsp_endpoint"), stream.rtsp_endpoint,
+                             keep("ch" + name.substr(6)), validateCharNotEmpty});
+        charItems.push_back({keep(name + ".rtsp_info"), stream.rtsp_info, streamName(chn), validateCharNotEmpty});
+        intItems.push_back({keep(name + ".source"), stream.source, NUM_SOURCE_STREAMS - 1,
+                            [](const int &v) { return v >= 0 && v < NUM_SOURCE_STREAMS; }});
+        intItems.push_back({keep(name + ".bitrate"), stream.bitrate, 250, validateIntGe0});
+        intItems.push_back({keep(name + ".fps"), stream.fps, 10, validateInt120});
+        intItems.push_back({keep(name + ".gop"), stream.gop, 20, validateIntGe0});
+        intItems.push_back({keep(name + ".max_gop"), stream.max_gop, 60, validateIntGe0});
+        intItems.push_back({keep(name + ".profile"), stream.profile, 2, validateInt2});
+        intItems.push_back({keep(name + ".idle_timeout"), stream.idle_timeout, 60, validateTimeout});
+        intItems.push_back({keep(name + ".standby_encoder_timeout"), stream.standby_encoder_timeout, 0,
+                            validateTimeout});
+    }
+}
+
 void CFG::migrateOldColorSettings()
 {
     // Helper function to combine RGB color with alpha transparency
@@ -931,35 +862,381 @@ void CFG::migrateOldColorSettings()
     }
 }
 
+template <typename T>
+void CFG::buildIndex(const std::vector<ConfigItem<T>> &items, ItemType type)
+{
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        if (!index.emplace(items[i].path, ItemSlot{type, static_cast<uint32_t>(i)}).second)
+            LOG_WARN("Duplicate config key " << items[i].path);
+        else
+            keyTable.push_back({items[i].path, type});
+    }
+}
+
+void CFG::buildIndexes()
+{
+    index.clear();
+    index.reserve(boolItems.size() + charItems.size() + intItems.size() +
+                  uintItems.size() + floatItems.size());
+    keyTable.clear();
+    buildIndex(boolItems, ItemType::Bool);
+    buildIndex(charItems, ItemType::Char);
+    buildIndex(intItems, ItemType::Int);
+    buildIndex(uintItems, ItemType::Uint);
+    buildIndex(floatItems, ItemType::Float);
+}
+
+template <typename T>
+void CFG::loadDefaults(std::vector<ConfigItem<T>> &items)
+{
+    for (auto &item : items)
+    {
+        if constexpr (std::is_same_v<T, const char *>) {
+            item.value = strings.store(item.defaultValue);
+        } else {
+            item.value = item.defaultValue;
+        }
+    }
+}
+
+template <typename T>
+void CFG::loadJsonValue(ConfigItem<T> &item, json_object *valueObj)
+{
+    // Sensor items are read like the others, loadProc() overrides them with
+    // what the driver reports, where it reports a usable value
+    T value{};
+    bool read = false;
+    if constexpr (std::is_same_v<T, const char *>) {
+        if (json_object_is_type(valueObj, json_type_string)) {
+            value = json_object_get_string(valueObj);
+            read = true;
+        }
+    } else if constexpr (std::is_same_v<T, bool>) {
+        if (json_object_is_type(valueObj, json_type_boolean)) {
+            value = json_object_get_boolean(valueObj);
+            read = true;
+        }
+    } else if constexpr (std::is_same_v<T, int>) {
+        if (json_object_is_type(valueObj, json_type_int)) {
+            value = json_object_get_int(valueObj);
+            read = true;
+        }
+    } else if constexpr (std::is_same_v<T, unsigned int>) {
+        if (json_object_is_type(valueObj, json_type_int)) {
+            int64_t val = json_object_get_int64(valueObj);
+            if (val >= 0) {
+                value = static_cast<unsigned int>(val);
+                read = true;
+            }
+        } else if (json_object_is_type(valueObj, json_type_string)) {
+            // OSD colors may be written in hex format
+            std::string_view path = item.path;
+            if (path.find("font_color") != std::string_view::npos ||
+                path.find("font_stroke_color") != std::string_view::npos) {
+                const char *str = json_object_get_string(valueObj);
+                if (isValidHexColor(str)) {
+                    value = hexColorToUint(str);
+                    read = true;
+                }
+            }
+        }
+    } else if constexpr (std::is_same_v<T, float>) {
+        if (json_object_is_type(valueObj, json_type_double)) {
+            value = static_cast<float>(json_object_get_double(valueObj));
+            read = true;
+        } else if (json_object_is_type(valueObj, json_type_int)) {
+            value = static_cast<float>(json_object_get_int(valueObj));
+            read = true;
+        }
+    }
+
+    // A value of the wrong type is ignored like a missing one
+    if (!read)
+        return;
+
+    if (!item.validate(value))
+    {
+        LOG_ERROR("invalid config value. " << item.path << " = " << value);
+        invalidValues++;
+        return;
+    }
+
+    if constexpr (std::is_same_v<T, const char *>) {
+        item.value = strings.store(value);
+    } else {
+        item.value = value;
+    }
+}
+
+void CFG::loadJson(json_object *obj, std::string &path)
+{
+    const size_t prefix = path.size();
+
+    json_object_object_foreach(obj, key, valueObj)
+    {
+        path.resize(prefix);
+        path += key;
+
+        if (json_object_is_type(valueObj, json_type_object))
+        {
+            // ROIs are not config items, they are read by load()
+            if (prefix == 0 && path == "rois")
+                continue;
+            path += '.';
+            loadJson(valueObj, path);
+            continue;
+        }
+
+        auto it = index.find(path);
+        if (it == index.end())
+            continue;
+
+        const ItemSlot &slot = it->second;
+        switch (slot.type)
+        {
+        case ItemType::Bool:
+            loadJsonValue(boolItems[slot.pos], valueObj);
+            break;
+        case ItemType::Char:
+            loadJsonValue(charItems[slot.pos], valueObj);
+            break;
+        case ItemType::Int:
+            loadJsonValue(intItems[slot.pos], valueObj);
+            break;
+        case ItemType::Uint:
+            loadJsonValue(uintItems[slot.pos], valueObj);
+            break;
+        case ItemType::Float:
+            loadJsonValue(floatItems[slot.pos], valueObj);
+            break;
+        }
+    }
+
+    path.resize(prefix);
+}
+
+template <typename T>
+void CFG::loadProc(std::vector<ConfigItem<T>> &items,
+                   const std::unordered_map<std::string, std::string> &procValues)
+{
+    for (auto &item : items)
+    {
+        if (!item.procPath)
+            continue;
+
+        std::string_view name = item.procPath;
+        name.remove_prefix(name.rfind('/') + 1);
+        auto it = procValues.find(std::string(name));
+        if (it == procValues.end())
+            continue;
+
+        const std::string &line = it->second;
+        T value{};
+        bool parsed = false;
+        if constexpr (std::is_same_v<T, const char *>) {
+            value = line.c_str();
+            parsed = true;
+        } else if constexpr (std::is_same_v<T, unsigned int>) {
+            if (line.compare(0, 2, "0x") == 0) {
+                parsed = SystemSensor::parseHex(line, value);
+            } else {
+                auto [end, ec] = std::from_chars(line.data(), line.data() + line.size(), value);
+                parsed = ec == std::errc() && end == line.data() + line.size();
+            }
+        } else if constexpr (std::is_same_v<T, int>) {
+            parsed = SystemSensor::parseInt(line, value);
+        }
+
+        if (!parsed || !item.validate(value))
+        {
+            LOG_WARN("Ignoring " << item.procPath << " = " << line);
+            continue;
+        }
+
+        if constexpr (std::is_same_v<T, const char *>) {
+            item.value = strings.store(value);
+        } else {
+            item.value = value;
+        }
+    }
+}
+
+template <typename T>
+void CFG::mergeItems(std::vector<ConfigItem<T>> &items, CFG &next, std::vector<std::string_view> &changed)
+{
+    for (auto &item : items)
+    {
+        // Runtime values (auto sizes, sensor probes) are not in the file
+        if (item.noSave)
+            continue;
+
+        ConfigItem<T> *other = next.find<T>(item.path);
+        if (!other)
+            continue;
+
+        if constexpr (std::is_same_v<T, const char *>)
+        {
+            if (item.value && other->value && strcmp(item.value, other->value) == 0)
+                continue;
+            item.value = strings.store(other->value);
+        }
+        else
+        {
+            if (item.value == other->value)
+                continue;
+            item.value = other->value;
+        }
+        changed.push_back(item.path);
+    }
+}
+
+std::vector<std::string_view> CFG::reload()
+{
+    std::vector<std::string_view> changed;
+
+    // Everything is parsed into a private object first, a broken or half
+    // written file never touches the running config
+    auto next = std::make_shared<CFG>();
+    if (!next->config_loaded)
+    {
+        LOG_WARN("Config reload failed, keeping the running configuration.");
+        return changed;
+    }
+    if (next->invalidValues)
+    {
+        LOG_WARN("Config file has " << next->invalidValues << " invalid value(s), keeping the running configuration.");
+        return changed;
+    }
+
+    std::lock_guard lock(writeMutex);
+
+    mergeItems(boolItems, *next, changed);
+    mergeItems(charItems, *next, changed);
+    mergeItems(intItems, *next, changed);
+    mergeItems(uintItems, *next, changed);
+    mergeItems(floatItems, *next, changed);
+
+    if (memcmp(motion.rois.data(), next->motion.rois.data(), sizeof(motion.rois)) != 0)
+    {
+        motion.rois = next->motion.rois;
+        changed.push_back("rois");
+    }
+
+    stream2.width = next->stream2.width;
+    stream2.height = next->stream2.height;
+    for (int chn = NUM_SOURCE_STREAMS; chn < MAX_VIDEO_STREAMS; chn++)
+    {
+        streams[chn].width = next->streams[chn].width;
+        streams[chn].height = next->streams[chn].height;
+    }
+
+    if (!changed.empty())
+        generation++;
+
+    return changed;
+}
+
 CFG::CFG()
 {
     load();
 }
 
+const char *ConfigStrings::store(const char *value)
+{
+    if (!value)
+        return nullptr;
+
+    // Elements of an unordered_set keep their address across rehashes
+    std::lock_guard lock(mutex);
+    return values.emplace(value).first->c_str();
+}
+
+#if defined(__cpp_lib_atomic_shared_ptr)
+#define LOAD_SNAPSHOT() published.load()
+#define STORE_SNAPSHOT(s) published.store(s)
+#else
+#define LOAD_SNAPSHOT() std::atomic_load(&published)
+#define STORE_SNAPSHOT(s) std::atomic_store(&published, s)
+#endif
+
+std::shared_ptr<const ConfigSnapshot> CFG::snapshot()
+{
+    std::shared_ptr<const ConfigSnapshot> current = LOAD_SNAPSHOT();
+    if (current && current->generation == generation)
+        return current;
+
+    std::lock_guard lock(writeMutex);
+
+    // Another reader may have built it while we waited
+    current = LOAD_SNAPSHOT();
+    if (current && current->generation == generation)
+        return current;
+
+    auto next = std::make_shared<ConfigSnapshot>();
+    next->generation = generation;
+#if defined(AUDIO_SUPPORT)
+    next->audio = audio;
+#endif
+    next->general = general;
+    next->rtsp = rtsp;
+    next->sensor = sensor;
+    next->image = image;
+    next->streams = streams;
+    next->stream2 = stream2;
+    next->motion = motion;
+    next->dvr = dvr;
+    next->record = record;
+    next->events = events;
+    next->websocket = websocket;
+
+    STORE_SNAPSHOT(next);
+    return next;
+}
+
+// Defaults first, then a single walk over the parsed JSON that dispatches
+// every member through the index, then the sensor values the driver reports
+// in /proc/jz/sensor/, which override the file wherever the driver gives a
+// value that parses and validates.
 void CFG::load()
 {
-    boolItems = getBoolItems();
-    charItems = getCharItems();
-    intItems = getIntItems();
-    uintItems = getUintItems();
-    floatItems = getFloatItems();
+    auto start = std::chrono::steady_clock::now();
 
+    if (index.empty())
+    {
+        boolItems = getBoolItems();
+        charItems = getCharItems();
+        intItems = getIntItems();
+        uintItems = getUintItems();
+        floatItems = getFloatItems();
+        addDerivedStreamItems();
+        buildIndexes();
+    }
+
+    loadDefaults(boolItems);
+    loadDefaults(charItems);
+    loadDefaults(intItems);
+    loadDefaults(uintItems);
+    loadDefaults(floatItems);
+
+    invalidValues = 0;
     config_loaded = readConfig();
 
     if (jsonConfig) {
         // Handle backward compatibility migration first
         migrateOldColorSettings();
 
-        for (auto &item : boolItems)
-            handleConfigItem(jsonConfig, item);
-        for (auto &item : charItems)
-            handleConfigItem(jsonConfig, item);
-        for (auto &item : intItems)
-            handleConfigItem(jsonConfig, item);
-        for (auto &item : uintItems)
-            handleConfigItem(jsonConfig, item);
-        for (auto &item : floatItems)
-            handleConfigItem(jsonConfig, item);
+        std::string path;
+        path.reserve(64);
+        loadJson(jsonConfig, path);
+    }
+
+    std::unordered_map<std::string, std::string> procValues = SystemSensor::readAll();
+    if (!procValues.empty())
+    {
+        loadProc(charItems, procValues);
+        loadProc(intItems, procValues);
+        loadProc(uintItems, procValues);
     }
 
     if (stream2.jpeg_channel == 0)
@@ -973,6 +1250,13 @@ void CFG::load()
         stream2.height = stream1.height;
     }
 
+    // Derived streams encode at the size of their source
+    for (int chn = NUM_SOURCE_STREAMS; chn < MAX_VIDEO_STREAMS; chn++)
+    {
+        streams[chn].width = streams[streams[chn].source].width;
+        streams[chn].height = streams[streams[chn].source].height;
+    }
+
     // Handle ROIs from JSON
     if (jsonConfig) {
         json_object *roisObj = nullptr;
@@ -998,4 +1282,9 @@ void CFG::load()
             }
         }
     }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    LOG_INFO("Config loaded in " << elapsed.count() << " us, " << index.size() << " items, "
+             << invalidValues << " invalid");
 }
@@ -1,10 +1,18 @@
 #pragma once
 
 #include <set>
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <iostream>
 #include <functional>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #include <json-c/json.h>
 #include <sys/time.h>
 #include <any>
@@ -37,6 +45,14 @@
 #define THREAD_SLEEP 100000
 #define GET_STREAM_BLOCKING false
 
+/* Video streams. stream0 and stream1 have a framesource channel each, the
+ * others are derived: another encoder channel in the group of their source
+ * stream, at its resolution and typically at a lower bitrate or frame rate.
+ * stream2 is the JPEG channel, the derived streams are stream3 and up.
+ */
+#define MAX_VIDEO_STREAMS 4
+#define NUM_SOURCE_STREAMS 2
+
 #if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
     #define DEFAULT_ENC_MODE_0 "FIXQP"
     #define DEFAULT_ENC_MODE_1 "CAPPED_QUALITY"
@@ -114,6 +130,13 @@ struct _rtsp {
     const char *name;
     float packet_loss_threshold;
     float bandwidth_margin;
+    bool adaptive_bitrate_enabled;
+    int adaptation_interval_seconds;
+    int adaptive_min_bitrate;
+    int adaptive_min_fps;
+    const char *adaptive_policy;
+    const char *slow_client_policy;
+    int slow_client_seconds;
 };
 struct _sensor {
     int fps;
@@ -173,10 +196,24 @@ struct _audio {
     bool force_stereo;
     bool output_enabled;
     int output_sample_rate;
+    int output_jitter_min_ms;
+    int output_jitter_max_ms;
+    const char *output_sink;
+    const char *output_sink_path;
+    int output_vol;
+    int output_gain;
 #endif
     // Buffer tuning (in 20 ms frames per channel)
     int buffer_warn_frames;
     int buffer_cap_frames;
+    // Encode stage, runs in its own thread behind the capture stage
+    int encode_thread_priority;
+    int encode_thread_cpu;
+    int opus_complexity;
+    int opus_encode_budget_us;
+    // A/V sync, drift correction of the audio timestamps
+    bool av_sync_enabled;
+    int av_sync_resync_ms;
 };
 #endif
 struct _osd {
@@ -220,7 +257,6 @@ struct _osd {
     unsigned int user_text_font_stroke_color;
     _regions regions;
     _stream_stats stats;
-    std::atomic<int> thread_signal;
 };
 struct _stream {
     int gop;
@@ -234,6 +270,9 @@ struct _stream {
     int rotation;
     int scale_width;
     int scale_height;
+    int idle_timeout;
+    int standby_encoder_timeout;
+    int standby_framesource_timeout;
     bool enabled;
     bool scale_enabled;
     bool power_saving;
@@ -247,7 +286,13 @@ struct _stream {
     int jpeg_refresh;
     int jpeg_channel;
     int jpeg_idle_fps;
+    int jpeg_cache_ttl;
+    int jpeg_thumbnail_quality;
+    bool jpeg_thumbnail;
     const char *jpeg_path;
+    const char *jpeg_sync;
+    /* derived stream */
+    int source;
     _osd osd;
     _stream_stats stats;
 #if defined(AUDIO_SUPPORT)
@@ -271,10 +316,44 @@ struct _motion {
     int roi_1_x;
     int roi_1_y;
     int roi_count;
+    int grid_cols;
+    int grid_rows;
+    int analysis_fps;
+    int cell_threshold;
+    int min_cells;
+    int max_cpu_percent;
     bool enabled;
+    const char *engine;
     const char *script_path;
     std::array<roi, 52> rois;
 };
+struct _dvr {
+    bool enabled;
+    bool audio;
+    int stream;
+    int preroll_s;
+    int postroll_s;
+    int max_clip_s;
+    int max_memory_kb;
+    const char *output_type;
+    const char *output_path;
+};
+struct _record {
+    bool enabled;
+    bool audio;
+    int stream;
+    int segment_s;
+    int segment_mb;
+    int max_storage_mb;
+    int keep_hours;
+    int buffer_kb;
+    const char *path;
+};
+struct _events {
+    int queue_size;
+    const char *socket_path;
+    const char *helper_path;
+};
 struct _websocket {
     bool enabled;
     bool ws_secured;
@@ -288,6 +367,77 @@ struct _sysinfo {
     const char *cpu = nullptr;
 };
 
+// Owns the strings behind const char * config values. Threads read those
+// values as plain pointers from the live structs, without holding a
+// snapshot, so a stored string is never released while the config exists.
+// Equal values share one copy: the memory grows with the number of distinct
+// values ever set, not with the number of sets.
+class ConfigStrings {
+    public:
+        // Copy of value, valid for the life of the config
+        const char *store(const char *value);
+
+    private:
+        std::mutex mutex;
+        std::unordered_set<std::string> values;
+};
+
+// Collects the keys CFG::set changes on the calling thread while in scope,
+// a request handler uses it to find out what a request actually modified.
+class ConfigChanges {
+    public:
+        ConfigChanges() : prev(current) { current = this; }
+        ~ConfigChanges() { current = prev; }
+        ConfigChanges(const ConfigChanges &) = delete;
+        ConfigChanges &operator=(const ConfigChanges &) = delete;
+
+        static void record(std::string_view key) {
+            if (!current)
+                return;
+            for (auto k : current->keys)
+                if (k == key)
+                    return;
+            current->keys.push_back(key);
+        }
+
+        std::vector<std::string_view> keys;
+
+    private:
+        ConfigChanges *prev;
+        inline static thread_local ConfigChanges *current = nullptr;
+};
+
+// Immutable copy of the configuration values, published by CFG::snapshot().
+// A worker takes one per loop pass and reads consistent values without
+// locking while the config is changed or reloaded. The strings it points at
+// are never released, see ConfigStrings.
+//
+// Runtime state the workers write into the live structs (stats, OSD regions,
+// auto sizes) is copied as it was when the snapshot was taken, read it from
+// cfg.
+struct ConfigSnapshot {
+    uint32_t generation = 0;
+#if defined(AUDIO_SUPPORT)
+    _audio audio{};
+#endif
+    _general general{};
+    _rtsp rtsp{};
+    _sensor sensor{};
+    _image image{};
+    std::array<_stream, MAX_VIDEO_STREAMS> streams{};
+    const _stream &stream0 = streams[0];
+    const _stream &stream1 = streams[1];
+    _stream stream2{};
+    _motion motion{};
+    _dvr dvr{};
+    _record record{};
+    _events events{};
+    _websocket websocket{};
+
+    // Video stream by index, see CFG::streams
+    const _stream &stream(int chn) const { return streams[chn]; }
+};
+
 class CFG {
 	public:
         // Destructor to clean up JSON object
@@ -299,11 +449,21 @@ class CFG {
         }
 
         bool config_loaded = false;
+        int invalidValues = 0;      // values of the last load() that failed validation
         json_object *jsonConfig = nullptr;
         std::string filePath{};
+        // Counts up with every value set() or reload() changes, cached
+        // answers built from the config compare it
+        std::atomic<uint32_t> generation{0};
 
 		CFG();
         void load();
+        // Parse the config file into a fresh CFG and apply only the values
+        // that differ from this one, returns the keys that changed
+        std::vector<std::string_view> reload();
+        // The values as of the last set() or reload(), built again on the
+        // first call after a change. Lock free while nothing changed.
+        std::shared_ptr<const ConfigSnapshot> snapshot();
         static CFG *createNew();
         bool readConfig();
         bool updateConfig();
@@ -315,67 +475,58 @@ class CFG {
 		_rtsp rtsp{};
 		_sensor sensor{};
         _image image{};
-		_stream stream0{};
-        _stream stream1{};
+        // Video streams by index: stream0, stream1, then the derived ones
+        std::array<_stream, MAX_VIDEO_STREAMS> streams{};
+        _stream &stream0 = streams[0];
+        _stream &stream1 = streams[1];
 		_stream stream2{};
 		_motion motion{};
+        _dvr dvr{};
+        _record record{};
+        _events events{};
         _websocket websocket{};
         _sysinfo sysinfo{};
 
+    // Config section of video stream chn: stream0, stream1, stream3, ...
+    static const char *streamName(int chn);
+
+    enum class ItemType : uint8_t { Bool, Char, Int, Uint, Float };
+    struct KeyInfo {
+        std::string_view path;
+        ItemType type;
+    };
+
+    // Every key, for clients that address values by number instead of path.
+    // The id of a key is its position here, it stays the same while prudynt
+    // runs.
+    const std::vector<KeyInfo> &keys() const { return keyTable; }
+
     template <typename T>
-    T get(const std::string &name) {
-        T result = T{};
-        std::vector<ConfigItem<T>> *items = nullptr;
-        if constexpr (std::is_same_v<T, bool>) {
-            items = &boolItems;
-        } else if constexpr (std::is_same_v<T, const char*>) {
-            items = &charItems;
-        } else if constexpr (std::is_same_v<T, int>) {
-            items = &intItems;
-        } else if constexpr (std::is_same_v<T, unsigned int>) {
-            items = &uintItems;
-        } else if constexpr (std::is_same_v<T, float>) {
-            items = &floatItems;
-        } else {
-            return result;
-        }
-        for (auto &item : *items) {
-            if (item.path == name) {
-                return item.value;
-            }
-        }
-        return result;
+    T get(std::string_view name) {
+        ConfigItem<T> *item = find<T>(name);
+        return item ? item->value : T{};
     }
 
     template <typename T>
-    bool set(const std::string &name, T value, bool noSave = false) {
+    bool set(std::string_view name, T value, bool noSave = false) {
         //std::cout << name << "=" << value << std::endl;
-        std::vector<ConfigItem<T>> *items = nullptr;
-        if constexpr (std::is_same_v<T, bool>) {
-            items = &boolItems;
-        } else if constexpr (std::is_same_v<T, const char*>) {
-            items = &charItems;
-        } else if constexpr (std::is_same_v<T, int>) {
-            items = &intItems;
-        } else if constexpr (std::is_same_v<T, unsigned int>) {
-            items = &uintItems;
-        } else if constexpr (std::is_same_v<T, float>) {
-            items = &floatItems;
-        } else {
+        ConfigItem<T> *item = find<T>(name);
+        if (!item || !item->validate(value))
             return false;
-        }
-        for (auto &item : *items) {
-            if (item.path == name) {
-                if (item.validate(value)) {
-                    item.value = value;
-                    item.noSave = noSave;
-                    return true;
-                } else {
-                    return false;
-                }
+        std::lock_guard lock(writeMutex);
+        if constexpr (std::is_same_v<T, const char*>) {
+            if (!item->value || !value || strcmp(item->value, value) != 0) {
+                item->value = strings.store(value);
+                ConfigChanges::record(item->path);
+                generation++;
             }
+        } else if (item->value != value) {
+            item->value = value;
+            ConfigChanges::record(item->path);
+            generation++;
         }
-        return false;
+        item->noSave = noSave;
+        return true;
     }
 
     private:
@@ -385,12 +536,74 @@ class CFG {
         std::vector<ConfigItem<int>> intItems{};
         std::vector<ConfigItem<unsigned int>> uintItems{};
         std::vector<ConfigItem<float>> floatItems{};
+        ConfigStrings strings{};
+        // Paths and default strings of the derived stream items, built at
+        // runtime. A deque keeps them in place while it grows.
+        std::deque<std::string> derivedStrings{};
+
+        // Serializes set(), the merge of reload() and building a snapshot,
+        // readers of the live structs don't take it
+        std::mutex writeMutex;
+#if defined(__cpp_lib_atomic_shared_ptr)
+        std::atomic<std::shared_ptr<const ConfigSnapshot>> published;
+#else
+        std::shared_ptr<const ConfigSnapshot> published;    // std::atomic_load/store
+#endif
+
+        // path -> type and position in the item vector of that type. Keys
+        // point at the string literals of the item definitions, lookups
+        // don't allocate. One table serves get/set and the loader.
+        struct ItemSlot {
+            ItemType type;
+            uint32_t pos;
+        };
+        std::unordered_map<std::string_view, ItemSlot> index{};
+        std::vector<KeyInfo> keyTable{};
+
+        template <typename T>
+        ConfigItem<T> *find(std::string_view name) {
+            auto it = index.find(name);
+            if (it == index.end())
+                return nullptr;
+            const ItemSlot &slot = it->second;
+            if constexpr (std::is_same_v<T, bool>) {
+                return slot.type == ItemType::Bool ? &boolItems[slot.pos] : nullptr;
+            } else if constexpr (std::is_same_v<T, const char*>) {
+                return slot.type == ItemType::Char ? &charItems[slot.pos] : nullptr;
+            } else if constexpr (std::is_same_v<T, int>) {
+                return slot.type == ItemType::Int ? &intItems[slot.pos] : nullptr;
+            } else if constexpr (std::is_same_v<T, unsigned int>) {
+                return slot.type == ItemType::Uint ? &uintItems[slot.pos] : nullptr;
+            } else if constexpr (std::is_same_v<T, float>) {
+                return slot.type == ItemType::Float ? &floatItems[slot.pos] : nullptr;
+            } else {
+                return nullptr;
+            }
+        }
+
+        template <typename T>
+        void buildIndex(const std::vector<ConfigItem<T>> &items, ItemType type);
+        void buildIndexes();
+
+        // Loader passes, see load()
+        template <typename T>
+        void loadDefaults(std::vector<ConfigItem<T>> &items);
+        void loadJson(json_object *obj, std::string &path);
+        template <typename T>
+        void loadJsonValue(ConfigItem<T> &item, json_object *valueObj);
+        template <typename T>
+        void loadProc(std::vector<ConfigItem<T>> &items,
+                      const std::unordered_map<std::string, std::string> &procValues);
+
+        template <typename T>
+        void mergeItems(std::vector<ConfigItem<T>> &items, CFG &next, std::vector<std::string_view> &changed);
 
         std::vector<ConfigItem<bool>> getBoolItems();
         std::vector<ConfigItem<const char *>> getCharItems() ;
         std::vector<ConfigItem<int>> getIntItems();
         std::vector<ConfigItem<unsigned int>> getUintItems();
         std::vector<ConfigItem<float>> getFloatItems();
+        void addDerivedStreamItems();
         void migrateOldColorSettings();
 };
 
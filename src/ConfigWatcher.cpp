@@ -2,119 +2,178 @@
 
 #include "Config.hpp"
 #include "Logger.hpp"
+#include "Reactor.hpp"
+#include "Reconfig.hpp"
 #include "globals.hpp"
 
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <sys/epoll.h>
 #include <sys/inotify.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #define MODULE "ConfigWatcher"
 
 #define EVENT_SIZE (sizeof(struct inotify_event))
 #define EVENT_BUF_LEN (1024 * (EVENT_SIZE + 16))
+// Quiet time after the last write before a change is reloaded
+#define CONFIG_RELOAD_DEBOUNCE_MS 300
+// mtime check interval without inotify
+#define CONFIG_POLL_INTERVAL_MS 1000
 
 ConfigWatcher::ConfigWatcher()
+    : reactor(nullptr)
+    , inotifyFd(-1)
+    , watchDescriptor(-1)
+    , notifySource(-1)
+    , timerSource(-1)
+    , lastModifiedTime(0)
 {
     LOG_DEBUG("ConfigWatcher created.");
 }
 
 ConfigWatcher::~ConfigWatcher()
 {
+    if (reactor)
+    {
+        reactor->remove(notifySource);
+        reactor->remove(timerSource);
+    }
+    if (inotifyFd >= 0)
+    {
+        inotify_rm_watch(inotifyFd, watchDescriptor);
+        close(inotifyFd);
+    }
     LOG_DEBUG("ConfigWatcher destroyed.");
 }
 
-void ConfigWatcher::run()
+void ConfigWatcher::attach(Reactor &reactor)
 {
+    this->reactor = &reactor;
+
 #ifdef __linux__ // Check if on Linux where inotify is expected
-    watch_using_notify();
-#else
+    if (watch_using_notify())
+        return;
+#endif
     // Fallback to polling on non-Linux systems or if inotify fails
     watch_using_poll();
-#endif
 }
 
-void *ConfigWatcher::thread_entry(void *arg)
+void ConfigWatcher::reload()
 {
-    (void) arg; // Mark unused
-    LOG_DEBUG("Starting config watch thread.");
-    ConfigWatcher watcher;
-    watcher.run();
-    LOG_DEBUG("Exiting config watch thread.");
-    return nullptr;
+    std::vector<std::string_view> changed = cfg->reload();
+    if (changed.empty())
+    {
+        LOG_DEBUG("Config file changed, no values differ from the running config.");
+        return;
+    }
+
+    LOG_INFO("Config reloaded from " << cfg->filePath << ", " << changed.size() << " value(s) changed.");
+
+    // Runtime changes are applied in place, only the workers that can't pick
+    // up a change while running are restarted
+    std::vector<ReconfigResult> results = Reconfig::apply(changed, false);
+    for (auto &result : results)
+    {
+        LOG_INFO("Config changed: " << result.key << " (" << Reconfig::actionName(result.action) << ")");
+    }
+    Reconfig::requestRestart(results);
 }
 
-void ConfigWatcher::watch_using_notify()
+bool ConfigWatcher::watch_using_notify()
 {
-    int inotifyFd = inotify_init();
+    // Editors and the websocket save by writing in place or by renaming a
+    // temporary file over the config. Watching the directory catches both
+    // and survives the inode being replaced.
+    std::filesystem::path path(cfg->filePath);
+    std::string dir = path.parent_path().string();
+    name = path.filename().string();
+
+    inotifyFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
     if (inotifyFd < 0)
     {
-        LOG_ERROR("inotify_init() failed");
-        return;
+        LOG_ERROR("inotify_init1() failed: " << strerror(errno));
+        return false;
     }
 
-    int watchDescriptor = inotify_add_watch(inotifyFd,
-                                            cfg->filePath.c_str(),
-                                            IN_MODIFY | IN_ALL_EVENTS);
+    watchDescriptor = inotify_add_watch(inotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
     if (watchDescriptor == -1)
     {
-        LOG_ERROR("inotify_add_watch() failed");
+        LOG_ERROR("inotify_add_watch(" << dir << ") failed: " << strerror(errno));
         close(inotifyFd);
-        return;
+        inotifyFd = -1;
+        return false;
     }
 
-    char buffer[EVENT_BUF_LEN];
+    // After a matching event, wait for the burst to settle so one save is
+    // one reload. The timer is armed by the events.
+    timerSource = reactor->addTimer(0, 0, Reactor::Priority::Low, [this] { reload(); });
+    notifySource = reactor->addFd(inotifyFd, EPOLLIN, Reactor::Priority::Low, [this](uint32_t) { read_notify(); });
+    if (timerSource < 0 || notifySource < 0)
+    {
+        reactor->remove(timerSource);
+        reactor->remove(notifySource);
+        timerSource = notifySource = -1;
+        inotify_rm_watch(inotifyFd, watchDescriptor);
+        close(inotifyFd);
+        inotifyFd = -1;
+        return false;
+    }
 
-    LOG_DEBUG("Monitoring file for changes: " << cfg->filePath);
+    LOG_DEBUG("Monitoring " << dir << " for changes of " << name);
+    return true;
+}
+
+void ConfigWatcher::read_notify()
+{
+    alignas(struct inotify_event) char buffer[EVENT_BUF_LEN];
 
     while (true)
     {
-        int length = read(inotifyFd, buffer, EVENT_BUF_LEN);
+        ssize_t length = read(inotifyFd, buffer, EVENT_BUF_LEN);
         if (length < 0)
         {
-            LOG_ERROR("Error reading file change notification.");
-            break;
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+                LOG_ERROR("Error reading file change notification: " << strerror(errno));
+            return;
         }
 
-        int i = 0;
+        ssize_t i = 0;
         while (i < length)
         {
             struct inotify_event *event = (struct inotify_event *) &buffer[i];
 
-            if (event->mask & IN_MODIFY)
-            {
-                cfg->load();
-                LOG_INFO("Config file changed, the config is reloaded from: " << cfg->filePath);
-            }
+            if (event->len && name == event->name)
+                reactor->setTimer(timerSource, CONFIG_RELOAD_DEBOUNCE_MS, 0);
 
             i += EVENT_SIZE + event->len;
         }
     }
-
-    inotify_rm_watch(inotifyFd, watchDescriptor);
-    close(inotifyFd);
-    return;
 }
 
 void ConfigWatcher::watch_using_poll()
+{
+    timerSource = reactor->addTimer(CONFIG_POLL_INTERVAL_MS, CONFIG_POLL_INTERVAL_MS, Reactor::Priority::Low,
+                                    [this] { check_mtime(); });
+}
+
+void ConfigWatcher::check_mtime()
 {
     struct stat fileInfo;
-    time_t lastModifiedTime = 0;
+    if (stat(cfg->filePath.c_str(), &fileInfo) != 0)
+        return;
 
-    while (true)
+    if (lastModifiedTime == 0)
     {
-        if (stat(cfg->filePath.c_str(), &fileInfo) == 0)
-        {
-            if (lastModifiedTime == 0)
-            {
-                lastModifiedTime = fileInfo.st_mtime;
-            }
-            else if (fileInfo.st_mtime != lastModifiedTime)
-            {
-                lastModifiedTime = fileInfo.st_mtime;
-                cfg->load();
-                LOG_INFO("Config file changed, the config is reloaded from: " << cfg->filePath);
-            }
-        }
-
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+        lastModifiedTime = fileInfo.st_mtime;
+    }
+    else if (fileInfo.st_mtime != lastModifiedTime)
+    {
+        lastModifiedTime = fileInfo.st_mtime;
+        reload();
     }
 }
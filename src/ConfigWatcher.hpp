@@ -1,18 +1,34 @@
 #ifndef CONFIG_WATCHER_HPP
 #define CONFIG_WATCHER_HPP
 
+#include <ctime>
+#include <string>
+
+class Reactor;
+
 class ConfigWatcher
 {
 public:
     ConfigWatcher();
     ~ConfigWatcher();
 
-    static void *thread_entry(void *arg);
+    // Watch the config file from the reactor thread
+    void attach(Reactor &reactor);
 
 private:
-    void run();
-    void watch_using_notify();
+    void reload();
+    bool watch_using_notify();
     void watch_using_poll();
+    void read_notify();
+    void check_mtime();
+
+    Reactor *reactor;
+    int inotifyFd;
+    int watchDescriptor;
+    int notifySource;
+    int timerSource;    // debounce with inotify, mtime check without
+    std::string name;
+    time_t lastModifiedTime;
 };
 
 #endif // CONFIG_WATCHER_HPP
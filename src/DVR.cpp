@@ -0,0 +1,666 @@
+#include "DVR.hpp"
+
+#include "Config.hpp"
+#include "Logger.hpp"
+#include "RTSPStatus.hpp"
+#include "TimestampManager.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MODULE "DVR"
+
+#define DVR_STATS_INTERVAL_MS 1000
+// Exporter wait granularity
+#define DVR_WAIT_MS 250
+// Output is written in chunks of about this size
+#define DVR_WRITE_CHUNK (64 * 1024)
+// Close a clip this long after its end time if no more video arrives
+#define DVR_IDLE_GRACE_US 1000000
+// Rough per packet bookkeeping cost, counted against max_memory_kb
+#define DVR_PACKET_OVERHEAD (sizeof(DVRPacket) + 64)
+// Clip names tried per second before giving up
+#define DVR_NAME_ATTEMPTS 100
+
+static int64_t timeval_to_us(const struct timeval &tv)
+{
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+DVR::DVR()
+    : videoCodec(TSMuxer::VideoCodec::H264)
+    , audioCodec(TSMuxer::AudioCodec::None)
+    , audioSampleRate(0)
+    , audioChannels(1)
+    , haveVideoSeq(false)
+    , nextVideoSeq(0)
+    , waitKeyframe(true)
+    , prevNalType(-1)
+    , maxBytes(0)
+    , prerollUs(0)
+    , overflows(0)
+    , ringFirst(0)
+    , ringBytes(0)
+    , exportUntilUs(0)
+    , triggerPending(false)
+    , cursor(0)
+    , clipStartUs(-1)
+    , outFd(-1)
+{}
+
+void DVR::pushVideo(const H264NALUnit &nalu)
+{
+    uint64_t seq = videoSeq.fetch_add(1, std::memory_order_relaxed);
+    DVRPacket *slot = videoQueue.acquire();
+    if (!slot || nalu.data.empty())
+    {
+        droppedPackets.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    slot->data.assign(nalu.data.begin(), nalu.data.end());
+    slot->timestampUs = timeval_to_us(nalu.time);
+    slot->seq = seq;
+    slot->audio = false;
+    videoQueue.publish();
+    dataReady.release();
+}
+
+void DVR::pushAudio(const AudioFrame &frame)
+{
+    uint64_t seq = audioSeq.fetch_add(1, std::memory_order_relaxed);
+    DVRPacket *slot = audioQueue.acquire();
+    if (!slot)
+    {
+        droppedPackets.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    slot->data.assign(frame.data.begin(), frame.data.end());
+    slot->timestampUs = timeval_to_us(frame.time);
+    slot->seq = seq;
+    slot->audio = true;
+    audioQueue.publish();
+    dataReady.release();
+}
+
+bool DVR::trigger(const char *source)
+{
+    if (!running)
+    {
+        LOG_DEBUG("Trigger from " << source << " ignored, DVR is not running.");
+        return false;
+    }
+
+    int64_t until = TimestampManager::getInstance().getTimestampUs()
+                    + static_cast<int64_t>(cfg->dvr.postroll_s) * 1000000;
+    {
+        std::lock_guard<std::mutex> lock(ringMutex);
+        if (until > exportUntilUs)
+            exportUntilUs = until;
+        if (!exporting && !triggerPending)
+        {
+            LOG_INFO("Clip triggered by " << source);
+            triggerPending = true;
+            triggerSource = source;
+        }
+    }
+    ringCv.notify_all();
+    return true;
+}
+
+void DVR::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(ringMutex);
+        running = false;
+    }
+    dataReady.release();
+    ringCv.notify_all();
+}
+
+void *DVR::thread_entry(void *arg)
+{
+    LOG_DEBUG("Start dvr thread.");
+    static_cast<DVR *>(arg)->run();
+    LOG_DEBUG("Exit dvr thread.");
+    return nullptr;
+}
+
+void DVR::run()
+{
+    int chn = cfg->dvr.stream;
+    _stream *stream = (chn == 0) ? &cfg->stream0 : &cfg->stream1;
+    if (!stream->enabled || !global_video[chn])
+    {
+        LOG_ERROR("DVR source stream" << chn << " is disabled.");
+        return;
+    }
+
+    videoCodec = (strcmp(stream->format, "H265") == 0) ? TSMuxer::VideoCodec::H265
+                                                       : TSMuxer::VideoCodec::H264;
+    audioCodec = TSMuxer::AudioCodec::None;
+#if defined(AUDIO_SUPPORT)
+    if (cfg->dvr.audio && cfg->audio.input_enabled && global_audio[0] && global_audio[0]->imp_audio)
+    {
+        IMPAudio *audio = global_audio[0]->imp_audio;
+        if (audio->format == IMPAudioFormat::AAC)
+            audioCodec = TSMuxer::AudioCodec::AAC;
+        else if (audio->format == IMPAudioFormat::OPUS)
+            audioCodec = TSMuxer::AudioCodec::Opus;
+        else
+            LOG_WARN("Audio format " << cfg->audio.input_format << " can't be stored in clips, recording video only.");
+        audioSampleRate = audio->sample_rate;
+        audioChannels = audio->outChnCnt;
+    }
+#endif
+
+    maxBytes = static_cast<size_t>(cfg->dvr.max_memory_kb) * 1024;
+    prerollUs = static_cast<int64_t>(cfg->dvr.preroll_s) * 1000000;
+
+    // Leftovers from a previous run
+    while (videoQueue.peek())
+        videoQueue.release();
+    while (audioQueue.peek())
+        audioQueue.release();
+    haveVideoSeq = false;
+    waitKeyframe = true;
+    prevNalType = -1;
+    {
+        std::lock_guard<std::mutex> lock(ringMutex);
+        ring.clear();
+        gops.clear();
+        ringBytes = 0;
+        exportUntilUs = 0;
+        triggerPending = false;
+        running = true;
+    }
+
+    int ret = pthread_create(&exportThread, nullptr, export_entry, this);
+    LOG_DEBUG_OR_ERROR(ret, "create dvr export thread");
+    if (ret != 0)
+    {
+        running = false;
+        return;
+    }
+
+    videoChn = chn;
+    audioAccepted = (audioCodec != TSMuxer::AudioCodec::None);
+
+    // The workers sleep while no RTSP client is connected, wake them up
+    {
+        std::unique_lock<std::mutex> lck(mutex_main);
+    }
+    global_video[chn]->should_grab_frames.notify_one();
+#if defined(AUDIO_SUPPORT)
+    if (audioAccepted)
+        global_audio[0]->should_grab_frames.notify_one();
+#endif
+
+    LOG_INFO("Recording " << cfg->dvr.preroll_s << "s pre-roll of stream" << chn
+                          << (audioAccepted ? " with audio" : "") << ", "
+                          << cfg->dvr.max_memory_kb << " KiB max.");
+
+    auto lastStats = std::chrono::steady_clock::now();
+    while (running)
+    {
+        dataReady.try_acquire_for(std::chrono::milliseconds(DVR_WAIT_MS));
+        collect();
+
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration_cast<std::chrono::milliseconds>(now - lastStats).count() >= DVR_STATS_INTERVAL_MS)
+        {
+            lastStats = now;
+            updateStats();
+        }
+    }
+
+    videoChn = -1;
+    audioAccepted = false;
+
+    ret = pthread_join(exportThread, nullptr);
+    LOG_DEBUG_OR_ERROR(ret, "join dvr export thread");
+
+    {
+        std::lock_guard<std::mutex> lock(ringMutex);
+        ringFirst += ring.size();
+        ring.clear();
+        gops.clear();
+        ringBytes = 0;
+    }
+    updateStats();
+}
+
+void DVR::collect()
+{
+    DVRPacket *slot;
+    while ((slot = videoQueue.peek()) != nullptr)
+    {
+        if (haveVideoSeq && slot->seq != nextVideoSeq)
+        {
+            // A missing NAL breaks the GOP, continue with the next keyframe
+            waitKeyframe = true;
+        }
+        haveVideoSeq = true;
+        nextVideoSeq = slot->seq + 1;
+
+        bool gopStart = TSMuxer::isGopStart(videoCodec, slot->data[0], prevNalType);
+
+        if (waitKeyframe && !gopStart)
+        {
+            videoQueue.release();
+            continue;
+        }
+        waitKeyframe = false;
+
+        auto packet = std::make_shared<DVRPacket>();
+        packet->data = slot->data;
+        packet->timestampUs = slot->timestampUs;
+        packet->seq = slot->seq;
+        packet->audio = false;
+        packet->gopStart = gopStart;
+        videoQueue.release();
+
+        append(std::move(packet));
+    }
+
+    while ((slot = audioQueue.peek()) != nullptr)
+    {
+        auto packet = std::make_shared<DVRPacket>();
+        packet->data = slot->data;
+        packet->timestampUs = slot->timestampUs;
+        packet->seq = slot->seq;
+        packet->audio = true;
+        packet->gopStart = false;
+        audioQueue.release();
+
+        append(std::move(packet));
+    }
+}
+
+void DVR::append(std::shared_ptr<DVRPacket> &&packet)
+{
+    {
+        std::lock_guard<std::mutex> lock(ringMutex);
+        if (!packet->audio && packet->gopStart)
+        {
+            gops.push_back(ringFirst + ring.size());
+        }
+        if (gops.empty())
+        {
+            // Nothing is kept ahead of the first keyframe
+            return;
+        }
+
+        ringBytes += packet->data.size() + DVR_PACKET_OVERHEAD;
+        ring.push_back(std::move(packet));
+        trim();
+    }
+
+    if (exporting)
+        ringCv.notify_all();
+}
+
+void DVR::trim()
+{
+    int64_t newest = ring.back()->timestampUs;
+
+    // Drop the oldest GOP while the next one still covers the pre-roll, or
+    // while over the memory budget
+    while (gops.size() > 1)
+    {
+        const auto &second = ring[gops[1] - ringFirst];
+        if (newest - second->timestampUs < prerollUs && ringBytes <= maxBytes)
+            break;
+
+        while (ringFirst < gops[1])
+        {
+            ringBytes -= ring.front()->data.size() + DVR_PACKET_OVERHEAD;
+            ring.pop_front();
+            ringFirst++;
+        }
+        gops.pop_front();
+    }
+
+    if (ringBytes > maxBytes)
+    {
+        // A single GOP doesn't fit, start over with the next keyframe
+        if (overflows++ % 100 == 0)
+        {
+            LOG_WARN("GOP exceeds dvr.max_memory_kb (" << ringBytes / 1024 << " KiB), pre-roll dropped. "
+                     << "Raise the limit or shorten the GOP.");
+        }
+        ringFirst += ring.size();
+        ring.clear();
+        gops.clear();
+        ringBytes = 0;
+        waitKeyframe = true;
+    }
+}
+
+void DVR::updateStats()
+{
+    size_t bytes;
+    size_t gopCount;
+    int64_t bufferedUs = 0;
+    {
+        std::lock_guard<std::mutex> lock(ringMutex);
+        bytes = ringBytes;
+        gopCount = gops.size();
+        if (!ring.empty())
+            bufferedUs = ring.back()->timestampUs - ring.front()->timestampUs;
+    }
+
+    RTSPStatus::writeCustomParameter("dvr", "buffered_bytes", std::to_string(bytes));
+    RTSPStatus::writeCustomParameter("dvr", "buffered_ms", std::to_string(bufferedUs / 1000));
+    RTSPStatus::writeCustomParameter("dvr", "buffered_gops", std::to_string(gopCount));
+    RTSPStatus::writeCustomParameter("dvr", "memory_limit_bytes", std::to_string(maxBytes));
+    RTSPStatus::writeCustomParameter("dvr", "dropped_packets", std::to_string(droppedPackets.load()));
+    RTSPStatus::writeCustomParameter("dvr", "overflows", std::to_string(overflows));
+    RTSPStatus::writeCustomParameter("dvr", "export_active", exporting ? "true" : "false");
+    RTSPStatus::writeCustomParameter("dvr", "clips", std::to_string(clipCount.load()));
+    RTSPStatus::writeCustomParameter("dvr", "export_skips", std::to_string(exportSkips.load()));
+    RTSPStatus::writeCustomParameter("dvr", "export_errors", std::to_string(exportErrors.load()));
+}
+
+void *DVR::export_entry(void *arg)
+{
+    static_cast<DVR *>(arg)->exportLoop();
+    return nullptr;
+}
+
+void DVR::exportLoop()
+{
+    std::unique_lock<std::mutex> lock(ringMutex);
+
+    while (running)
+    {
+        if (!exporting)
+        {
+            ringCv.wait_for(lock, std::chrono::milliseconds(DVR_WAIT_MS),
+                            [&] { return !running || (triggerPending && !gops.empty()); });
+            if (!running || !triggerPending || gops.empty())
+                continue;
+            triggerPending = false;
+
+            // Latest GOP that still starts at least the pre-roll before now
+            int64_t newest = ring.back()->timestampUs;
+            cursor = gops.front();
+            for (uint64_t gop : gops)
+            {
+                if (newest - ring[gop - ringFirst]->timestampUs < prerollUs)
+                    break;
+                cursor = gop;
+            }
+
+            lock.unlock();
+            bool started = startClip();
+            lock.lock();
+            exporting = started;
+            continue;
+        }
+
+        if (cursor < ringFirst)
+        {
+            // Trimmed away underneath us, continue at the oldest keyframe
+            exportSkips++;
+            cursor = gops.empty() ? ringFirst + ring.size() : gops.front();
+        }
+
+        if (cursor >= ringFirst + ring.size())
+        {
+            int64_t now = TimestampManager::getInstance().getTimestampUs();
+            if (now > exportUntilUs + DVR_IDLE_GRACE_US)
+            {
+                exporting = false;
+                lock.unlock();
+                finishClip();
+                lock.lock();
+                continue;
+            }
+            ringCv.wait_for(lock, std::chrono::milliseconds(DVR_WAIT_MS));
+            continue;
+        }
+
+        std::shared_ptr<const DVRPacket> packet = ring[cursor - ringFirst];
+        if (!packet->audio && packet->timestampUs > exportUntilUs)
+        {
+            // Post-roll is complete
+            exporting = false;
+            lock.unlock();
+            finishClip();
+            lock.lock();
+            continue;
+        }
+        cursor++;
+
+        lock.unlock();
+        writePacket(packet);
+        lock.lock();
+
+        if (outFd < 0)
+        {
+            // Output failed, wait for the next trigger
+            exporting = false;
+        }
+    }
+
+    if (exporting)
+    {
+        exporting = false;
+        lock.unlock();
+        finishClip();
+    }
+}
+
+bool DVR::startClip()
+{
+    muxer = std::make_unique<TSMuxer>(videoCodec, audioCodec, audioSampleRate, audioChannels);
+    accessUnit.clear();
+    outBuffer.clear();
+    clipStartUs = -1;
+
+    if (!openOutput())
+    {
+        exportErrors++;
+        muxer.reset();
+        return false;
+    }
+
+    muxer->writeTables(outBuffer);
+    LOG_INFO("Exporting clip to " << clipPath);
+    return true;
+}
+
+void DVR::finishClip()
+{
+    if (!muxer)
+        return;
+
+    flushAccessUnit();
+    bool ok = outFd >= 0 && writeOutput();
+    closeOutput(ok);
+    muxer.reset();
+
+    if (ok)
+    {
+        clipCount++;
+        LOG_INFO("Clip " << clipPath << " finished.");
+    }
+}
+
+void DVR::writePacket(const std::shared_ptr<const DVRPacket> &packet)
+{
+    if (packet->audio)
+    {
+        muxer->writeAudio(packet->data.data(), packet->data.size(), packet->timestampUs, outBuffer);
+    }
+    else
+    {
+        if (!accessUnit.empty() && accessUnit.front()->timestampUs != packet->timestampUs)
+        {
+            flushAccessUnit();
+        }
+
+        if (packet->gopStart && clipStartUs >= 0
+            && packet->timestampUs - clipStartUs >= static_cast<int64_t>(cfg->dvr.max_clip_s) * 1000000)
+        {
+            // Long events are split at a keyframe into several clips
+            finishClip();
+            if (!startClip())
+                return;
+        }
+
+        accessUnit.push_back(packet);
+    }
+
+    if (outBuffer.size() >= DVR_WRITE_CHUNK && !writeOutput())
+    {
+        closeOutput(false);
+        muxer.reset();
+    }
+}
+
+void DVR::flushAccessUnit()
+{
+    if (accessUnit.empty() || !muxer)
+        return;
+
+    std::vector<const std::vector<uint8_t> *> nals;
+    bool keyframe = false;
+    for (const auto &packet : accessUnit)
+    {
+        nals.push_back(&packet->data);
+        keyframe |= packet->gopStart;
+    }
+
+    int64_t timestampUs = accessUnit.front()->timestampUs;
+    if (clipStartUs < 0)
+        clipStartUs = timestampUs;
+
+    muxer->writeVideo(nals, timestampUs, keyframe, outBuffer);
+    accessUnit.clear();
+}
+
+bool DVR::openOutput()
+{
+    const char *path = cfg->dvr.output_path;
+
+    if (strcmp(cfg->dvr.output_type, "socket") == 0)
+    {
+        outFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (outFd < 0)
+        {
+            LOG_ERROR("socket() failed: " << strerror(errno));
+            return false;
+        }
+
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+        if (connect(outFd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0)
+        {
+            LOG_ERROR("connect(" << path << ") failed: " << strerror(errno));
+            ::close(outFd);
+            outFd = -1;
+            return false;
+        }
+
+        clipPath = path;
+        clipPartPath.clear();
+        return true;
+    }
+
+    if (mkdir(path, 0755) != 0 && errno != EEXIST)
+    {
+        LOG_ERROR("mkdir(" << path << ") failed: " << strerror(errno));
+        return false;
+    }
+
+    char stamp[32];
+    time_t now = time(nullptr);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+
+    // Clips triggered within the same second get a counter after the stamp
+    std::string base = std::string(path) + "/stream" + std::to_string(cfg->dvr.stream) + "-" + stamp;
+    for (int n = 0; n < DVR_NAME_ATTEMPTS; n++)
+    {
+        clipPath = base + (n ? "-" + std::to_string(n) : "") + ".ts";
+        // Written under a temporary name, renamed once complete
+        clipPartPath = clipPath + ".part";
+
+        struct stat st;
+        if (stat(clipPath.c_str(), &st) == 0)
+            continue;
+
+        outFd = ::open(clipPartPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (outFd >= 0)
+            return true;
+        if (errno != EEXIST)
+            break;
+    }
+
+    LOG_ERROR("open(" << clipPartPath << ") failed: " << strerror(errno));
+    return false;
+}
+
+bool DVR::writeOutput()
+{
+    const uint8_t *data = outBuffer.data();
+    size_t left = outBuffer.size();
+    bool isSocket = clipPartPath.empty();
+
+    while (left > 0)
+    {
+        ssize_t n = isSocket ? send(outFd, data, left, MSG_NOSIGNAL) : ::write(outFd, data, left);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("Writing clip " << clipPath << " failed: " << strerror(errno));
+            exportErrors++;
+            outBuffer.clear();
+            return false;
+        }
+        data += n;
+        left -= n;
+    }
+
+    outBuffer.clear();
+    return true;
+}
+
+void DVR::closeOutput(bool ok)
+{
+    if (outFd < 0)
+        return;
+
+    ::close(outFd);
+    outFd = -1;
+
+    if (!clipPartPath.empty())
+    {
+        // A clip that could not be written completely is not published
+        if (!ok)
+        {
+            unlink(clipPartPath.c_str());
+            return;
+        }
+        if (rename(clipPartPath.c_str(), clipPath.c_str()) != 0)
+        {
+            LOG_ERROR("rename(" << clipPartPath << ") failed: " << strerror(errno));
+            return;
+        }
+        RTSPStatus::writeCustomParameter("dvr", "last_clip", clipPath);
+    }
+}
@@ -0,0 +1,137 @@
+#ifndef DVR_HPP
+#define DVR_HPP
+
+// Pre-roll recorder. Keeps the last dvr.preroll_s seconds of encoded video
+// (and AAC/Opus audio) in memory, trimmed in whole GOPs so the oldest packet
+// is always a keyframe. A trigger (motion, websocket) exports the pre-roll
+// plus everything up to dvr.postroll_s after the last trigger as MPEG-TS to a
+// clip file or a local socket, without re-encoding.
+//
+// Threads:
+//  - VideoWorker / AudioWorker copy packets into lock-free queues and never
+//    wait; packets are dropped (and counted) when the queues are full.
+//  - the collector drains the queues into the ring and trims it to
+//    dvr.max_memory_kb.
+//  - the exporter muxes and writes clips. It only holds the ring lock while
+//    picking up the next packet, a slow disk or reader loses data instead of
+//    stalling the ring.
+
+#include "SPSCQueue.hpp"
+#include "TSMuxer.hpp"
+#include "globals.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <semaphore>
+#include <string>
+#include <vector>
+
+// Producer queue slots, buffers are reused
+#define DVR_VIDEO_QUEUE_SIZE 128
+#define DVR_AUDIO_QUEUE_SIZE 64
+
+struct DVRPacket
+{
+    std::vector<uint8_t> data;
+    int64_t timestampUs;
+    uint64_t seq;       // producer sequence, a gap means packets were dropped
+    bool audio;
+    bool gopStart;      // first NAL of a GOP (SPS/VPS or bare IDR)
+};
+
+class DVR
+{
+public:
+    DVR();
+
+    // Producer side, never blocks
+    void pushVideo(const H264NALUnit &nalu);
+    void pushAudio(const AudioFrame &frame);
+
+    // Whether the producers should feed packets, cheap enough for every NAL
+    bool acceptsVideo(int encChn) const { return videoChn.load(std::memory_order_relaxed) == encChn; }
+    bool acceptsAudio() const { return audioAccepted.load(std::memory_order_relaxed); }
+
+    // Start a clip with pre-roll or extend the running one to postroll_s from now
+    bool trigger(const char *source);
+
+    // Ask run() to return, main joins the thread
+    void stop();
+
+    static void *thread_entry(void *arg);
+
+private:
+    void run();
+    void collect();
+    void append(std::shared_ptr<DVRPacket> &&packet);
+    void trim();
+    void updateStats();
+
+    static void *export_entry(void *arg);
+    void exportLoop();
+    bool startClip();
+    void finishClip();
+    void writePacket(const std::shared_ptr<const DVRPacket> &packet);
+    void flushAccessUnit();
+    bool openOutput();
+    bool writeOutput();
+    // Renames the clip into place, or removes it when it is incomplete
+    void closeOutput(bool ok);
+
+    SPSCQueue<DVRPacket> videoQueue{DVR_VIDEO_QUEUE_SIZE};
+    SPSCQueue<DVRPacket> audioQueue{DVR_AUDIO_QUEUE_SIZE};
+    std::counting_semaphore<> dataReady{0};
+    std::atomic<uint64_t> videoSeq{0};
+    std::atomic<uint64_t> audioSeq{0};
+    std::atomic<int> videoChn{-1};
+    std::atomic<bool> audioAccepted{false};
+    std::atomic<uint64_t> droppedPackets{0};
+
+    std::atomic<bool> running{false};
+    pthread_t exportThread;
+
+    // Collector state
+    TSMuxer::VideoCodec videoCodec;
+    TSMuxer::AudioCodec audioCodec;
+    int audioSampleRate;
+    int audioChannels;
+    bool haveVideoSeq;
+    uint64_t nextVideoSeq;
+    bool waitKeyframe;
+    int prevNalType;
+    size_t maxBytes;
+    int64_t prerollUs;
+    uint64_t overflows;
+
+    // Ring, packet index = ringFirst + position, gops holds indices of GOP starts
+    std::mutex ringMutex;
+    std::condition_variable ringCv;
+    std::deque<std::shared_ptr<const DVRPacket>> ring;
+    std::deque<uint64_t> gops;
+    uint64_t ringFirst;
+    size_t ringBytes;
+
+    // Export state, exportUntilUs is guarded by ringMutex
+    int64_t exportUntilUs;
+    bool triggerPending;
+    std::string triggerSource;
+    std::atomic<bool> exporting{false};
+    uint64_t cursor;
+    int64_t clipStartUs;
+    std::unique_ptr<TSMuxer> muxer;
+    std::vector<std::shared_ptr<const DVRPacket>> accessUnit;
+    std::vector<uint8_t> outBuffer;
+    int outFd;
+    std::string clipPath;
+    std::string clipPartPath;
+    std::atomic<uint64_t> clipCount{0};
+    std::atomic<uint64_t> exportSkips{0};
+    std::atomic<uint64_t> exportErrors{0};
+};
+
+#endif // DVR_HPP
@@ -0,0 +1,60 @@
+#include "EncoderPoll.hpp"
+
+#include "IMPEncoder.hpp"
+#include "Logger.hpp"
+#include "Reactor.hpp"
+#include "globals.hpp"
+
+#include <chrono>
+#include <sys/epoll.h>
+
+#define MODULE "EncoderPoll"
+
+// One shot: the fd stays readable until the worker takes the stream, the
+// shared loop must not spin on it in the meantime. wait() re-arms it.
+#define ENCODER_POLL_EVENTS (EPOLLIN | EPOLLONESHOT)
+
+void EncoderPoll::attach(int encChn)
+{
+    detach();
+    this->encChn = encChn;
+
+#if defined(IMP_ENCODER_HAS_FD)
+    int fd = IMP_Encoder_GetFd(encChn);
+    if (fd < 0)
+    {
+        LOG_WARN("IMP_Encoder_GetFd(" << encChn << ") failed, polling the channel instead.");
+        return;
+    }
+    source = global_encoder_reactor->addFd(fd, ENCODER_POLL_EVENTS, Reactor::Priority::High,
+                                           [this](uint32_t) { ready.release(); });
+#endif
+}
+
+void EncoderPoll::detach()
+{
+    if (source >= 0)
+    {
+        // returns once a running callback is done
+        global_encoder_reactor->remove(source);
+        source = -1;
+    }
+    while (ready.try_acquire())
+    {
+    }
+    encChn = -1;
+}
+
+bool EncoderPoll::wait(int timeoutMs)
+{
+    if (source < 0)
+        return encChn >= 0 && IMP_Encoder_PollingStream(encChn, timeoutMs) == 0;
+
+    // A wakeup left by a wait that timed out, the re-armed fd reports the
+    // same stream again
+    while (ready.try_acquire())
+    {
+    }
+    global_encoder_reactor->modifyFd(source, ENCODER_POLL_EVENTS);
+    return ready.try_acquire_for(std::chrono::milliseconds(timeoutMs));
+}
@@ -0,0 +1,28 @@
+#ifndef ENCODER_POLL_HPP
+#define ENCODER_POLL_HPP
+
+#include <semaphore>
+
+/* Waits for the next stream of an encoder channel. Where the SDK gives the
+ * channel a device fd (IMP_Encoder_GetFd) it is watched on
+ * global_encoder_reactor, shared by all channels, whose callback wakes the
+ * waiting worker. Elsewhere IMP_Encoder_PollingStream waits.
+ */
+class EncoderPoll
+{
+public:
+    // Watch encChn, once the channel is created
+    void attach(int encChn);
+    // Stop watching, before the channel is destroyed
+    void detach();
+
+    // Whether a stream can be taken without blocking, false after timeoutMs
+    bool wait(int timeoutMs);
+
+private:
+    int encChn = -1;
+    int source = -1;
+    std::counting_semaphore<> ready{0};
+};
+
+#endif // ENCODER_POLL_HPP
@@ -0,0 +1,516 @@
+#include "EventBus.hpp"
+
+#include "Config.hpp"
+#include "Logger.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MODULE "EventBus"
+
+// Subscriber threads wake at least this often to run idle()
+#define EVENT_IDLE_MS 500
+// Minimum time between two starts of the helper process
+#define EVENT_HELPER_RESPAWN_S 5
+
+extern char **environ;
+
+/* EventSubscriber */
+
+EventSubscriber::~EventSubscriber()
+{
+    stop();
+}
+
+bool EventSubscriber::start(size_t capacity)
+{
+    this->capacity = capacity;
+    if (!open())
+        return false;
+
+    running = true;
+    int ret = pthread_create(&thread, nullptr, thread_entry, this);
+    LOG_DEBUG_OR_ERROR(ret, "create " << name() << " event thread");
+    if (ret != 0)
+    {
+        running = false;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void EventSubscriber::stop()
+{
+    {
+        std::lock_guard lock(mutex);
+        if (!running)
+            return;
+        running = false;
+    }
+    cv.notify_one();
+    pthread_join(thread, nullptr);
+    close();
+}
+
+void EventSubscriber::offer(const BusEventPtr &event)
+{
+    {
+        std::lock_guard lock(mutex);
+        if (!running)
+            return;
+        if (queue.size() >= capacity)
+        {
+            queue.pop_front();
+            uint64_t drops = droppedCount.fetch_add(1, std::memory_order_relaxed) + 1;
+            if (drops <= 10 || (drops % 100) == 0)
+                LOG_WARN(name() << " subscriber is behind, dropped event (" << drops << " so far)");
+        }
+        queue.push_back(event);
+    }
+    cv.notify_one();
+}
+
+void *EventSubscriber::thread_entry(void *arg)
+{
+    static_cast<EventSubscriber *>(arg)->run();
+    return nullptr;
+}
+
+void EventSubscriber::run()
+{
+    // A reader that went away has to surface as EPIPE, not kill us
+    sigset_t sigpipe;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe, nullptr);
+
+    while (true)
+    {
+        BusEventPtr event;
+        {
+            std::unique_lock lock(mutex);
+            cv.wait_for(lock, std::chrono::milliseconds(EVENT_IDLE_MS),
+                        [this] { return !running || !queue.empty(); });
+            if (!running)
+                break;
+            if (!queue.empty())
+            {
+                event = std::move(queue.front());
+                queue.pop_front();
+            }
+        }
+
+        idle();
+        if (event)
+            deliver(*event);
+    }
+}
+
+/* WSEventSubscriber */
+
+void WSEventSubscriber::setWake(std::function<void()> wake)
+{
+    std::lock_guard lock(ringMutex);
+    this->wake = std::move(wake);
+}
+
+void WSEventSubscriber::fetch(uint64_t &seq, std::vector<BusEventPtr> &out)
+{
+    std::lock_guard lock(ringMutex);
+    for (auto &event : ring)
+    {
+        if (event->seq > seq)
+        {
+            out.push_back(event);
+            seq = event->seq;
+        }
+    }
+}
+
+uint64_t WSEventSubscriber::last()
+{
+    std::lock_guard lock(ringMutex);
+    return ring.empty() ? 0 : ring.back()->seq;
+}
+
+void WSEventSubscriber::deliver(const BusEvent &event)
+{
+    std::lock_guard lock(ringMutex);
+    ring.push_back(std::make_shared<const BusEvent>(event));
+    // Sessions that are further behind lose the oldest events
+    while (ring.size() > static_cast<size_t>(cfg->events.queue_size))
+        ring.pop_front();
+    if (wake)
+        wake();
+}
+
+namespace
+{
+
+void discard_sigpipe()
+{
+    sigset_t sigpipe;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    struct timespec zero = {0, 0};
+    sigtimedwait(&sigpipe, nullptr, &zero);
+}
+
+// Subscriber threads block SIGPIPE, the children start with an empty mask and
+// SIGPIPE at its default action, like from a shell
+int spawn_child(pid_t *pid, const char *path, const posix_spawn_file_actions_t *actions, char *const argv[])
+{
+    sigset_t mask;
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigaddset(&mask, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    int ret = posix_spawn(pid, path, actions, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    return ret;
+}
+
+// Stream socket, every client gets the events as JSON lines. A client that
+// can't take a line without blocking is disconnected.
+class UnixSocketSubscriber : public EventSubscriber
+{
+public:
+    explicit UnixSocketSubscriber(const char *path) : path(path) {}
+    ~UnixSocketSubscriber() override { stop(); }
+
+    const char *name() const override { return "socket"; }
+
+protected:
+    bool open() override
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+        unlink(path.c_str());
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0)
+        {
+            LOG_ERROR("socket() failed: " << strerror(errno));
+            return false;
+        }
+
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        if (bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+            listen(listenFd, 4) != 0)
+        {
+            LOG_ERROR("Can't listen on " << path << ": " << strerror(errno));
+            ::close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+
+        LOG_INFO("Publishing events on " << path);
+        return true;
+    }
+
+    void close() override
+    {
+        for (int fd : clients)
+            ::close(fd);
+        clients.clear();
+        if (listenFd >= 0)
+        {
+            ::close(listenFd);
+            listenFd = -1;
+            unlink(path.c_str());
+        }
+    }
+
+    void idle() override
+    {
+        int fd;
+        while ((fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+        {
+            LOG_DEBUG("Event client connected (fd=" << fd << ")");
+            clients.push_back(fd);
+        }
+    }
+
+    void deliver(const BusEvent &event) override
+    {
+        line = event.json;
+        line += '\n';
+
+        for (auto it = clients.begin(); it != clients.end();)
+        {
+            ssize_t sent = send(*it, line.data(), line.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sent == static_cast<ssize_t>(line.size()))
+            {
+                ++it;
+                continue;
+            }
+
+            // Gone, or too slow to take a whole line: a partial line would
+            // corrupt the stream, drop the client
+            LOG_DEBUG("Event client disconnected (fd=" << *it << ")");
+            ::close(*it);
+            it = clients.erase(it);
+        }
+    }
+
+private:
+    std::string path;
+    int listenFd = -1;
+    std::vector<int> clients;
+    std::string line;
+};
+
+// One long running helper, fed JSON lines on its stdin. Restarted on the next
+// event when it exited.
+class HelperSubscriber : public EventSubscriber
+{
+public:
+    explicit HelperSubscriber(const char *path) : path(path) {}
+    ~HelperSubscriber() override { stop(); }
+
+    const char *name() const override { return "helper"; }
+
+protected:
+    void close() override
+    {
+        closePipe();
+    }
+
+    void deliver(const BusEvent &event) override
+    {
+        if (pipeFd < 0 && !spawn())
+            return;
+
+        line = event.json;
+        line += '\n';
+
+        ssize_t written;
+        do
+        {
+            written = write(pipeFd, line.data(), line.size());
+        } while (written < 0 && errno == EINTR);
+
+        if (written == static_cast<ssize_t>(line.size()))
+            return;
+
+        if (written < 0 && errno == EAGAIN)
+        {
+            LOG_WARN("Event helper is not reading, dropped event " << event.seq);
+            return;
+        }
+
+        if (written < 0 && errno == EPIPE)
+            discard_sigpipe();
+        LOG_WARN("Event helper " << path << " went away");
+        closePipe();
+    }
+
+private:
+    bool spawn()
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (started && now - lastSpawn < std::chrono::seconds(EVENT_HELPER_RESPAWN_S))
+            return false;
+        lastSpawn = now;
+        started = true;
+
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0)
+        {
+            LOG_ERROR("pipe2() failed: " << strerror(errno));
+            return false;
+        }
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+
+        char *argv[] = {const_cast<char *>(path.c_str()), nullptr};
+        int ret = spawn_child(&pid, path.c_str(), &actions, argv);
+        posix_spawn_file_actions_destroy(&actions);
+        ::close(fds[0]);
+
+        if (ret != 0)
+        {
+            LOG_ERROR("Can't start event helper " << path << ": " << strerror(ret));
+            ::close(fds[1]);
+            pid = -1;
+            return false;
+        }
+
+        // A stuck helper must not stall the subscriber thread
+        fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+        pipeFd = fds[1];
+        LOG_INFO("Started event helper " << path << " (pid " << pid << ")");
+        return true;
+    }
+
+    void closePipe()
+    {
+        if (pipeFd >= 0)
+        {
+            ::close(pipeFd);
+            pipeFd = -1;
+        }
+        if (pid > 0)
+        {
+            // Closing stdin is the signal to exit, don't wait for it here
+            if (waitpid(pid, nullptr, WNOHANG) == 0)
+            {
+                kill(pid, SIGTERM);
+                waitpid(pid, nullptr, 0);
+            }
+            pid = -1;
+        }
+    }
+
+    std::string path;
+    int pipeFd = -1;
+    pid_t pid = -1;
+    bool started = false;
+    std::chrono::steady_clock::time_point lastSpawn;
+    std::string line;
+};
+
+// motion.script_path start|stop, like before, but spawned and waited for on
+// the subscriber thread instead of system() in the motion loop. The path is
+// looked up for every event, it can be changed or installed at runtime.
+class ScriptSubscriber : public EventSubscriber
+{
+public:
+    const char *name() const override { return "script"; }
+    bool wants(EventType type) const override { return type == EventType::Motion; }
+
+protected:
+    void deliver(const BusEvent &event) override
+    {
+        path = cfg->motion.script_path;
+        if (access(path.c_str(), X_OK) != 0)
+        {
+            // Once per path, motion events keep coming
+            if (path != missing)
+                LOG_WARN("Motion script " << path << " is not executable: " << strerror(errno));
+            missing = path;
+            return;
+        }
+        missing.clear();
+
+        char *argv[] = {const_cast<char *>(path.c_str()), const_cast<char *>(event.state.c_str()), nullptr};
+        pid_t pid;
+        int ret = spawn_child(&pid, path.c_str(), nullptr, argv);
+        if (ret != 0)
+        {
+            LOG_ERROR("Motion script failed: " << path << " " << event.state << ": " << strerror(ret));
+            return;
+        }
+
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+            ;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            LOG_ERROR("Motion script failed: " << path << " " << event.state);
+    }
+
+private:
+    std::string path;
+    std::string missing;
+};
+
+} // namespace
+
+/* EventBus */
+
+void EventBus::start()
+{
+    size_t capacity = cfg->events.queue_size;
+
+    if (cfg->events.socket_path[0])
+        subscribers.push_back(std::make_unique<UnixSocketSubscriber>(cfg->events.socket_path));
+    if (cfg->events.helper_path[0])
+        subscribers.push_back(std::make_unique<HelperSubscriber>(cfg->events.helper_path));
+    if (cfg->motion.script_path[0])
+        subscribers.push_back(std::make_unique<ScriptSubscriber>());
+
+    for (auto it = subscribers.begin(); it != subscribers.end();)
+    {
+        if ((*it)->start(capacity))
+            ++it;
+        else
+            it = subscribers.erase(it);
+    }
+
+    bool websocket = cfg->websocket.enabled && wsSubscriber.start(capacity);
+    hasSubscribers = websocket || !subscribers.empty();
+}
+
+void EventBus::stop()
+{
+    hasSubscribers = false;
+    for (auto &subscriber : subscribers)
+        subscriber->stop();
+    subscribers.clear();
+    wsSubscriber.stop();
+}
+
+void EventBus::publish(EventType type, const char *typeName, const char *state, const std::string &fields)
+{
+    if (!active())
+        return;
+
+    auto event = std::make_shared<BusEvent>();
+    event->type = type;
+    event->seq = seq.fetch_add(1, std::memory_order_relaxed) + 1;
+    event->state = state;
+
+    int64_t ts = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    event->json = "{\"event\":\"" + std::string(typeName) + "\",\"seq\":" + std::to_string(event->seq) +
+                  ",\"ts\":" + std::to_string(ts) + ",\"state\":\"" + state + "\"";
+    if (!fields.empty())
+        event->json += "," + fields;
+    event->json += "}";
+
+    BusEventPtr shared = std::move(event);
+    for (auto &subscriber : subscribers)
+    {
+        if (subscriber->wants(type))
+            subscriber->offer(shared);
+    }
+    wsSubscriber.offer(shared);
+}
+
+void EventBus::motion(bool start, int activity)
+{
+    publish(EventType::Motion, "motion", start ? "start" : "stop",
+            "\"activity\":" + std::to_string(activity));
+}
+
+void EventBus::audioLevel(int channel, float rmsDb, float peakDb)
+{
+    char fields[96];
+    snprintf(fields, sizeof(fields), "\"channel\":%d,\"rms_db\":%.1f,\"peak_db\":%.1f",
+             channel, rmsDb, peakDb);
+    publish(EventType::AudioLevel, "audio_level", "level", fields);
+}
+
+void EventBus::streamState(const char *stream, const char *state)
+{
+    publish(EventType::Stream, "stream", state, "\"stream\":\"" + std::string(stream) + "\"");
+}
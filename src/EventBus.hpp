@@ -0,0 +1,137 @@
+#ifndef EVENT_BUS_HPP
+#define EVENT_BUS_HPP
+
+// In-process event bus. Motion, audio level and stream state events are
+// published as one line of JSON each and handed to every subscriber:
+//  - the Unix socket at events.socket_path, newline separated JSON for every
+//    connected client
+//  - websocket sessions that sent {"action":{"events":true}}
+//  - one persistent helper process (events.helper_path) reading JSON lines
+//    on stdin
+//  - the motion script (motion.script_path start|stop), spawned from the
+//    subscriber thread
+//
+// publish() never blocks: every subscriber has its own bounded queue and
+// thread, when a subscriber falls behind its oldest events are dropped and
+// counted.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+enum class EventType
+{
+    Motion,
+    AudioLevel,
+    Stream
+};
+
+struct BusEvent
+{
+    EventType type;
+    uint64_t seq;
+    std::string state;  // e.g. "start" / "stop" of a motion event
+    std::string json;   // complete event object, no newline
+};
+
+using BusEventPtr = std::shared_ptr<const BusEvent>;
+
+class EventSubscriber
+{
+public:
+    virtual ~EventSubscriber();
+
+    bool start(size_t capacity);
+    void stop();
+
+    // Queue an event, never blocks. Drops the oldest event when full.
+    void offer(const BusEventPtr &event);
+
+    virtual const char *name() const = 0;
+    virtual bool wants(EventType) const { return true; }
+
+    uint64_t dropped() const { return droppedCount.load(std::memory_order_relaxed); }
+
+protected:
+    EventSubscriber() = default;
+
+    virtual bool open() { return true; }
+    virtual void close() {}
+    // Called from the subscriber thread, may block
+    virtual void deliver(const BusEvent &event) = 0;
+    // Called from the subscriber thread about every EVENT_IDLE_MS
+    virtual void idle() {}
+
+private:
+    static void *thread_entry(void *arg);
+    void run();
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<BusEventPtr> queue;
+    size_t capacity = 0;
+    bool running = false;
+    pthread_t thread{};
+    std::atomic<uint64_t> droppedCount{0};
+};
+
+// Keeps the last events for the websocket sessions, which pick them up from
+// the lws thread when their connection is writable
+class WSEventSubscriber : public EventSubscriber
+{
+public:
+    const char *name() const override { return "websocket"; }
+
+    // Called with the new events, wakes the lws service loop
+    void setWake(std::function<void()> wake);
+
+    // Events after seq, seq is advanced to the last one returned
+    void fetch(uint64_t &seq, std::vector<BusEventPtr> &out);
+
+    // Sequence of the newest event, new sessions start there
+    uint64_t last();
+
+protected:
+    void deliver(const BusEvent &event) override;
+
+private:
+    std::mutex ringMutex;
+    std::deque<BusEventPtr> ring;
+    std::function<void()> wake;
+};
+
+class EventBus
+{
+public:
+    // Creates the subscribers enabled in cfg->events and cfg->motion
+    void start();
+    void stop();
+
+    // Whether anybody listens, lets producers skip preparing an event
+    bool active() const { return hasSubscribers.load(std::memory_order_relaxed); }
+
+    void motion(bool start, int activity);
+    void audioLevel(int channel, float rmsDb, float peakDb);
+    void streamState(const char *stream, const char *state);
+
+    WSEventSubscriber &websocket() { return wsSubscriber; }
+
+private:
+    // fields: JSON members without braces, appended after the common ones
+    void publish(EventType type, const char *typeName, const char *state, const std::string &fields);
+
+    std::vector<std::unique_ptr<EventSubscriber>> subscribers;
+    WSEventSubscriber wsSubscriber;
+    std::atomic<bool> hasSubscribers{false};
+    std::atomic<uint64_t> seq{0};
+};
+
+#endif // EVENT_BUS_HPP
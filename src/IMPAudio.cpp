@@ -6,7 +6,9 @@
 
 #define MODULE "IMPAUDIO"
 
-static thread_local IMPAudioEncoder *encoder = nullptr;
+// Not thread_local: the AENC callbacks run on the AudioWorker encode thread,
+// not on the thread that registered the encoder
+static IMPAudioEncoder *encoder = nullptr;
 
 static int openEncoder(void* attr, void* enc)
 {
@@ -0,0 +1,111 @@
+#include "IMPAudioOutputSink.hpp"
+
+#include "Config.hpp"
+#include "Logger.hpp"
+
+#include <imp/imp_audio.h>
+
+#define MODULE "IMPAudioOutputSink"
+
+// Periods queued inside the AO driver, keeps device latency at ~4 periods
+#define AO_FRAME_NUM 4
+
+IMPAudioOutputSink *IMPAudioOutputSink::createNew(int devId, int chn)
+{
+    return new IMPAudioOutputSink(devId, chn);
+}
+
+IMPAudioOutputSink::~IMPAudioOutputSink()
+{
+    close();
+}
+
+bool IMPAudioOutputSink::openDevice(int sampleRate, size_t periodSamples)
+{
+    int ret;
+
+    this->periodSamples = periodSamples;
+
+    IMPAudioIOAttr attr = {
+        .samplerate = static_cast<IMPAudioSampleRate>(sampleRate),
+        .bitwidth = AUDIO_BIT_WIDTH_16,
+        .soundmode = AUDIO_SOUND_MODE_MONO,
+        .frmNum = AO_FRAME_NUM,
+        .numPerFrm = static_cast<int>(periodSamples),
+        .chnCnt = 1
+    };
+
+    ret = IMP_AO_SetPubAttr(devId, &attr);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_AO_SetPubAttr(" << devId << ")");
+    if (ret != 0)
+        return false;
+
+    ret = IMP_AO_Enable(devId);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_AO_Enable(" << devId << ")");
+    if (ret != 0)
+        return false;
+
+    ret = IMP_AO_EnableChn(devId, chn);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_AO_EnableChn(" << devId << ", " << chn << ")");
+    if (ret != 0)
+    {
+        IMP_AO_Disable(devId);
+        return false;
+    }
+
+    ret = IMP_AO_SetVol(devId, chn, cfg->audio.output_vol);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_AO_SetVol(" << devId << ", " << chn << ", " << cfg->audio.output_vol << ")");
+
+    ret = IMP_AO_SetGain(devId, chn, cfg->audio.output_gain);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_AO_SetGain(" << devId << ", " << chn << ", " << cfg->audio.output_gain << ")");
+
+    enabled = true;
+    return true;
+}
+
+bool IMPAudioOutputSink::writePeriod(const int16_t *samples, size_t count)
+{
+    IMPAudioFrame frame = {};
+    frame.bitwidth = AUDIO_BIT_WIDTH_16;
+    frame.soundmode = AUDIO_SOUND_MODE_MONO;
+    frame.virAddr = reinterpret_cast<uint32_t *>(const_cast<int16_t *>(samples));
+    frame.len = static_cast<int>(count * sizeof(int16_t));
+
+    // Blocks while all AO_FRAME_NUM driver buffers are busy, this paces the writer
+    int ret = IMP_AO_SendFrame(devId, chn, &frame, BLOCK);
+    if (ret != 0)
+    {
+        LOG_ERROR("IMP_AO_SendFrame(" << devId << ", " << chn << ") failed: " << ret);
+        return false;
+    }
+    return true;
+}
+
+void IMPAudioOutputSink::closeDevice()
+{
+    if (!enabled)
+        return;
+
+    int ret = IMP_AO_FlushChnBuf(devId, chn);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_AO_FlushChnBuf(" << devId << ", " << chn << ")");
+
+    ret = IMP_AO_DisableChn(devId, chn);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_AO_DisableChn(" << devId << ", " << chn << ")");
+
+    ret = IMP_AO_Disable(devId);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_AO_Disable(" << devId << ")");
+
+    enabled = false;
+}
+
+size_t IMPAudioOutputSink::deviceQueuedSamples()
+{
+    if (!enabled)
+        return 0;
+
+    IMPAudioOChnState state;
+    if (IMP_AO_QueryChnStat(devId, chn, &state) != 0)
+        return 0;
+
+    return static_cast<size_t>(state.chnBusyNum) * periodSamples;
+}
@@ -0,0 +1,31 @@
+#ifndef IMP_AUDIO_OUTPUT_SINK_HPP
+#define IMP_AUDIO_OUTPUT_SINK_HPP
+
+// AudioOutputSink on the IMP AO device (speaker output of the SoC).
+
+#include "AudioOutputSink.hpp"
+
+class IMPAudioOutputSink : public AudioOutputSink
+{
+public:
+    static IMPAudioOutputSink *createNew(int devId = 0, int chn = 0);
+    ~IMPAudioOutputSink() override;
+
+    const char *name() const override { return "imp"; }
+
+protected:
+    IMPAudioOutputSink(int devId, int chn) : devId(devId), chn(chn) {}
+
+    bool openDevice(int sampleRate, size_t periodSamples) override;
+    bool writePeriod(const int16_t *samples, size_t count) override;
+    void closeDevice() override;
+    size_t deviceQueuedSamples() override;
+
+private:
+    int devId;
+    int chn;
+    size_t periodSamples{0};
+    bool enabled{false};
+};
+
+#endif // IMP_AUDIO_OUTPUT_SINK_HPP
@@ -26,10 +26,14 @@
  *      dequeues frames from the queue, decodes the audio data using the
  *      IMP audio SDK, and resamples it if necessary. It maintains a
  *      concept of a "current" session, processing only frames from that
- *      session and discarding frames from other sessions.
- *   5. Audio Output: The decoded PCM audio is then sent to a pipe, where
- *      the `/bin/iac` program receives the data and handles the audio
- *      output.
+ *      session and discarding frames from other sessions. Frames of the
+ *      current session are reordered by RTP sequence number in a
+ *      BackchannelJitterBuffer whose playout delay follows the measured
+ *      jitter; missing frames are concealed.
+ *   5. Audio Output: The decoded PCM audio is then sent, paced at the
+ *      output sample rate, to an AudioOutputSink. By default this is the
+ *      IMP AO device; a pipe to `/bin/iac` remains available as fallback
+ *      and a file sink can be used for testing.
  *
  *  The IMPBackchannel class is responsible for:
  *   - Registering and managing audio decoders (e.g., Opus) with the IMP
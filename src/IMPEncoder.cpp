@@ -325,7 +325,9 @@ int IMPEncoder::init()
     ret = IMP_Encoder_RegisterChn(encGrp, encChn);
     LOG_DEBUG_OR_ERROR_AND_EXIT(ret, "IMP_Encoder_RegisterChn(" << encGrp << ", " << encChn << ")");
 
-    if (strcmp(stream->format, "JPEG") != 0)
+    // The first channel of a group creates and binds it, the JPEG and derived
+    // channels are registered into the group of their source stream
+    if (encChn == encGrp)
     {
         ret = IMP_Encoder_CreateGroup(encGrp);
         LOG_DEBUG_OR_ERROR_AND_EXIT(ret, "IMP_Encoder_CreateGroup(" << encGrp << ")");
@@ -351,7 +353,7 @@ int IMPEncoder::init()
         }
     }
 #if !(defined(PLATFORM_T31) || !defined(PLATFORM_C100) || !defined(PLATFORM_T40) || !defined(PLATFORM_T41))
-    else
+    else if (strcmp(stream->format, "JPEG") == 0)
     {
         IMPEncoderJpegeQl pstJpegeQl;
         // fix for bad jpeg image quality on T10 based cameras
@@ -374,13 +376,83 @@ int IMPEncoder::init()
     return ret;
 }
 
+bool IMPEncoder::setBitrate(int bitrate)
+{
+#if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
+    int ret = IMP_Encoder_SetChnBitRate(encChn, bitrate, bitrate);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_SetChnBitRate(" << encChn << ", " << bitrate << ")");
+    return ret == 0;
+#else
+    IMPEncoderAttrRcMode rcMode;
+    int ret = IMP_Encoder_GetChnAttrRcMode(encChn, &rcMode);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_GetChnAttrRcMode(" << encChn << ")");
+    if (ret != 0)
+        return false;
+
+#if defined(PLATFORM_T30)
+    if (chnAttr.encAttr.enType == PT_H265)
+    {
+        if (rcMode.rcMode != ENC_RC_MODE_SMART)
+            return false;
+        rcMode.attrH265Smart.maxBitRate = bitrate;
+    }
+    else
+#endif
+    switch (rcMode.rcMode)
+    {
+    case ENC_RC_MODE_CBR:
+        rcMode.attrH264Cbr.outBitRate = bitrate;
+        break;
+    case ENC_RC_MODE_VBR:
+        rcMode.attrH264Vbr.maxBitRate = bitrate;
+        break;
+    case ENC_RC_MODE_SMART:
+        rcMode.attrH264Smart.maxBitRate = bitrate;
+        break;
+    default:
+        return false;
+    }
+
+    ret = IMP_Encoder_SetChnAttrRcMode(encChn, &rcMode);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_SetChnAttrRcMode(" << encChn << ", " << bitrate << ")");
+    return ret == 0;
+#endif
+}
+
+bool IMPEncoder::setFps(int fps)
+{
+    // The frame source keeps the rate the channel was created with, the
+    // encoder can only drop frames from it
+    if (fps <= 0 || fps > static_cast<int>(chnAttr.rcAttr.outFrmRate.frmRateNum))
+        return false;
+
+    IMPEncoderFrmRate frmRate{};
+    frmRate.frmRateNum = fps;
+    frmRate.frmRateDen = 1;
+    int ret = IMP_Encoder_SetChnFrmRate(encChn, &frmRate);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_SetChnFrmRate(" << encChn << ", " << fps << ")");
+    return ret == 0;
+}
+
+bool IMPEncoder::setGop(int gop)
+{
+#if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
+    int ret = IMP_Encoder_SetChnGopLength(encChn, gop);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_SetChnGopLength(" << encChn << ", " << gop << ")");
+    return ret == 0;
+#else
+    (void) gop;
+    return false;
+#endif
+}
+
 int IMPEncoder::deinit()
 {
     LOG_DEBUG("IMPEncoder::deinit(" << encChn << ", " << encGrp << ")");
 
     int ret;
 
-    if (strcmp(stream->format, "JPEG") != 0)
+    if (encChn == encGrp)
     {
         if (osd)
         {
@@ -400,7 +472,7 @@ int IMPEncoder::deinit()
             LOG_DEBUG_OR_ERROR(ret, "IMP_System_UnBind(&fs, &enc)");
         }
     }
-    else
+    else if (strcmp(stream->format, "JPEG") == 0)
     {
 
         ret = IMP_Encoder_StopRecvPic(encChn);
@@ -421,6 +493,10 @@ int IMPEncoder::destroy()
 
     int ret;
 
+    // registered channels go with their group
+    if (encChn != encGrp)
+        return 0;
+
     ret = IMP_Encoder_DestroyGroup(encChn);
     LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_DestroyGroup(" << encChn << ")");
 
@@ -13,6 +13,14 @@
 #define IMPEncoderCHNStat IMPEncoderChnStat
 #endif
 
+/* The encoder channels have a device fd (IMP_Encoder_GetFd) that becomes
+ * readable with a new stream and can be waited on with epoll. The T10 SDK
+ * only offers IMP_Encoder_PollingStream.
+ */
+#if !defined(PLATFORM_T10)
+#define IMP_ENCODER_HAS_FD
+#endif
+
 static const std::array<int, 64> jpeg_chroma_quantizer = {{17, 18, 24, 47, 99, 99, 99, 99,
                                                            18, 21, 26, 66, 99, 99, 99, 99,
                                                            24, 26, 56, 99, 99, 99, 99, 99,
@@ -50,6 +58,11 @@ public:
     int destroy();
     static void flush(int encChn);
 
+    // Change a running channel in place, false if it needs a restart
+    bool setBitrate(int bitrate);
+    bool setFps(int fps);
+    bool setGop(int gop);
+
     OSD *osd = nullptr;
 
 private:
@@ -9,6 +9,10 @@
 #include "GroupsockHelper.hh"
 #include "Config.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <sys/socket.h>
+
 // Modify method to accept pointers for the NAL units
 IMPServerMediaSubsession *IMPServerMediaSubsession::createNew(
     UsageEnvironment &env,
@@ -30,7 +34,7 @@ IMPServerMediaSubsession::IMPServerMediaSubsession(
     int encChn)
     : OnDemandServerMediaSubsession(env, true),
       vps(vps ? new H264NALUnit(*vps) : nullptr), // Copy if not nullptr
-      sps(sps), pps(pps), encChn(encChn)
+      sps(sps), pps(pps), encChn(encChn), abr(encChn), sampleTask(nullptr)
 {
 }
 
@@ -38,6 +42,131 @@ IMPServerMediaSubsession::IMPServerMediaSubsession(
 IMPServerMediaSubsession::~IMPServerMediaSubsession()
 {
     delete vps; // Safe to delete nullptr if vps is not set
+    envir().taskScheduler().unscheduleDelayedTask(sampleTask);
+    for (auto &session : sessions)
+        session.second->stats.remove();
+    if (!sessions.empty())
+        abr.reset();
+}
+
+void IMPServerMediaSubsession::getStreamParameters(unsigned clientSessionId,
+                                                   struct sockaddr_storage const &clientAddress,
+                                                   Port const &clientRTPPort,
+                                                   Port const &clientRTCPPort,
+                                                   int tcpSocketNum,
+                                                   unsigned char rtpChannelId,
+                                                   unsigned char rtcpChannelId,
+                                                   TLSState *tlsState,
+                                                   struct sockaddr_storage &destinationAddress,
+                                                   u_int8_t &destinationTTL,
+                                                   Boolean &isMulticast,
+                                                   Port &serverRTPPort,
+                                                   Port &serverRTCPPort,
+                                                   void *&streamToken)
+{
+    OnDemandServerMediaSubsession::getStreamParameters(clientSessionId, clientAddress, clientRTPPort, clientRTCPPort,
+                                                       tcpSocketNum, rtpChannelId, rtcpChannelId, tlsState,
+                                                       destinationAddress, destinationTTL, isMulticast,
+                                                       serverRTPPort, serverRTCPPort, streamToken);
+    tcpSockets[clientSessionId] = tcpSocketNum;
+}
+
+void IMPServerMediaSubsession::startStream(unsigned clientSessionId, void* streamToken, TaskFunc* rtcpRRHandler,
+                                           void* rtcpRRHandlerClientData, unsigned short& rtpSeqNum, unsigned& rtpTimestamp,
+                                           ServerRequestAlternativeByteHandler* serverRequestAlternativeByteHandler,
+                                           void* serverRequestAlternativeByteHandlerClientData)
+{
+    // A PLAY after PAUSE starts the same session again, its context is replaced
+    auto &context = sessions[clientSessionId];
+    context.reset(new SessionContext{this, streamToken, rtcpRRHandler, rtcpRRHandlerClientData,
+                                     SessionStats(encChn, clientSessionId)});
+
+    OnDemandServerMediaSubsession::startStream(clientSessionId, streamToken, onReceiverReport, context.get(),
+                                               rtpSeqNum, rtpTimestamp, serverRequestAlternativeByteHandler,
+                                               serverRequestAlternativeByteHandlerClientData);
+
+    RTPSink *sink = nullptr;
+    RTCPInstance *rtcp = nullptr;
+    getRTPSinkandRTCP(streamToken, sink, rtcp);
+    auto tcp = tcpSockets.find(clientSessionId);
+    context->stats.start(sink, tcp != tcpSockets.end() ? tcp->second : -1);
+
+    if (sampleTask == nullptr)
+        sampleTask = envir().taskScheduler().scheduleDelayedTask(1000000, sampleSessions, this);
+
+    //request idr frame every second for the next x seconds
+    global_video[encChn]->idr_fix = 5;
+    // a lazy stream gets its encoder from the worker once it sees the consumer
+    if (video_stream::LockedEncoder encoder = global_video[encChn]->lock_encoder())
+        IMPEncoder::flush(global_video[encChn]->encChn);
+}
+
+void IMPServerMediaSubsession::deleteStream(unsigned clientSessionId, void*& streamToken)
+{
+    // The RR handler of the session is unset in here, the context can go after
+    OnDemandServerMediaSubsession::deleteStream(clientSessionId, streamToken);
+
+    tcpSockets.erase(clientSessionId);
+    auto it = sessions.find(clientSessionId);
+    if (it == sessions.end())
+        return;
+
+    it->second->stats.remove();
+    sessions.erase(it);
+
+    if (sessions.empty())
+    {
+        envir().taskScheduler().unscheduleDelayedTask(sampleTask);
+        abr.reset();
+    }
+}
+
+void IMPServerMediaSubsession::onReceiverReport(void *clientData)
+{
+    SessionContext *context = static_cast<SessionContext *>(clientData);
+
+    RTPSink *sink = nullptr;
+    RTCPInstance *rtcp = nullptr;
+    context->subsession->getRTPSinkandRTCP(context->streamToken, sink, rtcp);
+    context->stats.onReceiverReport(sink);
+    context->subsession->abr.onReceiverReport(sink);
+
+    // Client liveness of the RTSP server
+    if (context->handler)
+        context->handler(context->clientData);
+}
+
+void IMPServerMediaSubsession::sampleSessions(void *clientData)
+{
+    IMPServerMediaSubsession *self = static_cast<IMPServerMediaSubsession *>(clientData);
+
+    // Disconnecting closes the socket, the session is deleted later on
+    for (auto &session : self->sessions)
+    {
+        SessionContext &context = *session.second;
+        if (context.stats.sample())
+            self->applySlowClientPolicy(context);
+        context.stats.write();
+    }
+
+    self->sampleTask = self->envir().taskScheduler().scheduleDelayedTask(1000000, sampleSessions, self);
+}
+
+void IMPServerMediaSubsession::applySlowClientPolicy(SessionContext &context)
+{
+    const char *policy = cfg->rtsp.slow_client_policy;
+
+    if (strcmp(policy, "disconnect") == 0 && context.stats.isTcp())
+    {
+        LOG_WARN("Disconnecting slow client " << context.stats.name());
+        shutdown(context.stats.socket(), SHUT_RDWR);
+    }
+    else if (strcmp(policy, "none") != 0)
+    {
+        // The viewer resumes at the next IDR instead of waiting for the GOP
+        // end with a broken picture
+        global_video[encChn]->idr_fix = std::max(global_video[encChn]->idr_fix, 1);
+    }
 }
 
 FramedSource *IMPServerMediaSubsession::createNewStreamSource(
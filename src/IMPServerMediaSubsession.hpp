@@ -1,12 +1,17 @@
 #ifndef IMPServerMediaSubsession_hpp
 #define IMPServerMediaSubsession_hpp
 
+#include "AdaptiveBitrate.hpp"
 #include "Config.hpp"
+#include "SessionStats.hpp"
 #include "globals.hpp"
 #include "StreamReplicator.hh"
 #include "ServerMediaSession.hh"
 #include "OnDemandServerMediaSubsession.hh"
 
+#include <map>
+#include <memory>
+
 class IMPServerMediaSubsession : public OnDemandServerMediaSubsession
 {
 public:
@@ -37,24 +42,51 @@ protected:
         unsigned char rtpPayloadTypeIfDynamic,
         FramedSource *inputSource);
 
+    virtual void getStreamParameters(unsigned clientSessionId,
+                                     struct sockaddr_storage const &clientAddress,
+                                     Port const &clientRTPPort,
+                                     Port const &clientRTCPPort,
+                                     int tcpSocketNum,
+                                     unsigned char rtpChannelId,
+                                     unsigned char rtcpChannelId,
+                                     TLSState *tlsState,
+                                     struct sockaddr_storage &destinationAddress,
+                                     u_int8_t &destinationTTL,
+                                     Boolean &isMulticast,
+                                     Port &serverRTPPort,
+                                     Port &serverRTCPPort,
+                                     void *&streamToken) override;
     virtual void startStream(unsigned clientSessionId, void* streamToken, TaskFunc* rtcpRRHandler,
                              void* rtcpRRHandlerClientData, unsigned short& rtpSeqNum, unsigned& rtpTimestamp,
                              ServerRequestAlternativeByteHandler* serverRequestAlternativeByteHandler,
-                             void* serverRequestAlternativeByteHandlerClientData) override {
-
-        OnDemandServerMediaSubsession::startStream(clientSessionId, streamToken, rtcpRRHandler, rtcpRRHandlerClientData,
-                                                   rtpSeqNum, rtpTimestamp, serverRequestAlternativeByteHandler,
-                                                   serverRequestAlternativeByteHandlerClientData);
+                             void* serverRequestAlternativeByteHandlerClientData) override;
+    virtual void deleteStream(unsigned clientSessionId, void*& streamToken) override;
 
-        //request idr frame every second for the next x seconds
-        global_video[encChn]->idr_fix = 5;
-        IMPEncoder::flush(encChn);
-    }
 private:
+    // A playing session. Its RR handler passes reports on to the rate control
+    // and the session stats before the handler of the server.
+    struct SessionContext
+    {
+        IMPServerMediaSubsession *subsession;
+        void *streamToken;
+        TaskFunc *handler;
+        void *clientData;
+        SessionStats stats;
+    };
+    static void onReceiverReport(void *clientData);
+
+    // Samples the session stats once a second while sessions are playing
+    static void sampleSessions(void *clientData);
+    void applySlowClientPolicy(SessionContext &context);
+
     H264NALUnit *vps; // Change to pointer for optional VPS
     H264NALUnit sps;
     H264NALUnit pps;
     int encChn;
+    AdaptiveBitrate abr;
+    std::map<unsigned, std::unique_ptr<SessionContext>> sessions;
+    std::map<unsigned, int> tcpSockets;     // from SETUP, -1 for UDP
+    TaskToken sampleTask;
 };
 
 #endif
@@ -0,0 +1,251 @@
+#include "ImageTuning.hpp"
+
+#include "Config.hpp"
+#include "Logger.hpp"
+#include "RTSPStatus.hpp"
+
+#include <cstring>
+#include <imp/imp_isp.h>
+
+#define MODULE "ImageTuning"
+
+namespace
+{
+
+struct Tuning
+{
+    std::string_view key;
+    int (*apply)();
+};
+
+#if !defined(NO_TUNINGS)
+int apply_wb()
+{
+    IMPISPWB wb;
+    memset(&wb, 0, sizeof(IMPISPWB));
+    int ret = IMP_ISP_Tuning_GetWB(&wb);
+    if (ret == 0)
+    {
+        wb.mode = (isp_core_wb_mode)cfg->image.core_wb_mode;
+        wb.rgain = cfg->image.wb_rgain;
+        wb.bgain = cfg->image.wb_bgain;
+        ret = IMP_ISP_Tuning_SetWB(&wb);
+    }
+    return ret;
+}
+
+const Tuning tunings[] = {
+    {"brightness", [] { return IMP_ISP_Tuning_SetBrightness(cfg->image.brightness); }},
+    {"contrast", [] { return IMP_ISP_Tuning_SetContrast(cfg->image.contrast); }},
+    {"sharpness", [] { return IMP_ISP_Tuning_SetSharpness(cfg->image.sharpness); }},
+    {"saturation", [] { return IMP_ISP_Tuning_SetSaturation(cfg->image.saturation); }},
+    {"temper_strength", [] { return IMP_ISP_Tuning_SetTemperStrength(cfg->image.temper_strength); }},
+    {"vflip", [] {
+         return IMP_ISP_Tuning_SetISPVflip(cfg->image.vflip ? IMPISP_TUNING_OPS_MODE_ENABLE
+                                                            : IMPISP_TUNING_OPS_MODE_DISABLE);
+     }},
+    {"hflip", [] {
+         return IMP_ISP_Tuning_SetISPHflip(cfg->image.hflip ? IMPISP_TUNING_OPS_MODE_ENABLE
+                                                            : IMPISP_TUNING_OPS_MODE_DISABLE);
+     }},
+    {"anti_flicker", [] { return IMP_ISP_Tuning_SetAntiFlickerAttr((IMPISPAntiflickerAttr)cfg->image.anti_flicker); }},
+    {"running_mode", [] { return IMP_ISP_Tuning_SetISPRunningMode((IMPISPRunningMode)cfg->image.running_mode); }},
+    {"highlight_depress", [] { return IMP_ISP_Tuning_SetHiLightDepress(cfg->image.highlight_depress); }},
+    {"max_again", [] { return IMP_ISP_Tuning_SetMaxAgain(cfg->image.max_again); }},
+    {"max_dgain", [] { return IMP_ISP_Tuning_SetMaxDgain(cfg->image.max_dgain); }},
+    {"core_wb_mode", apply_wb},
+    {"wb_rgain", apply_wb},
+    {"wb_bgain", apply_wb},
+#if !defined(PLATFORM_T21)
+    {"sinter_strength", [] { return IMP_ISP_Tuning_SetSinterStrength(cfg->image.sinter_strength); }},
+    {"ae_compensation", [] { return IMP_ISP_Tuning_SetAeComp(cfg->image.ae_compensation); }},
+#endif
+#if !defined(PLATFORM_T10) && !defined(PLATFORM_T20) && !defined(PLATFORM_T21) && !defined(PLATFORM_T23) && !defined(PLATFORM_T30)
+    {"hue", [] { return IMP_ISP_Tuning_SetBcshHue(cfg->image.hue); }},
+    {"defog_strength", [] {
+         uint8_t strength = static_cast<uint8_t>(cfg->image.defog_strength);
+         return IMP_ISP_Tuning_SetDefog_Strength(&strength);
+     }},
+    {"dpc_strength", [] { return IMP_ISP_Tuning_SetDPC_Strength(cfg->image.dpc_strength); }},
+    {"drc_strength", [] { return IMP_ISP_Tuning_SetDRC_Strength(cfg->image.drc_strength); }},
+    {"backlight_compensation", [] { return IMP_ISP_Tuning_SetBacklightComp(cfg->image.backlight_compensation); }},
+#endif
+};
+#endif // #if !defined(NO_TUNINGS)
+
+const Tuning *find(std::string_view key)
+{
+#if !defined(NO_TUNINGS)
+    for (const Tuning &tuning : tunings)
+        if (tuning.key == key)
+            return &tuning;
+#else
+    (void)key;
+#endif
+    return nullptr;
+}
+
+} // namespace
+
+bool ImageTuning::supported(std::string_view key)
+{
+    return find(key) != nullptr;
+}
+
+ImageTuning::~ImageTuning()
+{
+    stop();
+}
+
+bool ImageTuning::start()
+{
+    running = true;
+    int ret = pthread_create(&thread, nullptr, thread_entry, this);
+    LOG_DEBUG_OR_ERROR(ret, "create image tuning thread");
+    if (ret != 0)
+    {
+        running = false;
+        return false;
+    }
+    return true;
+}
+
+void ImageTuning::stop()
+{
+    {
+        std::lock_guard lock(mutex);
+        if (!running)
+            return;
+        running = false;
+    }
+    cv.notify_one();
+    pthread_join(thread, nullptr);
+}
+
+void ImageTuning::post(std::string_view key)
+{
+    const Tuning *tuning = find(key);
+    if (!tuning)
+        return;
+
+    {
+        std::lock_guard lock(mutex);
+        for (const Pending &p : pending)
+        {
+            if (p.key == tuning->key)
+            {
+                // the value is read when applied, the newer one wins
+                coalesced++;
+                return;
+            }
+        }
+        pending.push_back({tuning->key, std::chrono::steady_clock::now()});
+    }
+    cv.notify_one();
+}
+
+void *ImageTuning::thread_entry(void *arg)
+{
+    static_cast<ImageTuning *>(arg)->run();
+    return nullptr;
+}
+
+void ImageTuning::run()
+{
+    std::vector<Pending> batch;
+
+    std::unique_lock lock(mutex);
+    while (running)
+    {
+        if (pending.empty())
+        {
+            // flush the stats of the last batches once things calm down
+            if (statsDirty)
+            {
+                cv.wait_for(lock, std::chrono::seconds(1), [this] { return !running || !pending.empty(); });
+                if (pending.empty() && running)
+                {
+                    lock.unlock();
+                    writeStats();
+                    lock.lock();
+                }
+            }
+            else
+            {
+                cv.wait(lock, [this] { return !running || !pending.empty(); });
+            }
+            continue;
+        }
+
+        // one batch per frame interval, posts until then are coalesced
+        int fps = cfg->sensor.fps > 0 ? cfg->sensor.fps : 25;
+        auto next = lastApply + std::chrono::microseconds(1000000 / fps);
+        if (std::chrono::steady_clock::now() < next)
+        {
+            cv.wait_until(lock, next, [this] { return !running; });
+            continue;
+        }
+
+        batch.swap(pending);
+        lock.unlock();
+
+        applyBatch(batch);
+        batch.clear();
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastStats >= std::chrono::seconds(1))
+            writeStats();
+
+        lock.lock();
+    }
+}
+
+void ImageTuning::applyBatch(std::vector<Pending> &batch)
+{
+    // tuning calls already made in this batch, keys can share one
+    std::vector<int (*)()> done;
+
+    for (const Pending &p : batch)
+    {
+        const Tuning *tuning = find(p.key);
+        bool again = false;
+        for (auto fn : done)
+            again |= (fn == tuning->apply);
+
+        if (!again)
+        {
+            int ret = tuning->apply();
+            LOG_DEBUG_OR_ERROR(ret, "image." << p.key);
+            if (ret != 0)
+                errors++;
+            done.push_back(tuning->apply);
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        latencyMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - p.posted).count();
+        if (latencyMs > maxLatencyMs)
+            maxLatencyMs = latencyMs;
+        applied++;
+    }
+
+    lastApply = std::chrono::steady_clock::now();
+    statsDirty = true;
+}
+
+void ImageTuning::writeStats()
+{
+    uint32_t coalescedNow;
+    {
+        std::lock_guard lock(mutex);
+        coalescedNow = coalesced;
+    }
+
+    RTSPStatus::writeCustomParameter("image", "tuning_applied", std::to_string(applied));
+    RTSPStatus::writeCustomParameter("image", "tuning_coalesced", std::to_string(coalescedNow));
+    RTSPStatus::writeCustomParameter("image", "tuning_errors", std::to_string(errors));
+    RTSPStatus::writeCustomParameter("image", "tuning_latency_ms", std::to_string(latencyMs));
+    RTSPStatus::writeCustomParameter("image", "tuning_latency_max_ms", std::to_string(maxLatencyMs));
+
+    lastStats = std::chrono::steady_clock::now();
+    statsDirty = false;
+}
@@ -0,0 +1,70 @@
+#ifndef IMAGE_TUNING_HPP
+#define IMAGE_TUNING_HPP
+
+// Pushes the image.* settings of the config to the ISP. The websocket handlers
+// (JSON and binary) set the config value first and then post the key here,
+// the value is read from cfg->image when it is applied.
+//
+// A tuning thread applies the posted keys at most once per sensor frame
+// interval. A key posted again before it was applied is coalesced, only its
+// latest value reaches the ISP, so a dragged slider costs one tuning call per
+// frame instead of one per message. Keys sharing a call (the white balance
+// mode and gains) are applied once per batch.
+//
+// Keys are given without the "image." prefix. Keys the platform has no tuning
+// call for are not supported, the handlers answer them with null.
+//
+// Exposed under /run/prudynt/rtsp/image/.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <pthread.h>
+#include <string_view>
+#include <vector>
+
+class ImageTuning
+{
+public:
+    ~ImageTuning();
+
+    static bool supported(std::string_view key);
+
+    bool start();
+    void stop();
+
+    // Queue the key for the tuning thread, never blocks on the ISP
+    void post(std::string_view key);
+
+private:
+    struct Pending
+    {
+        std::string_view key;
+        std::chrono::steady_clock::time_point posted;   // oldest post not applied yet
+    };
+
+    static void *thread_entry(void *arg);
+    void run();
+    void applyBatch(std::vector<Pending> &batch);
+    void writeStats();
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<Pending> pending;
+    bool running = false;
+    pthread_t thread{};
+
+    std::chrono::steady_clock::time_point lastApply;
+    std::chrono::steady_clock::time_point lastStats;
+    bool statsDirty = false;
+
+    // Tuning thread only, except coalesced
+    uint32_t applied = 0;
+    uint32_t coalesced = 0;
+    uint32_t errors = 0;
+    uint32_t latencyMs = 0;
+    uint32_t maxLatencyMs = 0;
+};
+
+#endif // IMAGE_TUNING_HPP
@@ -2,11 +2,11 @@
 
 #include "Config.hpp"
 #include "Logger.hpp"
+#include "SnapshotCache.hpp"
 #include "WorkerUtils.hpp"
 #include "globals.hpp"
 
-#include <fcntl.h>   // For O_RDWR, O_CREAT, O_TRUNC flags
-#include <unistd.h>  // For open(), close(), etc.
+#include <unistd.h>
 
 #define MODULE "JPEGWorker"
 
@@ -23,58 +23,35 @@ JPEGWorker::~JPEGWorker()
     LOG_DEBUG("JPEGWorker destroyed for JPEG channel index " << jpgChn);
 }
 
-int JPEGWorker::save_jpeg_stream(int fd, IMPEncoderStream *stream)
+void JPEGWorker::copy_jpeg_stream(IMPEncoderStream *stream, std::vector<uint8_t> &buffer)
 {
-    int ret, i, nr_pack = stream->packCount;
+    buffer.resize(LWS_PRE);
 
-    for (i = 0; i < nr_pack; i++)
+    for (uint32_t i = 0; i < stream->packCount; i++)
     {
-        void *data_ptr;
-        size_t data_len;
-
 #if defined(PLATFORM_T31) || defined(PLATFORM_T40) || defined(PLATFORM_T41) || defined(PLATFORM_C100)
         IMPEncoderPack *pack = &stream->pack[i];
-        uint32_t remSize = 0; // Declare remSize here
-        if (pack->length)
+        if (!pack->length)
+            continue; // Skip empty packs
+
+        // a pack may wrap around the end of the stream buffer
+        uint8_t *base = (uint8_t *) stream->virAddr;
+        uint32_t remSize = stream->streamSize - pack->offset;
+        if (remSize < pack->length)
         {
-            remSize = stream->streamSize - pack->offset;
-            data_ptr = (void *) ((char *) stream->virAddr
-                                 + ((remSize < pack->length) ? 0 : pack->offset));
-            data_len = (remSize < pack->length) ? remSize : pack->length;
+            buffer.insert(buffer.end(), base + pack->offset, base + pack->offset + remSize);
+            buffer.insert(buffer.end(), base, base + pack->length - remSize);
         }
         else
         {
-            continue; // Skip empty packs
+            buffer.insert(buffer.end(), base + pack->offset, base + pack->offset + pack->length);
         }
 #elif defined(PLATFORM_T10) || defined(PLATFORM_T20) || defined(PLATFORM_T21) \
     || defined(PLATFORM_T23) || defined(PLATFORM_T30)
-        data_ptr = reinterpret_cast<void *>(stream->pack[i].virAddr);
-        data_len = stream->pack[i].length;
-#endif
-
-        // Write data to file
-        ret = write(fd, data_ptr, data_len);
-        if (ret != static_cast<int>(data_len))
-        {
-            printf("Stream write error: %s\n", strerror(errno));
-            return -1; // Return error on write failure
-        }
-
-#if defined(PLATFORM_T31) || defined(PLATFORM_T40) || defined(PLATFORM_T41) || defined(PLATFORM_C100)
-        // Check the condition only under T31 platform, as remSize is used here
-        if (remSize && pack->length > remSize)
-        {
-            ret = write(fd, (void *) ((char *) stream->virAddr), pack->length - remSize);
-            if (ret != static_cast<int>(pack->length - remSize))
-            {
-                printf("Stream write error (remaining part): %s\n", strerror(errno));
-                return -1;
-            }
-        }
+        uint8_t *start = (uint8_t *) stream->pack[i].virAddr;
+        buffer.insert(buffer.end(), start, start + stream->pack[i].length);
 #endif
     }
-
-    return 0;
 }
 
 // Main processing loop, adapted from Worker::jpeg_grabber
@@ -83,8 +60,13 @@ void JPEGWorker::run()
     LOG_DEBUG("Start JPEG processing run loop for index " << jpgChn << " (IMP Encoder Channel "
                                                           << impEncChn << ")");
 
+    // only the main snapshot keeps encoding without requests
+    auto idle_fps = [this]() { return jpgChn == 0 ? global_jpeg[jpgChn]->stream->jpeg_idle_fps : 0; };
+
     // Initial target FPS based on idle setting
-    int targetFps = global_jpeg[jpgChn]->stream->jpeg_idle_fps;
+    int targetFps = idle_fps();
+
+    encoderPoll.attach(global_jpeg[jpgChn]->encChn);
 
     // Local stats counters
     uint32_t bps{0}; // Bytes per second
@@ -107,6 +89,9 @@ void JPEGWorker::run()
         */
         auto now = steady_clock::now();
 
+        // one consistent view of the config per pass
+        std::shared_ptr<const ConfigSnapshot> conf = cfg->snapshot();
+
         std::unique_lock lck(mutex_main);
         bool request_or_overrun = global_jpeg[jpgChn]->request_or_overrun();
         lck.unlock();
@@ -136,19 +121,17 @@ void JPEGWorker::run()
                 // subscriber is connected
                 if (request_or_overrun)
                 {
-                    if (targetFps != global_jpeg[jpgChn]->stream->fps)
-                        targetFps = global_jpeg[jpgChn]->stream->fps;
+                    if (targetFps != conf->stream2.fps)
+                        targetFps = conf->stream2.fps;
                 }
                 // no subscriber is connected
                 else
                 {
-                    if (targetFps != global_jpeg[jpgChn]->stream->jpeg_idle_fps)
-                        targetFps = global_jpeg[jpgChn]->stream->jpeg_idle_fps;
+                    if (targetFps != idle_fps())
+                        targetFps = idle_fps();
                 }
 
-                if (IMP_Encoder_PollingStream(global_jpeg[jpgChn]->encChn,
-                                              cfg->general.imp_polling_timeout)
-                    == 0)
+                if (encoderPoll.wait(conf->general.imp_polling_timeout))
                 {
                     IMPEncoderStream stream;
                     if (IMP_Encoder_GetStream(global_jpeg[jpgChn]->encChn,
@@ -159,39 +142,19 @@ void JPEGWorker::run()
                         fps++;
                         bps += stream.pack->length;
 
-                        //  Check for success
-                        const char *tempPath = "/tmp/snapshot.tmp"; // Temporary path
-                        const char *finalPath = global_jpeg[jpgChn]
-                                                    ->stream
-                                                    ->jpeg_path; // Final path for the JPEG snapshot
-
-                        // Open and create temporary file with read and write permissions
-                        int snap_fd = open(tempPath, O_RDWR | O_CREAT | O_TRUNC, 0666);
-                        if (snap_fd >= 0)
-                        {
-                            // Save the JPEG stream to the file
-                            save_jpeg_stream(snap_fd, &stream);
-
-                            // Close the temporary file after writing is done
-                            close(snap_fd);
-
-                            // Atomically move the temporary file to the final destination
-                            if (rename(tempPath, finalPath) != 0)
-                            {
-                                LOG_ERROR("Failed to move JPEG snapshot from " << tempPath << " to "
-                                                                               << finalPath);
-                                std::remove(
-                                    tempPath); // Attempt to remove the temporary file if rename fails
-                            }
-                            else
-                            {
-                                // LOG_DEBUG("JPEG snapshot successfully updated");
-                            }
-                        }
-                        else
-                        {
-                            LOG_ERROR("Failed to open JPEG snapshot for writing: " << tempPath);
-                        }
+                        std::vector<uint8_t> buffer;
+                        copy_jpeg_stream(&stream, buffer);
+
+                        // the main snapshot also goes to jpeg_path for scripts and the web ui
+                        if (jpgChn == 0)
+                            snapshot_file.write(global_jpeg[jpgChn]->stream->jpeg_path,
+                                                buffer.data() + LWS_PRE,
+                                                buffer.size() - LWS_PRE);
+
+                        global_snapshots->put(global_jpeg[jpgChn]->stream->width,
+                                              global_jpeg[jpgChn]->stream->height,
+                                              global_jpeg[jpgChn]->stream->jpeg_quality,
+                                              std::move(buffer));
 
                         IMP_Encoder_ReleaseStream(global_jpeg[jpgChn]->encChn,
                                                   &stream); // Release stream after saving
@@ -219,7 +182,12 @@ void JPEGWorker::run()
             }
             else
             {
-                usleep(1000);
+                // sleep until the next image is due instead of polling every millisecond,
+                // capped so a new request or fps change is still picked up quickly
+                long wait_ms = 1;
+                if (targetFps)
+                    wait_ms = std::clamp<long>(((1000 / targetFps) - targetFps / 10) - diff_last_image, 1, 100);
+                usleep(wait_ms * 1000);
             }
         }
         else
@@ -236,7 +204,7 @@ void JPEGWorker::run()
             while (!global_jpeg[jpgChn]->request_or_overrun() && !global_restart_video)
                 global_jpeg[jpgChn]->should_grab_frames.wait(lock_stream);
 
-            targetFps = global_jpeg[jpgChn]->stream->fps;
+            targetFps = cfg->snapshot()->stream2.fps;
 
             global_jpeg[jpgChn]->is_activated.release();
             global_jpeg[jpgChn]->active = true;
@@ -245,6 +213,7 @@ void JPEGWorker::run()
         }
     }
 
+    encoderPoll.detach();
     LOG_DEBUG("Exiting JPEG processing run loop for index " << jpgChn);
 }
 
@@ -257,25 +226,45 @@ void *JPEGWorker::thread_entry(void *arg)
     int jpgChn = sh->encChn - 2;
     int ret;
 
-    /* do not use the live config variable
-    */
-    global_jpeg[jpgChn]->streamChn = global_jpeg[jpgChn]->stream->jpeg_channel;
-
-    if (global_jpeg[jpgChn]->streamChn == 0)
+    if (jpgChn == 0)
     {
-        cfg->stream2.width = cfg->stream0.width;
-        cfg->stream2.height = cfg->stream0.height;
+        /* do not use the live config variable
+        */
+        global_jpeg[jpgChn]->streamChn = global_jpeg[jpgChn]->stream->jpeg_channel;
+
+        if (global_jpeg[jpgChn]->streamChn == 0)
+        {
+            cfg->stream2.width = cfg->stream0.width;
+            cfg->stream2.height = cfg->stream0.height;
+        }
+        else
+        {
+            cfg->stream2.width = cfg->stream1.width;
+            cfg->stream2.height = cfg->stream1.height;
+        }
     }
     else
     {
-        cfg->stream2.width = cfg->stream1.width;
-        cfg->stream2.height = cfg->stream1.height;
+        /* the thumbnail has the size of the other stream, it gets its own
+         * settings with what the JPEG encoder reads of stream2
+         */
+        global_jpeg[jpgChn]->streamChn = thumbnailSource();
+
+        _stream &source = (global_jpeg[jpgChn]->streamChn == 0) ? cfg->stream0 : cfg->stream1;
+        _stream &thumbnail = global_jpeg[jpgChn]->own_stream;
+        thumbnail.format = cfg->stream2.format;
+        thumbnail.profile = cfg->stream2.profile;
+        thumbnail.fps = cfg->stream2.fps;
+        thumbnail.width = source.width;
+        thumbnail.height = source.height;
+        thumbnail.jpeg_quality = cfg->stream2.jpeg_thumbnail_quality;
+        global_jpeg[jpgChn]->stream = &thumbnail;
     }
 
     global_jpeg[jpgChn]->imp_encoder = IMPEncoder::createNew(global_jpeg[jpgChn]->stream,
                                                              sh->encChn,
                                                              global_jpeg[jpgChn]->streamChn,
-                                                             "stream2");
+                                                             jpgChn == 0 ? "stream2" : "thumbnail");
 
     // inform main that initialization is complete
     sh->has_started.release();
@@ -300,3 +289,13 @@ void *JPEGWorker::thread_entry(void *arg)
 
     return 0;
 }
+
+int JPEGWorker::thumbnailSource()
+{
+    if (!cfg->stream2.enabled || !cfg->stream2.jpeg_thumbnail)
+        return -1;
+
+    int source = (cfg->stream2.jpeg_channel == 0) ? 1 : 0;
+    bool enabled = (source == 0) ? cfg->stream0.enabled : cfg->stream1.enabled;
+    return enabled ? source : -1;
+}
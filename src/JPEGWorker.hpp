@@ -1,7 +1,12 @@
 #ifndef JPEG_WORKER_HPP
 #define JPEG_WORKER_HPP
 
+#include "EncoderPoll.hpp"
 #include "IMPEncoder.hpp"
+#include "SnapshotFile.hpp"
+
+#include <cstdint>
+#include <vector>
 
 class JPEGWorker
 {
@@ -11,12 +16,20 @@ public:
 
     static void *thread_entry(void *arg);
 
+    /* Video stream the thumbnail channel encodes from, the one
+     * stream2.jpeg_channel does not use. -1 when stream2.jpeg_thumbnail is
+     * off or that stream is disabled.
+     */
+    static int thumbnailSource();
+
 private:
     void run();
-    int save_jpeg_stream(int fd, IMPEncoderStream *stream);
+    void copy_jpeg_stream(IMPEncoderStream *stream, std::vector<uint8_t> &buffer);
 
     int jpgChn;
     int impEncChn;
+    EncoderPoll encoderPoll;
+    SnapshotFile snapshot_file;
 };
 
 #endif // JPEG_PROCESSOR_HPP
@@ -0,0 +1,55 @@
+#include "JsonCache.hpp"
+
+#include "Config.hpp"
+
+WSMessagePtr WSMessage::createNew(const std::string &json)
+{
+    auto message = std::make_shared<WSMessage>();
+    message->buffer.reserve(LWS_PRE + json.size());
+    message->buffer.resize(LWS_PRE);
+    message->buffer.insert(message->buffer.end(), json.begin(), json.end());
+    return message;
+}
+
+void JsonCache::expire()
+{
+    uint32_t current = cfg->generation.load(std::memory_order_relaxed);
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count()
+                  / JSON_CACHE_TICK_MS;
+
+    if (current != generation || now != tick)
+    {
+        answers.clear();
+        generation = current;
+        tick = now;
+    }
+}
+
+WSMessagePtr JsonCache::get(const std::string &request)
+{
+    expire();
+
+    auto it = answers.find(request);
+    return it != answers.end() ? it->second : nullptr;
+}
+
+void JsonCache::put(const std::string &request, WSMessagePtr answer)
+{
+    // the config or the stats moved on while the answer was built
+    uint32_t builtGeneration = generation;
+    int64_t builtTick = tick;
+    expire();
+    if (generation != builtGeneration || tick != builtTick)
+        return;
+
+    if (answers.size() >= JSON_CACHE_MAX_ENTRIES)
+        answers.clear();
+    answers[request] = std::move(answer);
+}
+
+void JsonCache::clear()
+{
+    answers.clear();
+}
@@ -0,0 +1,63 @@
+#ifndef JSON_CACHE_HPP
+#define JSON_CACHE_HPP
+
+// Answers of websocket and /json queries, ready to send. A query is a request
+// that only reads: every value is null and nothing is under "action". Its
+// answer is kept with LWS_PRE bytes of headroom, keyed by the request text, so
+// dashboards polling the same query get the shared buffer without the request
+// being parsed and the answer built again.
+//
+// An answer is dropped when the configuration changes (CFG::generation, any
+// write request) and at the latest on the next stats tick, stream stats are
+// updated once a second.
+//
+// Only used from the lws service thread, nothing here is locked.
+
+#include <libwebsockets.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define JSON_CACHE_TICK_MS 1000
+// More distinct queries than this within a tick start over
+#define JSON_CACHE_MAX_ENTRIES 32
+
+// One websocket message ready to send, JSON text or a binary answer
+struct WSMessage
+{
+    std::vector<uint8_t> buffer;    // LWS_PRE, message
+    bool binary = false;
+
+    const uint8_t *data() const { return buffer.data() + LWS_PRE; }
+    size_t size() const { return buffer.size() - LWS_PRE; }
+
+    static std::shared_ptr<const WSMessage> createNew(const std::string &json);
+};
+
+using WSMessagePtr = std::shared_ptr<const WSMessage>;
+
+class JsonCache
+{
+public:
+    // Cached answer of the query, nullptr when there is none or it is stale
+    WSMessagePtr get(const std::string &request);
+    // Follows the get() of the same request, the answer built in between
+    void put(const std::string &request, WSMessagePtr answer);
+
+    // A request changed something, no answer can be trusted anymore
+    void clear();
+
+private:
+    // Drops everything when the config generation or the tick moved on
+    void expire();
+
+    std::unordered_map<std::string, WSMessagePtr> answers;
+    uint32_t generation = 0;
+    int64_t tick = -1;
+};
+
+#endif // JSON_CACHE_HPP
@@ -4,6 +4,7 @@
 #include <cstring>
 #include <sstream>
 #include <mutex>
+#include <string_view>
 #include "Config.hpp"
 
 #define FILENAME (strrchr("/" __FILE__, '/') + 1)
@@ -57,6 +58,19 @@ struct LogMsg
         return *this;
     }
 
+    LogMsg &operator<<(const char *a)
+    {
+        log_str.append(a ? a : "(null)");
+        return *this;
+    }
+
+    // config keys are string_views into the item table
+    LogMsg &operator<<(std::string_view a)
+    {
+        log_str.append(a);
+        return *this;
+    }
+
     LogMsg &operator<<(int a)
     {
         std::stringstream ss;
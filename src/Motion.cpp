@@ -1,7 +1,10 @@
 #include "Motion.hpp"
+#include "DVR.hpp"
+#include "EventBus.hpp"
+
+#include <algorithm>
 
 using namespace std::chrono;
-bool ignoreInitialPeriod = true;
 
 std::string Motion::getConfigPath(const char *itemName)
 {
@@ -12,137 +15,182 @@ void Motion::detect()
 {
     LOG_INFO("Start motion detection thread.");
 
-    int ret;
-    int debounce = 0;
-    IMP_IVS_MoveOutput *result;
-    bool isInCooldown = false;
-    auto cooldownEndTime = steady_clock::now();
-    auto motionEndTime = steady_clock::now();
-    auto startTime = steady_clock::now();
+    software = strcmp(cfg->motion.engine, "software") == 0;
+    debounce = 0;
+    ignoreInitialPeriod = true;
+    isInCooldown = false;
+    startTime = steady_clock::now();
+    cooldownEndTime = startTime;
+    motionEndTime = startTime;
 
     if(init() != 0) return;
 
     global_motion_thread_signal = true;
     while (global_motion_thread_signal)
     {
+        if (software)
+            pollSoftware();
+        else
+            pollIvs();
+    }
 
-        ret = IMP_IVS_PollingResult(ivsChn, cfg->motion.ivs_polling_timeout);
-        if (ret < 0)
-        {
-            LOG_WARN("IMP_IVS_PollingResult error: " << ret);
-            continue;
-        }
+    exit();
 
-        ret = IMP_IVS_GetResult(ivsChn, (void **)&result);
-        if (ret < 0)
-        {
-            LOG_WARN("IMP_IVS_GetResult error: " << ret);
-            continue;
-        }
+    LOG_DEBUG("Exit motion detect thread.");
+}
 
-        auto currentTime = steady_clock::now();
-        auto elapsedTime = duration_cast<seconds>(currentTime - startTime);
+void Motion::pollIvs()
+{
+    int ret;
+    IMP_IVS_MoveOutput *result;
 
-        if (ignoreInitialPeriod && elapsedTime.count() < cfg->motion.init_time)
-        {
-            continue;
-        }
-        else
-        {
-            ignoreInitialPeriod = false;
-        }
+    ret = IMP_IVS_PollingResult(ivsChn, cfg->motion.ivs_polling_timeout);
+    if (ret < 0)
+    {
+        LOG_WARN("IMP_IVS_PollingResult error: " << ret);
+        return;
+    }
 
-        if (isInCooldown && duration_cast<seconds>(currentTime - cooldownEndTime).count() < cfg->motion.cooldown_time)
-        {
-            continue;
-        }
-        else
+    ret = IMP_IVS_GetResult(ivsChn, (void **)&result);
+    if (ret < 0)
+    {
+        LOG_WARN("IMP_IVS_GetResult error: " << ret);
+        return;
+    }
+
+    int activeRegions = 0;
+    for (int i = 0; i < IMP_IVS_MOVE_MAX_ROI_CNT; i++)
+    {
+        if (result->retRoi[i])
         {
-            isInCooldown = false;
+            LOG_INFO("Active motion detected in region " << i);
+            activeRegions++;
         }
+    }
+
+    ret = IMP_IVS_ReleaseResult(ivsChn, (void *)result);
+    if (ret < 0)
+    {
+        LOG_WARN("IMP_IVS_ReleaseResult error: " << ret);
+    }
 
-        bool motionDetected = false;
-        for (int i = 0; i < IMP_IVS_MOVE_MAX_ROI_CNT; i++)
+    update(activeRegions);
+}
+
+void Motion::pollSoftware()
+{
+    auto frameStart = steady_clock::now();
+
+    IMPFrameInfo frameInfo;
+    int ret = IMP_FrameSource_SnapFrame(cfg->motion.monitor_stream, PIX_FMT_NV12, frameWidth, frameHeight,
+                                        frameBuffer.data(), &frameInfo);
+    int activeCells = 0;
+    if (ret < 0)
+    {
+        LOG_WARN("IMP_FrameSource_SnapFrame error: " << ret);
+    }
+    else
+    {
+        // NV12, the luma plane comes first
+        activeCells = grid.process(frameBuffer.data(), cfg->motion.cell_threshold);
         {
-            if (result->retRoi[i])
-            {
-                motionDetected = true;
-                LOG_INFO("Active motion detected in region " << i);
-                debounce++;
-                if (debounce >= cfg->motion.debounce_time)
-                {
-                    if (!moving.load())
-                    {
-                        moving = true;
-                        LOG_INFO("Motion Start");
-
-                        char cmd[128];
-                        memset(cmd, 0, sizeof(cmd));
-                        snprintf(cmd, sizeof(cmd), "%s start", cfg->motion.script_path);
-                        ret = system(cmd);
-                        if (ret != 0)
-                        {
-                            LOG_ERROR("Motion script failed:" << cmd);
-                        }
-                    }
-                    indicator = true;
-                    motionEndTime = steady_clock::now(); // Update last motion time
-                }
-            }
+            std::lock_guard lock(heatmapMutex);
+            heatmapCells = grid.heatmap();
         }
+        if (activeCells)
+            LOG_DEBUG("Active motion detected in " << activeCells << " cells");
+        update(activeCells >= cfg->motion.min_cells ? activeCells : 0);
+    }
+
+    // Stay at analysis_fps, slow down when a frame takes more than
+    // max_cpu_percent of the interval
+    auto busy = steady_clock::now() - frameStart;
+    auto interval = duration_cast<steady_clock::duration>(milliseconds(1000 / cfg->motion.analysis_fps));
+    auto budget = busy * 100 / cfg->motion.max_cpu_percent;
+    auto wait = std::max(interval, budget) - busy;
+    if (wait > steady_clock::duration::zero())
+        std::this_thread::sleep_for(wait);
+}
+
+void Motion::update(int activity)
+{
+    auto currentTime = steady_clock::now();
+    auto elapsedTime = duration_cast<seconds>(currentTime - startTime);
+
+    if (ignoreInitialPeriod && elapsedTime.count() < cfg->motion.init_time)
+    {
+        return;
+    }
+    else
+    {
+        ignoreInitialPeriod = false;
+    }
+
+    if (isInCooldown && duration_cast<seconds>(currentTime - cooldownEndTime).count() < cfg->motion.cooldown_time)
+    {
+        return;
+    }
+    else
+    {
+        isInCooldown = false;
+    }
 
-        if (!motionDetected)
+    if (activity)
+    {
+        debounce += activity;
+        if (debounce >= cfg->motion.debounce_time)
         {
-            debounce = 0;
-            auto duration = duration_cast<seconds>(currentTime - motionEndTime).count();
-            if (moving && duration >= cfg->motion.min_time && duration >= cfg->motion.post_time)
+            if (!moving.load())
             {
-                LOG_INFO("End of Motion");
-                char cmd[128];
-                memset(cmd, 0, sizeof(cmd));
-                snprintf(cmd, sizeof(cmd), "%s stop", cfg->motion.script_path);
-                ret = system(cmd);
-                if (ret != 0)
-                {
-                    LOG_ERROR("Motion script failed:" << cmd);
-                }
-                moving = false;
-                indicator = false;
-                cooldownEndTime = steady_clock::now(); // Start cooldown
-                isInCooldown = true;
+                moving = true;
+                LOG_INFO("Motion Start");
+                // the script runs from the event bus, not in this loop
+                global_events->motion(true, activity);
             }
+            indicator = true;
+            motionEndTime = steady_clock::now(); // Update last motion time
+            // start a pre-roll clip or extend its post-roll
+            global_dvr->trigger("motion");
         }
-
-        ret = IMP_IVS_ReleaseResult(ivsChn, (void *)result);
-        if (ret < 0)
+    }
+    else
+    {
+        debounce = 0;
+        auto duration = duration_cast<seconds>(currentTime - motionEndTime).count();
+        if (moving && duration >= cfg->motion.min_time && duration >= cfg->motion.post_time)
         {
-            LOG_WARN("IMP_IVS_ReleaseResult error: " << ret);
-            continue;
+            LOG_INFO("End of Motion");
+            global_events->motion(false, 0);
+            moving = false;
+            indicator = false;
+            cooldownEndTime = steady_clock::now(); // Start cooldown
+            isInCooldown = true;
         }
     }
-
-    exit();
-
-    LOG_DEBUG("Exit motion detect thread.");
 }
 
-int Motion::init()
+std::string Motion::heatmap(int &cols, int &rows)
 {
-    LOG_INFO("Initialize motion detection.");
+    static const char hex[] = "0123456789abcdef";
 
-    if((cfg->motion.monitor_stream == 0 && !cfg->stream0.enabled) ||
-       (cfg->motion.monitor_stream == 1 && !cfg->stream1.enabled)) {
+    std::lock_guard lock(heatmapMutex);
+    cols = heatmapCols;
+    rows = heatmapRows;
 
-        LOG_ERROR("Monitor stream is disabled, abort.");
-        return -1;
+    std::string out;
+    out.reserve(heatmapCells.size() * 2);
+    for (uint8_t v : heatmapCells)
+    {
+        out.push_back(hex[v >> 4]);
+        out.push_back(hex[v & 0x0f]);
     }
-    int ret;
-
-    ret = IMP_IVS_CreateGroup(0);
-    LOG_DEBUG_OR_ERROR_AND_EXIT(ret, "IMP_IVS_CreateGroup(0)");
+    return out;
+}
 
+bool Motion::setFrameSize()
+{
     //automatically set frame size / height
-    ret = IMP_Encoder_GetChnAttr(cfg->motion.monitor_stream, &channelAttributes);
+    int ret = IMP_Encoder_GetChnAttr(cfg->motion.monitor_stream, &channelAttributes);
     if (ret == 0)
     {
         if (cfg->motion.frame_width == IVS_AUTO_VALUE)
@@ -162,6 +210,89 @@ int Motion::init()
             cfg->set<int>(getConfigPath("roi_1_y"), channelAttributes.encAttr.picHeight - 1, true);
         }
     }
+    return ret == 0;
+}
+
+int Motion::init()
+{
+    LOG_INFO("Initialize motion detection (" << cfg->motion.engine << ").");
+
+    if((cfg->motion.monitor_stream == 0 && !cfg->stream0.enabled) ||
+       (cfg->motion.monitor_stream == 1 && !cfg->stream1.enabled)) {
+
+        LOG_ERROR("Monitor stream is disabled, abort.");
+        return -1;
+    }
+
+    setFrameSize();
+
+    return software ? initSoftware() : initIvs();
+}
+
+int Motion::exit()
+{
+    LOG_DEBUG("Exit motion detection.");
+
+    return software ? exitSoftware() : exitIvs();
+}
+
+int Motion::initSoftware()
+{
+    int ret;
+
+    frameWidth = cfg->motion.frame_width;
+    frameHeight = cfg->motion.frame_height;
+    if (frameWidth == IVS_AUTO_VALUE || frameHeight == IVS_AUTO_VALUE)
+    {
+        LOG_ERROR("Unknown size of the monitor stream, abort.");
+        return -1;
+    }
+
+    // SnapFrame takes the frame from the channel queue
+    ret = IMP_FrameSource_SetFrameDepth(cfg->motion.monitor_stream, 1);
+    LOG_DEBUG_OR_ERROR_AND_EXIT(ret, "IMP_FrameSource_SetFrameDepth(" << cfg->motion.monitor_stream << ", 1)");
+
+    frameBuffer.resize(frameWidth * frameHeight * 3 / 2);
+    grid.configure(frameWidth, frameHeight, frameWidth, cfg->motion.grid_cols, cfg->motion.grid_rows);
+
+    {
+        std::lock_guard lock(heatmapMutex);
+        heatmapCols = grid.columns();
+        heatmapRows = grid.rows();
+        heatmapCells.assign(heatmapCols * heatmapRows, 0);
+    }
+
+    LOG_INFO("Motion detection:" <<
+             " grid: " << grid.columns() << "x" << grid.rows() <<
+             ", fps:" << cfg->motion.analysis_fps <<
+             ", threshold:" << cfg->motion.cell_threshold <<
+             ", width:" << frameWidth <<
+             ", height:" << frameHeight);
+
+    return 0;
+}
+
+int Motion::exitSoftware()
+{
+    {
+        std::lock_guard lock(heatmapMutex);
+        heatmapCols = 0;
+        heatmapRows = 0;
+        heatmapCells.clear();
+    }
+
+    int ret = IMP_FrameSource_SetFrameDepth(cfg->motion.monitor_stream, 0);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_FrameSource_SetFrameDepth(" << cfg->motion.monitor_stream << ", 0)");
+
+    return ret;
+}
+
+int Motion::initIvs()
+{
+    int ret;
+
+    ret = IMP_IVS_CreateGroup(0);
+    LOG_DEBUG_OR_ERROR_AND_EXIT(ret, "IMP_IVS_CreateGroup(0)");
 
     memset(&move_param, 0, sizeof(IMP_IVS_MoveParam));
     // OSD is affecting motion for some reason.
@@ -218,12 +349,10 @@ int Motion::init()
     return ret;
 }
 
-int Motion::exit()
+int Motion::exitIvs()
 {
     int ret;
 
-    LOG_DEBUG("Exit motion detection.");
-
     ret = IMP_IVS_StopRecvPic(ivsChn);
     LOG_DEBUG_OR_ERROR(ret, "IMP_IVS_StopRecvPic(0)");
 
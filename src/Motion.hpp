@@ -1,15 +1,20 @@
 #ifndef Motion_hpp
 #define Motion_hpp
 
+#include <chrono>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <atomic>
+#include <vector>
 #include "Config.hpp"
 #include "Logger.hpp"
 #include "globals.hpp"
 #include "imp/imp_system.h"
 #include "imp/imp_ivs.h"
 #include "imp/imp_ivs_move.h"
+#include "imp/imp_framesource.h"
+#include "MotionGrid.hpp"
 
 #if defined(PLATFORM_T31) || defined(PLATFORM_C100) || defined(PLATFORM_T40) || defined(PLATFORM_T41)
 #define IMPEncoderCHNAttr IMPEncoderChnAttr
@@ -28,11 +33,47 @@ class Motion {
         int init();
         int exit();
 
+        // Latest heatmap of the software engine as hex, two digits per cell
+        // row by row, empty while the engine is not running
+        static std::string heatmap(int &cols, int &rows);
+
     private:
         int ivsChn = 0;
         int ivsGrp = 0;
 
         std::string getConfigPath(const char *itemName);
+        bool setFrameSize();
+
+        // IVS engine: move interface on the bound framesource
+        int initIvs();
+        void pollIvs();
+        int exitIvs();
+
+        // Software engine: snapshots of the monitor stream, see MotionGrid
+        int initSoftware();
+        void pollSoftware();
+        int exitSoftware();
+
+        // Shared start/stop logic, activity = active regions or cells
+        void update(int activity);
+
+        bool software = false;
+        int debounce = 0;
+        bool ignoreInitialPeriod = true;
+        bool isInCooldown = false;
+        std::chrono::steady_clock::time_point startTime;
+        std::chrono::steady_clock::time_point cooldownEndTime;
+        std::chrono::steady_clock::time_point motionEndTime;
+
+        MotionGrid grid;
+        std::vector<uint8_t> frameBuffer;
+        int frameWidth = 0;
+        int frameHeight = 0;
+
+        inline static std::mutex heatmapMutex;
+        inline static std::vector<uint8_t> heatmapCells;
+        inline static int heatmapCols = 0;
+        inline static int heatmapRows = 0;
 
         std::atomic<bool> moving;
         std::atomic<bool> indicator;
@@ -0,0 +1,99 @@
+#include "MotionGrid.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+// Background follows the scene by 1/16 of the difference per analyzed frame
+#define MOTION_GRID_LEARN_SHIFT 4
+
+void MotionGrid::configure(int width, int height, int stride, int cols, int rows)
+{
+    this->stride = stride;
+
+    step = std::max(1, (width + MOTION_GRID_MAX_WIDTH - 1) / MOTION_GRID_MAX_WIDTH);
+    smallWidth = std::max(1, width / step);
+    smallHeight = std::max(1, height / step);
+    this->cols = std::clamp(cols, 1, smallWidth);
+    gridRows = std::clamp(rows, 1, smallHeight);
+
+    background.assign(smallWidth * smallHeight, 0);
+    sample.assign(smallWidth, 0);
+    diff.assign(smallWidth, 0);
+    haveBackground = false;
+
+    cellEnd.resize(this->cols);
+    for (int c = 0; c < this->cols; c++)
+        cellEnd[c] = (c + 1) * smallWidth / this->cols;
+
+    size_t count = this->cols * gridRows;
+    sad.assign(count, 0);
+    cells.assign(count, 0);
+    area.assign(count, 0);
+    for (int y = 0; y < smallHeight; y++)
+    {
+        int r = y * gridRows / smallHeight;
+        int x = 0;
+        for (int c = 0; c < this->cols; c++)
+        {
+            area[r * this->cols + c] += cellEnd[c] - x;
+            x = cellEnd[c];
+        }
+    }
+}
+
+int MotionGrid::process(const uint8_t *luma, int threshold)
+{
+    std::fill(sad.begin(), sad.end(), 0);
+
+    for (int y = 0; y < smallHeight; y++)
+    {
+        const uint8_t *src = luma + static_cast<size_t>(y) * step * stride;
+        uint16_t *bg = &background[y * smallWidth];
+
+        for (int x = 0; x < smallWidth; x++)
+            sample[x] = src[x * step];
+
+        if (!haveBackground)
+        {
+            for (int x = 0; x < smallWidth; x++)
+                bg[x] = sample[x] << 4;
+            continue;
+        }
+
+        // Plain loops over contiguous rows, left for the compiler to vectorize
+        for (int x = 0; x < smallWidth; x++)
+        {
+            int d = (sample[x] << 4) - bg[x];
+            diff[x] = std::abs(d) >> 4;
+            bg[x] += d >> MOTION_GRID_LEARN_SHIFT;
+        }
+
+        uint32_t *rowSad = &sad[(y * gridRows / smallHeight) * cols];
+        int x = 0;
+        for (int c = 0; c < cols; c++)
+        {
+            uint32_t sum = 0;
+            for (; x < cellEnd[c]; x++)
+                sum += diff[x];
+            rowSad[c] += sum;
+        }
+    }
+
+    if (!haveBackground)
+    {
+        haveBackground = true;
+        std::fill(cells.begin(), cells.end(), 0);
+        return 0;
+    }
+
+    int active = 0;
+    for (size_t i = 0; i < cells.size(); i++)
+    {
+        uint32_t mean = area[i] ? sad[i] / area[i] : 0;
+        cells[i] = std::min<uint32_t>(mean, 255);
+        if (static_cast<int>(mean) >= threshold)
+            active++;
+    }
+
+    return active;
+}
@@ -0,0 +1,50 @@
+#ifndef MOTION_GRID_HPP
+#define MOTION_GRID_HPP
+
+// Software motion detection on the luma plane of a frame. The frame is
+// subsampled to at most MOTION_GRID_MAX_WIDTH pixels per row, compared with a
+// slowly adapting background and the absolute differences are summed per cell
+// of a cols x rows grid. The mean difference of every cell (0-255) forms the
+// heatmap, cells at or above the threshold count as active.
+//
+// No SDK dependencies: frames come as plain 8 bit luma rows, so recorded
+// YUV files can be fed on the build host.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define MOTION_GRID_MAX_WIDTH 160
+
+class MotionGrid
+{
+public:
+    // Resets the background, the next frame only initializes it
+    void configure(int width, int height, int stride, int cols, int rows);
+
+    // Returns the number of active cells, 0 for the first frame
+    int process(const uint8_t *luma, int threshold);
+
+    const std::vector<uint8_t> &heatmap() const { return cells; }
+    int columns() const { return cols; }
+    int rows() const { return gridRows; }
+
+private:
+    int stride = 0;
+    int step = 1;
+    int cols = 0;
+    int gridRows = 0;
+    int smallWidth = 0;
+    int smallHeight = 0;
+    bool haveBackground = false;
+
+    std::vector<uint16_t> background;   // 8.4 fixed point
+    std::vector<uint8_t> sample;        // one subsampled row
+    std::vector<uint8_t> diff;          // its absolute difference
+    std::vector<uint16_t> cellEnd;      // last column + 1 of every grid column
+    std::vector<uint32_t> sad;
+    std::vector<uint32_t> area;
+    std::vector<uint8_t> cells;
+};
+
+#endif // MOTION_GRID_HPP
@@ -824,43 +824,46 @@ void OSD::updateDisplayEverySecond()
         // this should relieve the system
         if (flag != 0)
         {
+            // formats and positions from one snapshot, the stats are live
+            std::shared_ptr<const ConfigSnapshot> conf = cfg->snapshot();
+            const _osd &settings = conf->stream(encChn).osd;
 
             // Format and update system time
-            if ((flag & 1) && osd.time_enabled)
+            if ((flag & 1) && settings.time_enabled)
             {
-                strftime(timeFormatted, sizeof(timeFormatted), osd.time_format, ltime);
+                strftime(timeFormatted, sizeof(timeFormatted), settings.time_format, ltime);
 
                 set_text(&osdTime, nullptr, timeFormatted,
-                         osd.pos_time_x, osd.pos_time_y, osd.time_rotation,
-                         osd.time_font_color, osd.time_font_stroke_color);
+                         settings.pos_time_x, settings.pos_time_y, settings.time_rotation,
+                         settings.time_font_color, settings.time_font_stroke_color);
 
                 flag ^= 1;
                 return;
             }
 
             // Format and update user text
-            if ((flag & 2) && osd.user_text_enabled)
+            if ((flag & 2) && settings.user_text_enabled)
             {
-                std::string user_text = osd.user_text_format;
+                std::string user_text = settings.user_text_format;
 
-                if (strstr(osd.user_text_format, "%hostname") != nullptr)
+                if (strstr(settings.user_text_format, "%hostname") != nullptr)
                 {
                     replace(user_text, "%hostname", hostname);
                 }
 
-                if (strstr(osd.user_text_format, "%ipaddress") != nullptr)
+                if (strstr(settings.user_text_format, "%ipaddress") != nullptr)
                 {
                     replace(user_text, "%ipaddress", ip);
                 }
 
-                if (strstr(osd.user_text_format, "%fps") != nullptr)
+                if (strstr(settings.user_text_format, "%fps") != nullptr)
                 {
                     char fps[4];
                     snprintf(fps, 4, "%3d", osd.stats.fps);
                     replace(user_text, "%fps", fps);
                 }
 
-                if (strstr(osd.user_text_format, "%bps") != nullptr)
+                if (strstr(settings.user_text_format, "%bps") != nullptr)
                 {
                     char bps[8];
                     snprintf(bps, 8, "%5d", osd.stats.bps);
@@ -868,8 +871,8 @@ void OSD::updateDisplayEverySecond()
                 }
 
                 set_text(&osdUser, nullptr, user_text.c_str(),
-                         osd.pos_user_text_x, osd.pos_user_text_y, osd.user_text_rotation,
-                         osd.user_text_font_color, osd.user_text_font_stroke_color);
+                         settings.pos_user_text_x, settings.pos_user_text_y, settings.user_text_rotation,
+                         settings.user_text_font_color, settings.user_text_font_stroke_color);
 
                 user_text.clear();
 
@@ -878,7 +881,7 @@ void OSD::updateDisplayEverySecond()
             }
 
             // Format and update uptime
-            if ((flag & 4) && osd.uptime_enabled)
+            if ((flag & 4) && settings.uptime_enabled)
             {
                 unsigned long currentUptime = getSystemUptime();
                 unsigned long days = currentUptime / 86400;
@@ -886,11 +889,11 @@ void OSD::updateDisplayEverySecond()
                 unsigned long minutes = (currentUptime % 3600) / 60;
                 //unsigned long seconds = currentUptime % 60;
 
-                snprintf(uptimeFormatted, sizeof(uptimeFormatted), osd.uptime_format, days, hours, minutes);
+                snprintf(uptimeFormatted, sizeof(uptimeFormatted), settings.uptime_format, days, hours, minutes);
 
                 set_text(&osdUptm, nullptr, uptimeFormatted,
-                         osd.pos_uptime_x, osd.pos_uptime_y, osd.uptime_rotation,
-                         osd.uptime_font_color, osd.uptime_font_stroke_color);
+                         settings.pos_uptime_x, settings.pos_uptime_y, settings.uptime_rotation,
+                         settings.uptime_font_color, settings.uptime_font_stroke_color);
 
                 flag ^= 4;
                 return;
@@ -899,41 +902,44 @@ void OSD::updateDisplayEverySecond()
     }
 }
 
-void *OSD::thread_entry(void *arg) {
-    LOG_DEBUG("start osd update thread.");
+void OSD::relayout()
+{
+    // set_text() only positions a region when its size changes
+    osdTime.width = 0;
+    osdUser.width = 0;
+    osdUptm.width = 0;
+    flag |= 7;
+}
 
-    global_osd_thread_signal = true;
-    while (global_osd_thread_signal) {
-        for (auto v : global_video)
+void OSD::tick()
+{
+    for (auto v : global_video)
+    {
+        if (v != nullptr)
         {
-            if (v != nullptr)
+            // a lazy stream creates and tears down its encoder while running
+            std::lock_guard<std::mutex> lock_encoder{v->encoder_lock};
+            if (v->active && v->imp_encoder)
             {
-                if (v->active)
+                if ((v->imp_encoder->osd != nullptr))
                 {
-                    if ((v->imp_encoder->osd != nullptr))
+                    if (v->imp_encoder->osd->is_started)
                     {
-                        if (v->imp_encoder->osd->is_started)
+                        v->imp_encoder->osd->updateDisplayEverySecond();
+                    }
+                    else
+                    {
+                        if (v->imp_encoder->osd->startup_delay)
                         {
-                            v->imp_encoder->osd->updateDisplayEverySecond();
+                            v->imp_encoder->osd->startup_delay--;
                         }
                         else
                         {
-                            if (v->imp_encoder->osd->startup_delay)
-                            {
-                                v->imp_encoder->osd->startup_delay--;
-                            }
-                            else
-                            {
-                                v->imp_encoder->osd->start();
-                            }
+                            v->imp_encoder->osd->start();
                         }
                     }
                 }
             }
         }
-        usleep(THREAD_SLEEP);
     }
-
-    LOG_DEBUG("exit osd update thread.");
-    return 0;
 }
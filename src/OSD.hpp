@@ -50,7 +50,10 @@ public:
     int start();
 
     void updateDisplayEverySecond();
-    static void *thread_entry(void *arg);
+    // Apply changed text positions with the next update
+    void relayout();
+    // One update of all running OSDs, called every THREAD_SLEEP from global_imp_reactor
+    static void tick();
 
     void rotateBGRAImage(uint8_t *&inputImage, uint16_t &width, uint16_t &height, int angle, bool del);
     static void set_pos(IMPOSDRgnAttr *rgnAttr, int x, int y, uint16_t width, uint16_t height, const uint16_t max_width, const uint16_t max_height);
@@ -2,8 +2,14 @@
 #include "Logger.hpp"
 #include "Opus.hpp"
 #include <atomic>
+#include <chrono>
 #include "RTSPStatus.hpp"
 
+// Frames per complexity decision (1s of 20ms frames)
+#define OPUS_ADAPT_WINDOW 50
+// Step down if more than this many frames of a window exceed the budget
+#define OPUS_ADAPT_MAX_OVER 5
+
 namespace { std::atomic<uint32_t> g_opusMismatches{0}; }
 
 Opus* Opus::createNew(int sampleRate, int numChn)
@@ -35,8 +41,16 @@ int Opus::open()
         LOG_ERROR("Failed to set bitrate (" << bitrate << ") for Opus encoder: " << opus_strerror(opusError));
     }
 
-    // Highest complexity for quality (CPU usage is negligible at 1ch/48k on this SoC)
-    opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(10));
+    // Start at the configured (default highest) complexity, adaptComplexity()
+    // lowers it if the SoC can't keep up
+    maxComplexity = cfg->audio.opus_complexity;
+    complexity = maxComplexity;
+    budgetUs = cfg->audio.opus_encode_budget_us;
+    windowFrames = 0;
+    overBudgetFrames = 0;
+    windowMaxUs = 0;
+    opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(complexity));
+    RTSPStatus::writeCustomParameter("audio0", "opus_complexity", std::to_string(complexity));
     // Make VBR explicit (better quality at target rate)
     opus_encoder_ctl(encoder, OPUS_SET_VBR(1));
     // Hint fullband capability
@@ -104,6 +118,8 @@ int Opus::encode(IMPAudioFrame *data, unsigned char *outbuf, int *outLen)
         }
     }
 
+    auto encodeStart = std::chrono::steady_clock::now();
+
     opus_int32 bytesEncoded = opus_encode(
         encoder,
         reinterpret_cast<const opus_int16*>(data->virAddr),
@@ -111,6 +127,9 @@ int Opus::encode(IMPAudioFrame *data, unsigned char *outbuf, int *outLen)
         reinterpret_cast<unsigned char*>(outbuf),
         1024);
 
+    adaptComplexity(std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - encodeStart).count());
+
     if (bytesEncoded < 0)
     {
         LOG_WARN("Encoding failed with error code: " << bytesEncoded);
@@ -121,3 +140,42 @@ int Opus::encode(IMPAudioFrame *data, unsigned char *outbuf, int *outLen)
 
     return 0;
 }
+
+void Opus::adaptComplexity(int64_t encodeUs)
+{
+    if (budgetUs <= 0)
+        return;
+
+    windowFrames++;
+    if (encodeUs > budgetUs)
+        overBudgetFrames++;
+    if (encodeUs > windowMaxUs)
+        windowMaxUs = encodeUs;
+
+    if (windowFrames < OPUS_ADAPT_WINDOW)
+        return;
+
+    int next = complexity;
+    if (overBudgetFrames > OPUS_ADAPT_MAX_OVER && complexity > 0)
+    {
+        next = complexity - 1;
+    }
+    else if (overBudgetFrames == 0 && windowMaxUs < budgetUs / 2 && complexity < maxComplexity)
+    {
+        // Plenty of headroom for a whole window, try one step up again
+        next = complexity + 1;
+    }
+
+    if (next != complexity)
+    {
+        LOG_INFO("Opus complexity " << complexity << " -> " << next << " (" << overBudgetFrames
+                 << "/" << windowFrames << " frames over " << budgetUs << "us, max " << windowMaxUs << "us)");
+        complexity = next;
+        opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(complexity));
+        RTSPStatus::writeCustomParameter("audio0", "opus_complexity", std::to_string(complexity));
+    }
+
+    windowFrames = 0;
+    overBudgetFrames = 0;
+    windowMaxUs = 0;
+}
@@ -3,6 +3,7 @@
 
 #include "IMPAudio.hpp"
 #include <opus/opus.h>
+#include <cstdint>
 
 class Opus : public IMPAudioEncoder
 {
@@ -20,9 +21,19 @@ public:
     int close() override;
 
 private:
+    void adaptComplexity(int64_t encodeUs);
+
     int sampleRate;
     int numChn;
     OpusEncoder* encoder;
+
+    // Complexity steps down while encoding exceeds the per frame budget
+    int complexity = 10;
+    int maxComplexity = 10;
+    int budgetUs = 0;
+    int windowFrames = 0;
+    int overBudgetFrames = 0;
+    int64_t windowMaxUs = 0;
 };
 
 #endif // OPUS_ENCODER_HPP
@@ -117,8 +117,7 @@ void RTSP::addSubsession(int chnNr, _stream &stream)
     streamInfo.mode = stream.mode;
     streamInfo.enabled = stream.enabled;
 
-    std::string streamName = "stream" + std::to_string(chnNr);
-    RTSPStatus::updateStreamStatus(streamName, streamInfo);
+    RTSPStatus::updateStreamStatus(CFG::streamName(chnNr), streamInfo);
 
     delete[] url; // Free the URL string allocated by rtspURL()
 }
@@ -176,14 +175,11 @@ void RTSP::start()
     }
 #endif
 
-    if (cfg->stream0.enabled)
+    // a derived stream without its source was not started by main
+    for (int chn = 0; chn < MAX_VIDEO_STREAMS; chn++)
     {
-        addSubsession(0, cfg->stream0);
-    }
-
-    if (cfg->stream1.enabled)
-    {
-        addSubsession(1, cfg->stream1);
+        if (cfg->streams[chn].enabled && global_video[chn]->running)
+            addSubsession(chn, cfg->streams[chn]);
     }
 
     global_rtsp_thread_signal = 0;
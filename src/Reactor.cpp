@@ -0,0 +1,272 @@
+#include "Reactor.hpp"
+
+#include "Logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#define MODULE "REACTOR"
+
+#define REACTOR_MAX_EVENTS 16
+
+static void set_timerfd(int fd, int delayMs, int intervalMs)
+{
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = delayMs / 1000;
+    spec.it_value.tv_nsec = static_cast<long>(delayMs % 1000) * 1000000;
+    spec.it_interval.tv_sec = intervalMs / 1000;
+    spec.it_interval.tv_nsec = static_cast<long>(intervalMs % 1000) * 1000000;
+    if (timerfd_settime(fd, 0, &spec, nullptr) != 0)
+        LOG_ERROR("timerfd_settime() failed: " << strerror(errno));
+}
+
+Reactor::Reactor()
+    : epollFd(-1)
+    , wakeFd(-1)
+    , running(false)
+    , thread()
+    , nextId(1)
+{
+    ready.reserve(REACTOR_MAX_EVENTS);
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0)
+        LOG_ERROR("epoll_create1() failed: " << strerror(errno));
+
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wakeFd < 0)
+        LOG_ERROR("eventfd() failed: " << strerror(errno));
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u32 = 0;
+    if (epollFd >= 0 && wakeFd >= 0 && epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev) != 0)
+        LOG_ERROR("epoll_ctl(wake) failed: " << strerror(errno));
+}
+
+Reactor::~Reactor()
+{
+    for (auto &entry : sources)
+    {
+        if (entry.second->ownsFd)
+            ::close(entry.second->fd);
+    }
+    if (wakeFd >= 0)
+        ::close(wakeFd);
+    if (epollFd >= 0)
+        ::close(epollFd);
+}
+
+int Reactor::add(int fd, bool ownsFd, uint32_t events, Priority priority, Callback callback)
+{
+    auto source = std::make_shared<Source>();
+    source->fd = fd;
+    source->ownsFd = ownsFd;
+    source->priority = priority;
+    source->callback = std::move(callback);
+
+    int id;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        id = nextId++;
+        sources[id] = source;
+    }
+
+    struct epoll_event ev = {};
+    ev.events = events;
+    ev.data.u32 = static_cast<uint32_t>(id);
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) != 0)
+    {
+        LOG_ERROR("epoll_ctl(" << fd << ") failed: " << strerror(errno));
+        std::lock_guard<std::mutex> lock(mutex);
+        sources.erase(id);
+        if (ownsFd)
+            ::close(fd);
+        return -1;
+    }
+    return id;
+}
+
+int Reactor::addFd(int fd, uint32_t events, Priority priority, Callback callback)
+{
+    return add(fd, false, events, priority, std::move(callback));
+}
+
+int Reactor::addTimer(int delayMs, int intervalMs, Priority priority, std::function<void()> callback)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0)
+    {
+        LOG_ERROR("timerfd_create() failed: " << strerror(errno));
+        return -1;
+    }
+
+    int id = add(fd, true, EPOLLIN, priority, [fd, callback = std::move(callback)](uint32_t) {
+        uint64_t expirations;
+        // Missed expirations are not made up for, one call per wakeup
+        if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+            callback();
+    });
+
+    if (id >= 0)
+        set_timerfd(fd, delayMs, intervalMs);
+    return id;
+}
+
+void Reactor::setTimer(int id, int delayMs, int intervalMs)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = sources.find(id);
+    if (it != sources.end())
+        set_timerfd(it->second->fd, delayMs, intervalMs);
+}
+
+void Reactor::modifyFd(int id, uint32_t events)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = sources.find(id);
+    if (it == sources.end())
+        return;
+
+    struct epoll_event ev = {};
+    ev.events = events;
+    ev.data.u32 = static_cast<uint32_t>(id);
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, it->second->fd, &ev) != 0)
+        LOG_ERROR("epoll_ctl(" << it->second->fd << ") failed: " << strerror(errno));
+}
+
+void Reactor::remove(int id)
+{
+    std::shared_ptr<Source> source;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = sources.find(id);
+        if (it == sources.end())
+            return;
+        source = it->second;
+        sources.erase(it);
+    }
+
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, source->fd, nullptr);
+
+    // Wait for a callback of this source that may be running right now
+    std::lock_guard<std::recursive_mutex> dispatch(dispatchMutex);
+    if (source->ownsFd)
+        ::close(source->fd);
+}
+
+void Reactor::post(std::function<void()> fn)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        posted.push_back(std::move(fn));
+    }
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        LOG_ERROR("Waking the reactor failed: " << strerror(errno));
+}
+
+void Reactor::stop()
+{
+    post([this] { running = false; });
+}
+
+void *Reactor::thread_entry(void *arg)
+{
+    LOG_DEBUG("Start reactor thread.");
+    static_cast<Reactor *>(arg)->run();
+    LOG_DEBUG("Exit reactor thread.");
+    return nullptr;
+}
+
+void Reactor::runPosted()
+{
+    uint64_t count;
+    while (read(wakeFd, &count, sizeof(count)) == sizeof(count))
+    {
+    }
+
+    std::vector<std::function<void()>> fns;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fns.swap(posted);
+    }
+
+    std::lock_guard<std::recursive_mutex> dispatch(dispatchMutex);
+    for (auto &fn : fns)
+        fn();
+}
+
+int Reactor::poll(int timeoutMs)
+{
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    int n = epoll_wait(epollFd, events, REACTOR_MAX_EVENTS, timeoutMs);
+    if (n < 0)
+    {
+        if (errno == EINTR)
+            return 0;
+        LOG_ERROR("epoll_wait() failed: " << strerror(errno));
+        return -1;
+    }
+
+    ready.clear();
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < n; i++)
+        {
+            uint32_t id = events[i].data.u32;
+            if (id == 0)
+            {
+                wake = true;
+                continue;
+            }
+            auto it = sources.find(static_cast<int>(id));
+            if (it != sources.end())
+                ready.push_back({it->second->priority, id, events[i].events});
+        }
+    }
+
+    // stable: sources of equal priority keep the kernel's order
+    std::stable_sort(ready.begin(), ready.end(),
+                     [](const Ready &a, const Ready &b) { return a.priority < b.priority; });
+
+    int dispatched = 0;
+    for (const Ready &r : ready)
+    {
+        std::lock_guard<std::recursive_mutex> dispatch(dispatchMutex);
+        std::shared_ptr<Source> source;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = sources.find(static_cast<int>(r.id));
+            if (it == sources.end())
+                continue;   // removed in the meantime
+            source = it->second;
+        }
+        source->callback(r.events);
+        dispatched++;
+    }
+
+    if (wake)
+        runPosted();
+
+    return dispatched;
+}
+
+void Reactor::run()
+{
+    if (epollFd < 0 || wakeFd < 0)
+        return;
+
+    running = true;
+    while (running)
+    {
+        if (poll(-1) < 0)
+            break;
+    }
+}
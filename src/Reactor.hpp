@@ -0,0 +1,101 @@
+#ifndef REACTOR_HPP
+#define REACTOR_HPP
+
+// Single threaded event loop on epoll. File descriptors, timers (timerfd) and
+// wakeups from other threads (eventfd) are dispatched from one thread, ready
+// sources in order of their priority. Periodic housekeeping shares a loop
+// instead of sleeping in threads of its own:
+//  - global_reactor: config watching. Its callbacks must not block.
+//  - global_imp_reactor: OSD updates, which call into the SDK and may wait
+//    for the driver. Nothing latency critical runs there.
+//  - global_encoder_reactor: the encoder channel fds of all video and JPEG
+//    workers. The callbacks only wake the worker, which takes the stream on
+//    its own thread.
+//
+// Callbacks hold up the other sources of their loop while they run. Sources
+// can be added and removed from any thread; remove() returns once the
+// callback of the source is no longer running.
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <vector>
+
+class Reactor
+{
+public:
+    enum class Priority
+    {
+        High,
+        Normal,
+        Low
+    };
+
+    using Callback = std::function<void(uint32_t events)>;
+
+    Reactor();
+    ~Reactor();
+
+    // Watch fd for the epoll events, the fd stays owned by the caller
+    int addFd(int fd, uint32_t events, Priority priority, Callback callback);
+
+    // Timer calling back after delayMs and then every intervalMs (0 = once)
+    int addTimer(int delayMs, int intervalMs, Priority priority, std::function<void()> callback);
+    // Re-arm a timer, delayMs 0 disarms it
+    void setTimer(int id, int delayMs, int intervalMs);
+
+    // Change the epoll events of an fd source, re-arms an EPOLLONESHOT one
+    void modifyFd(int id, uint32_t events);
+
+    void remove(int id);
+
+    // Run fn on the reactor thread
+    void post(std::function<void()> fn);
+
+    void stop();
+
+    // Wait up to timeoutMs (-1 forever) and dispatch what is ready on the
+    // calling thread. Returns the number of callbacks run, -1 on error.
+    int poll(int timeoutMs);
+
+    static void *thread_entry(void *arg);
+
+private:
+    struct Source
+    {
+        int fd;
+        bool ownsFd;
+        Priority priority;
+        Callback callback;
+    };
+
+    struct Ready
+    {
+        Priority priority;
+        uint32_t id;
+        uint32_t events;
+    };
+
+    int add(int fd, bool ownsFd, uint32_t events, Priority priority, Callback callback);
+    void run();
+    void runPosted();
+
+    int epollFd;
+    int wakeFd;
+    bool running;
+    pthread_t thread;
+
+    std::mutex mutex;
+    std::map<int, std::shared_ptr<Source>> sources;
+    std::vector<std::function<void()>> posted;
+    int nextId;
+    std::vector<Ready> ready;   // of the current poll()
+
+    // Held while a callback runs, remove() waits on it
+    std::recursive_mutex dispatchMutex;
+};
+
+#endif // REACTOR_HPP
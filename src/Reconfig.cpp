@@ -0,0 +1,284 @@
+#include "Reconfig.hpp"
+
+#include "Config.hpp"
+#include "Logger.hpp"
+#include "globals.hpp"
+
+#include <imp/imp_osd.h>
+
+#define MODULE "Reconfig"
+
+namespace
+{
+
+// Keys that take effect by being read again, nothing to push
+const std::string_view liveStreamKeys[] = {
+    "osd.time_format",
+    "osd.uptime_format",
+    "osd.user_text_format",
+    "osd.time_font_color",
+    "osd.time_font_stroke_color",
+    "osd.uptime_font_color",
+    "osd.uptime_font_stroke_color",
+    "osd.user_text_font_color",
+    "osd.user_text_font_stroke_color",
+    "osd.time_rotation",
+    "osd.uptime_rotation",
+    "osd.user_text_rotation",
+    "osd.font_stroke",
+};
+
+const std::string_view liveJpegKeys[] = {
+    "fps",
+    "jpeg_cache_ttl",
+    "jpeg_idle_fps",
+    "jpeg_path",
+    "jpeg_sync",
+};
+
+// Read by the rate control and the session stats as they go
+const std::string_view liveRtspKeys[] = {
+    "adaptive_bitrate_enabled",
+    "adaptation_interval_seconds",
+    "adaptive_min_bitrate",
+    "adaptive_min_fps",
+    "adaptive_policy",
+    "packet_loss_threshold",
+    "bandwidth_margin",
+    "slow_client_policy",
+    "slow_client_seconds",
+};
+
+// Pushed to the hardware by the websocket handler itself
+const std::string_view handlerAudioKeys[] = {
+    "input_enabled",
+    "input_high_pass_filter",
+    "input_vol",
+    "input_gain",
+    "input_alc_gain",
+};
+
+template <size_t N>
+bool contains(const std::string_view (&list)[N], std::string_view key)
+{
+    for (auto k : list)
+        if (k == key)
+            return true;
+    return false;
+}
+
+bool starts_with(std::string_view key, std::string_view prefix)
+{
+    return key.substr(0, prefix.size()) == prefix;
+}
+
+// Encoder of video stream chn with its lock held, empty while stopped or
+// restarting
+video_stream::LockedEncoder running_encoder(int chn)
+{
+    if (global_restart || !global_video[chn])
+        return {};
+    return global_video[chn]->lock_encoder();
+}
+
+// The logo is blended with a global alpha, text items carry theirs in the
+// alpha byte of their font colors and are redrawn instead
+ReconfigAction apply_osd_logo_transparency(int chn, _stream &stream)
+{
+    video_stream::LockedEncoder encoder = running_encoder(chn);
+    if (!encoder || !encoder->osd)
+        return ReconfigAction::Stored;
+
+    // A hidden logo has no region, the value is used when it is enabled
+    if (!stream.osd.logo_enabled)
+        return ReconfigAction::Stored;
+
+    int hnd = stream.osd.regions.logo;
+    if (hnd < 0)
+        return ReconfigAction::Encoder;
+
+    IMPOSDGrpRgnAttr grpRgnAttr;
+    if (IMP_OSD_GetGrpRgnAttr(hnd, chn, &grpRgnAttr) != 0)
+        return ReconfigAction::Encoder;
+
+    // Only the alpha changes, position, scale and layer stay as OSD set them
+    grpRgnAttr.gAlphaEn = 1;
+    grpRgnAttr.fgAlhpa = stream.osd.logo_transparency;
+    int ret = IMP_OSD_SetGrpRgnAttr(hnd, chn, &grpRgnAttr);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_SetGrpRgnAttr(" << hnd << ", " << chn << ")");
+    return ret == 0 ? ReconfigAction::Runtime : ReconfigAction::Encoder;
+}
+
+ReconfigAction apply_osd_logo_position(int chn, _stream &stream)
+{
+    video_stream::LockedEncoder encoder = running_encoder(chn);
+    if (!encoder || !encoder->osd)
+        return ReconfigAction::Stored;
+
+    if (!stream.osd.logo_enabled)
+        return ReconfigAction::Stored;
+
+    int hnd = stream.osd.regions.logo;
+    if (hnd < 0)
+        return ReconfigAction::Encoder;
+
+    IMPOSDRgnAttr rgnAttr;
+    memset(&rgnAttr, 0, sizeof(IMPOSDRgnAttr));
+    if (IMP_OSD_GetRgnAttr(hnd, &rgnAttr) != 0)
+        return ReconfigAction::Encoder;
+
+    OSD::set_pos(&rgnAttr, stream.osd.pos_logo_x, stream.osd.pos_logo_y, 0, 0, stream.width, stream.height);
+    int ret = IMP_OSD_SetRgnAttr(hnd, &rgnAttr);
+    LOG_DEBUG_OR_ERROR(ret, "IMP_OSD_SetRgnAttr(" << hnd << ")");
+    return ret == 0 ? ReconfigAction::Runtime : ReconfigAction::Encoder;
+}
+
+ReconfigAction apply_stream(int chn, std::string_view key)
+{
+    _stream &stream = cfg->streams[chn];
+
+    if (key == "rtsp_endpoint" || key == "rtsp_info" || key == "audio_enabled")
+        return ReconfigAction::Restart;
+
+    // Read by the video worker whenever the stream goes idle
+    if (key == "idle_timeout" || key == "standby_encoder_timeout" || key == "standby_framesource_timeout")
+        return ReconfigAction::Runtime;
+
+    if (key == "bitrate" || key == "fps" || key == "gop")
+    {
+        video_stream::LockedEncoder encoder = running_encoder(chn);
+        if (!encoder)
+            return ReconfigAction::Stored;
+
+        bool applied = false;
+        if (key == "bitrate")
+            applied = encoder->setBitrate(stream.bitrate);
+        else if (key == "fps")
+            applied = encoder->setFps(stream.fps);
+        else
+            applied = encoder->setGop(stream.gop);
+        return applied ? ReconfigAction::Runtime : ReconfigAction::Encoder;
+    }
+
+    if (starts_with(key, "osd."))
+    {
+        if (contains(liveStreamKeys, key))
+            return ReconfigAction::Runtime;
+
+        if (key == "osd.logo_transparency")
+            return apply_osd_logo_transparency(chn, stream);
+
+        if (key == "osd.pos_logo_x" || key == "osd.pos_logo_y")
+            return apply_osd_logo_position(chn, stream);
+
+        if (starts_with(key, "osd.pos_"))
+        {
+            video_stream::LockedEncoder encoder = running_encoder(chn);
+            if (!encoder || !encoder->osd)
+                return ReconfigAction::Stored;
+            encoder->osd->relayout();
+            return ReconfigAction::Runtime;
+        }
+    }
+
+    // Resolution, codec, rate control mode, OSD layout and fonts
+    return ReconfigAction::Encoder;
+}
+
+ReconfigAction plan(std::string_view key, bool handlerApplied)
+{
+    for (int chn = 0; chn < MAX_VIDEO_STREAMS; chn++)
+    {
+        std::string_view name = CFG::streamName(chn);
+        if (starts_with(key, name) && key.size() > name.size() && key[name.size()] == '.')
+            return apply_stream(chn, key.substr(name.size() + 1));
+    }
+
+    if (starts_with(key, "stream2."))
+        return contains(liveJpegKeys, key.substr(8)) ? ReconfigAction::Runtime : ReconfigAction::Encoder;
+
+    if (starts_with(key, "image."))
+        return handlerApplied ? ReconfigAction::Runtime : ReconfigAction::Stored;
+
+    if (starts_with(key, "audio."))
+    {
+        if (handlerApplied && contains(handlerAudioKeys, key.substr(6)))
+            return ReconfigAction::Runtime;
+        return ReconfigAction::Restart;
+    }
+
+    if (starts_with(key, "rtsp."))
+        return contains(liveRtspKeys, key.substr(5)) ? ReconfigAction::Runtime : ReconfigAction::Restart;
+
+    if (starts_with(key, "motion.") || starts_with(key, "dvr.") || starts_with(key, "record.")
+        || key == "rois")
+        return ReconfigAction::Encoder;
+
+    if (key == "general.loglevel")
+    {
+        Logger::setLevel(cfg->general.loglevel);
+        return ReconfigAction::Runtime;
+    }
+
+    // general, sensor and websocket settings are read at startup
+    return ReconfigAction::Stored;
+}
+
+} // namespace
+
+std::vector<ReconfigResult> Reconfig::apply(const std::vector<std::string_view> &keys, bool handlerApplied)
+{
+    std::vector<ReconfigResult> results;
+    results.reserve(keys.size());
+
+    for (auto key : keys)
+    {
+        ReconfigAction action = plan(key, handlerApplied);
+        LOG_DEBUG(key << ": " << actionName(action));
+        results.push_back({key, action});
+    }
+
+    return results;
+}
+
+void Reconfig::requestRestart(const std::vector<ReconfigResult> &results)
+{
+    bool rtsp = false;
+    bool video = false;
+    bool audio = false;
+
+    for (auto &result : results)
+    {
+        if (result.action == ReconfigAction::Encoder)
+            video = true;
+        else if (result.action == ReconfigAction::Restart && starts_with(result.key, "audio."))
+            audio = true;
+        else if (result.action == ReconfigAction::Restart)
+            rtsp = true;
+    }
+
+    if (!rtsp && !video && !audio)
+        return;
+
+    std::unique_lock lck(mutex_main);
+    global_restart_rtsp |= rtsp;
+    global_restart_video |= video;
+    global_restart_audio |= audio;
+    global_cv_worker_restart.notify_one();
+}
+
+const char *Reconfig::actionName(ReconfigAction action)
+{
+    switch (action)
+    {
+    case ReconfigAction::Runtime:
+        return "runtime";
+    case ReconfigAction::Encoder:
+        return "encoder";
+    case ReconfigAction::Restart:
+        return "restart";
+    case ReconfigAction::Stored:
+    default:
+        return "stored";
+    }
+}
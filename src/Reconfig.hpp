@@ -0,0 +1,44 @@
+#ifndef RECONFIG_HPP
+#define RECONFIG_HPP
+
+// Reconfiguration planner. Every changed config key is classified by what it
+// takes to make the new value effective:
+//  - runtime: applied to the running pipeline (encoder rate control, OSD)
+//  - encoder: the video pipeline has to be restarted, RTSP stays up
+//  - restart: the RTSP server or the audio threads have to be restarted
+//  - stored:  kept in the config, used the next time it is read or on the
+//             next start of prudynt
+// Runtime changes are applied by apply(), the other actions are reported to
+// the caller, which decides whether to restart.
+
+#include <string_view>
+#include <vector>
+
+enum class ReconfigAction
+{
+    Stored,
+    Runtime,
+    Encoder,
+    Restart
+};
+
+struct ReconfigResult
+{
+    std::string_view key;
+    ReconfigAction action;
+};
+
+class Reconfig
+{
+public:
+    // handlerApplied: the caller already pushed values it handles inline
+    // (image tuning, audio volume) to the hardware, e.g. the websocket
+    static std::vector<ReconfigResult> apply(const std::vector<std::string_view> &keys, bool handlerApplied);
+
+    // Signal main to restart the threads the results need
+    static void requestRestart(const std::vector<ReconfigResult> &results);
+
+    static const char *actionName(ReconfigAction action);
+};
+
+#endif // RECONFIG_HPP
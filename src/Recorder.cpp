@@ -0,0 +1,679 @@
+#include "Recorder.hpp"
+
+#include "Config.hpp"
+#include "Logger.hpp"
+#include "RTSPStatus.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <string_view>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MODULE "RECORDER"
+
+#define RECORD_STATS_INTERVAL_MS 1000
+// Muxer wait granularity
+#define RECORD_WAIT_MS 250
+// Room for the access unit that completes a block
+#define RECORD_BLOCK_SLACK (64 * 1024)
+// Buffers kept for reuse beyond the ones in flight
+#define RECORD_FREE_BUFFERS 4
+// Audio allowance in the preallocation estimate, bytes per second
+#define RECORD_AUDIO_ESTIMATE 16000
+// Segments started within the same second get a counter, up to this many
+#define RECORD_NAME_ATTEMPTS 100
+// YYYYmmdd-HHMMSS
+#define RECORD_STAMP_LEN 15
+
+static int64_t timeval_to_us(const struct timeval &tv)
+{
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+// The n in record<N>-YYYYmmdd-HHMMSS-n.ts, 0 without one
+static unsigned segment_counter(std::string_view name, size_t stampEnd)
+{
+    unsigned n = 0;
+    if (stampEnd < name.size() && name[stampEnd] == '-')
+    {
+        for (size_t i = stampEnd + 1; i < name.size() && name[i] >= '0' && name[i] <= '9'; i++)
+            n = n * 10 + (name[i] - '0');
+    }
+    return n;
+}
+
+Recorder::Recorder()
+    : streamChn(0)
+    , videoCodec(TSMuxer::VideoCodec::H264)
+    , audioCodec(TSMuxer::AudioCodec::None)
+    , audioSampleRate(0)
+    , audioChannels(1)
+    , haveVideoSeq(false)
+    , nextVideoSeq(0)
+    , waitKeyframe(true)
+    , prevNalType(-1)
+    , segmentUs(0)
+    , segmentMaxBytes(0)
+    , preallocateBytes(0)
+    , segmentStartUs(-1)
+    , segmentBytes(0)
+    , accessUnitNals(0)
+    , accessUnitUs(0)
+    , accessUnitKeyframe(false)
+    , droppedGops(0)
+    , queuedBytes(0)
+    , maxQueuedBytes(0)
+    , writerRunning(false)
+    , fd(-1)
+    , written(0)
+    , preallocated(false)
+    , writeFailed(false)
+{}
+
+void Recorder::pushVideo(const H264NALUnit &nalu)
+{
+    uint64_t seq = videoSeq.fetch_add(1, std::memory_order_relaxed);
+    DVRPacket *slot = videoQueue.acquire();
+    if (!slot || nalu.data.empty())
+    {
+        droppedPackets.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    slot->data.assign(nalu.data.begin(), nalu.data.end());
+    slot->timestampUs = timeval_to_us(nalu.time);
+    slot->seq = seq;
+    slot->audio = false;
+    videoQueue.publish();
+    dataReady.release();
+}
+
+void Recorder::pushAudio(const AudioFrame &frame)
+{
+    uint64_t seq = audioSeq.fetch_add(1, std::memory_order_relaxed);
+    DVRPacket *slot = audioQueue.acquire();
+    if (!slot)
+    {
+        droppedPackets.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    slot->data.assign(frame.data.begin(), frame.data.end());
+    slot->timestampUs = timeval_to_us(frame.time);
+    slot->seq = seq;
+    slot->audio = true;
+    audioQueue.publish();
+    dataReady.release();
+}
+
+void Recorder::stop()
+{
+    running = false;
+    dataReady.release();
+}
+
+void *Recorder::thread_entry(void *arg)
+{
+    LOG_DEBUG("Start recorder thread.");
+    static_cast<Recorder *>(arg)->run();
+    LOG_DEBUG("Exit recorder thread.");
+    return nullptr;
+}
+
+void Recorder::run()
+{
+    streamChn = cfg->record.stream;
+    _stream *stream = (streamChn == 0) ? &cfg->stream0 : &cfg->stream1;
+    if (!stream->enabled || !global_video[streamChn])
+    {
+        LOG_ERROR("Recorder source stream" << streamChn << " is disabled.");
+        return;
+    }
+
+    const char *path = cfg->record.path;
+    if (mkdir(path, 0755) != 0 && errno != EEXIST)
+    {
+        LOG_ERROR("mkdir(" << path << ") failed: " << strerror(errno));
+        return;
+    }
+
+    videoCodec = (strcmp(stream->format, "H265") == 0) ? TSMuxer::VideoCodec::H265
+                                                       : TSMuxer::VideoCodec::H264;
+    audioCodec = TSMuxer::AudioCodec::None;
+#if defined(AUDIO_SUPPORT)
+    if (cfg->record.audio && cfg->audio.input_enabled && global_audio[0] && global_audio[0]->imp_audio)
+    {
+        IMPAudio *audio = global_audio[0]->imp_audio;
+        if (audio->format == IMPAudioFormat::AAC)
+            audioCodec = TSMuxer::AudioCodec::AAC;
+        else if (audio->format == IMPAudioFormat::OPUS)
+            audioCodec = TSMuxer::AudioCodec::Opus;
+        else
+            LOG_WARN("Audio format " << cfg->audio.input_format << " can't be recorded, recording video only.");
+        audioSampleRate = audio->sample_rate;
+        audioChannels = audio->outChnCnt;
+    }
+#endif
+
+    segmentUs = static_cast<int64_t>(cfg->record.segment_s) * 1000000;
+    segmentMaxBytes = static_cast<size_t>(cfg->record.segment_mb) * 1024 * 1024;
+    maxQueuedBytes = std::max<size_t>(static_cast<size_t>(cfg->record.buffer_kb) * 1024, RECORD_BLOCK_SIZE * 2);
+
+    // Expected segment size with some headroom, so the filesystem can hand
+    // out one contiguous extent instead of growing the file block by block
+    size_t perSecond = static_cast<size_t>(stream->bitrate) * 1000 / 8;
+    if (audioCodec != TSMuxer::AudioCodec::None)
+        perSecond += RECORD_AUDIO_ESTIMATE;
+    preallocateBytes = std::min(perSecond * cfg->record.segment_s * 5 / 4, segmentMaxBytes);
+
+    // Leftovers from a previous run
+    while (videoQueue.peek())
+        videoQueue.release();
+    while (audioQueue.peek())
+        audioQueue.release();
+    haveVideoSeq = false;
+    waitKeyframe = true;
+    prevNalType = -1;
+    accessUnitNals = 0;
+    block.clear();
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        jobs.clear();
+        queuedBytes = 0;
+        writerRunning = true;
+    }
+
+    int ret = pthread_create(&writerThread, nullptr, writer_entry, this);
+    LOG_DEBUG_OR_ERROR(ret, "create recorder writer thread");
+    if (ret != 0)
+        return;
+
+    running = true;
+    videoChn = streamChn;
+    audioAccepted = (audioCodec != TSMuxer::AudioCodec::None);
+
+    // The workers sleep while no RTSP client is connected, wake them up
+    {
+        std::unique_lock<std::mutex> lck(mutex_main);
+    }
+    global_video[streamChn]->should_grab_frames.notify_one();
+#if defined(AUDIO_SUPPORT)
+    if (audioAccepted)
+        global_audio[0]->should_grab_frames.notify_one();
+#endif
+
+    LOG_INFO("Recording stream" << streamChn << (audioAccepted ? " with audio" : "") << " to " << path
+                                << " in " << cfg->record.segment_s << "s segments.");
+
+    auto lastStats = std::chrono::steady_clock::now();
+    while (running)
+    {
+        dataReady.try_acquire_for(std::chrono::milliseconds(RECORD_WAIT_MS));
+        collect();
+
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration_cast<std::chrono::milliseconds>(now - lastStats).count() >= RECORD_STATS_INTERVAL_MS)
+        {
+            lastStats = now;
+            updateStats();
+        }
+    }
+
+    videoChn = -1;
+    audioAccepted = false;
+
+    finishSegment();
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        writerRunning = false;
+    }
+    writerCv.notify_all();
+
+    ret = pthread_join(writerThread, nullptr);
+    LOG_DEBUG_OR_ERROR(ret, "join recorder writer thread");
+
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        freeBuffers.clear();
+    }
+    block = std::vector<uint8_t>();
+    updateStats();
+}
+
+void Recorder::collect()
+{
+    DVRPacket *slot;
+    while ((slot = videoQueue.peek()) != nullptr)
+    {
+        if (haveVideoSeq && slot->seq != nextVideoSeq)
+        {
+            // A missing NAL breaks the GOP, continue with the next keyframe
+            accessUnitNals = 0;
+            waitKeyframe = true;
+        }
+        haveVideoSeq = true;
+        nextVideoSeq = slot->seq + 1;
+
+        bool gopStart = TSMuxer::isGopStart(videoCodec, slot->data[0], prevNalType);
+        if (waitKeyframe && !gopStart)
+        {
+            videoQueue.release();
+            continue;
+        }
+        waitKeyframe = false;
+
+        if (accessUnitNals > 0 && accessUnitUs != slot->timestampUs)
+            flushAccessUnit();
+
+        if (gopStart && muxer
+            && (slot->timestampUs - segmentStartUs >= segmentUs || segmentBytes + block.size() >= segmentMaxBytes))
+        {
+            finishSegment();
+        }
+
+        if (!muxer && !startSegment(slot->timestampUs))
+        {
+            waitKeyframe = true;
+            videoQueue.release();
+            continue;
+        }
+
+        if (accessUnitNals == 0)
+        {
+            accessUnitUs = slot->timestampUs;
+            accessUnitKeyframe = false;
+        }
+        accessUnitKeyframe |= gopStart;
+        if (accessUnitNals == accessUnit.size())
+            accessUnit.emplace_back();
+        // Hand our spare buffer to the producer instead of copying
+        accessUnit[accessUnitNals++].swap(slot->data);
+        videoQueue.release();
+    }
+
+    while ((slot = audioQueue.peek()) != nullptr)
+    {
+        if (muxer && !waitKeyframe)
+        {
+            muxer->writeAudio(slot->data.data(), slot->data.size(), slot->timestampUs, block);
+            submitBlocks();
+        }
+        audioQueue.release();
+    }
+}
+
+void Recorder::flushAccessUnit()
+{
+    if (accessUnitNals == 0 || !muxer)
+        return;
+
+    nalPointers.clear();
+    for (size_t i = 0; i < accessUnitNals; i++)
+        nalPointers.push_back(&accessUnit[i]);
+    accessUnitNals = 0;
+
+    muxer->writeVideo(nalPointers, accessUnitUs, accessUnitKeyframe, block);
+    submitBlocks();
+}
+
+bool Recorder::startSegment(int64_t timestampUs)
+{
+    char stamp[32];
+    time_t now = time(nullptr);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+
+    WriterJob job{};
+    job.type = JobType::Open;
+    // Without the extension, writerOpen() picks a name that is not taken
+    job.path = std::string(cfg->record.path) + "/record" + std::to_string(streamChn) + "-" + stamp;
+    job.preallocate = preallocateBytes;
+    if (!queueJob(std::move(job)))
+        return false;
+
+    muxer = std::make_unique<TSMuxer>(videoCodec, audioCodec, audioSampleRate, audioChannels);
+    segmentStartUs = timestampUs;
+    segmentBytes = 0;
+    if (block.capacity() == 0)
+        block = takeBuffer();
+    block.clear();
+    muxer->writeTables(block);
+    return true;
+}
+
+void Recorder::finishSegment()
+{
+    if (!muxer)
+        return;
+
+    flushAccessUnit();
+    if (!block.empty())
+    {
+        WriterJob job{};
+        job.type = JobType::Write;
+        job.data = std::move(block);
+        if (!queueJob(std::move(job)))
+            droppedGops++;
+        block = takeBuffer();
+    }
+
+    WriterJob job{};
+    job.type = JobType::Close;
+    queueJob(std::move(job));
+    muxer.reset();
+}
+
+void Recorder::submitBlocks()
+{
+    while (block.size() >= RECORD_BLOCK_SIZE)
+    {
+        std::vector<uint8_t> next = takeBuffer();
+        next.assign(block.begin() + RECORD_BLOCK_SIZE, block.end());
+        block.resize(RECORD_BLOCK_SIZE);
+
+        WriterJob job{};
+        job.type = JobType::Write;
+        job.data = std::move(block);
+        block = std::move(next);
+
+        if (!queueJob(std::move(job)))
+        {
+            dropSegmentData();
+            return;
+        }
+        segmentBytes += RECORD_BLOCK_SIZE;
+    }
+}
+
+void Recorder::dropSegmentData()
+{
+    // The segment continues with the next keyframe, players resync on the
+    // tables written in front of it
+    if (droppedGops++ % 100 == 0)
+        LOG_WARN("Storage too slow for stream" << streamChn << ", dropping video up to the next keyframe.");
+    accessUnitNals = 0;
+    block.clear();
+    waitKeyframe = true;
+}
+
+std::vector<uint8_t> Recorder::takeBuffer()
+{
+    std::vector<uint8_t> buffer;
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        if (!freeBuffers.empty())
+        {
+            buffer = std::move(freeBuffers.back());
+            freeBuffers.pop_back();
+        }
+    }
+    buffer.clear();
+    buffer.reserve(RECORD_BLOCK_SIZE + RECORD_BLOCK_SLACK);
+    return buffer;
+}
+
+bool Recorder::queueJob(WriterJob &&job)
+{
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        if (job.type == JobType::Write)
+        {
+            if (queuedBytes + job.data.size() > maxQueuedBytes)
+            {
+                job.data.clear();
+                if (freeBuffers.size() < RECORD_FREE_BUFFERS)
+                    freeBuffers.push_back(std::move(job.data));
+                return false;
+            }
+            queuedBytes += job.data.size();
+        }
+        jobs.push_back(std::move(job));
+    }
+    writerCv.notify_one();
+    return true;
+}
+
+void Recorder::updateStats()
+{
+    size_t queued;
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        queued = queuedBytes;
+    }
+
+    RTSPStatus::writeCustomParameter("record", "active", running ? "true" : "false");
+    RTSPStatus::writeCustomParameter("record", "segments", std::to_string(segmentCount.load()));
+    RTSPStatus::writeCustomParameter("record", "bytes_written", std::to_string(bytesWritten.load()));
+    RTSPStatus::writeCustomParameter("record", "queued_bytes", std::to_string(queued));
+    RTSPStatus::writeCustomParameter("record", "dropped_packets", std::to_string(droppedPackets.load()));
+    RTSPStatus::writeCustomParameter("record", "dropped_gops", std::to_string(droppedGops));
+    RTSPStatus::writeCustomParameter("record", "write_errors", std::to_string(writeErrors.load()));
+    RTSPStatus::writeCustomParameter("record", "removed_segments", std::to_string(removedSegments.load()));
+}
+
+void *Recorder::writer_entry(void *arg)
+{
+    static_cast<Recorder *>(arg)->writerLoop();
+    return nullptr;
+}
+
+void Recorder::writerLoop()
+{
+    enforceRetention();
+
+    std::unique_lock<std::mutex> lock(writerMutex);
+    while (true)
+    {
+        writerCv.wait(lock, [&] { return !jobs.empty() || !writerRunning; });
+        if (jobs.empty())
+            break;
+
+        WriterJob job = std::move(jobs.front());
+        jobs.pop_front();
+        lock.unlock();
+
+        switch (job.type)
+        {
+        case JobType::Open:
+            writerOpen(job);
+            break;
+        case JobType::Write:
+            writerWrite(job);
+            break;
+        case JobType::Close:
+            writerClose();
+            break;
+        }
+
+        lock.lock();
+        if (job.type == JobType::Write)
+        {
+            queuedBytes -= job.data.size();
+            job.data.clear();
+            if (freeBuffers.size() < RECORD_FREE_BUFFERS)
+                freeBuffers.push_back(std::move(job.data));
+        }
+    }
+    lock.unlock();
+
+    // Stopped without a Close, keep what was written
+    writerClose();
+}
+
+void Recorder::writerOpen(const WriterJob &job)
+{
+    writerClose();
+
+    written = 0;
+    writeFailed = false;
+    preallocated = false;
+
+    for (int n = 0; n < RECORD_NAME_ATTEMPTS; n++)
+    {
+        segmentPath = job.path + (n ? "-" + std::to_string(n) : "") + ".ts";
+        // Written under a temporary name, renamed once complete
+        segmentPartPath = segmentPath + ".part";
+
+        struct stat st;
+        if (stat(segmentPath.c_str(), &st) == 0)
+            continue;
+
+        fd = ::open(segmentPartPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd >= 0 || errno != EEXIST)
+            break;
+    }
+
+    if (fd < 0)
+    {
+        LOG_ERROR("open(" << segmentPartPath << ") failed: " << strerror(errno));
+        writeErrors++;
+        return;
+    }
+
+    // KEEP_SIZE leaves the file size at what was written, a segment cut
+    // short by a crash or power loss doesn't end in zeros
+    if (job.preallocate > 0)
+    {
+        if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, job.preallocate) == 0)
+            preallocated = true;
+        else if (errno != EOPNOTSUPP)
+            LOG_DEBUG("fallocate(" << segmentPartPath << ") failed: " << strerror(errno));
+    }
+}
+
+void Recorder::writerWrite(const WriterJob &job)
+{
+    if (fd < 0 || writeFailed)
+        return;
+
+    const uint8_t *data = job.data.data();
+    size_t left = job.data.size();
+    while (left > 0)
+    {
+        ssize_t n = ::write(fd, data, left);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("Writing segment " << segmentPartPath << " failed: " << strerror(errno));
+            writeErrors++;
+            // Keep the segment up to here, continue with the next one
+            writeFailed = true;
+            return;
+        }
+        data += n;
+        left -= n;
+        written += n;
+    }
+    bytesWritten += job.data.size();
+}
+
+void Recorder::writerClose()
+{
+    if (fd < 0)
+        return;
+
+    // Release the preallocated space beyond the data
+    if (preallocated && ftruncate(fd, written) != 0)
+        LOG_DEBUG("ftruncate(" << segmentPartPath << ") failed: " << strerror(errno));
+    ::close(fd);
+    fd = -1;
+
+    if (written == 0)
+    {
+        unlink(segmentPartPath.c_str());
+        return;
+    }
+
+    if (rename(segmentPartPath.c_str(), segmentPath.c_str()) != 0)
+    {
+        LOG_ERROR("rename(" << segmentPartPath << ") failed: " << strerror(errno));
+        writeErrors++;
+        return;
+    }
+
+    segmentCount++;
+    RTSPStatus::writeCustomParameter("record", "last_segment", segmentPath);
+    LOG_DEBUG("Segment " << segmentPath << " finished, " << written / 1024 << " KiB.");
+
+    enforceRetention();
+}
+
+void Recorder::enforceRetention()
+{
+    const char *path = cfg->record.path;
+    uint64_t maxBytes = static_cast<uint64_t>(cfg->record.max_storage_mb) * 1024 * 1024;
+    time_t maxAge = static_cast<time_t>(cfg->record.keep_hours) * 3600;
+    if (maxBytes == 0 && maxAge == 0)
+        return;
+
+    DIR *dir = opendir(path);
+    if (!dir)
+    {
+        LOG_ERROR("opendir(" << path << ") failed: " << strerror(errno));
+        return;
+    }
+
+    struct Segment
+    {
+        std::string name;
+        uint64_t size;
+        time_t mtime;
+    };
+    std::vector<Segment> segments;
+    uint64_t total = 0;
+
+    // Only the recorder's own segments, DVR clips may share the directory
+    std::string prefix = "record" + std::to_string(streamChn) + "-";
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        std::string_view name = entry->d_name;
+        if (name.size() <= prefix.size() + 3 || name.substr(0, prefix.size()) != prefix
+            || name.substr(name.size() - 3) != ".ts")
+            continue;
+
+        struct stat st;
+        if (fstatat(dirfd(dir), entry->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+            continue;
+        segments.push_back({entry->d_name, static_cast<uint64_t>(st.st_size), st.st_mtime});
+        total += st.st_size;
+    }
+
+    // Names carry the start time and a counter within the second, oldest
+    // first. The newest segment is kept.
+    size_t stampEnd = prefix.size() + RECORD_STAMP_LEN;
+    std::sort(segments.begin(), segments.end(), [stampEnd](const Segment &a, const Segment &b) {
+        int c = a.name.compare(0, stampEnd, b.name, 0, stampEnd);
+        if (c != 0)
+            return c < 0;
+        return segment_counter(a.name, stampEnd) < segment_counter(b.name, stampEnd);
+    });
+    time_t now = time(nullptr);
+    for (size_t i = 0; i + 1 < segments.size(); i++)
+    {
+        bool overSize = maxBytes > 0 && total > maxBytes;
+        bool tooOld = maxAge > 0 && now - segments[i].mtime > maxAge;
+        if (!overSize && !tooOld)
+            break;
+
+        if (unlinkat(dirfd(dir), segments[i].name.c_str(), 0) != 0)
+        {
+            LOG_ERROR("Removing " << segments[i].name << " failed: " << strerror(errno));
+            continue;
+        }
+        LOG_DEBUG("Removed segment " << segments[i].name);
+        total -= segments[i].size;
+        removedSegments++;
+    }
+
+    closedir(dir);
+}
@@ -0,0 +1,152 @@
+#ifndef RECORDER_HPP
+#define RECORDER_HPP
+
+// Continuous recorder. Writes one encoded stream (plus AAC/Opus audio) to
+// record.path as MPEG-TS segments without re-encoding. Segments are split at
+// a keyframe once they reach record.segment_s or record.segment_mb, the
+// oldest ones are removed beyond record.max_storage_mb or record.keep_hours.
+//
+// Threads:
+//  - VideoWorker / AudioWorker copy packets into lock-free queues and never
+//    wait; packets are dropped (and counted) when the queues are full.
+//  - the muxer drains the queues and muxes whole access units into blocks of
+//    RECORD_BLOCK_SIZE, taken from a pool of reused buffers.
+//  - the writer preallocates the segment files and writes the blocks. At most
+//    record.buffer_kb is queued for it, when the disk falls behind the muxer
+//    drops data up to the next keyframe instead of holding up capture.
+//
+// Nothing here talks to the SDK after start-up: pushVideo() / pushAudio() can
+// be fed from a file to replay a recording.
+
+#include "DVR.hpp"
+#include "SPSCQueue.hpp"
+#include "TSMuxer.hpp"
+#include "globals.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <semaphore>
+#include <string>
+#include <vector>
+
+// Producer queue slots, buffers are reused
+#define RECORD_VIDEO_QUEUE_SIZE 128
+#define RECORD_AUDIO_QUEUE_SIZE 64
+// Files are written in blocks of this size, a multiple of the page size
+#define RECORD_BLOCK_SIZE (256 * 1024)
+
+class Recorder
+{
+public:
+    Recorder();
+
+    // Producer side, never blocks
+    void pushVideo(const H264NALUnit &nalu);
+    void pushAudio(const AudioFrame &frame);
+
+    // Whether the producers should feed packets, cheap enough for every NAL
+    bool acceptsVideo(int encChn) const { return videoChn.load(std::memory_order_relaxed) == encChn; }
+    bool acceptsAudio() const { return audioAccepted.load(std::memory_order_relaxed); }
+
+    // Ask run() to return, main joins the thread
+    void stop();
+
+    static void *thread_entry(void *arg);
+
+private:
+    enum class JobType
+    {
+        Open,
+        Write,
+        Close
+    };
+
+    struct WriterJob
+    {
+        JobType type;
+        std::vector<uint8_t> data;
+        std::string path;
+        size_t preallocate;
+    };
+
+    void run();
+    void collect();
+    void flushAccessUnit();
+    bool startSegment(int64_t timestampUs);
+    void finishSegment();
+    void submitBlocks();
+    void dropSegmentData();
+    std::vector<uint8_t> takeBuffer();
+    bool queueJob(WriterJob &&job);
+    void updateStats();
+
+    static void *writer_entry(void *arg);
+    void writerLoop();
+    void writerOpen(const WriterJob &job);
+    void writerWrite(const WriterJob &job);
+    void writerClose();
+    void enforceRetention();
+
+    SPSCQueue<DVRPacket> videoQueue{RECORD_VIDEO_QUEUE_SIZE};
+    SPSCQueue<DVRPacket> audioQueue{RECORD_AUDIO_QUEUE_SIZE};
+    std::counting_semaphore<> dataReady{0};
+    std::atomic<uint64_t> videoSeq{0};
+    std::atomic<uint64_t> audioSeq{0};
+    std::atomic<int> videoChn{-1};
+    std::atomic<bool> audioAccepted{false};
+    std::atomic<uint64_t> droppedPackets{0};
+    std::atomic<bool> running{false};
+
+    // Muxer state
+    int streamChn;
+    TSMuxer::VideoCodec videoCodec;
+    TSMuxer::AudioCodec audioCodec;
+    int audioSampleRate;
+    int audioChannels;
+    bool haveVideoSeq;
+    uint64_t nextVideoSeq;
+    bool waitKeyframe;
+    int prevNalType;
+    int64_t segmentUs;
+    size_t segmentMaxBytes;
+    size_t preallocateBytes;
+    std::unique_ptr<TSMuxer> muxer;
+    int64_t segmentStartUs;
+    size_t segmentBytes;        // submitted to the writer so far
+    std::vector<std::vector<uint8_t>> accessUnit;   // NAL buffers, reused
+    size_t accessUnitNals;
+    int64_t accessUnitUs;
+    bool accessUnitKeyframe;
+    std::vector<const std::vector<uint8_t> *> nalPointers;
+    std::vector<uint8_t> block;
+    uint64_t droppedGops;
+
+    // Writer queue and buffer pool
+    pthread_t writerThread;
+    std::mutex writerMutex;
+    std::condition_variable writerCv;
+    std::deque<WriterJob> jobs;
+    std::vector<std::vector<uint8_t>> freeBuffers;
+    size_t queuedBytes;
+    size_t maxQueuedBytes;
+    bool writerRunning;
+
+    // Writer state, only touched by the writer thread
+    int fd;
+    std::string segmentPath;
+    std::string segmentPartPath;
+    size_t written;
+    bool preallocated;
+    bool writeFailed;
+    std::atomic<uint64_t> segmentCount{0};
+    std::atomic<uint64_t> bytesWritten{0};
+    std::atomic<uint64_t> writeErrors{0};
+    std::atomic<uint64_t> removedSegments{0};
+};
+
+#endif // RECORDER_HPP
@@ -1,3 +1,6 @@
+#ifndef RING_BUFFER_HPP
+#define RING_BUFFER_HPP
+
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -73,3 +76,5 @@ private:
     size_t tail;
     size_t size;
 };
+
+#endif // RING_BUFFER_HPP
@@ -0,0 +1,60 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/* Lock-free single producer / single consumer queue with a fixed number of
+ * preallocated slots. Slots are filled and consumed in place, so elements
+ * holding buffers (e.g. std::vector) keep their capacity and the steady state
+ * does not allocate.
+ *
+ * Producer: T *slot = q.acquire(); if (slot) { fill(*slot); q.publish(); }
+ * Consumer: T *slot = q.peek(); if (slot) { use(*slot); q.release(); }
+ */
+template <class T> class SPSCQueue {
+public:
+    explicit SPSCQueue(size_t capacity) : slots(capacity + 1) { }
+
+    // Producer side: free slot to fill or nullptr if the queue is full
+    T *acquire() {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (next(t) == head.load(std::memory_order_acquire))
+            return nullptr;
+        return &slots[t];
+    }
+
+    void publish() {
+        tail.store(next(tail.load(std::memory_order_relaxed)), std::memory_order_release);
+    }
+
+    // Consumer side: oldest filled slot or nullptr if the queue is empty
+    T *peek() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return nullptr;
+        return &slots[h];
+    }
+
+    void release() {
+        head.store(next(head.load(std::memory_order_relaxed)), std::memory_order_release);
+    }
+
+    size_t size() const {
+        size_t h = head.load(std::memory_order_acquire);
+        size_t t = tail.load(std::memory_order_acquire);
+        return (t + slots.size() - h) % slots.size();
+    }
+
+    size_t capacity() const { return slots.size() - 1; }
+
+private:
+    size_t next(size_t i) const { return (i + 1) % slots.size(); }
+
+    std::vector<T> slots;
+    std::atomic<size_t> head{0};
+    std::atomic<size_t> tail{0};
+};
+
+#endif
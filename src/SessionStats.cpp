@@ -0,0 +1,149 @@
+#include "SessionStats.hpp"
+
+#include "Config.hpp"
+#include "Logger.hpp"
+#include "RTSPStatus.hpp"
+#include "globals.hpp"
+
+#include "RTPSink.hh"
+
+#include <cstdio>
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#define MODULE "RTSP_SESSION"
+
+SessionStats::SessionStats(int encChn, unsigned clientSessionId)
+    : encChn(encChn)
+    , sink(nullptr)
+    , tcpSocket(-1)
+    , sendBuffer(0)
+    , startPackets(0)
+    , startOctets(0)
+    , startDropped(0)
+    , packets(0)
+    , octets(0)
+    , dropped(0)
+    , queuedBytes(0)
+    , loss(0.0f)
+    , jitterMs(0)
+    , rttMs(0)
+    , lostPackets(0)
+    , reportLossy(false)
+    , slowSeconds(0)
+    , slow(false)
+    , actions(0)
+{
+    char id[16];
+    snprintf(id, sizeof(id), "%08X", clientSessionId);
+    statusName = std::string(CFG::streamName(encChn)) + "/sessions/" + id;
+}
+
+void SessionStats::start(RTPSink *sink, int tcpSocket)
+{
+    this->sink = sink;
+    this->tcpSocket = tcpSocket;
+
+    if (sink)
+    {
+        startPackets = sink->packetCount();
+        startOctets = sink->octetCount();
+    }
+    if (global_video[encChn])
+        startDropped = global_video[encChn]->dropped_nals.load(std::memory_order_relaxed);
+
+    sendBuffer = 0;
+    if (tcpSocket >= 0)
+    {
+        socklen_t len = sizeof(sendBuffer);
+        if (getsockopt(tcpSocket, SOL_SOCKET, SO_SNDBUF, &sendBuffer, &len) != 0)
+            sendBuffer = 0;
+    }
+}
+
+void SessionStats::onReceiverReport(RTPSink *sink)
+{
+    if (sink == nullptr)
+        return;
+
+    // The handler runs right after the report of this viewer went into the
+    // stats, its entry is the one received last
+    RTPTransmissionStats *latest = nullptr;
+    RTPTransmissionStatsDB::Iterator iter(sink->transmissionStats());
+    RTPTransmissionStats *stats;
+    while ((stats = iter.next()) != nullptr)
+    {
+        if (latest == nullptr || timercmp(&stats->lastTimeReceived(), &latest->lastTimeReceived(), >))
+            latest = stats;
+    }
+    if (latest == nullptr)
+        return;
+
+    loss = latest->packetLossRatio() / 256.0f;
+    jitterMs = latest->jitter() / 90;
+    rttMs = static_cast<int>((static_cast<uint64_t>(latest->roundTripDelay()) * 1000) >> 16);
+    // Over TCP nothing gets lost on the way, these are packets live555 dropped
+    // on a full socket
+    lostPackets = latest->totNumPacketsLost();
+    reportLossy = loss > cfg->rtsp.packet_loss_threshold;
+}
+
+bool SessionStats::sample()
+{
+    if (sink)
+    {
+        packets = sink->packetCount() - startPackets;
+        octets = sink->octetCount() - startOctets;
+    }
+    if (global_video[encChn])
+        dropped = global_video[encChn]->dropped_nals.load(std::memory_order_relaxed) - startDropped;
+
+    bool congested = reportLossy;
+    if (tcpSocket >= 0)
+    {
+        int queued = 0;
+        if (ioctl(tcpSocket, SIOCOUTQ, &queued) == 0)
+            queuedBytes = queued;
+        congested |= sendBuffer > 0 && queuedBytes > sendBuffer / 4 * 3;
+    }
+
+    slowSeconds = congested ? slowSeconds + 1 : 0;
+
+    int limit = cfg->rtsp.slow_client_seconds;
+    bool wasSlow = slow;
+    slow = slowSeconds >= limit;
+    if (slow != wasSlow)
+        LOG_INFO(statusName << (slow ? " is slow" : " caught up") << " (queued: " << queuedBytes
+                            << " bytes, loss: " << static_cast<int>(loss * 100) << "%)");
+
+    // Right when it turns slow and again every limit seconds it stays slow
+    if (slow && (slowSeconds - limit) % limit == 0)
+    {
+        actions++;
+        return true;
+    }
+    return false;
+}
+
+void SessionStats::write() const
+{
+    RTSPStatus::writeCustomParameter(statusName, "transport", isTcp() ? "tcp" : "udp");
+    // The RTP sink is shared by all viewers of the stream, these count what the
+    // stream sent while this session was playing, not what reached this viewer
+    RTSPStatus::writeCustomParameter(statusName, "stream_packets_sent", std::to_string(packets));
+    RTSPStatus::writeCustomParameter(statusName, "stream_bytes_sent", std::to_string(octets));
+    RTSPStatus::writeCustomParameter(statusName, "loss_percent", std::to_string(static_cast<int>(loss * 100)));
+    RTSPStatus::writeCustomParameter(statusName, "lost_packets", std::to_string(lostPackets));
+    RTSPStatus::writeCustomParameter(statusName, "jitter_ms", std::to_string(jitterMs));
+    RTSPStatus::writeCustomParameter(statusName, "rtt_ms", std::to_string(rttMs));
+    RTSPStatus::writeCustomParameter(statusName, "send_queue_bytes", std::to_string(queuedBytes));
+    RTSPStatus::writeCustomParameter(statusName, "dropped_nals", std::to_string(dropped));
+    RTSPStatus::writeCustomParameter(statusName, "slow", slow ? "true" : "false");
+    RTSPStatus::writeCustomParameter(statusName, "slow_actions", std::to_string(actions));
+}
+
+void SessionStats::remove() const
+{
+    RTSPStatus::removeStreamStatus(statusName);
+}
@@ -0,0 +1,70 @@
+#ifndef SESSION_STATS_HPP
+#define SESSION_STATS_HPP
+
+// Counters of one RTSP viewer of a video stream, kept on the live555 thread.
+// Nothing is touched per packet: the sink counters are read once a second,
+// loss, jitter and round trip time when the viewer's RTCP report arrives, and
+// the kernel send queue of an RTP-over-TCP session with one SIOCOUTQ per
+// second.
+//
+// A viewer is slow when its send queue stays above 3/4 of the socket buffer
+// (TCP) or its reported loss above rtsp.packet_loss_threshold (UDP) for
+// rtsp.slow_client_seconds.
+//
+// Exposed under /run/prudynt/rtsp/stream<N>/sessions/<session id>/.
+
+#include <cstdint>
+#include <string>
+
+class RTPSink;
+
+class SessionStats
+{
+public:
+    SessionStats(int encChn, unsigned clientSessionId);
+
+    void start(RTPSink *sink, int tcpSocket);
+    void onReceiverReport(RTPSink *sink);
+
+    // Once a second, true when the slow client policy should be applied
+    bool sample();
+
+    void write() const;
+    void remove() const;
+
+    bool isTcp() const { return tcpSocket >= 0; }
+    int socket() const { return tcpSocket; }
+    bool isSlow() const { return slow; }
+    const std::string &name() const { return statusName; }
+
+private:
+    int encChn;
+    std::string statusName;
+
+    RTPSink *sink;
+    int tcpSocket;
+    int sendBuffer;
+
+    // Sink and stream counters when the session joined, the sink is shared
+    // with the other viewers of the stream
+    uint32_t startPackets;
+    uint32_t startOctets;
+    uint32_t startDropped;
+
+    uint32_t packets;
+    uint32_t octets;
+    uint32_t dropped;
+    int queuedBytes;
+
+    float loss;
+    int jitterMs;
+    int rttMs;
+    unsigned lostPackets;
+    bool reportLossy;
+
+    int slowSeconds;
+    bool slow;
+    int actions;
+};
+
+#endif // SESSION_STATS_HPP
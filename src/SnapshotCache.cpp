@@ -0,0 +1,35 @@
+#include "SnapshotCache.hpp"
+
+void SnapshotCache::setWake(std::function<void()> wake)
+{
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    this->wake = std::move(wake);
+}
+
+void SnapshotCache::put(int width, int height, int quality, std::vector<uint8_t> &&buffer)
+{
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->buffer = std::move(buffer);
+    snapshot->width = width;
+    snapshot->height = height;
+    snapshot->quality = quality;
+    snapshot->time = std::chrono::steady_clock::now();
+    snapshot->modified = time(nullptr);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        snapshot->seq = ++nextSeq;
+        snapshots[{width, quality}] = std::move(snapshot);
+    }
+
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    if (wake)
+        wake();
+}
+
+SnapshotPtr SnapshotCache::get(int width, int quality) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = snapshots.find({width, quality});
+    return it != snapshots.end() ? it->second : nullptr;
+}
@@ -0,0 +1,69 @@
+#ifndef SNAPSHOT_CACHE_HPP
+#define SNAPSHOT_CACHE_HPP
+
+// Latest JPEG of every snapshot size in memory. The JPEG workers put each
+// image they encode, keyed by width and quality, HTTP and websocket clients
+// get the shared image without touching the file system. Images are kept with
+// LWS_PRE bytes of headroom so lws can send them as they are.
+//
+// A size is only encoded while it is asked for: a request within
+// stream2.jpeg_cache_ttl milliseconds keeps its JPEG channel running, a cached
+// image younger than that is served without waking the channel.
+//
+// seq counts up over all sizes, HTTP sends it as ETag so pollers that have
+// the latest image get a 304 instead of the JPEG again.
+
+#include <libwebsockets.h>
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+struct Snapshot
+{
+    std::vector<uint8_t> buffer;    // LWS_PRE, JPEG
+    int width;
+    int height;
+    int quality;
+    uint64_t seq;                   // counts up over all sizes, 0 = not from the cache
+    std::chrono::steady_clock::time_point time;
+    time_t modified;                // wall clock, for Last-Modified
+
+    const uint8_t *jpeg() const { return buffer.data() + LWS_PRE; }
+    size_t size() const { return buffer.size() - LWS_PRE; }
+    bool fresh(int ttlMs) const
+    {
+        return std::chrono::steady_clock::now() - time < std::chrono::milliseconds(ttlMs);
+    }
+};
+
+using SnapshotPtr = std::shared_ptr<const Snapshot>;
+
+class SnapshotCache
+{
+public:
+    // Called after every new image, wakes the lws service loop
+    void setWake(std::function<void()> wake);
+
+    // Producer side, buffer holds LWS_PRE bytes of headroom and the JPEG
+    void put(int width, int height, int quality, std::vector<uint8_t> &&buffer);
+
+    // Latest image of the size, nullptr before the first one
+    SnapshotPtr get(int width, int quality) const;
+
+private:
+    mutable std::mutex mutex;
+    std::map<std::pair<int, int>, SnapshotPtr> snapshots;
+    uint64_t nextSeq = 0;
+
+    std::mutex wakeMutex;
+    std::function<void()> wake;
+};
+
+#endif // SNAPSHOT_CACHE_HPP
@@ -0,0 +1,64 @@
+#include "SnapshotFile.hpp"
+
+#include "Config.hpp"
+#include "Logger.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+#define MODULE "SnapshotFile"
+
+SnapshotFile::SnapshotFile()
+    : lastSync()
+{
+}
+
+bool SnapshotFile::write(const char *path, const uint8_t *data, size_t size)
+{
+    std::string tempPath = std::string(path) + ".tmp";
+    int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0)
+    {
+        LOG_ERROR("Failed to open JPEG snapshot for writing: " << tempPath << ": " << strerror(errno));
+        return false;
+    }
+
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t ret = ::write(fd, data + done, size - done);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("Stream write error: " << strerror(errno));
+            ::close(fd);
+            unlink(tempPath.c_str());
+            return false;
+        }
+        done += ret;
+    }
+
+    const char *sync = cfg->stream2.jpeg_sync;
+    auto now = std::chrono::steady_clock::now();
+    if (strcmp(sync, "always") == 0
+        || (strcmp(sync, "periodic") == 0 && now - lastSync >= std::chrono::seconds(SNAPSHOT_SYNC_PERIOD_S)))
+    {
+        fdatasync(fd);
+        lastSync = now;
+    }
+    ::close(fd);
+
+    if (rename(tempPath.c_str(), path) != 0)
+    {
+        LOG_ERROR("Failed to move JPEG snapshot to " << path << ": " << strerror(errno));
+        unlink(tempPath.c_str());
+        return false;
+    }
+
+    return true;
+}
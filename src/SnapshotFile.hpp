@@ -0,0 +1,31 @@
+#ifndef SNAPSHOT_FILE_HPP
+#define SNAPSHOT_FILE_HPP
+
+// The snapshot on the file system for scripts and the web ui. Every image is
+// written in one go to <path>.tmp, next to <path> so both are on the same
+// file system, and renamed over <path>. A reader sees either the previous or
+// the new image, complete, and keeps the one it opened for as long as it
+// holds it.
+//
+// stream2.jpeg_sync: "none" never flushes (tmpfs), "periodic" at most every
+// SNAPSHOT_SYNC_PERIOD_S, "always" after every image.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#define SNAPSHOT_SYNC_PERIOD_S 60
+
+class SnapshotFile
+{
+public:
+    SnapshotFile();
+
+    // Writes the image to a temporary file and renames it to path
+    bool write(const char *path, const uint8_t *data, size_t size);
+
+private:
+    std::chrono::steady_clock::time_point lastSync;
+};
+
+#endif // SNAPSHOT_FILE_HPP
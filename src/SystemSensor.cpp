@@ -1,9 +1,11 @@
 #include "SystemSensor.hpp"
+#include <charconv>
 #include <iostream>
-#include <sstream>
 #include <stdexcept>
-#include <fstream>
 #include <filesystem>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // For logging compatibility with prudynt-t
 #ifdef LOG_DEBUG
@@ -26,28 +28,40 @@ SystemSensor::SensorInfo SystemSensor::getSensorInfo() {
         throw std::runtime_error("Sensor proc filesystem /proc/jz/sensor/ is not accessible");
     }
 
+    std::unordered_map<std::string, std::string> proc = readAll();
+    auto text = [&proc](const char *name) -> std::string {
+        auto it = proc.find(name);
+        return it != proc.end() ? it->second : std::string();
+    };
+    auto number = [&proc](const char *name, int &value) {
+        auto it = proc.find(name);
+        if (it != proc.end() && !parseInt(it->second, value)) {
+            SYSTEM_SENSOR_LOG_ERROR("Failed to parse '" << it->second << "' as int from " << name);
+        }
+    };
+
     SensorInfo info;
 
     // Read basic sensor information
-    info.name = readProcString("name");
-    info.chip_id = readProcString("chip_id");
-    info.i2c_addr = readProcString("i2c_addr");
-    info.version = readProcString("version");
+    info.name = text("name");
+    info.chip_id = text("chip_id");
+    info.i2c_addr = text("i2c_addr");
+    info.version = text("version");
 
     // Read numeric values with defaults from constructor
-    info.width = readProcInt("width", info.width);
-    info.height = readProcInt("height", info.height);
-    info.min_fps = readProcInt("min_fps", info.min_fps);
-    info.max_fps = readProcInt("max_fps", info.max_fps);
-    info.i2c_bus = readProcInt("i2c_bus", info.i2c_bus);
-    info.boot = readProcInt("boot", info.boot);
-    info.mclk = readProcInt("mclk", info.mclk);
-    info.video_interface = readProcInt("video_interface", info.video_interface);
-    info.reset_gpio = readProcInt("reset_gpio", info.reset_gpio);
+    number("width", info.width);
+    number("height", info.height);
+    number("min_fps", info.min_fps);
+    number("max_fps", info.max_fps);
+    number("i2c_bus", info.i2c_bus);
+    number("boot", info.boot);
+    number("mclk", info.mclk);
+    number("video_interface", info.video_interface);
+    number("reset_gpio", info.reset_gpio);
 
     // Parse I2C address if available
-    if (!info.i2c_addr.empty()) {
-        info.i2c_address = parseHexString(info.i2c_addr);
+    if (!info.i2c_addr.empty() && !parseHex(info.i2c_addr, info.i2c_address)) {
+        SYSTEM_SENSOR_LOG_ERROR("Failed to parse hex string '" << info.i2c_addr << "'");
     }
 
     // Set default FPS to max_fps
@@ -65,60 +79,63 @@ bool SystemSensor::isAvailable() {
     return std::filesystem::exists(SENSOR_PROC_DIR) && std::filesystem::is_directory(SENSOR_PROC_DIR);
 }
 
-std::string SystemSensor::readProcString(const std::string& filename) {
-    std::string fullPath = SENSOR_PROC_DIR + filename;
-    std::ifstream file(fullPath);
+std::unordered_map<std::string, std::string> SystemSensor::readAll() {
+    std::unordered_map<std::string, std::string> values;
 
-    if (!file.is_open()) {
-        SYSTEM_SENSOR_LOG_DEBUG("Failed to open " << fullPath);
-        return "";
+    DIR *dir = opendir(SENSOR_PROC_DIR.c_str());
+    if (!dir) {
+        SYSTEM_SENSOR_LOG_DEBUG("Failed to open " << SENSOR_PROC_DIR);
+        return values;
     }
 
-    std::string line;
-    if (std::getline(file, line)) {
-        // Trim whitespace
-        line.erase(0, line.find_first_not_of(" \t\r\n"));
-        line.erase(line.find_last_not_of(" \t\r\n") + 1);
-        SYSTEM_SENSOR_LOG_DEBUG("Read from " << fullPath << ": " << line);
-        return line;
+    // proc entries report size 0, read a bounded first chunk of each
+    char buffer[256];
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        int fd = openat(dirfd(dir), entry->d_name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        ssize_t len = read(fd, buffer, sizeof(buffer));
+        close(fd);
+        if (len <= 0)
+            continue;
+
+        std::string_view line(buffer, len);
+        line = line.substr(0, line.find('\n'));
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string_view::npos)
+            continue;
+        line = line.substr(first, line.find_last_not_of(" \t\r") - first + 1);
+
+        SYSTEM_SENSOR_LOG_DEBUG("Read " << entry->d_name << ": " << line);
+        values.emplace(entry->d_name, line);
     }
+    closedir(dir);
 
-    SYSTEM_SENSOR_LOG_DEBUG("No content in " << fullPath);
-    return "";
+    return values;
 }
 
-int SystemSensor::readProcInt(const std::string& filename, int defaultValue) {
-    std::string value = readProcString(filename);
-
-    if (value.empty()) {
-        SYSTEM_SENSOR_LOG_DEBUG("Using default value " << defaultValue << " for " << filename);
-        return defaultValue;
-    }
-
-    try {
-        int result = std::stoi(value);
-        SYSTEM_SENSOR_LOG_DEBUG("Parsed " << filename << " as int: " << result);
-        return result;
-    } catch (const std::exception& e) {
-        SYSTEM_SENSOR_LOG_ERROR("Failed to parse '" << value << "' as int from " << filename << ": " << e.what());
-        return defaultValue;
-    }
+bool SystemSensor::parseInt(std::string_view str, int &value) {
+    int result = 0;
+    auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), result);
+    if (ec != std::errc() || end != str.data() + str.size())
+        return false;
+    value = result;
+    return true;
 }
 
-unsigned int SystemSensor::parseHexString(const std::string& hexStr) {
-    if (hexStr.empty()) {
-        return 0;
-    }
-
-    try {
-        // Handle both "0x37" and "37" formats
-        if (hexStr.substr(0, 2) == "0x" || hexStr.substr(0, 2) == "0X") {
-            return static_cast<unsigned int>(std::stoul(hexStr, nullptr, 16));
-        } else {
-            return static_cast<unsigned int>(std::stoul(hexStr, nullptr, 16));
-        }
-    } catch (const std::exception& e) {
-        SYSTEM_SENSOR_LOG_ERROR("Failed to parse hex string '" << hexStr << "': " << e.what());
-        return 0;
-    }
+bool SystemSensor::parseHex(std::string_view str, unsigned int &value) {
+    // Handle both "0x37" and "37" formats
+    if (str.size() > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
+        str.remove_prefix(2);
+
+    unsigned int result = 0;
+    auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), result, 16);
+    if (str.empty() || ec != std::errc() || end != str.data() + str.size())
+        return false;
+    value = result;
+    return true;
 }
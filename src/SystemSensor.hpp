@@ -2,6 +2,8 @@
 #define SYSTEM_SENSOR_HPP
 
 #include <string>
+#include <string_view>
+#include <unordered_map>
 
 /**
  * SystemSensor - Interface to thingino system sensor information
@@ -58,30 +60,30 @@ public:
      */
     static bool isAvailable();
 
-private:
-    static const std::string SENSOR_PROC_DIR;
-
     /**
-     * Read string value from proc file
-     * @param filename Filename in /proc/jz/sensor/
-     * @return File content as string, empty if file doesn't exist
+     * Read all files of /proc/jz/sensor/ in a single directory pass
+     * @return Map of filename to its first line (trimmed), empty if the
+     *         directory is not accessible
      */
-    static std::string readProcString(const std::string& filename);
+    static std::unordered_map<std::string, std::string> readAll();
 
     /**
-     * Read integer value from proc file
-     * @param filename Filename in /proc/jz/sensor/
-     * @param defaultValue Default value if file doesn't exist or parse fails
-     * @return Parsed integer value or default
+     * Parse a decimal integer without locale or stream overhead
+     * @param str Text to parse (e.g., "1920")
+     * @param value Receives the value, untouched on failure
+     * @return true if the whole text is a valid number
      */
-    static int readProcInt(const std::string& filename, int defaultValue = 0);
+    static bool parseInt(std::string_view str, int &value);
 
     /**
-     * Convert hex string to unsigned int
-     * @param hexStr Hex string (e.g., "0x37")
-     * @return Parsed unsigned integer value
+     * Parse a hex number with or without 0x prefix
+     * @param str Text to parse (e.g., "0x37")
+     * @param value Receives the value, untouched on failure
+     * @return true if the whole text is a valid number
      */
-    static unsigned int parseHexString(const std::string& hexStr);
+    static bool parseHex(std::string_view str, unsigned int &value);
+
+    static const std::string SENSOR_PROC_DIR;
 };
 
 #endif // SYSTEM_SENSOR_HPP
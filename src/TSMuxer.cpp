@@ -0,0 +1,339 @@
+#include "TSMuxer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#define TS_PACKET_SIZE 188
+#define TS_PAYLOAD_SIZE 184
+
+#define PID_PAT 0x0000
+#define PID_PMT 0x1000
+#define PID_VIDEO 0x0100
+#define PID_AUDIO 0x0101
+
+#define STREAM_ID_VIDEO 0xE0
+#define STREAM_ID_AUDIO 0xC0
+#define STREAM_ID_PRIVATE_1 0xBD
+
+// Timestamps start at 1s so audio slightly ahead of the first video frame
+// doesn't wrap, PCR runs 100ms ahead of the presentation time
+#define PTS_OFFSET 90000
+#define PCR_DELAY 9000
+
+static uint32_t crc32_mpeg2(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= static_cast<uint32_t>(data[i]) << 24;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static int aac_sampling_index(int sampleRate)
+{
+    static const int rates[] = {96000, 88200, 64000, 48000, 44100, 32000, 24000,
+                                22050, 16000, 12000, 11025, 8000,  7350};
+    for (int i = 0; i < static_cast<int>(sizeof(rates) / sizeof(rates[0])); i++)
+    {
+        if (rates[i] == sampleRate)
+            return i;
+    }
+    return 8; // 16 kHz
+}
+
+TSMuxer::TSMuxer(VideoCodec video, AudioCodec audio, int sampleRate, int channels)
+    : video(video)
+    , audio(audio)
+    , sampleRate(sampleRate)
+    , channels(std::max(1, channels))
+    , haveBase(false)
+    , baseUs(0)
+    , ccPat(0)
+    , ccPmt(0)
+    , ccVideo(0)
+    , ccAudio(0)
+{}
+
+bool TSMuxer::isGopStart(VideoCodec codec, uint8_t header, int &prevNalType)
+{
+    int type;
+    bool gopStart;
+    if (codec == VideoCodec::H265)
+    {
+        type = (header >> 1) & 0x3F;
+        bool prevParam = prevNalType >= 32 && prevNalType <= 34;
+        gopStart = type == 32 || (type >= 16 && type <= 21 && !prevParam);
+    }
+    else
+    {
+        type = header & 0x1F;
+        bool prevParam = prevNalType == 7 || prevNalType == 8;
+        gopStart = type == 7 || (type == 5 && !prevParam);
+    }
+    prevNalType = type;
+    return gopStart;
+}
+
+uint64_t TSMuxer::toPts(int64_t timestampUs)
+{
+    if (!haveBase)
+    {
+        haveBase = true;
+        baseUs = timestampUs;
+    }
+
+    int64_t pts = (timestampUs - baseUs) * 9 / 100 + PTS_OFFSET;
+    return static_cast<uint64_t>(std::max<int64_t>(pts, 0)) & 0x1FFFFFFFFULL;
+}
+
+void TSMuxer::writeSection(uint16_t pid, const std::vector<uint8_t> &section, std::vector<uint8_t> &out)
+{
+    uint8_t &cc = (pid == PID_PAT) ? ccPat : ccPmt;
+
+    size_t start = out.size();
+    out.resize(start + TS_PACKET_SIZE, 0xFF);
+    uint8_t *pkt = &out[start];
+
+    pkt[0] = 0x47;
+    pkt[1] = 0x40 | ((pid >> 8) & 0x1F);
+    pkt[2] = pid & 0xFF;
+    pkt[3] = 0x10 | (cc & 0x0F);
+    pkt[4] = 0x00; // pointer field
+    memcpy(pkt + 5, section.data(), std::min(section.size(), static_cast<size_t>(TS_PAYLOAD_SIZE - 1)));
+
+    cc = (cc + 1) & 0x0F;
+}
+
+void TSMuxer::writeTables(std::vector<uint8_t> &out)
+{
+    std::vector<uint8_t> pat = {
+        0x00,                       // table_id
+        0xB0, 0x0D,                 // section_length 13
+        0x00, 0x01,                 // transport_stream_id
+        0xC1, 0x00, 0x00,           // version 0, current, section 0/0
+        0x00, 0x01,                 // program_number 1
+        0xE0 | (PID_PMT >> 8), PID_PMT & 0xFF,
+    };
+    uint32_t crc = crc32_mpeg2(pat.data(), pat.size());
+    pat.insert(pat.end(), {static_cast<uint8_t>(crc >> 24), static_cast<uint8_t>(crc >> 16),
+                           static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc)});
+    writeSection(PID_PAT, pat, out);
+
+    std::vector<uint8_t> streams = {
+        static_cast<uint8_t>(video == VideoCodec::H265 ? 0x24 : 0x1B),
+        0xE0 | (PID_VIDEO >> 8), PID_VIDEO & 0xFF,
+        0xF0, 0x00,
+    };
+    if (audio == AudioCodec::AAC)
+    {
+        streams.insert(streams.end(), {0x0F, 0xE0 | (PID_AUDIO >> 8), PID_AUDIO & 0xFF, 0xF0, 0x00});
+    }
+    else if (audio == AudioCodec::Opus)
+    {
+        // Registration 'Opus' and the DVB extension descriptor with the channel count
+        streams.insert(streams.end(), {0x06, 0xE0 | (PID_AUDIO >> 8), PID_AUDIO & 0xFF, 0xF0, 0x0A,
+                                       0x05, 0x04, 'O', 'p', 'u', 's',
+                                       0x7F, 0x02, 0x80, static_cast<uint8_t>(channels)});
+    }
+
+    size_t sectionLength = 9 + streams.size() + 4;
+    std::vector<uint8_t> pmt = {
+        0x02,                       // table_id
+        static_cast<uint8_t>(0xB0 | ((sectionLength >> 8) & 0x0F)), static_cast<uint8_t>(sectionLength & 0xFF),
+        0x00, 0x01,                 // program_number 1
+        0xC1, 0x00, 0x00,           // version 0, current, section 0/0
+        0xE0 | (PID_VIDEO >> 8), PID_VIDEO & 0xFF, // PCR on the video PID
+        0xF0, 0x00,                 // no program info
+    };
+    pmt.insert(pmt.end(), streams.begin(), streams.end());
+    crc = crc32_mpeg2(pmt.data(), pmt.size());
+    pmt.insert(pmt.end(), {static_cast<uint8_t>(crc >> 24), static_cast<uint8_t>(crc >> 16),
+                           static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc)});
+    writeSection(PID_PMT, pmt, out);
+}
+
+void TSMuxer::writePes(uint16_t pid, uint8_t streamId, const std::vector<uint8_t> &payload,
+                       uint64_t pts, bool withPcr, bool randomAccess, std::vector<uint8_t> &out)
+{
+    uint8_t &cc = (pid == PID_VIDEO) ? ccVideo : ccAudio;
+
+    uint8_t header[14];
+    size_t pesLength = 3 + 5 + payload.size();
+    header[0] = 0x00;
+    header[1] = 0x00;
+    header[2] = 0x01;
+    header[3] = streamId;
+    // Unbounded (0) is only allowed for video
+    header[4] = pesLength > 0xFFFF ? 0 : (pesLength >> 8) & 0xFF;
+    header[5] = pesLength > 0xFFFF ? 0 : pesLength & 0xFF;
+    header[6] = 0x80;
+    header[7] = 0x80; // PTS only
+    header[8] = 0x05;
+    header[9] = 0x21 | ((pts >> 29) & 0x0E);
+    header[10] = (pts >> 22) & 0xFF;
+    header[11] = ((pts >> 14) & 0xFE) | 0x01;
+    header[12] = (pts >> 7) & 0xFF;
+    header[13] = ((pts << 1) & 0xFE) | 0x01;
+
+    size_t total = sizeof(header) + payload.size();
+    size_t pos = 0;
+    bool first = true;
+
+    while (pos < total)
+    {
+        uint8_t adapt[TS_PAYLOAD_SIZE];
+        size_t adaptLen = 0;
+        bool hasAdapt = false;
+
+        if (first && (withPcr || randomAccess))
+        {
+            hasAdapt = true;
+            adapt[adaptLen++] = (randomAccess ? 0x40 : 0x00) | (withPcr ? 0x10 : 0x00);
+            if (withPcr)
+            {
+                uint64_t pcr = (pts >= PCR_DELAY) ? pts - PCR_DELAY : 0;
+                adapt[adaptLen++] = (pcr >> 25) & 0xFF;
+                adapt[adaptLen++] = (pcr >> 17) & 0xFF;
+                adapt[adaptLen++] = (pcr >> 9) & 0xFF;
+                adapt[adaptLen++] = (pcr >> 1) & 0xFF;
+                adapt[adaptLen++] = ((pcr & 0x01) << 7) | 0x7E;
+                adapt[adaptLen++] = 0x00;
+            }
+        }
+
+        size_t space = TS_PAYLOAD_SIZE - (hasAdapt ? 1 + adaptLen : 0);
+        size_t remaining = total - pos;
+        if (remaining < space)
+        {
+            // Pad the last packet through the adaptation field
+            size_t stuffing = space - remaining;
+            if (!hasAdapt)
+            {
+                hasAdapt = true;
+                stuffing--; // length byte
+                if (stuffing > 0)
+                {
+                    adapt[adaptLen++] = 0x00;
+                    stuffing--;
+                }
+            }
+            memset(adapt + adaptLen, 0xFF, stuffing);
+            adaptLen += stuffing;
+            space = remaining;
+        }
+
+        size_t start = out.size();
+        out.resize(start + TS_PACKET_SIZE);
+        uint8_t *pkt = &out[start];
+        pkt[0] = 0x47;
+        pkt[1] = (first ? 0x40 : 0x00) | ((pid >> 8) & 0x1F);
+        pkt[2] = pid & 0xFF;
+        pkt[3] = (hasAdapt ? 0x30 : 0x10) | (cc & 0x0F);
+        cc = (cc + 1) & 0x0F;
+
+        uint8_t *p = pkt + 4;
+        if (hasAdapt)
+        {
+            *p++ = static_cast<uint8_t>(adaptLen);
+            memcpy(p, adapt, adaptLen);
+            p += adaptLen;
+        }
+
+        // Copy from the PES header first, then the payload
+        size_t left = space;
+        while (left > 0)
+        {
+            size_t n;
+            if (pos < sizeof(header))
+            {
+                n = std::min(left, sizeof(header) - pos);
+                memcpy(p, header + pos, n);
+            }
+            else
+            {
+                n = left;
+                memcpy(p, payload.data() + (pos - sizeof(header)), n);
+            }
+            p += n;
+            pos += n;
+            left -= n;
+        }
+
+        first = false;
+    }
+}
+
+void TSMuxer::writeVideo(const std::vector<const std::vector<uint8_t> *> &nals, int64_t timestampUs,
+                         bool keyframe, std::vector<uint8_t> &out)
+{
+    static const uint8_t startCode[] = {0x00, 0x00, 0x00, 0x01};
+    static const uint8_t audH264[] = {0x09, 0xF0};
+    static const uint8_t audH265[] = {0x46, 0x01, 0x50};
+
+    uint64_t pts = toPts(timestampUs);
+
+    if (keyframe)
+    {
+        writeTables(out);
+    }
+
+    pes.clear();
+    pes.insert(pes.end(), startCode, startCode + sizeof(startCode));
+    if (video == VideoCodec::H265)
+        pes.insert(pes.end(), audH265, audH265 + sizeof(audH265));
+    else
+        pes.insert(pes.end(), audH264, audH264 + sizeof(audH264));
+
+    for (const std::vector<uint8_t> *nal : nals)
+    {
+        pes.insert(pes.end(), startCode, startCode + sizeof(startCode));
+        pes.insert(pes.end(), nal->begin(), nal->end());
+    }
+
+    writePes(PID_VIDEO, STREAM_ID_VIDEO, pes, pts, true, keyframe, out);
+}
+
+void TSMuxer::writeAudio(const uint8_t *data, size_t len, int64_t timestampUs, std::vector<uint8_t> &out)
+{
+    if (audio == AudioCodec::None)
+        return;
+
+    uint64_t pts = toPts(timestampUs);
+
+    pes.clear();
+    if (audio == AudioCodec::AAC)
+    {
+        // AAC LC with ADTS header, the encoder emits raw frames
+        size_t frameLen = len + 7;
+        int sfi = aac_sampling_index(sampleRate);
+        pes.push_back(0xFF);
+        pes.push_back(0xF1);
+        pes.push_back((1 << 6) | (sfi << 2) | ((channels >> 2) & 0x01));
+        pes.push_back(((channels & 0x03) << 6) | ((frameLen >> 11) & 0x03));
+        pes.push_back((frameLen >> 3) & 0xFF);
+        pes.push_back(((frameLen & 0x07) << 5) | 0x1F);
+        pes.push_back(0xFC);
+        pes.insert(pes.end(), data, data + len);
+        writePes(PID_AUDIO, STREAM_ID_AUDIO, pes, pts, false, false, out);
+    }
+    else
+    {
+        // Opus control header, access unit size as a run of 0xFF bytes
+        pes.push_back(0x7F);
+        pes.push_back(0xE0);
+        size_t size = len;
+        while (size >= 255)
+        {
+            pes.push_back(0xFF);
+            size -= 255;
+        }
+        pes.push_back(static_cast<uint8_t>(size));
+        pes.insert(pes.end(), data, data + len);
+        writePes(PID_AUDIO, STREAM_ID_PRIVATE_1, pes, pts, false, false, out);
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef TS_MUXER_HPP
+#define TS_MUXER_HPP
+
+// Minimal MPEG-2 transport stream muxer for already encoded video and audio.
+// One program, H.264 or H.265 video plus optional AAC (raw frames, ADTS is
+// added here) or Opus audio. Output is appended to a byte vector so the caller
+// decides where it goes (file, socket) and when it blocks.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class TSMuxer
+{
+public:
+    enum class VideoCodec
+    {
+        H264,
+        H265
+    };
+
+    enum class AudioCodec
+    {
+        None,
+        AAC,
+        Opus
+    };
+
+    TSMuxer(VideoCodec video, AudioCodec audio, int sampleRate, int channels);
+
+    // Whether the NAL with this header byte starts a GOP (parameter sets, or
+    // an IDR without them in front). prevNalType tracks the previous NAL
+    // type of the stream, start with -1.
+    static bool isGopStart(VideoCodec codec, uint8_t header, int &prevNalType);
+
+    // PAT and PMT, written at the start and in front of every keyframe
+    void writeTables(std::vector<uint8_t> &out);
+
+    // One access unit, NALs without start codes
+    void writeVideo(const std::vector<const std::vector<uint8_t> *> &nals, int64_t timestampUs,
+                    bool keyframe, std::vector<uint8_t> &out);
+
+    // One encoded audio frame
+    void writeAudio(const uint8_t *data, size_t len, int64_t timestampUs, std::vector<uint8_t> &out);
+
+private:
+    uint64_t toPts(int64_t timestampUs);
+    void writePes(uint16_t pid, uint8_t streamId, const std::vector<uint8_t> &payload,
+                  uint64_t pts, bool withPcr, bool randomAccess, std::vector<uint8_t> &out);
+    void writeSection(uint16_t pid, const std::vector<uint8_t> &section, std::vector<uint8_t> &out);
+
+    VideoCodec video;
+    AudioCodec audio;
+    int sampleRate;
+    int channels;
+
+    bool haveBase;
+    int64_t baseUs;
+
+    uint8_t ccPat;
+    uint8_t ccPmt;
+    uint8_t ccVideo;
+    uint8_t ccAudio;
+
+    std::vector<uint8_t> pes;
+};
+
+#endif // TS_MUXER_HPP
@@ -1,51 +1,117 @@
 #include "VideoWorker.hpp"
 
 #include "Config.hpp"
+#include "DVR.hpp"
+#include "Recorder.hpp"
+#include "WSLive.hpp"
+#include "EventBus.hpp"
 #include "IMPEncoder.hpp"
 #include "IMPFramesource.hpp"
+#include "JPEGWorker.hpp"
 #include "Logger.hpp"
+#include "RTSPStatus.hpp"
 #include "WorkerUtils.hpp"
 #include "TimestampManager.hpp"
 #include "globals.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <unistd.h>
+
 #undef MODULE
 #define MODULE "VideoWorker"
 
+// Wait before starting a failed encoder again, doubled up to the maximum
+static constexpr int START_RETRY_MIN_MS = 250;
+static constexpr int START_RETRY_MAX_MS = 8000;
+
 VideoWorker::VideoWorker(int chn)
-    : encChn(chn)
+    : chn(chn)
+    , encChn(videoEncChn(chn))
+    , power(POWER_ACTIVE)
+    , powerSince(steady_clock::now())
+    , powerMs{}
+    , resumePending(false)
+    , startRetryMs(0)
+    , resumes(0)
+    , lastResumeMs(0)
+    , maxResumeMs(0)
 {
-    LOG_DEBUG("VideoWorker created for channel " << encChn);
+    LOG_DEBUG("VideoWorker created for stream " << chn << " (encoder channel " << encChn << ")");
 }
 
 VideoWorker::~VideoWorker()
 {
-    LOG_DEBUG("VideoWorker destroyed for channel " << encChn);
+    LOG_DEBUG("VideoWorker destroyed for stream " << chn);
 }
 
 void VideoWorker::run()
 {
-    LOG_DEBUG("Start video processing run loop for stream " << encChn);
+    LOG_DEBUG("Start video processing run loop for stream " << chn);
 
     uint32_t bps = 0;
     uint32_t fps = 0;
     uint32_t error_count = 0; // Keep track of polling errors
     unsigned long long ms = 0;
     bool run_for_jpeg = false;
+    bool run_for_dvr = false;
+    bool run_for_record = false;
+    bool run_for_live = false;
 
-    while (global_video[encChn]->running)
+    while (global_video[chn]->running)
     {
-        /* bool helper to check if this is the active jpeg channel and a jpeg is requested while
+        // one consistent view of the config per pass
+        std::shared_ptr<const ConfigSnapshot> conf = cfg->snapshot();
+
+        /* bool helper to check if this stream feeds a jpeg channel and a jpeg is requested while
          * the channel is inactive
          */
-        run_for_jpeg = (encChn == global_jpeg[0]->streamChn && global_video[encChn]->run_for_jpeg);
+        run_for_jpeg = ((chn == global_jpeg[0]->streamChn || chn == global_jpeg[1]->streamChn)
+                        && global_video[chn]->run_for_jpeg);
+        run_for_dvr = global_dvr->acceptsVideo(chn);
+        run_for_record = global_recorder->acceptsVideo(chn);
+        run_for_live = global_live->accepts(chn);
 
         /* now we need to verify that
          * 1. a client is connected (hasDataCallback)
          * 2. a jpeg is requested
+         * 3. the dvr or the recorder records this stream
+         * 4. a websocket session watches it live
          */
-        if (global_video[encChn]->hasDataCallback || run_for_jpeg)
+        if (global_video[chn]->hasDataCallback || run_for_jpeg || run_for_dvr || run_for_record
+            || run_for_live)
         {
-            if (IMP_Encoder_PollingStream(encChn, cfg->general.imp_polling_timeout) == 0)
+            // a lazy stream gets its encoder with the first consumer
+            if (!global_video[chn]->imp_encoder)
+            {
+                if (global_restart_video)
+                {
+                    usleep(10000);
+                    continue;
+                }
+                if (!resumePending)
+                {
+                    resumeStart = steady_clock::now();
+                    resumePending = true;
+                }
+                if (startEncoder() != 0)
+                {
+                    // nothing is left half started, try again unless stopped meanwhile
+                    startRetryMs = std::clamp(startRetryMs * 2, START_RETRY_MIN_MS, START_RETRY_MAX_MS);
+                    LOG_ERROR(global_video[chn]->name << " encoder failed to start, retrying in " << startRetryMs << " ms");
+                    std::unique_lock<std::mutex> lock_stream{mutex_main};
+                    global_video[chn]->should_grab_frames.wait_for(lock_stream, milliseconds(startRetryMs), [this]() {
+                        return !global_video[chn]->running;
+                    });
+                    continue;
+                }
+                startRetryMs = 0;
+                setPower(POWER_ACTIVE);
+                LOG_INFO(global_video[chn]->name << " encoder started on demand");
+            }
+
+            if (encoderPoll.wait(conf->general.imp_polling_timeout))
             {
                 IMPEncoderStream stream;
                 if (IMP_Encoder_GetStream(encChn, &stream, GET_STREAM_BLOCKING) != 0)
@@ -55,6 +121,15 @@ void VideoWorker::run()
                     continue;
                 }
 
+                if (resumePending)
+                {
+                    resumePending = false;
+                    resumes++;
+                    lastResumeMs = duration_cast<milliseconds>(steady_clock::now() - resumeStart).count();
+                    maxResumeMs = std::max(maxResumeMs, lastResumeMs);
+                    LOG_DEBUG(global_video[chn]->name << " first frame " << lastResumeMs << " ms after wake up");
+                    writePowerStats();
+                }
 
                 // SINGLE SOURCE OF TRUTH: Use TimestampManager (which uses IMP hardware timestamps)
                 struct timeval monotonic_time;
@@ -69,7 +144,7 @@ void VideoWorker::run()
                     fps++;
                     bps += stream.pack[i].length;
 
-                    if (global_video[encChn]->hasDataCallback)
+                    if (global_video[chn]->hasDataCallback || run_for_dvr || run_for_record || run_for_live)
                     {
 #if defined(PLATFORM_T31) || defined(PLATFORM_T40) || defined(PLATFORM_T41) || defined(PLATFORM_C100)
                         uint8_t *start = (uint8_t *) stream.virAddr + stream.pack[i].offset;
@@ -86,18 +161,29 @@ void VideoWorker::run()
                         // We use start+4 because the encoder inserts 4-byte MPEG
                         //'startcodes' at the beginning of each NAL. Live555 complains
                         nalu.data.insert(nalu.data.end(), start + 4, end);
-                        if (global_video[encChn]->idr == false)
+
+                        // copied into the dvr and recorder queues, never blocks
+                        if (run_for_dvr)
+                            global_dvr->pushVideo(nalu);
+                        if (run_for_record)
+                            global_recorder->pushVideo(nalu);
+                        if (run_for_live)
+                            global_live->pushVideo(chn, nalu);
+                        if (!global_video[chn]->hasDataCallback)
+                            continue;
+
+                        if (global_video[chn]->idr == false)
                         {
 #if defined(PLATFORM_T31) || defined(PLATFORM_T40) || defined(PLATFORM_T41) || defined(PLATFORM_C100)
                             if (stream.pack[i].nalType.h264NalType == 7
                                 || stream.pack[i].nalType.h264NalType == 8
                                 || stream.pack[i].nalType.h264NalType == 5)
                             {
-                                global_video[encChn]->idr = true;
+                                global_video[chn]->idr = true;
                             }
                             else if (stream.pack[i].nalType.h265NalType == 32)
                             {
-                                global_video[encChn]->idr = true;
+                                global_video[chn]->idr = true;
                             }
 #elif defined(PLATFORM_T10) || defined(PLATFORM_T20) || defined(PLATFORM_T21) \
     || defined(PLATFORM_T23)
@@ -105,26 +191,27 @@ void VideoWorker::run()
                                 || stream.pack[i].dataType.h264Type == 8
                                 || stream.pack[i].dataType.h264Type == 5)
                             {
-                                global_video[encChn]->idr = true;
+                                global_video[chn]->idr = true;
                             }
 #elif defined(PLATFORM_T30)
                             if (stream.pack[i].dataType.h264Type == 7
                                 || stream.pack[i].dataType.h264Type == 8
                                 || stream.pack[i].dataType.h264Type == 5)
                             {
-                                global_video[encChn]->idr = true;
+                                global_video[chn]->idr = true;
                             }
                             else if (stream.pack[i].dataType.h265Type == 32)
                             {
-                                global_video[encChn]->idr = true;
+                                global_video[chn]->idr = true;
                             }
 #endif
                         }
 
-                        if (global_video[encChn]->idr == true)
+                        if (global_video[chn]->idr == true)
                         {
-                            if (!global_video[encChn]->msgChannel->write(nalu))
+                            if (!global_video[chn]->msgChannel->write(nalu))
                             {
+                                global_video[chn]->dropped_nals.fetch_add(1, std::memory_order_relaxed);
                                 LOG_ERROR("video " << "channel:" << encChn << ", "
                                                    << "package:" << i << " of " << stream.packCount
                                                    << ", " << "packageSize:" << nalu.data.size()
@@ -133,9 +220,9 @@ void VideoWorker::run()
                             else
                             {
                                 std::unique_lock<std::mutex> lock_stream{
-                                    global_video[encChn]->onDataCallbackLock};
-                                if (global_video[encChn]->onDataCallback)
-                                    global_video[encChn]->onDataCallback();
+                                    global_video[chn]->onDataCallbackLock};
+                                if (global_video[chn]->onDataCallback)
+                                    global_video[chn]->onDataCallback();
                             }
                         }
 #if defined(USE_AUDIO_STREAM_REPLICATOR)
@@ -143,10 +230,10 @@ void VideoWorker::run()
                          * and the audio grabber and encoder standby is also controlled by the video threads
                          * we need to wakeup the audio thread
                         */
-                        if (cfg->audio.input_enabled && !global_audio[0]->active && !global_restart)
+                        if (conf->audio.input_enabled && !global_audio[0]->active && !global_restart)
                         {
                             LOG_DDEBUG("NOTIFY AUDIO " << !global_audio[0]->active << " "
-                                                       << cfg->audio.input_enabled);
+                                                       << conf->audio.input_enabled);
                             global_audio[0]->should_grab_frames.notify_one();
                         }
 #endif
@@ -155,21 +242,29 @@ void VideoWorker::run()
 
                 IMP_Encoder_ReleaseStream(encChn, &stream);
 
-                ms = WorkerUtils::getMonotonicTimeDiffInMs(&global_video[encChn]->stream->stats.ts);
+                // the packs of one GetStream form one frame for the live sessions
+                if (run_for_live)
+                {
+                    global_live->commit(chn);
+                    if (global_live->takeKeyframeRequest(chn))
+                        IMP_Encoder_RequestIDR(encChn);
+                }
+
+                ms = WorkerUtils::getMonotonicTimeDiffInMs(&global_video[chn]->stream->stats.ts);
                 if (ms > 1000)
                 {
                     /* currently we write into osd and stream stats,
                      * osd will be removed and redesigned in future
                     */
-                    global_video[encChn]->stream->stats.bps = bps;
-                    global_video[encChn]->stream->osd.stats.bps = bps;
-                    global_video[encChn]->stream->stats.fps = fps;
-                    global_video[encChn]->stream->osd.stats.fps = fps;
+                    global_video[chn]->stream->stats.bps = bps;
+                    global_video[chn]->stream->osd.stats.bps = bps;
+                    global_video[chn]->stream->stats.fps = fps;
+                    global_video[chn]->stream->osd.stats.fps = fps;
 
                     fps = 0;
                     bps = 0;
-                    WorkerUtils::getMonotonicTimeOfDay(&global_video[encChn]->stream->stats.ts);
-                    global_video[encChn]->stream->osd.stats.ts = global_video[encChn]
+                    WorkerUtils::getMonotonicTimeOfDay(&global_video[chn]->stream->stats.ts);
+                    global_video[chn]->stream->osd.stats.ts = global_video[chn]
                                                                      ->stream->stats.ts;
                     /*
                     IMPEncoderCHNStat encChnStats;
@@ -182,10 +277,10 @@ void VideoWorker::run()
                                 ", curPacks:" << encChnStats.curPacks <<
                                 ", work_done:" << encChnStats.work_done);
                     */
-                    if (global_video[encChn]->idr_fix)
+                    if (global_video[chn]->idr_fix)
                     {
                         IMP_Encoder_RequestIDR(encChn);
-                        global_video[encChn]->idr_fix--;
+                        global_video[chn]->idr_fix--;
                     }
                 }
             }
@@ -193,30 +288,86 @@ void VideoWorker::run()
             {
                 error_count++;
                 LOG_DDEBUG("IMP_Encoder_PollingStream("
-                           << encChn << ", " << cfg->general.imp_polling_timeout << ") timeout !");
+                           << encChn << ", " << conf->general.imp_polling_timeout << ") timeout !");
             }
         }
-        else if (global_video[encChn]->onDataCallback == nullptr && !global_restart_video
-                 && !global_video[encChn]->run_for_jpeg)
+        else if (global_video[chn]->onDataCallback == nullptr && !global_restart_video
+                 && !global_video[chn]->run_for_jpeg)
         {
             LOG_DDEBUG("VIDEO LOCK" << " channel:" << encChn << " hasCallbackIsNull:"
-                                    << (global_video[encChn]->onDataCallback == nullptr)
+                                    << (global_video[chn]->onDataCallback == nullptr)
                                     << " restartVideo:" << global_restart_video
-                                    << " runForJpeg:" << global_video[encChn]->run_for_jpeg);
+                                    << " runForJpeg:" << global_video[chn]->run_for_jpeg);
+
+            global_video[chn]->stream->stats.bps = 0;
+            global_video[chn]->stream->stats.fps = 0;
+            global_video[chn]->stream->osd.stats.bps = 0;
+            global_video[chn]->stream->osd.stats.fps = 0;
 
-            global_video[encChn]->stream->stats.bps = 0;
-            global_video[encChn]->stream->stats.fps = 0;
-            global_video[encChn]->stream->osd.stats.bps = 0;
-            global_video[encChn]->stream->osd.stats.fps = 0;
+            global_events->streamState(global_video[chn]->name, "idle");
+
+            auto idle = [this]() {
+                return global_video[chn]->onDataCallback == nullptr && !global_restart_video
+                       && !global_video[chn]->run_for_jpeg && !global_dvr->acceptsVideo(chn)
+                       && !global_recorder->acceptsVideo(chn) && !global_live->accepts(chn);
+            };
+
+            if (power == POWER_ACTIVE)
+                setPower(POWER_IDLE);
+            auto idleSince = steady_clock::now();
 
             std::unique_lock<std::mutex> lock_stream{mutex_main};
-            global_video[encChn]->active = false;
-            while (global_video[encChn]->onDataCallback == nullptr && !global_restart_video
-                   && !global_video[encChn]->run_for_jpeg)
-                global_video[encChn]->should_grab_frames.wait(lock_stream);
+            global_video[chn]->active = false;
+
+            /* step down the standby tiers while nobody shows up, the deadlines
+             * are read again after every step to follow configuration changes
+             */
+            Power next;
+            int after;
+            while (idle())
+            {
+                if (!nextStandby(next, after))
+                {
+                    global_video[chn]->should_grab_frames.wait(lock_stream);
+                    continue;
+                }
+                if (global_video[chn]->should_grab_frames.wait_until(lock_stream,
+                                                                        idleSince + seconds(after),
+                                                                        [&idle]() { return !idle(); }))
+                    break;
+
+                lock_stream.unlock();
+                enterStandby(next);
+                lock_stream.lock();
+            }
 
-            global_video[encChn]->active = true;
-            global_video[encChn]->is_activated.release();
+            /* a lazy stream gets its encoder in the polling branch, the lighter
+             * tiers come back here so a waiting JPEG request finds frames
+             */
+            if (power >= POWER_RECV_STOPPED)
+            {
+                resumeStart = steady_clock::now();
+                resumePending = true;
+            }
+            if (power == POWER_RECV_STOPPED || power == POWER_FS_DISABLED)
+            {
+                if (!global_restart_video)
+                {
+                    lock_stream.unlock();
+                    resume();
+                    lock_stream.lock();
+                }
+            }
+            else if (power == POWER_IDLE)
+            {
+                setPower(POWER_ACTIVE);
+            }
+
+            global_video[chn]->active = true;
+            global_video[chn]->is_activated.release();
+            lock_stream.unlock();
+
+            global_events->streamState(global_video[chn]->name, "active");
 
             // unlock audio
             global_audio[0]->should_grab_frames.notify_one();
@@ -226,62 +377,265 @@ void VideoWorker::run()
     }
 }
 
-void *VideoWorker::thread_entry(void *arg)
+bool VideoWorker::lazy(int chn)
 {
-    StartHelper *sh = static_cast<StartHelper *>(arg);
-    int encChn = sh->encChn;
+    std::shared_ptr<const ConfigSnapshot> conf = cfg->snapshot();
+
+    if (conf->stream(chn).idle_timeout <= 0)
+        return false;
+    if (conf->stream2.enabled && conf->stream2.jpeg_channel == chn)
+        return false;
+    if (JPEGWorker::thumbnailSource() == chn)
+        return false;
+    if (conf->motion.enabled && conf->motion.monitor_stream == chn)
+        return false;
+    if (feedsDerived(chn))
+        return false;
+    return true;
+}
 
-    LOG_DEBUG("Start stream_grabber thread for stream " << encChn);
+bool VideoWorker::feedsDerived(int chn)
+{
+    std::shared_ptr<const ConfigSnapshot> conf = cfg->snapshot();
 
+    for (int derived = NUM_SOURCE_STREAMS; derived < MAX_VIDEO_STREAMS; derived++)
+    {
+        if (conf->streams[derived].enabled && conf->streams[derived].source == chn)
+            return true;
+    }
+    return false;
+}
+
+int VideoWorker::startEncoder()
+{
     int ret;
 
-    global_video[encChn]->imp_framesource = IMPFramesource::createNew(global_video[encChn]->stream,
-                                                                      &cfg->sensor,
-                                                                      encChn);
-    global_video[encChn]->imp_encoder = IMPEncoder::createNew(global_video[encChn]->stream,
-                                                              encChn,
-                                                              encChn,
-                                                              global_video[encChn]->name);
-    global_video[encChn]->imp_framesource->enable();
-    global_video[encChn]->run_for_jpeg = false;
-
-    // inform main that initialization is complete
-    sh->has_started.release();
+    std::lock_guard<std::mutex> lock_encoder{global_video[chn]->encoder_lock};
+
+    if (chn >= NUM_SOURCE_STREAMS)
+    {
+        // a derived channel joins the encoder group of its source, which
+        // keeps its framesource running while the derived stream is enabled
+        _stream &stream = *global_video[chn]->stream;
+        stream.width = cfg->streams[stream.source].width;
+        stream.height = cfg->streams[stream.source].height;
+        global_video[chn]->imp_encoder = IMPEncoder::createNew(global_video[chn]->stream,
+                                                               encChn,
+                                                               global_video[chn]->stream->source,
+                                                               global_video[chn]->name);
+    }
+    else
+    {
+        /* the framesource channel is kept once created, disabling it releases its
+         * buffers and init() applies the current attributes again
+         */
+        if (global_video[chn]->imp_framesource)
+            global_video[chn]->imp_framesource->init();
+        else
+            global_video[chn]->imp_framesource = IMPFramesource::createNew(global_video[chn]->stream,
+                                                                           &cfg->sensor,
+                                                                           encChn);
+        global_video[chn]->imp_encoder = IMPEncoder::createNew(global_video[chn]->stream,
+                                                               encChn,
+                                                               encChn,
+                                                               global_video[chn]->name);
+        global_video[chn]->imp_framesource->enable();
+    }
 
     ret = IMP_Encoder_StartRecvPic(encChn);
     LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_StartRecvPic(" << encChn << ")");
     if (ret != 0)
-        return 0;
+    {
+        // undo the start, the run loop retries from scratch
+        if (global_video[chn]->imp_framesource)
+            global_video[chn]->imp_framesource->disable();
+        global_video[chn]->imp_encoder->deinit();
+        delete global_video[chn]->imp_encoder;
+        global_video[chn]->imp_encoder = nullptr;
+        return ret;
+    }
+
+    encoderPoll.attach(encChn);
 
     // Proactively request an IDR to ensure SPS/PPS are emitted promptly
     IMP_Encoder_RequestIDR(encChn);
     LOG_DEBUG("IMP_Encoder_RequestIDR(" << encChn << ")");
     // Also schedule a couple more IDR requests in the first seconds, just in case
-    global_video[encChn]->idr_fix = 2;
+    global_video[chn]->idr_fix = 2;
+    global_video[chn]->idr = false;
 
-    /* 'active' indicates, the thread is activly polling and grabbing images
-     * 'running' describes the runlevel of the thread, if this value is set to false
-     *           the thread exits and cleanup all ressources
+    return 0;
+}
+
+void VideoWorker::stopEncoder()
+{
+    int ret;
+
+    std::lock_guard<std::mutex> lock_encoder{global_video[chn]->encoder_lock};
+
+    // a stream in standby has some of this done already
+    if (power < POWER_RECV_STOPPED)
+    {
+        ret = IMP_Encoder_StopRecvPic(encChn);
+        LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_StopRecvPic(" << encChn << ")");
+    }
+
+    if (global_video[chn]->imp_framesource && power < POWER_FS_DISABLED)
+        global_video[chn]->imp_framesource->disable();
+
+    if (global_video[chn]->imp_encoder)
+    {
+        encoderPoll.detach();
+        global_video[chn]->imp_encoder->deinit();
+        delete global_video[chn]->imp_encoder;
+        global_video[chn]->imp_encoder = nullptr;
+    }
+}
+
+bool VideoWorker::nextStandby(Power &next, int &after) const
+{
+    std::shared_ptr<const ConfigSnapshot> conf = cfg->snapshot();
+    const _stream &stream = conf->stream(chn);
+
+    if (power < POWER_RECV_STOPPED && stream.standby_encoder_timeout > 0)
+    {
+        next = POWER_RECV_STOPPED;
+        after = stream.standby_encoder_timeout;
+        return true;
+    }
+
+    /* motion detection and derived streams are bound to the framesource, not
+     * to the encoder. A derived stream has no framesource of its own.
      */
-    global_video[encChn]->active = true;
-    global_video[encChn]->running = true;
-    VideoWorker worker(encChn);
-    worker.run();
+    bool shared = (conf->motion.enabled && conf->motion.monitor_stream == chn) || feedsDerived(chn);
+    if (power < POWER_FS_DISABLED && global_video[chn]->imp_framesource && !shared
+        && stream.standby_framesource_timeout > 0)
+    {
+        next = POWER_FS_DISABLED;
+        after = stream.standby_framesource_timeout;
+        return true;
+    }
+
+    if (power < POWER_OFF && global_video[chn]->imp_encoder && lazy(chn))
+    {
+        next = POWER_OFF;
+        after = stream.idle_timeout;
+        return true;
+    }
 
-    ret = IMP_Encoder_StopRecvPic(encChn);
-    LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_StopRecvPic(" << encChn << ")");
+    return false;
+}
+
+void VideoWorker::enterStandby(Power next)
+{
+    if (next == POWER_OFF)
+    {
+        stopEncoder();
+        setPower(POWER_OFF);
+        LOG_INFO(global_video[chn]->name << " encoder stopped after " << global_video[chn]->stream->idle_timeout
+                          << "s idle");
+        global_events->streamState(global_video[chn]->name, "standby");
+        return;
+    }
 
-    if (global_video[encChn]->imp_framesource)
     {
-        global_video[encChn]->imp_framesource->disable();
+        std::lock_guard<std::mutex> lock_encoder{global_video[chn]->encoder_lock};
 
-        if (global_video[encChn]->imp_encoder)
+        if (power < POWER_RECV_STOPPED)
         {
-            global_video[encChn]->imp_encoder->deinit();
-            delete global_video[encChn]->imp_encoder;
-            global_video[encChn]->imp_encoder = nullptr;
+            int ret = IMP_Encoder_StopRecvPic(encChn);
+            LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_StopRecvPic(" << encChn << ")");
         }
+        if (next == POWER_FS_DISABLED)
+            global_video[chn]->imp_framesource->disable();
+    }
+
+    setPower(next);
+    LOG_DEBUG(global_video[chn]->name << (next == POWER_FS_DISABLED ? " framesource" : " encoder") << " in standby");
+}
+
+int VideoWorker::resume()
+{
+    int ret;
+
+    {
+        std::lock_guard<std::mutex> lock_encoder{global_video[chn]->encoder_lock};
+
+        if (power == POWER_FS_DISABLED)
+            global_video[chn]->imp_framesource->enable();
+
+        ret = IMP_Encoder_StartRecvPic(encChn);
+        LOG_DEBUG_OR_ERROR(ret, "IMP_Encoder_StartRecvPic(" << encChn << ")");
+
+        // continue with an IDR right away instead of at the end of the gop,
+        // whatever the encoder still holds from before is not passed on
+        IMP_Encoder_RequestIDR(encChn);
+        global_video[chn]->idr = false;
     }
 
+    setPower(POWER_ACTIVE);
+    return ret;
+}
+
+void VideoWorker::setPower(Power next)
+{
+    auto now = steady_clock::now();
+    powerMs[power] += duration_cast<milliseconds>(now - powerSince).count();
+    powerSince = now;
+    power = next;
+    writePowerStats();
+}
+
+void VideoWorker::writePowerStats()
+{
+    static const char *names[POWER_STATES] = {"active", "idle", "recv_stopped", "fs_disabled", "off"};
+
+    std::string streamName = global_video[chn]->name;
+    RTSPStatus::writeCustomParameter(streamName, "power_state", names[power]);
+    for (int i = 0; i < POWER_STATES; i++)
+        RTSPStatus::writeCustomParameter(streamName, std::string("power_") + names[i] + "_s",
+                                         std::to_string(powerMs[i] / 1000));
+    RTSPStatus::writeCustomParameter(streamName, "power_resumes", std::to_string(resumes));
+    RTSPStatus::writeCustomParameter(streamName, "resume_latency_ms", std::to_string(lastResumeMs));
+    RTSPStatus::writeCustomParameter(streamName, "resume_latency_max_ms", std::to_string(maxResumeMs));
+}
+
+void *VideoWorker::thread_entry(void *arg)
+{
+    StartHelper *sh = static_cast<StartHelper *>(arg);
+    int chn = sh->encChn;
+
+    LOG_DEBUG("Start stream_grabber thread for stream " << chn);
+
+    VideoWorker worker(chn);
+    global_video[chn]->run_for_jpeg = false;
+
+    /* a lazy stream creates its encoder once the first consumer shows up,
+     * the others right away
+     */
+    bool lazy = VideoWorker::lazy(chn);
+    int ret = lazy ? 0 : worker.startEncoder();
+    worker.setPower(lazy ? POWER_OFF : POWER_ACTIVE);
+
+    /* 'active' indicates, the thread is activly polling and grabbing images
+     * 'running' describes the runlevel of the thread, if this value is set to false
+     *           the thread exits and cleanup all ressources
+     */
+    global_video[chn]->active = !lazy;
+    global_video[chn]->running = true;
+
+    // inform main that initialization is complete, it joins the thread on restart
+    sh->has_started.release();
+
+    if (ret != 0)
+        return 0;
+
+    global_events->streamState(global_video[chn]->name, "started");
+    worker.run();
+    global_events->streamState(global_video[chn]->name, "stopped");
+
+    if (global_video[chn]->imp_encoder)
+        worker.stopEncoder();
+
     return 0;
 }
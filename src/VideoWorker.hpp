@@ -1,18 +1,71 @@
 #ifndef VIDEO_WORKER_HPP
 #define VIDEO_WORKER_HPP
 
+#include "EncoderPoll.hpp"
+
+#include <chrono>
+#include <cstdint>
+
 class VideoWorker
 {
 public:
-    explicit VideoWorker(int encChn);
+    explicit VideoWorker(int chn);
     ~VideoWorker();
 
     static void *thread_entry(void *arg);
 
+    /* Whether the encoder of the stream may be created on the first consumer
+     * and torn down after stream.idle_timeout seconds without one. Not when
+     * the JPEG channel shares its buffers, motion detection watches it or a
+     * derived stream is in its encoder group.
+     */
+    static bool lazy(int chn);
+
+    // Whether an enabled derived stream encodes from stream chn
+    static bool feedsDerived(int chn);
+
 private:
+    /* Power states of the stream, deeper ones save more and take longer to
+     * leave. An idle stream steps down after stream.standby_encoder_timeout
+     * (encoder stops taking pictures), stream.standby_framesource_timeout
+     * (framesource channel disabled) and, for a lazy stream,
+     * stream.idle_timeout (encoder torn down).
+     */
+    enum Power
+    {
+        POWER_ACTIVE,
+        POWER_IDLE,
+        POWER_RECV_STOPPED,
+        POWER_FS_DISABLED,
+        POWER_OFF,
+        POWER_STATES
+    };
+
     void run();
+    int startEncoder();
+    void stopEncoder();
+
+    bool nextStandby(Power &next, int &after) const;
+    void enterStandby(Power next);
+    int resume();
+    void setPower(Power next);
+    void writePowerStats();
+
+    int chn;    // index of global_video and CFG::streams
+    int encChn; // videoEncChn(chn)
+    EncoderPoll encoderPoll;
+
+    Power power;
+    std::chrono::steady_clock::time_point powerSince;
+    uint64_t powerMs[POWER_STATES];
 
-    int encChn;
+    // From the wake up of a standby stream to its first frame
+    std::chrono::steady_clock::time_point resumeStart;
+    bool resumePending;
+    int startRetryMs; // back-off after a failed start of a lazy encoder
+    uint32_t resumes;
+    int64_t lastResumeMs;
+    int64_t maxResumeMs;
 };
 
 #endif // VIDEO_PROCESSOR_HPP
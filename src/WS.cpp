@@ -1,4 +1,6 @@
 #include "WS.hpp"
+#include <algorithm>
+#include <deque>
 #include <random>
 #include <set>
 #include <fstream>
@@ -10,6 +12,15 @@
 #include <imp/imp_isp.h>
 #include <imp/imp_audio.h>
 #include "OSD.hpp"
+#include "DVR.hpp"
+#include "EventBus.hpp"
+#include "WSLive.hpp"
+#include "SnapshotCache.hpp"
+#include "JsonCache.hpp"
+#include "ImageTuning.hpp"
+#include "WSBinary.hpp"
+#include "Motion.hpp"
+#include "Reconfig.hpp"
 #include "globals.hpp"
 #include <filesystem>
 #include <sys/inotify.h>
@@ -18,6 +29,7 @@
 #include <cerrno>
 #include <cstring>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -25,6 +37,9 @@
 
 #define MODULE "WEBSOCKET"
 
+// A snapshot long-poll (?after=) is answered after this at the latest
+#define SNAPSHOT_LONG_POLL_S 10
+
 #pragma region keys_and_enums
 
 using namespace std::chrono;
@@ -79,7 +94,12 @@ enum
     PNT_FLAG_HTTP_SEND_MESSAGE = 4096,
     PNT_FLAG_HTTP_RECEIVED_MESSAGE = 8192,
     PNT_FLAG_HTTP_SEND_PREVIEW = 16384,
-    PNT_FLAG_HTTP_SEND_INVALID = 32768
+    PNT_FLAG_HTTP_SEND_INVALID = 32768,
+
+    PNT_FLAG_WS_EVENTS = 65536,
+    PNT_FLAG_WS_LIVE = 131072,
+
+    PNT_FLAG_HTTP_SNAPSHOT_WAIT = 262144
 };
 
 /* ROOT */
@@ -423,6 +443,14 @@ enum
     PNT_MOTION_ENABLED,
     PNT_MOTION_SCRIPT_PATH,
     PNT_MOTION_ROIS,
+    PNT_MOTION_GRID_COLS,
+    PNT_MOTION_GRID_ROWS,
+    PNT_MOTION_ANALYSIS_FPS,
+    PNT_MOTION_CELL_THRESHOLD,
+    PNT_MOTION_MIN_CELLS,
+    PNT_MOTION_MAX_CPU_PERCENT,
+    PNT_MOTION_ENGINE,
+    PNT_MOTION_HEATMAP,
 };
 
 static const char *const motion_keys[] = {
@@ -443,7 +471,15 @@ static const char *const motion_keys[] = {
     "roi_count",
     "enabled",
     "script_path",
-    "rois"};
+    "rois",
+    "grid_cols",
+    "grid_rows",
+    "analysis_fps",
+    "cell_threshold",
+    "min_cells",
+    "max_cpu_percent",
+    "engine",
+    "heatmap"};
 
 /* INFO */
 enum
@@ -459,7 +495,10 @@ enum
 {
     PNT_RESTART_THREAD = 1,
     PNT_SAVE_CONFIG,
-    PNT_CAPTURE
+    PNT_CAPTURE,
+    PNT_DVR_TRIGGER,
+    PNT_EVENTS,
+    PNT_LIVE
 };
 
 enum
@@ -472,7 +511,10 @@ enum
 static const char *const action_keys[] = {
     "restart_thread",
     "save_config",
-    "capture"};
+    "capture",
+    "dvr_trigger",
+    "events",
+    "live"};
 
 #pragma endregion keys_and_enums
 
@@ -499,15 +541,23 @@ int flag;                           // bitmask info store e.g. JSON separator ("
     int vidx;
     size_t post_data_size;
     std::string rx_message;
-    std::string tx_message;
+    std::deque<WSMessagePtr> tx_queue; // answers to send, cached ones shared with other sessions
+    size_t tx_queued;                    // bytes in tx_queue
     std::string message;
     lws_sorted_usec_list_t sul; // lws Soft Timer
     struct snapshot_info snapshot;
+    uint64_t event_seq;         // last bus event sent, see PNT_FLAG_WS_EVENTS
+    int live_chn;               // stream sent as live video, see PNT_FLAG_WS_LIVE
+    uint64_t live_seq;          // last live frame sent, 0 before the first one
+    int snapshot_chn;           // jpeg channel of the requested snapshot size
+    uint64_t snapshot_known;    // snapshot seq the client has (If-None-Match, ?after=)
+    steady_clock::time_point snapshot_deadline; // end of a long-poll
 
     user_ctx(const char* session_id, lws *wsi_handle)
         : wsi(wsi_handle), value(0), flag(0),
-          region(), midx(0), vidx(0), post_data_size(0), rx_message(), tx_message(),
-          message(), sul(), snapshot()
+          region(), midx(0), vidx(0), post_data_size(0), rx_message(), tx_queue(), tx_queued(0),
+          message(), sul(), snapshot(), event_seq(0), live_chn(-1), live_seq(0), snapshot_chn(0),
+          snapshot_known(0), snapshot_deadline()
     {
         strncpy(id, session_id, SESSION_ID_LENGTH);
         id[SESSION_ID_LENGTH] = '\0';
@@ -569,29 +619,104 @@ int restart_threads_by_signal(int &flag)
     return 0;
 }
 
-bool get_snapshot(std::vector<unsigned char> &image)
+// Smallest snapshot size at least width wide, the largest one when none is
+int snapshot_channel(int width)
 {
+    if (width <= 0)
+        return 0;
+
+    int best = 0;
+    for (int i = 1; i < NUM_JPEG_CHANNELS; i++)
+    {
+        if (!global_jpeg[i]->running)
+            continue;
+
+        int w = global_jpeg[i]->stream->width;
+        int bestWidth = global_jpeg[best]->stream->width;
+        bool fits = w >= width;
+        bool bestFits = bestWidth >= width;
+        if ((fits && (!bestFits || w < bestWidth)) || (!fits && !bestFits && w > bestWidth))
+            best = i;
+    }
+    return best;
+}
+
+SnapshotPtr get_snapshot(int jpgChn)
+{
+    SnapshotPtr cached = global_snapshots->get(global_jpeg[jpgChn]->stream->width,
+                                               global_jpeg[jpgChn]->stream->jpeg_quality);
+    if (cached || jpgChn != 0)
+        return cached;
+
+    // nothing encoded since the start yet, the last snapshot may still be there
     std::ifstream file(global_jpeg[0]->stream->jpeg_path, std::ios::binary);
     if (!file.is_open())
     {
         LOG_DDEBUGWS(strerror(errno));
-        return false;
+        return nullptr;
     }
 
     file.seekg(0, std::ios::end);
     size_t file_size = file.tellg();
     if (file_size)
     {
-        image.resize(LWS_PRE + file_size);
+        auto image = std::make_shared<Snapshot>();
+        image->buffer.resize(LWS_PRE + file_size);
+        image->width = global_jpeg[0]->stream->width;
+        image->height = global_jpeg[0]->stream->height;
+        image->quality = global_jpeg[0]->stream->jpeg_quality;
+        image->seq = 0;
+        struct stat st;
+        image->modified = (stat(global_jpeg[0]->stream->jpeg_path, &st) == 0) ? st.st_mtime : time(nullptr);
         file.seekg(0, std::ios::beg);
-        file.read(reinterpret_cast<char *>(image.data() + LWS_PRE), file_size);
+        file.read(reinterpret_cast<char *>(image->buffer.data() + LWS_PRE), file_size);
         file.close();
-        return true;
+        return image;
+    }
+
+    return nullptr;
+}
+
+// seq of an ETag as sent by snapshot_headers, W/"12" or "12"
+uint64_t parse_etag(const char *etag)
+{
+    if (strncmp(etag, "W/", 2) == 0)
+        etag += 2;
+    if (*etag == '"')
+        etag++;
+    return strtoull(etag, nullptr, 10);
+}
+
+// ETag, Last-Modified and Cache-Control of a snapshot, clients revalidate
+// every time and get a 304 while they have the latest image
+int snapshot_headers(struct lws *wsi, const Snapshot &image, uint8_t **p, uint8_t *end)
+{
+    static const char *no_cache = "no-cache";
+    if (lws_add_http_header_by_token(wsi, WSI_TOKEN_HTTP_CACHE_CONTROL, (const unsigned char *)no_cache,
+                                     strlen(no_cache), p, end))
+        return 1;
+
+    if (image.seq)
+    {
+        char etag[32];
+        int n = snprintf(etag, sizeof(etag), "\"%llu\"", (unsigned long long)image.seq);
+        if (lws_add_http_header_by_token(wsi, WSI_TOKEN_HTTP_ETAG, (const unsigned char *)etag, n, p, end))
+            return 1;
     }
 
-    return false;
+    char date[64];
+    struct tm tm;
+    gmtime_r(&image.modified, &tm);
+    size_t n = strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return lws_add_http_header_by_token(wsi, WSI_TOKEN_HTTP_LAST_MODIFIED, (const unsigned char *)date, n, p, end);
 }
 
+// http sessions holding a snapshot long-poll, woken on every new image
+static std::set<struct lws *> snapshot_waiters;
+
+// answers of read-only requests, see JsonCache.hpp
+static JsonCache json_cache;
+
 template <typename... Args>
 void append_session_msg(std::string &ws_send_msg, const char *t, Args &&...a)
 {
@@ -631,6 +756,54 @@ void add_json_key(std::string &message, bool separator, const char *key, const c
         message, "%s\"%s\":%s", separator ? "," : "", key, opener);
 }
 
+// Apply what a request changed and report the action taken per key,
+// encoder and restart actions are left to the restart_thread action
+void add_reconfig_result(std::string &message, const ConfigChanges &changes)
+{
+    if (changes.keys.empty())
+        return;
+
+    add_json_key(message, message.size() > 1, "reconfig", "{");
+    bool separator = false;
+    for (auto &result : Reconfig::apply(changes.keys, true))
+    {
+        std::string key(result.key);
+        add_json_key(message, separator, key.c_str());
+        add_json_str(message, Reconfig::actionName(result.action));
+        separator = true;
+    }
+    message.append("}");
+}
+
+/* any value other than null sets or triggers something, so does everything
+ * under "action"
+ */
+static signed char query_callback(struct lejp_ctx *ctx, char reason)
+{
+    bool *query = (bool *)ctx->user;
+
+    if ((reason & LEJP_FLAG_CB_IS_VALUE) &&
+        (reason != LEJPCB_VAL_NULL || strncmp(ctx->path, "action", 6) == 0))
+    {
+        *query = false;
+    }
+
+    return 0;
+}
+
+// true when the request only reads and its answer can come from json_cache
+bool is_query(const std::string &request)
+{
+    struct lejp_ctx ctx;
+    bool query = true;
+
+    lejp_construct(&ctx, query_callback, &query, NULL, 0);
+    lejp_parse(&ctx, (uint8_t *)request.c_str(), request.length());
+    lejp_destruct(&ctx);
+
+    return query;
+}
+
 // Helper function to safely combine path components
 void combine_path(std::string& result, const char* root, const char* path) {
     result = root;
@@ -668,7 +841,7 @@ signed char WS::general_callback(struct lejp_ctx *ctx, char reason)
             case PNT_GENERAL_LOGLEVEL:
                 if (reason == LEJPCB_VAL_STR_END)
                 {
-                    if (cfg->set<const char *>(u_ctx->path, strdup(ctx->buf)))
+                    if (cfg->set<const char *>(u_ctx->path, ctx->buf))
                     {
                         Logger::setLevel(ctx->buf);
                     }
@@ -721,7 +894,7 @@ signed char WS::rtsp_callback(struct lejp_ctx *ctx, char reason)
         {
             if (reason == LEJPCB_VAL_STR_END)
             {
-                if (cfg->set<const char *>(u_ctx->path, strdup(ctx->buf)))
+                if (cfg->set<const char *>(u_ctx->path, ctx->buf))
                 {
                     // better restart rtsp manually ?
                     // u_ctx->signal = PNT_THREAD_RTSP | PNT_THREAD_ACTION_RESTART;
@@ -827,273 +1000,32 @@ signed char WS::image_callback(struct lejp_ctx *ctx, char reason)
 
         u_ctx->flag |= PNT_FLAG_SEPARATOR;
 
-        if (ctx->path_match == PNT_IMAGE_DEFOG_STRENGTH)
+        const char *key = image_keys[ctx->path_match - 1];
+        if (!ImageTuning::supported(key))
         {
-#if !defined(PLATFORM_T10) && !defined(PLATFORM_T20) && !defined(PLATFORM_T21) && !defined(PLATFORM_T23) && !defined(PLATFORM_T30)
-            if (reason == LEJPCB_VAL_NUM_INT)
-            {
-                if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                {
-                    uint8_t t = static_cast<uint8_t>(cfg->get<int>(u_ctx->path));
-                    IMP_ISP_Tuning_SetDefog_Strength(reinterpret_cast<uint8_t *>(&t));
-                }
-            }
-            add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-#else
             add_json_null(u_ctx->message);
-#endif
         }
-        else if (ctx->path_match >= PNT_IMAGE_CORE_WB_MODE && ctx->path_match <= PNT_IMAGE_WB_BGAIN)
+        else if (ctx->path_match == PNT_IMAGE_VFLIP || ctx->path_match == PNT_IMAGE_HFLIP)
         {
-            if (reason == LEJPCB_VAL_NUM_INT)
+            if (reason == LEJPCB_VAL_TRUE || reason == LEJPCB_VAL_FALSE)
             {
-                if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
+                if (cfg->set<bool>(u_ctx->path, reason == LEJPCB_VAL_TRUE))
                 {
-                    IMPISPWB wb;
-                    memset(&wb, 0, sizeof(IMPISPWB));
-                    int ret = IMP_ISP_Tuning_GetWB(&wb);
-                    if (ret == 0)
-                    {
-                        wb.mode = (isp_core_wb_mode)cfg->image.core_wb_mode;
-                        wb.rgain = cfg->image.wb_rgain;
-                        wb.bgain = cfg->image.wb_bgain;
-                        ret = IMP_ISP_Tuning_SetWB(&wb);
-                    }
+                    global_tuning->post(key);
                 }
             }
-            add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
+            add_json_bool(u_ctx->message, cfg->get<bool>(u_ctx->path));
         }
         else
         {
-            switch (ctx->path_match)
+            if (reason == LEJPCB_VAL_NUM_INT)
             {
-            case PNT_IMAGE_BRIGHTNESS:
-                if (reason == LEJPCB_VAL_NUM_INT)
-                {
-                    if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                    {
-                        IMP_ISP_Tuning_SetBrightness(cfg->get<int>(u_ctx->path));
-                    }
-                }
-                add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-                break;
-            case PNT_IMAGE_CONTRAST:
-                if (reason == LEJPCB_VAL_NUM_INT)
-                {
-                    if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                    {
-                        IMP_ISP_Tuning_SetContrast(cfg->get<int>(u_ctx->path));
-                    }
-                }
-                add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-                break;
-            case PNT_IMAGE_HUE:
-#if !defined(PLATFORM_T10) && !defined(PLATFORM_T20) && !defined(PLATFORM_T21) && !defined(PLATFORM_T23) && !defined(PLATFORM_T30)
-                if (reason == LEJPCB_VAL_NUM_INT)
-                {
-                    if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                    {
-                        IMP_ISP_Tuning_SetBcshHue(cfg->get<int>(u_ctx->path));
-                    }
-                }
-                add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-#else
-                add_json_null(u_ctx->message);
-#endif
-                break;
-            case PNT_IMAGE_SATURATION:
-                if (reason == LEJPCB_VAL_NUM_INT)
-                {
-                    if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                    {
-                        IMP_ISP_Tuning_SetSaturation(cfg->get<int>(u_ctx->path));
-                    }
-                }
-                add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-                break;
-            case PNT_IMAGE_SHARPNESS:
-                if (reason == LEJPCB_VAL_NUM_INT)
-                {
-                    if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                    {
-                        IMP_ISP_Tuning_SetSharpness(cfg->get<int>(u_ctx->path));
-                    }
-                }
-                add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-                break;
-            case PNT_IMAGE_SINTER_STRENGTH:
-#if !defined(PLATFORM_T21)
-                if (reason == LEJPCB_VAL_NUM_INT)
-                {
-                    if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                    {
-                        IMP_ISP_Tuning_SetSinterStrength(cfg->get<int>(u_ctx->path));
-                    }
-                }
-                add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-#else
-                add_json_null(u_ctx->message);
-#endif
-                break;
-            case PNT_IMAGE_TEMPER_STRENGTH:
-                if (reason == LEJPCB_VAL_NUM_INT)
-                {
-                    if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                    {
-                        IMP_ISP_Tuning_SetTemperStrength(cfg->get<int>(u_ctx->path));
-                    }
-                }
-                add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-                break;
-            case PNT_IMAGE_VFLIP:
-                if (reason == LEJPCB_VAL_TRUE)
-                {
-                    if (cfg->set<bool>(u_ctx->path, true))
-                    {
-                        IMP_ISP_Tuning_SetISPVflip(IMPISP_TUNING_OPS_MODE_ENABLE);
-                    }
-                }
-                else if (reason == LEJPCB_VAL_FALSE)
-                {
-                    if (cfg->set<bool>(u_ctx->path, false))
-                    {
-                        IMP_ISP_Tuning_SetISPVflip(IMPISP_TUNING_OPS_MODE_DISABLE);
-                    }
-                }
-                add_json_bool(u_ctx->message, cfg->get<bool>(u_ctx->path));
-                break;
-            case PNT_IMAGE_HFLIP:
-                if (reason == LEJPCB_VAL_TRUE)
-                {
-                    if (cfg->set<bool>(u_ctx->path, true))
-                    {
-                        IMP_ISP_Tuning_SetISPHflip(IMPISP_TUNING_OPS_MODE_ENABLE);
-                    }
-                }
-                else if (reason == LEJPCB_VAL_FALSE)
-                {
-                    if (cfg->set<bool>(u_ctx->path, false))
-                    {
-                        IMP_ISP_Tuning_SetISPHflip(IMPISP_TUNING_OPS_MODE_DISABLE);
-                    }
-                }
-                add_json_bool(u_ctx->message, cfg->get<bool>(u_ctx->path));
-                break;
-            case PNT_IMAGE_ANTIFLICKER:
-                if (reason == LEJPCB_VAL_NUM_INT)
-                {
-                    if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                    {
-                        IMP_ISP_Tuning_SetAntiFlickerAttr((IMPISPAntiflickerAttr)cfg->get<int>(u_ctx->path));
-                    }
-                }
-                add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-                break;
-            case PNT_IMAGE_RUNNING_MODE:
-                {
-                    if (reason == LEJPCB_VAL_NUM_INT)
-                    {
-                        if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                        {
-                            IMP_ISP_Tuning_SetISPRunningMode((IMPISPRunningMode)cfg->get<int>(u_ctx->path));
-                        }
-                    }
-
-                    IMPISPRunningMode running_mode;
-                    IMP_ISP_Tuning_GetISPRunningMode(&running_mode);
-                    add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-                }
-                break;
-            case PNT_IMAGE_AE_COMPENSATION:
-#if !defined(PLATFORM_T21)
-                if (reason == LEJPCB_VAL_NUM_INT)
-                {
-                    if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                    {
-                        IMP_ISP_Tuning_SetAeComp(cfg->get<int>(u_ctx->path));
-                    }
-                }
-                add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-#else
-                add_json_null(u_ctx->message);
-#endif
-                break;
-            case PNT_IMAGE_DPC_STRENGTH:
-#if !defined(PLATFORM_T10) && !defined(PLATFORM_T20) && !defined(PLATFORM_T21) && !defined(PLATFORM_T23) && !defined(PLATFORM_T30)
-                if (reason == LEJPCB_VAL_NUM_INT)
-                {
-                    if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                    {
-                        IMP_ISP_Tuning_SetDPC_Strength(cfg->get<int>(u_ctx->path));
-                    }
-                }
-                add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-#else
-                add_json_null(u_ctx->message);
-#endif
-                break;
-            case PNT_IMAGE_DRC_STRENGTH:
-#if !defined(PLATFORM_T10) && !defined(PLATFORM_T20) && !defined(PLATFORM_T21) && !defined(PLATFORM_T23) && !defined(PLATFORM_T30)
-                if (reason == LEJPCB_VAL_NUM_INT)
-                {
-                    if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                    {
-                        IMP_ISP_Tuning_SetDRC_Strength(cfg->get<int>(u_ctx->path));
-                    }
-                }
-                add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-#else
-                add_json_null(u_ctx->message);
-#endif
-                break;
-            case PNT_IMAGE_HIGHLIGHT_DEPRESS:
-                if (reason == LEJPCB_VAL_NUM_INT)
-                {
-                    if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                    {
-                        IMP_ISP_Tuning_SetHiLightDepress(cfg->get<int>(u_ctx->path));
-                    }
-                }
-                add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-                break;
-            case PNT_IMAGE_BACKLIGHT_COMPENSTATION:
-#if !defined(PLATFORM_T10) && !defined(PLATFORM_T20) && !defined(PLATFORM_T21) && !defined(PLATFORM_T23) && !defined(PLATFORM_T30)
-                if (reason == LEJPCB_VAL_NUM_INT)
-                {
-                    if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                    {
-                        IMP_ISP_Tuning_SetBacklightComp(cfg->get<int>(u_ctx->path));
-                    }
-                }
-                add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-#else
-                add_json_null(u_ctx->message);
-#endif
-                break;
-            case PNT_IMAGE_MAX_AGAIN:
-                if (reason == LEJPCB_VAL_NUM_INT)
-                {
-                    if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                    {
-                        IMP_ISP_Tuning_SetMaxAgain(cfg->get<int>(u_ctx->path));
-                    }
-                }
-                add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-                break;
-            case PNT_IMAGE_MAX_DGAIN:
-                if (reason == LEJPCB_VAL_NUM_INT)
+                if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
                 {
-                    if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                    {
-                        IMP_ISP_Tuning_SetMaxDgain(cfg->get<int>(u_ctx->path));
-                    }
+                    global_tuning->post(key);
                 }
-                add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-                break;
-            default:
-                u_ctx->flag &= ~PNT_FLAG_SEPARATOR;
-                break;
             }
+            add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
         }
     }
     else if (reason == LEJPCB_OBJECT_END)
@@ -1271,7 +1203,7 @@ signed char WS::audio_callback(struct lejp_ctx *ctx, char reason)
                 break;
             case PNT_AUDIO_INPUT_FORMAT:
                 if (reason == LEJPCB_VAL_STR_END)
-                    cfg->set<const char *>(u_ctx->path, strdup(ctx->buf));
+                    cfg->set<const char *>(u_ctx->path, ctx->buf);
                 add_json_str(u_ctx->message, cfg->get<const char *>(u_ctx->path));
                 break;
             default:
@@ -1326,12 +1258,12 @@ signed char WS::stream_callback(struct lejp_ctx *ctx, char reason)
             {
             case PNT_STREAM_RTSP_ENDPOINT:
                 if (reason == LEJPCB_VAL_STR_END)
-                    cfg->set<const char *>(u_ctx->path, strdup(ctx->buf));
+                    cfg->set<const char *>(u_ctx->path, ctx->buf);
                 add_json_str(u_ctx->message, cfg->get<const char *>(u_ctx->path));
                 break;
             case PNT_STREAM_RTSP_INFO:
                 if (reason == LEJPCB_VAL_STR_END)
-                    cfg->set<const char *>(u_ctx->path, strdup(ctx->buf));
+                    cfg->set<const char *>(u_ctx->path, ctx->buf);
                 add_json_str(u_ctx->message, cfg->get<const char *>(u_ctx->path));
                 break;
             case PNT_STREAM_SCALE_ENABLED:
@@ -1347,12 +1279,12 @@ signed char WS::stream_callback(struct lejp_ctx *ctx, char reason)
                 break;
             case PNT_STREAM_FORMAT:
                 if (reason == LEJPCB_VAL_STR_END)
-                    cfg->set<const char *>(u_ctx->path, strdup(ctx->buf));
+                    cfg->set<const char *>(u_ctx->path, ctx->buf);
                 add_json_str(u_ctx->message, cfg->get<const char *>(u_ctx->path));
                 break;
             case PNT_STREAM_MODE:
                 if (reason == LEJPCB_VAL_STR_END)
-                    cfg->set<const char *>(u_ctx->path, strdup(ctx->buf));
+                    cfg->set<const char *>(u_ctx->path, ctx->buf);
                 add_json_str(u_ctx->message, cfg->get<const char *>(u_ctx->path));
                 break;
             case PNT_STREAM_STATS:
@@ -1427,7 +1359,7 @@ signed char WS::stream2_callback(struct lejp_ctx *ctx, char reason)
         case PNT_STREAM2_JPEG_PATH:
             if (reason == LEJPCB_VAL_STR_END)
             {
-                if (cfg->set<const char *>(u_ctx->path, strdup(ctx->buf)))
+                if (cfg->set<const char *>(u_ctx->path, ctx->buf))
                 {
                 }
             }
@@ -1503,55 +1435,13 @@ signed char WS::osd_callback(struct lejp_ctx *ctx, char reason)
 
         u_ctx->flag |= PNT_FLAG_SEPARATOR;
 
+        // integer, the new transparency is applied by the reconfig planner
         if (ctx->path_match >= PNT_OSD_TIME_TRANSPARENCY &&
             ctx->path_match <= PNT_OSD_LOGO_TRANSPARENCY)
         {
-            int hnd = -1;
             if (reason == LEJPCB_VAL_NUM_INT)
             {
-                if (cfg->set<int>(u_ctx->path, atoi(ctx->buf)))
-                {
-
-                    _regions regions{-1,-1,-1,-1};
-
-                    if (u_ctx->value == 0)
-                    {
-                        regions = cfg->stream0.osd.regions;
-                    }
-                    else if (u_ctx->value == 1)
-                    {
-                        regions = cfg->stream1.osd.regions;
-                    }
-
-                    switch (ctx->path_match)
-                    {
-                    case PNT_OSD_TIME_TRANSPARENCY:
-                        hnd = regions.time;
-                        break;
-                    case PNT_OSD_USER_TEXT_TRANSPARENCY:
-                        hnd = regions.user;
-                        break;
-                    case PNT_OSD_UPTIME_TRANSPARENCY:
-                        hnd = regions.uptime;
-                        break;
-                    case PNT_OSD_LOGO_TRANSPARENCY:
-                        hnd = regions.logo;
-                        break;
-                    }
-
-                    if(hnd >= 0) {
-                        IMPOSDGrpRgnAttr grpRgnAttr;
-                        int ret = IMP_OSD_GetGrpRgnAttr(hnd, u_ctx->value, &grpRgnAttr);
-                        if (ret == 0)
-                        {
-                            memset(&grpRgnAttr, 0, sizeof(IMPOSDGrpRgnAttr));
-                            grpRgnAttr.show = 1;
-                            grpRgnAttr.gAlphaEn = 1;
-                            grpRgnAttr.fgAlhpa = cfg->get<int>(u_ctx->path);
-                            IMP_OSD_SetGrpRgnAttr(hnd, u_ctx->value, &grpRgnAttr);
-                        }
-                    }
-                };
+                cfg->set<int>(u_ctx->path, atoi(ctx->buf));
             }
             add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
         }
@@ -1582,7 +1472,7 @@ signed char WS::osd_callback(struct lejp_ctx *ctx, char reason)
         {
             if (reason == LEJPCB_VAL_STR_END)
             {
-                if (cfg->set<const char *>(u_ctx->path, strdup(ctx->buf)))
+                if (cfg->set<const char *>(u_ctx->path, ctx->buf))
                 {
                 }
             }
@@ -1604,49 +1494,9 @@ signed char WS::osd_callback(struct lejp_ctx *ctx, char reason)
             switch (ctx->path_match)
             {
             case PNT_OSD_POS_LOGO_X:
-                if (reason == LEJPCB_VAL_NUM_INT)
-                {
-                    cfg->set<int>(u_ctx->path, atoi(ctx->buf));
-                    IMPOSDRgnAttr rgnAttr;
-                    memset(&rgnAttr, 0, sizeof(IMPOSDRgnAttr));
-                    if (IMP_OSD_GetRgnAttr(3, &rgnAttr) == 0)
-                    {
-                        if (u_ctx->value == 0)
-                        {
-                            OSD::set_pos(&rgnAttr, cfg->stream0.osd.pos_logo_x,
-                                         cfg->stream0.osd.pos_logo_y, 0, 0, cfg->stream0.width, cfg->stream0.height);
-                        }
-                        else if (u_ctx->value == 1)
-                        {
-                            OSD::set_pos(&rgnAttr, cfg->stream1.osd.pos_logo_x,
-                                         cfg->stream1.osd.pos_logo_y, 0, 0, cfg->stream1.width, cfg->stream1.height);
-                        }
-                        IMP_OSD_SetRgnAttr(3, &rgnAttr);
-                    }
-                }
-                add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
-                break;
             case PNT_OSD_POS_LOGO_Y:
                 if (reason == LEJPCB_VAL_NUM_INT)
-                {
                     cfg->set<int>(u_ctx->path, atoi(ctx->buf));
-                    IMPOSDRgnAttr rgnAttr;
-                    memset(&rgnAttr, 0, sizeof(IMPOSDRgnAttr));
-                    if (IMP_OSD_GetRgnAttr(3, &rgnAttr) == 0)
-                    {
-                        if (u_ctx->value == 0)
-                        {
-                            OSD::set_pos(&rgnAttr, cfg->stream0.osd.pos_logo_y,
-                                         cfg->stream0.osd.pos_logo_y, 0, 0, cfg->stream0.width, cfg->stream0.height);
-                        }
-                        else if (u_ctx->value == 1)
-                        {
-                            OSD::set_pos(&rgnAttr, cfg->stream1.osd.pos_logo_y,
-                                         cfg->stream1.osd.pos_logo_y, 0, 0, cfg->stream1.width, cfg->stream1.height);
-                        }
-                        IMP_OSD_SetRgnAttr(3, &rgnAttr);
-                    }
-                }
                 add_json_num(u_ctx->message, cfg->get<int>(u_ctx->path));
                 break;
             case PNT_OSD_LOGO_ROTATION:
@@ -1683,7 +1533,8 @@ signed char WS::motion_callback(struct lejp_ctx *ctx, char reason)
         u_ctx->flag |= PNT_FLAG_SEPARATOR;
 
         // integer
-        if (ctx->path_match >= PNT_MOTION_DEBOUNCE_TIME && ctx->path_match <= PNT_MOTION_ROI_COUNT)
+        if ((ctx->path_match >= PNT_MOTION_DEBOUNCE_TIME && ctx->path_match <= PNT_MOTION_ROI_COUNT) ||
+            (ctx->path_match >= PNT_MOTION_GRID_COLS && ctx->path_match <= PNT_MOTION_MAX_CPU_PERCENT))
         {
             if (reason == LEJPCB_VAL_NUM_INT)
             {
@@ -1705,11 +1556,11 @@ signed char WS::motion_callback(struct lejp_ctx *ctx, char reason)
             add_json_bool(u_ctx->message, cfg->get<bool>(u_ctx->path));
             // std::string
         }
-        else if (ctx->path_match == PNT_MOTION_SCRIPT_PATH)
+        else if (ctx->path_match == PNT_MOTION_SCRIPT_PATH || ctx->path_match == PNT_MOTION_ENGINE)
         {
             if (reason == LEJPCB_VAL_STR_END)
             {
-                if (cfg->set<const char *>(u_ctx->path, strdup(ctx->buf)))
+                if (cfg->set<const char *>(u_ctx->path, ctx->buf))
                 {
                 }
             }
@@ -1725,6 +1576,16 @@ signed char WS::motion_callback(struct lejp_ctx *ctx, char reason)
             }
             add_json_str(u_ctx->message, cfg->get<std::string>(u_ctx->path).c_str());
         }
+        else if (ctx->path_match == PNT_MOTION_HEATMAP)
+        {
+            // read only, longer than the add_json_* buffer
+            int cols = 0;
+            int rows = 0;
+            std::string cells = Motion::heatmap(cols, rows);
+            u_ctx->message.append("{\"cols\":" + std::to_string(cols) +
+                                  ",\"rows\":" + std::to_string(rows) +
+                                  ",\"cells\":\"" + cells + "\"}");
+        }
         else
         {
             u_ctx->flag &= ~PNT_FLAG_SEPARATOR;
@@ -1960,6 +1821,55 @@ signed char WS::action_callback(struct lejp_ctx *ctx, char reason)
             u_ctx->flag |= PNT_FLAG_WS_REQUEST_PREVIEW;
             add_json_str(u_ctx->message, pnt_ws_msg[PNT_WS_MSG_INITIATED]);
             break;
+        case PNT_DVR_TRIGGER:
+            if (global_dvr->trigger("websocket"))
+            {
+                add_json_str(u_ctx->message, pnt_ws_msg[PNT_WS_MSG_INITIATED]);
+            }
+            else
+            {
+                add_json_str(u_ctx->message, pnt_ws_msg[PNT_WS_MSG_ERROR]);
+            }
+            break;
+        case PNT_EVENTS:
+            // push bus events to this session from now on
+            if (reason == LEJPCB_VAL_TRUE && !(u_ctx->flag & PNT_FLAG_WS_EVENTS))
+            {
+                u_ctx->event_seq = global_events->websocket().last();
+                u_ctx->flag |= PNT_FLAG_WS_EVENTS;
+            }
+            else if (reason == LEJPCB_VAL_FALSE)
+            {
+                u_ctx->flag &= ~PNT_FLAG_WS_EVENTS;
+            }
+            add_json_bool(u_ctx->message, u_ctx->flag & PNT_FLAG_WS_EVENTS);
+            break;
+        case PNT_LIVE:
+            // live video of a stream by index (0, 1, then the derived ones),
+            // -1 or false stops it
+            if (reason == LEJPCB_VAL_NUM_INT || reason == LEJPCB_VAL_FALSE)
+            {
+                int chn = (reason == LEJPCB_VAL_NUM_INT) ? atoi(ctx->buf) : -1;
+                if (chn < 0 || chn >= MAX_VIDEO_STREAMS)
+                    chn = -1;
+                if (chn >= 0 && !cfg->streams[chn].enabled)
+                    chn = -1;
+
+                if (u_ctx->flag & PNT_FLAG_WS_LIVE)
+                {
+                    global_live->unsubscribe(u_ctx->live_chn);
+                    u_ctx->flag &= ~PNT_FLAG_WS_LIVE;
+                }
+                u_ctx->live_chn = chn;
+                u_ctx->live_seq = 0;
+                if (chn >= 0)
+                {
+                    global_live->subscribe(chn);
+                    u_ctx->flag |= PNT_FLAG_WS_LIVE;
+                }
+            }
+            add_json_num(u_ctx->message, (u_ctx->flag & PNT_FLAG_WS_LIVE) ? u_ctx->live_chn : -1);
+            break;
         default:
             u_ctx->flag &= ~PNT_FLAG_SEPARATOR;
             break;
@@ -2047,6 +1957,83 @@ signed char WS::root_callback(struct lejp_ctx *ctx, char reason)
     return 0;
 }
 
+/* answers the request in u_ctx->rx_message. A query repeated within the
+ * stats tick and without a config change in between gets the cached answer,
+ * any other request drops the cache
+ */
+WSMessagePtr WS::answer_request(struct user_ctx *u_ctx)
+{
+    struct lejp_ctx ctx;
+    bool query = is_query(u_ctx->rx_message);
+
+    if (query)
+    {
+        WSMessagePtr cached = json_cache.get(u_ctx->rx_message);
+        if (cached)
+        {
+            u_ctx->rx_message.clear();
+            return cached;
+        }
+    }
+
+    // parse json and write response into u_ctx->message
+    u_ctx->message = "{";               // open response json
+    {
+        ConfigChanges changes;
+        lejp_construct(&ctx, root_callback, u_ctx, root_keys, LWS_ARRAY_SIZE(root_keys));
+        lejp_parse(&ctx, (uint8_t *)u_ctx->rx_message.c_str(), u_ctx->rx_message.length());
+        lejp_destruct(&ctx);
+        add_reconfig_result(u_ctx->message, changes);
+    }
+    u_ctx->message.append("}");         // close response json
+    u_ctx->flag &= ~PNT_FLAG_SEPARATOR; // always reset separator after parsing
+
+    WSMessagePtr answer = WSMessage::createNew(u_ctx->message);
+    if (query)
+        json_cache.put(u_ctx->rx_message, answer);
+    else
+        json_cache.clear();
+
+    u_ctx->rx_message.clear();          // cleanup received data
+    return answer;
+}
+
+// Batch of gets and sets by key id, see WSBinary.hpp
+WSMessagePtr WS::answer_binary(const std::string &request)
+{
+    auto message = std::make_shared<WSMessage>();
+    message->binary = true;
+    message->buffer.reserve(LWS_PRE + 256);
+    message->buffer.resize(LWS_PRE);
+
+    std::vector<std::string_view> changed = WSBinary::run(request, message->buffer);
+    if (!changed.empty())
+    {
+        std::vector<std::string_view> tuned;
+        std::vector<std::string_view> other;
+        for (auto key : changed)
+        {
+            // same as the JSON handler, image settings go to the ISP
+            if (key.substr(0, 6) == "image." && ImageTuning::supported(key.substr(6)))
+            {
+                global_tuning->post(key.substr(6));
+                tuned.push_back(key);
+            }
+            else
+            {
+                other.push_back(key);
+            }
+        }
+
+        std::vector<ReconfigResult> results = Reconfig::apply(tuned, true);
+        for (auto &result : Reconfig::apply(other, false))
+            results.push_back(result);
+        WSBinary::addReconfig(message->buffer, results);
+    }
+
+    return message;
+}
+
 const char* generateSessionID()
 {
     static char idBuffer[SESSION_ID_LENGTH + 1];
@@ -2064,6 +2051,17 @@ const char* generateSessionID()
     return idBuffer;
 }
 
+/* keeps the jpeg channel of a long-poll encoding, new images wake the
+ * session anyway, this also checks for the deadline
+ */
+static void
+snapshot_poll_tick(lws_sorted_usec_list_t *sul)
+{
+    struct user_ctx *u_ctx = lws_container_of(sul, struct user_ctx, sul);
+    global_jpeg[u_ctx->snapshot_chn]->request();
+    lws_callback_on_writable(u_ctx->wsi);
+}
+
 static void
 send_snapshot(lws_sorted_usec_list_t *sul)
 {
@@ -2075,7 +2073,6 @@ send_snapshot(lws_sorted_usec_list_t *sul)
 
 int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len)
 {
-    struct lejp_ctx ctx;
     user_ctx *u_ctx = (struct user_ctx *)user;
 
     char client_ip[128];
@@ -2142,9 +2139,12 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
         // Immediately send a small server ack so clients can verify the socket is usable
         // and tools like wscat show incoming data right after connect.
         u_ctx = (user_ctx *)user; // per-session data already placement-new'ed above
-        u_ctx->tx_message.append("{\"hello\":\"prudynt\",\"session\":\"");
-        u_ctx->tx_message.append(u_ctx->id);
-        u_ctx->tx_message.append("\"}");
+        {
+            WSMessagePtr hello = WSMessage::createNew(
+                std::string("{\"hello\":\"prudynt\",\"session\":\"") + u_ctx->id + "\"}");
+            u_ctx->tx_queued += hello->size();
+            u_ctx->tx_queue.push_back(std::move(hello));
+        }
         lws_callback_on_writable(wsi);
 
         LOG_DEBUG("LWS_CALLBACK_ESTABLISHED completed successfully");
@@ -2181,24 +2181,30 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
         // set request pending
         //u_ctx->flag |= PNT_FLAG_WS_REQUEST_PENDING;
 
-        // parse json and write response into u_ctx->message
-        u_ctx->message = "{";               // open response json
-        lejp_construct(&ctx, root_callback, u_ctx, root_keys, LWS_ARRAY_SIZE(root_keys));
-        lejp_parse(&ctx, (uint8_t *)u_ctx->rx_message.c_str(), u_ctx->rx_message.length());
-        lejp_destruct(&ctx);
-        u_ctx->message.append("}");         // close response json
-        u_ctx->rx_message.clear();          // cleanup received data
-        u_ctx->flag &= ~PNT_FLAG_SEPARATOR; // always reset separator after parsing
+        {
+            WSMessagePtr answer;
+            if (lws_frame_is_binary(wsi))
+            {
+                answer = answer_binary(u_ctx->rx_message);
+                u_ctx->rx_message.clear();
+            }
+            else
+            {
+                answer = answer_request(u_ctx);
+            }
 
-        // splitt overlapping responses with a ";"
-        if(u_ctx->flag & PNT_FLAG_WS_REQUEST_PENDING) {
-            u_ctx->tx_message.append(";");
-        }
+            // Prevent unbounded tx queue growth
+            if (u_ctx->tx_queued > MAX_WS_TX_QUEUE_SIZE) {
+                LOG_ERROR("WebSocket TX queue too large, clearing queue");
+                u_ctx->tx_queue.clear();
+                u_ctx->tx_queued = 0;
+            }
 
-        // Prevent unbounded tx_message growth
-        if (u_ctx->tx_message.size() > MAX_WS_TX_QUEUE_SIZE) {
-            LOG_ERROR("WebSocket TX queue too large, clearing queue");
-            u_ctx->tx_message.clear();
+            /* overlapping answers queue up and go out as separate messages
+             * on the next writable callback
+             */
+            u_ctx->tx_queued += answer->size();
+            u_ctx->tx_queue.push_back(std::move(answer));
         }
 
         u_ctx->flag |= PNT_FLAG_WS_REQUEST_PENDING;
@@ -2271,42 +2277,86 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
             int delay = (LWS_USEC_PER_SEC / (global_jpeg[0]->stream->stats.fps + u_ctx->snapshot.throttle)) + first_request_delay;
             LOG_DDEBUGWS("shedule preview image. id:" << u_ctx->id << " delay:" << delay);
             lws_sul_schedule(lws_get_context(wsi), 0, &u_ctx->sul, send_snapshot, delay);
-
-            // send response for the image request
-            u_ctx->tx_message.append(u_ctx->message);
-            lws_callback_on_writable(wsi);
-        } else {
-
-            // send response for all 'non image request' json requests
-            u_ctx->tx_message.append(u_ctx->message);
-            lws_callback_on_writable(wsi);
         }
 
+        // send response
+        lws_callback_on_writable(wsi);
+
         break;
 
     case LWS_CALLBACK_SERVER_WRITEABLE:
         LOG_DDEBUGWS("LWS_CALLBACK_SERVER_WRITEABLE id:" << u_ctx->id << ", ip:" << client_ip);
 
         // send response message
-        if (!u_ctx->tx_message.empty())
+        if (!u_ctx->tx_queue.empty())
         {
             u_ctx->flag &= ~PNT_FLAG_WS_REQUEST_PENDING;
 
-            /* send all outstanding messages
-             * if messages faster received than an answer can be send, they will append to
-             * tx_message and separated with a ";". now we split them and send each
-             * segment separate
+            /* send all outstanding answers, one message each. Cached answers
+             * are shared by all sessions, lws_write() only fills the LWS_PRE
+             * area in front of them and this is one thread.
              */
-            std::stringstream ss(u_ctx->tx_message);
-            std::string item;
+            for (auto &answer : u_ctx->tx_queue)
+            {
+                if (answer->binary)
+                {
+                    LOG_DDEBUGWS("u_ctx->tx_queue id:" << u_ctx->id << ", binary:" << answer->size());
+                    lws_write(wsi, const_cast<uint8_t *>(answer->data()), answer->size(), LWS_WRITE_BINARY);
+                    continue;
+                }
+                LOG_DDEBUGWS("u_ctx->tx_queue id:" << u_ctx->id << ", tx:"
+                             << std::string_view((const char *)answer->data(), answer->size()));
+                lws_write(wsi, const_cast<uint8_t *>(answer->data()), answer->size(), LWS_WRITE_TEXT);
+            }
 
-            while (std::getline(ss, item, ';')) {
-                LOG_DDEBUGWS("u_ctx->tx_message id:" << u_ctx->id << ", tx:" << item);
-                item = std::string(LWS_PRE, '\0') + item;
+            u_ctx->tx_queue.clear();
+            u_ctx->tx_queued = 0;
+        }
+
+        // bus events for subscribed sessions
+        if (u_ctx->flag & PNT_FLAG_WS_EVENTS)
+        {
+            std::vector<BusEventPtr> events;
+            global_events->websocket().fetch(u_ctx->event_seq, events);
+            for (auto &event : events)
+            {
+                std::string item = std::string(LWS_PRE, '\0') + event->json;
                 lws_write(wsi, (unsigned char *)item.c_str() + LWS_PRE, item.length() - LWS_PRE, LWS_WRITE_TEXT);
             }
+        }
+
+        /* live video, as many frames as the connection takes without
+         * buffering. The frames are shared by all sessions, lws_write() only
+         * fills the LWS_PRE area in front of them and this is one thread.
+         */
+        if (u_ctx->flag & PNT_FLAG_WS_LIVE)
+        {
+            while (!lws_send_pipe_choked(wsi))
+            {
+                bool joining = (u_ctx->live_seq == 0);
+                LiveFramePtr frame = global_live->next(u_ctx->live_chn, u_ctx->live_seq);
+                if (!frame)
+                    break;
 
-            u_ctx->tx_message.clear();
+                if (joining)
+                {
+                    std::string item = std::string(LWS_PRE, '\0') + "{\"live\":" + global_live->describe(u_ctx->live_chn) + "}";
+                    lws_write(wsi, (unsigned char *)item.c_str() + LWS_PRE, item.length() - LWS_PRE, LWS_WRITE_TEXT);
+                    if (lws_send_pipe_choked(wsi))
+                    {
+                        // the frame follows on the next writable callback
+                        u_ctx->live_seq = 0;
+                        break;
+                    }
+                }
+
+                if (lws_write(wsi, const_cast<uint8_t *>(frame->message()), frame->messageSize(), LWS_WRITE_BINARY) < 0)
+                    return -1;
+            }
+
+            // frames left over are picked up as soon as the pipe drains
+            if (lws_send_pipe_choked(wsi))
+                lws_callback_on_writable(wsi);
         }
 
         // delayed snapshot request via websocket, sending the image
@@ -2314,21 +2364,32 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
         {
             LOG_DDEBUGWS("send preview image. id:" << u_ctx->id);
             global_jpeg[0]->request();
-            std::vector<unsigned char> jpeg_buf;
-            if (get_snapshot(jpeg_buf))
+            SnapshotPtr image = get_snapshot(0);
+            if (image)
             {
-                lws_write(wsi, jpeg_buf.data() + LWS_PRE, jpeg_buf.size() - LWS_PRE, LWS_WRITE_BINARY);
+                lws_write(wsi, const_cast<uint8_t *>(image->jpeg()), image->size(), LWS_WRITE_BINARY);
             }
             u_ctx->flag &= ~(PNT_FLAG_WS_SEND_PREVIEW | PNT_FLAG_WS_PREVIEW_PENDING);
         }
         break;
 
+    case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
+        // new bus events or live frames, sessions pick them up when writable
+        lws_callback_on_writable_all_protocol(lws_get_context(wsi), lws_get_protocol(wsi));
+        // a new snapshot for the long-polls
+        for (struct lws *waiter : snapshot_waiters)
+            lws_callback_on_writable(waiter);
+        break;
+
     case LWS_CALLBACK_CLOSED:
         LOG_DEBUG("LWS_CALLBACK_CLOSED ip:" << client_ip << " - WebSocket connection closed");
 
         // cleanup delete possibly existing shedules for this session
         lws_sul_cancel(&u_ctx->sul);
 
+        if (u_ctx->flag & PNT_FLAG_WS_LIVE)
+            global_live->unsubscribe(u_ctx->live_chn);
+
         u_ctx->~user_ctx();
         break;
 
@@ -2377,12 +2438,37 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
             {
                 u_ctx->flag |= PNT_FLAG_HTTP_SEND_PREVIEW;
 
-                global_jpeg[0]->request();
-
-                if (!global_jpeg[0]->active)
-                {
-                    global_jpeg[0]->should_grab_frames.notify_all();
-                    global_jpeg[0]->is_activated.acquire();
+                char url_width[8] = {0};
+                int width = 0;
+                if (lws_get_urlarg_by_name_safe(wsi, "width", url_width, sizeof(url_width)) > 0)
+                    width = atoi(url_width);
+                u_ctx->snapshot_chn = snapshot_channel(width);
+                std::shared_ptr<jpeg_stream> &jpeg = global_jpeg[u_ctx->snapshot_chn];
+
+                // the client's copy: a 304 while it is the latest, ?after= waits for a newer one
+                char etag[32] = {0};
+                char url_after[24] = {0};
+                u_ctx->snapshot_known = 0;
+                if (lws_hdr_copy(wsi, etag, sizeof(etag), WSI_TOKEN_HTTP_IF_NONE_MATCH) > 0)
+                    u_ctx->snapshot_known = parse_etag(etag);
+                if (lws_get_urlarg_by_name_safe(wsi, "after", url_after, sizeof(url_after)) > 0)
+                {
+                    u_ctx->snapshot_known = strtoull(url_after, nullptr, 10);
+                    u_ctx->snapshot_deadline = steady_clock::now() + seconds(SNAPSHOT_LONG_POLL_S);
+                    u_ctx->flag |= PNT_FLAG_HTTP_SNAPSHOT_WAIT;
+                    snapshot_waiters.insert(wsi);
+                }
+
+                jpeg->request();
+
+                // a cached image young enough goes out without waking the channel,
+                // a long-poll needs it encoding
+                SnapshotPtr cached = global_snapshots->get(jpeg->stream->width, jpeg->stream->jpeg_quality);
+                bool fresh = cached && cached->fresh(cfg->stream2.jpeg_cache_ttl);
+                if (!jpeg->active && (!fresh || (u_ctx->flag & PNT_FLAG_HTTP_SNAPSHOT_WAIT)))
+                {
+                    jpeg->should_grab_frames.notify_all();
+                    jpeg->is_activated.acquire();
                     /* we need this delay to grab a valid image when stream resume from sleep
                      * usleep is a bad choice, but lws_sul_schedule won't work as expected here
                      * hopfully we find a better solution later
@@ -2436,22 +2522,9 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
 
         if (u_ctx->flag & PNT_FLAG_HTTP_RECEIVED_MESSAGE)
         {
-            // parse json and write response into u_ctx->message
-            u_ctx->message = "{";               // open response json
-            lejp_construct(&ctx, root_callback, u_ctx, root_keys, LWS_ARRAY_SIZE(root_keys));
-            lejp_parse(&ctx, (uint8_t *)u_ctx->rx_message.c_str(), u_ctx->rx_message.length());
-            lejp_destruct(&ctx);
-            u_ctx->message.append("}");         // close response json
-            u_ctx->rx_message.clear();          // cleanup received data
-            u_ctx->flag &= ~PNT_FLAG_SEPARATOR; // always reset separator after parsing
+            u_ctx->tx_queue.assign(1, answer_request(u_ctx));
             u_ctx->flag |= PNT_FLAG_HTTP_SEND_MESSAGE;
 
-            /* copy response into u_ctx->message into u_ctx->tx_message
-             * can be helpfull to handle overlapping requests in future
-             */
-            u_ctx->tx_message = u_ctx->message;
-            u_ctx->tx_message.clear();
-
             // send response
             lws_callback_on_writable(wsi);
 
@@ -2471,15 +2544,50 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
 
             if (u_ctx->flag & PNT_FLAG_HTTP_SEND_PREVIEW)
             {
+                SnapshotPtr image = get_snapshot(u_ctx->snapshot_chn);
+
+                // long-poll, hold the answer until there is a newer image than the client has
+                bool long_poll = u_ctx->flag & PNT_FLAG_HTTP_SNAPSHOT_WAIT;
+                if (long_poll)
+                {
+                    if ((!image || image->seq <= u_ctx->snapshot_known)
+                        && steady_clock::now() < u_ctx->snapshot_deadline)
+                    {
+                        lws_usec_t tick = std::min(cfg->stream2.jpeg_cache_ttl / 2, 500) * 1000;
+                        lws_sul_schedule(lws_get_context(wsi), 0, &u_ctx->sul, snapshot_poll_tick, tick);
+                        return 0;
+                    }
+                    u_ctx->flag &= ~PNT_FLAG_HTTP_SNAPSHOT_WAIT;
+                    snapshot_waiters.erase(wsi);
+                    lws_sul_cancel(&u_ctx->sul);
+                }
+
                 u_ctx->flag &= ~PNT_FLAG_HTTP_SEND_PREVIEW;
 
+                // a long-poll that timed out has nothing newer than the client, whatever
+                // ?after= it sent
+                bool not_modified = image && image->seq
+                    && (long_poll ? image->seq <= u_ctx->snapshot_known : image->seq == u_ctx->snapshot_known);
+                if (not_modified)
+                {
+                    if (lws_add_http_header_status(wsi, HTTP_STATUS_NOT_MODIFIED, &p, end) ||
+                        snapshot_headers(wsi, *image, &p, end) ||
+                        lws_finalize_write_http_header(wsi, start, &p, end) ||
+                        lws_http_transaction_completed(wsi))
+                    {
+                        LOG_ERROR("lws error sending not modified");
+                        return 1;
+                    }
+                    return 0;
+                }
+
                 // Write image
-                std::vector<unsigned char> jpeg_buf;
-                if (get_snapshot(jpeg_buf))
+                if (image)
                 {
-                    if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK, "image/jpeg", jpeg_buf.size() - LWS_PRE, &p, end) ||
+                    if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK, "image/jpeg", image->size(), &p, end) ||
+                        snapshot_headers(wsi, *image, &p, end) ||
                         lws_finalize_write_http_header(wsi, start, &p, end) ||
-                        !lws_write(wsi, jpeg_buf.data() + LWS_PRE, jpeg_buf.size() - LWS_PRE, LWS_WRITE_BINARY) ||
+                        !lws_write(wsi, const_cast<uint8_t *>(image->jpeg()), image->size(), LWS_WRITE_BINARY) ||
                         lws_http_transaction_completed(wsi))
                     {
 
@@ -2497,14 +2605,17 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
             {
                 u_ctx->flag &= ~PNT_FLAG_HTTP_SEND_MESSAGE;
                 LOG_DDEBUGWS("/json " << u_ctx->flag);
-                if (!u_ctx->message.empty())
+                if (!u_ctx->tx_queue.empty())
                 {
-                    LOG_DDEBUGWS("TO " << client_ip << ":  " << u_ctx->message);
+                    WSMessagePtr answer = u_ctx->tx_queue.front();
+                    u_ctx->tx_queue.clear();
+                    LOG_DDEBUGWS("TO " << client_ip << ":  "
+                                 << std::string_view((const char *)answer->data(), answer->size()));
 
                     // Prepare the HTTP headers
-                    if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK, "application/json", u_ctx->message.length(), &p, end) ||
+                    if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK, "application/json", answer->size(), &p, end) ||
                         lws_finalize_write_http_header(wsi, start, &p, end) ||
-                        !lws_write(wsi, (unsigned char *)u_ctx->message.c_str(), u_ctx->message.length(), LWS_WRITE_TEXT) ||
+                        !lws_write(wsi, const_cast<uint8_t *>(answer->data()), answer->size(), LWS_WRITE_TEXT) ||
                         lws_http_transaction_completed(wsi))
                     {
 
@@ -2532,6 +2643,8 @@ int WS::ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *use
 
     case LWS_CALLBACK_HTTP_DROP_PROTOCOL:
         LOG_DDEBUGWS("LWS_CALLBACK_HTTP_DROP_PROTOCOL ip:" << client_ip << ", id:" << u_ctx->id);
+        snapshot_waiters.erase(wsi);
+        lws_sul_cancel(&u_ctx->sul);
         u_ctx->~user_ctx();
         break;
 
@@ -2690,6 +2803,11 @@ void WS::start()
 
     LOG_INFO("Server started on port " << cfg->websocket.port);
 
+    // wake lws_service() when the event bus has something for the sessions
+    global_events->websocket().setWake([ctx = context]() { lws_cancel_service(ctx); });
+    global_live->setWake([ctx = context]() { lws_cancel_service(ctx); });
+    global_snapshots->setWake([ctx = context]() { lws_cancel_service(ctx); });
+
     while (true)
     {
         lws_service(context, 50);
@@ -4,6 +4,7 @@
 #include <atomic>
 #include "Logger.hpp"
 #include "Config.hpp"
+#include "JsonCache.hpp"
 #include <memory>
 #include <utility>
 #include "libwebsockets.h"
@@ -16,6 +17,8 @@
 #define MAX_WS_MESSAGE_SIZE 4096
 #define MAX_WS_TX_QUEUE_SIZE 8192
 
+struct user_ctx;
+
 // WebSocket
 class WS
 {
@@ -29,6 +32,8 @@ private:
         struct lws_context *context{};
 
         static int ws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len);
+        static WSMessagePtr answer_request(struct user_ctx *u_ctx);
+        static WSMessagePtr answer_binary(const std::string &request);
 
         static signed char root_callback(struct lejp_ctx *ctx, char reason);
         static signed char general_callback(struct lejp_ctx *ctx, char reason);
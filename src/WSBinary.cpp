@@ -0,0 +1,317 @@
+#include "WSBinary.hpp"
+
+#include "Config.hpp"
+#include "Logger.hpp"
+
+#include <cstring>
+
+#define MODULE "WSBinary"
+
+#define WS_BINARY_HEADER_SIZE 4
+#define WS_BINARY_REQUEST_RECORD_SIZE 5
+#define WS_BINARY_ANSWER_RECORD_SIZE 7
+// Longest value a record of an otherwise empty answer can carry
+#define WS_BINARY_MAX_VALUE (WS_BINARY_MAX_ANSWER - WS_BINARY_HEADER_SIZE - WS_BINARY_ANSWER_RECORD_SIZE)
+
+namespace
+{
+
+enum Op : uint8_t
+{
+    OP_GET = 1,
+    OP_SET = 2,
+    OP_KEYS = 3,
+    OP_RECONFIG = 4
+};
+
+enum Status : uint8_t
+{
+    STATUS_OK = 0,
+    STATUS_UNKNOWN_KEY = 1,
+    STATUS_INVALID_VALUE = 2,
+    STATUS_UNKNOWN_OP = 3,
+    STATUS_TOO_LONG = 4
+};
+
+// Sections a set may change, the ones of the JSON protocol
+const char *const settable_sections[] = {"general.", "rtsp.", "image.", "audio.",
+                                         "stream0.", "stream1.", "stream2.", "motion."};
+// ... but not the programs prudynt starts or the files it writes
+const char *const local_keys[] = {"audio.output_sink_path", "motion.script_path", "stream2.jpeg_path"};
+
+bool settable(std::string_view path)
+{
+    for (const char *key : local_keys)
+    {
+        if (path == key)
+            return false;
+    }
+    for (const char *section : settable_sections)
+    {
+        if (path.compare(0, strlen(section), section) == 0)
+            return true;
+    }
+    return false;
+}
+
+uint16_t read16(const uint8_t *p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t read32(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+void store16(uint8_t *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xff;
+}
+
+void store32(uint8_t *p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = (value >> 16) & 0xff;
+    p[2] = (value >> 8) & 0xff;
+    p[3] = value & 0xff;
+}
+
+void add_record(std::vector<uint8_t> &answer, uint8_t op, uint8_t status, uint8_t type, uint16_t id,
+                const uint8_t *value, size_t length)
+{
+    uint8_t header[WS_BINARY_ANSWER_RECORD_SIZE];
+    header[0] = op;
+    header[1] = status;
+    header[2] = type;
+    store16(header + 3, id);
+    store16(header + 5, static_cast<uint16_t>(length));
+    answer.insert(answer.end(), header, header + sizeof(header));
+    if (length)
+        answer.insert(answer.end(), value, value + length);
+}
+
+// Record with the current value of the key
+void add_value(std::vector<uint8_t> &answer, uint8_t op, uint16_t id, const CFG::KeyInfo &key)
+{
+    uint8_t type = static_cast<uint8_t>(key.type);
+    uint8_t value[4];
+
+    switch (key.type)
+    {
+    case CFG::ItemType::Bool:
+        value[0] = cfg->get<bool>(key.path) ? 1 : 0;
+        add_record(answer, op, STATUS_OK, type, id, value, 1);
+        break;
+    case CFG::ItemType::Char:
+    {
+        const char *text = cfg->get<const char *>(key.path);
+        size_t length = text ? strlen(text) : 0;
+        if (length > WS_BINARY_MAX_VALUE)
+            add_record(answer, op, STATUS_TOO_LONG, type, id, nullptr, 0);
+        else
+            add_record(answer, op, STATUS_OK, type, id, (const uint8_t *)text, length);
+        break;
+    }
+    case CFG::ItemType::Int:
+        store32(value, static_cast<uint32_t>(cfg->get<int>(key.path)));
+        add_record(answer, op, STATUS_OK, type, id, value, 4);
+        break;
+    case CFG::ItemType::Uint:
+        store32(value, cfg->get<unsigned int>(key.path));
+        add_record(answer, op, STATUS_OK, type, id, value, 4);
+        break;
+    case CFG::ItemType::Float:
+    {
+        float number = cfg->get<float>(key.path);
+        uint32_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        store32(value, bits);
+        add_record(answer, op, STATUS_OK, type, id, value, 4);
+        break;
+    }
+    }
+}
+
+// Bytes of the value add_value() sends for the key
+size_t value_length(const CFG::KeyInfo &key)
+{
+    switch (key.type)
+    {
+    case CFG::ItemType::Bool:
+        return 1;
+    case CFG::ItemType::Char:
+    {
+        const char *text = cfg->get<const char *>(key.path);
+        size_t length = text ? strlen(text) : 0;
+        return length > WS_BINARY_MAX_VALUE ? 0 : length;
+    }
+    default:
+        return 4;
+    }
+}
+
+// true when the value had the size of the type and the config took it
+bool set_value(const CFG::KeyInfo &key, const uint8_t *value, size_t length)
+{
+    switch (key.type)
+    {
+    case CFG::ItemType::Bool:
+        return length == 1 && cfg->set<bool>(key.path, value[0] != 0);
+    case CFG::ItemType::Char:
+        return cfg->set<const char *>(key.path, std::string((const char *)value, length).c_str());
+    case CFG::ItemType::Int:
+        return length == 4 && cfg->set<int>(key.path, static_cast<int>(read32(value)));
+    case CFG::ItemType::Uint:
+        return length == 4 && cfg->set<unsigned int>(key.path, read32(value));
+    case CFG::ItemType::Float:
+    {
+        if (length != 4)
+            return false;
+        uint32_t bits = read32(value);
+        float number;
+        memcpy(&number, &bits, sizeof(number));
+        return cfg->set<float>(key.path, number);
+    }
+    }
+    return false;
+}
+
+} // namespace
+
+std::vector<std::string_view> WSBinary::run(const std::string &request, std::vector<uint8_t> &out)
+{
+    const uint8_t *data = (const uint8_t *)request.data();
+    size_t size = request.size();
+    const std::vector<CFG::KeyInfo> &keys = cfg->keys();
+
+    // out may start with headroom (LWS_PRE), the answer begins at base
+    size_t base = out.size();
+    out.resize(base + WS_BINARY_HEADER_SIZE);
+    out[base] = WS_BINARY_VERSION;
+    out[base + 1] = 0;
+    out[base + 2] = size >= WS_BINARY_HEADER_SIZE ? data[2] : 0;
+    out[base + 3] = size >= WS_BINARY_HEADER_SIZE ? data[3] : 0;
+
+    ConfigChanges changes;
+    if (size < WS_BINARY_HEADER_SIZE || data[0] != WS_BINARY_VERSION)
+    {
+        out[base + 1] = 1;
+        return changes.keys;
+    }
+
+    // room for the reconfig record of every key changed so far
+    auto fits = [&](size_t bytes) {
+        return out.size() - base + changes.keys.size() * WS_BINARY_ANSWER_RECORD_SIZE + bytes <= WS_BINARY_MAX_ANSWER;
+    };
+
+    size_t pos = WS_BINARY_HEADER_SIZE;
+    while (pos < size)
+    {
+        if (size - pos < WS_BINARY_REQUEST_RECORD_SIZE
+            || size - pos - WS_BINARY_REQUEST_RECORD_SIZE < read16(data + pos + 3))
+        {
+            out[base + 1] = 1;
+            break;
+        }
+
+        uint8_t op = data[pos];
+        uint16_t id = read16(data + pos + 1);
+        uint16_t length = read16(data + pos + 3);
+        const uint8_t *value = data + pos + WS_BINARY_REQUEST_RECORD_SIZE;
+
+        if (op == OP_KEYS)
+        {
+            for (size_t i = id; i < keys.size(); i++)
+            {
+                const CFG::KeyInfo &key = keys[i];
+                if (!fits(WS_BINARY_ANSWER_RECORD_SIZE + key.path.size()))
+                    break;
+                add_record(out, op, STATUS_OK, static_cast<uint8_t>(key.type), static_cast<uint16_t>(i),
+                           (const uint8_t *)key.path.data(), key.path.size());
+            }
+            pos += WS_BINARY_REQUEST_RECORD_SIZE + length;
+            continue;
+        }
+
+        // the record and what it answers, a set may add a reconfig record
+        size_t need = WS_BINARY_ANSWER_RECORD_SIZE;
+        bool known = (op == OP_GET || op == OP_SET) && id < keys.size();
+        bool refused = known && op == OP_SET && !settable(keys[id].path);
+        bool tooLong = false;
+        if (known && op == OP_SET && !refused)
+        {
+            tooLong = keys[id].type == CFG::ItemType::Char && length > WS_BINARY_MAX_VALUE;
+            need += WS_BINARY_ANSWER_RECORD_SIZE;
+            if (!tooLong)
+                need += keys[id].type == CFG::ItemType::Char ? length : value_length(keys[id]);
+        }
+        else if (known && !refused)
+        {
+            need += value_length(keys[id]);
+        }
+
+        if (!fits(need))
+        {
+            out[base + 1] = 1;
+            break;
+        }
+        pos += WS_BINARY_REQUEST_RECORD_SIZE + length;
+
+        if (op != OP_GET && op != OP_SET)
+        {
+            add_record(out, op, STATUS_UNKNOWN_OP, 0, id, nullptr, 0);
+            continue;
+        }
+
+        if (!known)
+        {
+            add_record(out, op, STATUS_UNKNOWN_KEY, 0, id, nullptr, 0);
+            continue;
+        }
+
+        const CFG::KeyInfo &key = keys[id];
+        if (op == OP_SET)
+        {
+            if (refused)
+            {
+                add_record(out, op, STATUS_UNKNOWN_KEY, static_cast<uint8_t>(key.type), id, nullptr, 0);
+                continue;
+            }
+
+            if (tooLong)
+            {
+                add_record(out, op, STATUS_TOO_LONG, static_cast<uint8_t>(key.type), id, nullptr, 0);
+                continue;
+            }
+
+            if (!set_value(key, value, length))
+            {
+                add_record(out, op, STATUS_INVALID_VALUE, static_cast<uint8_t>(key.type), id, nullptr, 0);
+                continue;
+            }
+        }
+
+        add_value(out, op, id, key);
+    }
+
+    return changes.keys;
+}
+
+void WSBinary::addReconfig(std::vector<uint8_t> &out, const std::vector<ReconfigResult> &results)
+{
+    const std::vector<CFG::KeyInfo> &keys = cfg->keys();
+    for (auto &result : results)
+    {
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            if (keys[i].path == result.key)
+            {
+                add_record(out, OP_RECONFIG, static_cast<uint8_t>(result.action), static_cast<uint8_t>(keys[i].type),
+                           static_cast<uint16_t>(i), nullptr, 0);
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef WS_BINARY_HPP
+#define WS_BINARY_HPP
+
+// Binary control messages for websocket sessions, next to JSON. A binary frame
+// is a batch of get and set operations on config keys addressed by id, see
+// CFG::keys(). Meant for sliders and drags that send many small changes,
+// nothing is parsed as text. JSON stays the default, a session uses this by
+// sending binary frames.
+//
+// All integers are big endian.
+//
+// request:  byte 0      version (1)
+//           byte 1      reserved
+//           bytes 2-3   request id, echoed in the answer
+//           records     op (1 byte), key id (2), length (2), value (length)
+//
+// answer:   byte 0      version (1)
+//           byte 1      0, or 1 when the request was cut short or of
+//                       another version
+//           bytes 2-3   request id
+//           records     op (1), status (1), type (1), key id (2), length (2),
+//                       value (length)
+//
+// ops:      1 get       the value of the key
+//           2 set       the value in the type of the key, answered with the
+//                       value the key has afterwards
+//           3 keys      the key table from the key id on, one record per key
+//                       with its path as value, as many as fit in an answer
+//           4 reconfig  answer only, after the sets: one record per key that
+//                       changed, status is what it took to apply it
+//                       (0 stored, 1 runtime, 2 encoder, 3 restart)
+//
+// types:    0 bool (1 byte), 1 string, 2 int (4), 3 uint (4), 4 float (4,
+//           IEEE 754)
+// status:   0 ok, 1 unknown key, or a key a set can't change, 2 invalid
+//           value, 3 unknown op, 4 too long, a string that does not fit in
+//           an answer on its own (a set of one is not run)
+//
+// A set can change the sections the JSON protocol has (general, rtsp, image,
+// audio, stream0-2, motion) except the keys that name a program to run or a
+// file to write: audio.output_sink_path, motion.script_path and
+// stream2.jpeg_path. events, websocket, dvr, record and the sensor values the
+// driver reports are left to the config file, get still reads them.
+//
+// An answer is at most WS_BINARY_MAX_ANSWER bytes. When the next record would
+// not fit, byte 1 of the answer is 1 and that record and the ones after it
+// are not run, the client sends them again.
+//
+// Only the config is touched here, WS pushes image settings to the ISP like
+// the JSON handler does and adds the reconfig records, they tell what restart
+// the other keys need.
+
+#include "Reconfig.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define WS_BINARY_VERSION 1
+#define WS_BINARY_MAX_ANSWER 4096
+
+class WSBinary
+{
+public:
+    // Runs the records of the request and appends the answer to out, returns
+    // the keys the sets changed. Room for one reconfig record per key is kept.
+    static std::vector<std::string_view> run(const std::string &request, std::vector<uint8_t> &out);
+
+    // Appends the reconfig records to an answer of run()
+    static void addReconfig(std::vector<uint8_t> &out, const std::vector<ReconfigResult> &results);
+};
+
+#endif // WS_BINARY_HPP
@@ -0,0 +1,271 @@
+#include "WSLive.hpp"
+
+#include "Config.hpp"
+#include "Logger.hpp"
+#include "TSMuxer.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#define MODULE "WS_LIVE"
+
+static const uint8_t start_code[] = {0x00, 0x00, 0x00, 0x01};
+
+// First bytes of a NAL with the emulation prevention bytes removed
+static std::vector<uint8_t> unescape(const std::vector<uint8_t> &nal, size_t max)
+{
+    std::vector<uint8_t> out;
+    int zeros = 0;
+    for (size_t i = 0; i < nal.size() && out.size() < max; i++)
+    {
+        if (zeros >= 2 && nal[i] == 0x03)
+        {
+            zeros = 0;
+            continue;
+        }
+        zeros = (nal[i] == 0) ? zeros + 1 : 0;
+        out.push_back(nal[i]);
+    }
+    return out;
+}
+
+// WebCodecs codec string from the SPS, avc3/hev1 as the parameter sets are
+// sent in band
+static std::string codec_string(bool h265, const std::vector<uint8_t> &sps)
+{
+    char buf[64];
+
+    if (!h265)
+    {
+        if (sps.size() < 4)
+            return "";
+        snprintf(buf, sizeof(buf), "avc3.%02x%02x%02x", sps[1], sps[2], sps[3]);
+        return buf;
+    }
+
+    // NAL header, vps id / sub layers, then the general profile_tier_level
+    std::vector<uint8_t> ptl = unescape(sps, 15);
+    if (ptl.size() < 15)
+        return "";
+
+    static const char *const spaces[] = {"", "A", "B", "C"};
+    int space = ptl[3] >> 6;
+    bool tier = ptl[3] & 0x20;
+    int profile = ptl[3] & 0x1F;
+
+    uint32_t compat = (ptl[4] << 24) | (ptl[5] << 16) | (ptl[6] << 8) | ptl[7];
+    uint32_t reversed = 0;
+    for (int i = 0; i < 32; i++)
+    {
+        if (compat & (1u << i))
+            reversed |= 1u << (31 - i);
+    }
+
+    std::string codec = "hev1.";
+    snprintf(buf, sizeof(buf), "%s%d.%x.%c%d", spaces[space], profile, reversed, tier ? 'H' : 'L', ptl[14]);
+    codec += buf;
+
+    // Constraint flags, trailing zero bytes are left out
+    int last = 13;
+    while (last >= 8 && ptl[last] == 0)
+        last--;
+    for (int i = 8; i <= last; i++)
+    {
+        snprintf(buf, sizeof(buf), ".%x", ptl[i]);
+        codec += buf;
+    }
+    return codec;
+}
+
+void WSLive::setWake(std::function<void()> wake)
+{
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    this->wake = std::move(wake);
+}
+
+void WSLive::pushVideo(int encChn, const H264NALUnit &nalu)
+{
+    Channel &channel = channels[encChn];
+    if (nalu.data.empty())
+        return;
+
+    if (channel.restart.exchange(false, std::memory_order_relaxed))
+    {
+        const char *format = cfg->streams[encChn].format;
+        channel.isH265 = strcmp(format, "H265") == 0;
+        channel.waitKeyframe = true;
+        channel.prevNalType = -1;
+        channel.building.reset();
+    }
+
+    TSMuxer::VideoCodec codec = channel.isH265 ? TSMuxer::VideoCodec::H265 : TSMuxer::VideoCodec::H264;
+    bool gopStart = TSMuxer::isGopStart(codec, nalu.data[0], channel.prevNalType);
+    bool sps = channel.isH265 ? channel.prevNalType == 33 : channel.prevNalType == 7;
+
+    if (sps)
+    {
+        std::string codecString = codec_string(channel.isH265, nalu.data);
+        std::lock_guard<std::mutex> lock(channel.mutex);
+        if (codecString != channel.codec)
+            channel.codec = codecString;
+    }
+
+    if (!channel.building)
+    {
+        channel.building = std::make_shared<LiveFrame>();
+        channel.building->buffer.reserve(LWS_PRE + WS_LIVE_HEADER_SIZE + nalu.data.size() + 1024);
+        channel.building->buffer.resize(LWS_PRE + WS_LIVE_HEADER_SIZE);
+        channel.building->timestampUs = static_cast<int64_t>(nalu.time.tv_sec) * 1000000 + nalu.time.tv_usec;
+        channel.building->keyframe = false;
+    }
+
+    LiveFrame &frame = *channel.building;
+    frame.keyframe |= gopStart;
+    frame.buffer.insert(frame.buffer.end(), start_code, start_code + sizeof(start_code));
+    frame.buffer.insert(frame.buffer.end(), nalu.data.begin(), nalu.data.end());
+}
+
+void WSLive::commit(int encChn)
+{
+    Channel &channel = channels[encChn];
+    std::shared_ptr<LiveFrame> frame = std::move(channel.building);
+    if (!frame)
+        return;
+
+    if (channel.waitKeyframe && !frame->keyframe)
+        return;
+    channel.waitKeyframe = false;
+
+    frame->seq = ++channel.nextSeq;
+
+    uint8_t *header = frame->buffer.data() + LWS_PRE;
+    header[0] = frame->keyframe ? 0x01 : 0x00;
+    header[1] = static_cast<uint8_t>(encChn);
+    header[2] = 0;
+    header[3] = 0;
+    uint64_t ts = static_cast<uint64_t>(frame->timestampUs);
+    for (int i = 0; i < 8; i++)
+        header[4 + i] = static_cast<uint8_t>(ts >> (56 - 8 * i));
+
+    publish(channel, std::move(frame));
+
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    if (wake)
+        wake();
+}
+
+void WSLive::publish(Channel &channel, std::shared_ptr<LiveFrame> &&frame)
+{
+    std::lock_guard<std::mutex> lock(channel.mutex);
+
+    if (frame->keyframe)
+        channel.keyframes.push_back(frame->seq);
+    channel.bytes += frame->buffer.size();
+    channel.frames.push_back(std::move(frame));
+
+    // The latest GOP is needed to join, the one before it only for sessions
+    // still sending its last frames
+    while (channel.keyframes.size() > 2
+           || (channel.keyframes.size() > 1 && channel.bytes > WS_LIVE_MAX_BYTES))
+    {
+        while (channel.frames.front()->seq < channel.keyframes[1])
+        {
+            channel.bytes -= channel.frames.front()->buffer.size();
+            channel.frames.pop_front();
+        }
+        channel.keyframes.pop_front();
+    }
+
+    if (channel.bytes > WS_LIVE_MAX_BYTES)
+    {
+        // A GOP this large isn't kept, sessions continue with the next one
+        LOG_DEBUG("GOP of stream" << (&channel - channels) << " exceeds " << WS_LIVE_MAX_BYTES / 1024 << " KiB.");
+        channel.frames.clear();
+        channel.keyframes.clear();
+        channel.bytes = 0;
+        channel.waitKeyframe = true;
+    }
+}
+
+bool WSLive::takeKeyframeRequest(int encChn)
+{
+    return channels[encChn].keyframeRequest.exchange(false, std::memory_order_relaxed);
+}
+
+void WSLive::subscribe(int encChn)
+{
+    Channel &channel = channels[encChn];
+    if (channel.viewers.fetch_add(1) == 0)
+    {
+        channel.restart = true;
+        channel.keyframeRequest = true;
+
+        // The worker sleeps while nobody needs the stream, wake it up
+        if (global_video[encChn])
+        {
+            {
+                std::unique_lock<std::mutex> lck(mutex_main);
+            }
+            global_video[encChn]->should_grab_frames.notify_one();
+        }
+    }
+}
+
+void WSLive::unsubscribe(int encChn)
+{
+    Channel &channel = channels[encChn];
+    if (channel.viewers.fetch_sub(1) == 1)
+    {
+        std::lock_guard<std::mutex> lock(channel.mutex);
+        channel.frames.clear();
+        channel.keyframes.clear();
+        channel.bytes = 0;
+    }
+}
+
+LiveFramePtr WSLive::next(int encChn, uint64_t &seq)
+{
+    Channel &channel = channels[encChn];
+    std::lock_guard<std::mutex> lock(channel.mutex);
+
+    if (channel.frames.empty())
+        return nullptr;
+
+    uint64_t first = channel.frames.front()->seq;
+    uint64_t newest = channel.frames.back()->seq;
+    if (seq >= newest)
+        return nullptr;
+
+    uint64_t want = seq + 1;
+    bool behind = seq == 0 || want < first
+                  || channel.frames.back()->timestampUs - channel.frames[want - first]->timestampUs > WS_LIVE_MAX_LAG_US;
+    if (behind && !channel.keyframes.empty() && channel.keyframes.back() > seq)
+    {
+        if (seq != 0)
+            skippedFrames.fetch_add(channel.keyframes.back() - want, std::memory_order_relaxed);
+        want = channel.keyframes.back();
+    }
+    else if (want < first)
+    {
+        // Trimmed away and no keyframe to start over, wait for the next one
+        return nullptr;
+    }
+
+    seq = want;
+    return channel.frames[want - first];
+}
+
+std::string WSLive::describe(int encChn)
+{
+    Channel &channel = channels[encChn];
+    _stream &stream = cfg->streams[encChn];
+
+    std::string codec;
+    {
+        std::lock_guard<std::mutex> lock(channel.mutex);
+        codec = channel.codec;
+    }
+
+    return "{\"stream\":" + std::to_string(encChn) + ",\"codec\":\"" + codec
+           + "\",\"width\":" + std::to_string(stream.width) + ",\"height\":" + std::to_string(stream.height) + "}";
+}
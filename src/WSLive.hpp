@@ -0,0 +1,106 @@
+#ifndef WS_LIVE_HPP
+#define WS_LIVE_HPP
+
+// Live video for websocket sessions. VideoWorker hands over the NALs of every
+// encoded frame, they are kept as Annex-B access units ready to be sent as
+// one binary websocket message each, e.g. to WebCodecs in the browser:
+//
+//   byte 0      flags, bit 0 = keyframe
+//   byte 1      stream index (0, 1, then the derived streams)
+//   bytes 2-3   reserved
+//   bytes 4-11  timestamp in microseconds, big endian
+//   ...         the access unit, every NAL behind a 4 byte start code
+//
+// The frames since the last keyframe are kept, a session joins at the latest
+// keyframe right away. A session that falls behind skips ahead to the newest
+// keyframe instead of queueing frames.
+
+#include "globals.hpp"
+
+#include <libwebsockets.h>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define WS_LIVE_HEADER_SIZE 12
+// Frames kept per stream, the current GOP is dropped when it grows beyond
+#define WS_LIVE_MAX_BYTES (2 * 1024 * 1024)
+// Sessions further behind than this skip ahead to the newest keyframe
+#define WS_LIVE_MAX_LAG_US 500000
+
+struct LiveFrame
+{
+    std::vector<uint8_t> buffer;    // LWS_PRE, header, access unit
+    uint64_t seq;
+    int64_t timestampUs;
+    bool keyframe;
+
+    const uint8_t *message() const { return buffer.data() + LWS_PRE; }
+    size_t messageSize() const { return buffer.size() - LWS_PRE; }
+};
+
+using LiveFramePtr = std::shared_ptr<const LiveFrame>;
+
+class WSLive
+{
+public:
+    // Called when a frame is published, wakes the lws service loop
+    void setWake(std::function<void()> wake);
+
+    // Producer side, the VideoWorker of the stream
+    bool accepts(int encChn) const { return channels[encChn].viewers.load(std::memory_order_relaxed) > 0; }
+    void pushVideo(int encChn, const H264NALUnit &nalu);
+    // End of the frame pushed since the last commit
+    void commit(int encChn);
+    // True once after the first session joined, the worker requests an IDR
+    bool takeKeyframeRequest(int encChn);
+
+    // lws thread
+    void subscribe(int encChn);
+    void unsubscribe(int encChn);
+
+    // Next frame for a session that got everything up to seq (0 = nothing
+    // yet), nullptr when there is none. seq is advanced to the frame.
+    LiveFramePtr next(int encChn, uint64_t &seq);
+
+    // {"stream":0,"codec":"avc3.640028","width":1920,"height":1080}, the
+    // codec string is known after the first keyframe
+    std::string describe(int encChn);
+
+    uint64_t skipped() const { return skippedFrames.load(std::memory_order_relaxed); }
+
+private:
+    struct Channel
+    {
+        std::mutex mutex;
+        std::deque<LiveFramePtr> frames;
+        std::deque<uint64_t> keyframes;     // seq of every keyframe in frames
+        size_t bytes = 0;
+        std::string codec;
+        std::atomic<int> viewers{0};
+        std::atomic<bool> restart{false};
+        std::atomic<bool> keyframeRequest{false};
+
+        // Producer state
+        std::shared_ptr<LiveFrame> building;
+        bool isH265 = false;
+        bool waitKeyframe = true;
+        int prevNalType = -1;
+        uint64_t nextSeq = 0;
+    };
+
+    void publish(Channel &channel, std::shared_ptr<LiveFrame> &&frame);
+
+    Channel channels[MAX_VIDEO_STREAMS];
+    std::mutex wakeMutex;
+    std::function<void()> wake;
+    std::atomic<uint64_t> skippedFrames{0};
+};
+
+#endif // WS_LIVE_HPP
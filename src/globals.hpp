@@ -14,7 +14,11 @@
 
 #define MSG_CHANNEL_SIZE 20
 #define NUM_AUDIO_CHANNELS 1
-#define NUM_VIDEO_CHANNELS 2
+#define NUM_JPEG_CHANNELS 2
+
+// Encoder channel of video stream chn, the JPEG channels come after the
+// source streams
+inline int videoEncChn(int chn) { return chn < NUM_SOURCE_STREAMS ? chn : chn + NUM_JPEG_CHANNELS; }
 
 using namespace std::chrono;
 
@@ -37,6 +41,9 @@ struct BackchannelFrame
     std::vector<uint8_t> payload;
     IMPBackchannelFormat format;
     unsigned int clientSessionId;
+    uint16_t rtpSeqNum{0};
+    uint32_t rtpTimestamp{0};
+    int64_t arrivalUs{0}; // steady clock, used for jitter estimation
 };
 
 struct jpeg_stream
@@ -44,6 +51,7 @@ struct jpeg_stream
     int encChn;
     int streamChn;
     _stream *stream;
+    _stream own_stream;        // settings of a channel at another size than stream2
     std::atomic<bool> running; // set to false to make jpeg_grabber thread exit
     std::atomic<bool> active{false};
     pthread_t thread;
@@ -62,11 +70,11 @@ struct jpeg_stream
     }
 
     bool request_or_overrun() {
-        return duration_cast<milliseconds>(steady_clock::now() - last_subscriber).count() < 1000;
+        return duration_cast<milliseconds>(steady_clock::now() - last_subscriber).count() < cfg->stream2.jpeg_cache_ttl;
     }
 
     jpeg_stream(int encChn, _stream *stream)
-        : encChn(encChn), stream(stream), running(false), imp_encoder(nullptr) {}
+        : encChn(encChn), streamChn(-1), stream(stream), own_stream(), running(false), imp_encoder(nullptr) {}
 };
 
 struct audio_stream
@@ -117,6 +125,28 @@ struct video_stream
     std::mutex onDataCallbackLock;     // protects onDataCallback from deallocation
     std::condition_variable should_grab_frames;
     std::binary_semaphore is_activated{0};
+    std::atomic<uint32_t> dropped_nals{0}; // msgChannel full, the RTSP source fell behind
+    std::mutex encoder_lock;               // held while imp_encoder is created or torn down, see lock_encoder()
+
+    /* imp_encoder with encoder_lock held, empty while the stream has none.
+     * Every thread but the video worker of the stream uses it this way, a
+     * lazy stream creates and tears down its encoder while running.
+     */
+    struct LockedEncoder
+    {
+        std::unique_lock<std::mutex> lock;
+        IMPEncoder *encoder = nullptr;
+
+        explicit operator bool() const { return encoder != nullptr; }
+        IMPEncoder *operator->() const { return encoder; }
+    };
+
+    LockedEncoder lock_encoder()
+    {
+        std::unique_lock<std::mutex> lock{encoder_lock};
+        IMPEncoder *encoder = imp_encoder;
+        return {std::move(lock), encoder};
+    }
 
     video_stream(int encChn, _stream *stream, const char *name)
         : encChn(encChn), stream(stream), name(name), running(false), idr(false), idr_fix(0), imp_encoder(nullptr), imp_framesource(nullptr),
@@ -148,14 +178,31 @@ extern bool global_restart_rtsp;
 extern bool global_restart_video;
 extern bool global_restart_audio;
 
-extern bool global_osd_thread_signal;
 extern bool global_main_thread_signal;
 extern bool global_motion_thread_signal;
 extern std::atomic<char> global_rtsp_thread_signal;
 
-extern std::shared_ptr<jpeg_stream> global_jpeg[NUM_VIDEO_CHANNELS];
+extern std::shared_ptr<jpeg_stream> global_jpeg[NUM_JPEG_CHANNELS];
 extern std::shared_ptr<audio_stream> global_audio[NUM_AUDIO_CHANNELS];
-extern std::shared_ptr<video_stream> global_video[NUM_VIDEO_CHANNELS];
+extern std::shared_ptr<video_stream> global_video[MAX_VIDEO_STREAMS];
 extern std::shared_ptr<backchannel_stream> global_backchannel;
 
+class DVR;
+extern std::shared_ptr<DVR> global_dvr;
+class Recorder;
+extern std::shared_ptr<Recorder> global_recorder;
+class WSLive;
+extern std::shared_ptr<WSLive> global_live;
+class Reactor;
+extern std::shared_ptr<Reactor> global_reactor;
+extern std::shared_ptr<Reactor> global_imp_reactor;
+extern std::shared_ptr<Reactor> global_encoder_reactor;
+class SnapshotCache;
+extern std::shared_ptr<SnapshotCache> global_snapshots;
+class ImageTuning;
+extern std::shared_ptr<ImageTuning> global_tuning;
+
+class EventBus;
+extern std::shared_ptr<EventBus> global_events;
+
 #endif // GLOBALS_HPP
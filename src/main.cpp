@@ -18,6 +18,13 @@
 #include "WorkerUtils.hpp"
 #include "IMPBackchannel.hpp"
 #include "TimestampManager.hpp"
+#include "DVR.hpp"
+#include "Recorder.hpp"
+#include "WSLive.hpp"
+#include "EventBus.hpp"
+#include "Reactor.hpp"
+#include "SnapshotCache.hpp"
+#include "ImageTuning.hpp"
 using namespace std::chrono;
 
 std::mutex mutex_main;
@@ -30,17 +37,25 @@ bool global_restart_rtsp = false;
 bool global_restart_video = false;
 bool global_restart_audio = false;
 
-bool global_osd_thread_signal = false;
 bool global_main_thread_signal = false;
 bool global_motion_thread_signal = false;
 std::atomic<char> global_rtsp_thread_signal{1};
 
-std::shared_ptr<jpeg_stream> global_jpeg[NUM_VIDEO_CHANNELS] = {nullptr};
-std::shared_ptr<video_stream> global_video[NUM_VIDEO_CHANNELS] = {nullptr};
+std::shared_ptr<jpeg_stream> global_jpeg[NUM_JPEG_CHANNELS] = {nullptr};
+std::shared_ptr<video_stream> global_video[MAX_VIDEO_STREAMS] = {nullptr};
 #if defined(AUDIO_SUPPORT)
 std::shared_ptr<audio_stream> global_audio[NUM_AUDIO_CHANNELS] = {nullptr};
 std::shared_ptr<backchannel_stream> global_backchannel = nullptr;
 #endif
+std::shared_ptr<DVR> global_dvr = nullptr;
+std::shared_ptr<Recorder> global_recorder = nullptr;
+std::shared_ptr<WSLive> global_live = nullptr;
+std::shared_ptr<Reactor> global_reactor = nullptr;
+std::shared_ptr<Reactor> global_imp_reactor = nullptr;
+std::shared_ptr<Reactor> global_encoder_reactor = nullptr;
+std::shared_ptr<SnapshotCache> global_snapshots = nullptr;
+std::shared_ptr<ImageTuning> global_tuning = nullptr;
+std::shared_ptr<EventBus> global_events = nullptr;
 
 std::shared_ptr<CFG> cfg = std::make_shared<CFG>();
 
@@ -65,11 +80,11 @@ bool timesync_wait()
     return true;
 }
 
-void start_video(int encChn)
+void start_video(int chn)
 {
-    StartHelper sh{encChn};
-    int ret = pthread_create(&global_video[encChn]->thread, nullptr, VideoWorker::thread_entry, static_cast<void *>(&sh));
-    LOG_DEBUG_OR_ERROR(ret, "create video["<< encChn << "] thread");
+    StartHelper sh{chn};
+    int ret = pthread_create(&global_video[chn]->thread, nullptr, VideoWorker::thread_entry, static_cast<void *>(&sh));
+    LOG_DEBUG_OR_ERROR(ret, "create video["<< chn << "] thread");
 
     // wait for initialization done
     sh.has_started.acquire();
@@ -79,12 +94,18 @@ int main(int argc, const char *argv[])
 {
     LOG_INFO("PRUDYNT-T Next-Gen Video Daemon: " << FULL_VERSION_STRING);
 
-    pthread_t cw_thread;
+    pthread_t reactor_thread;
+    pthread_t imp_reactor_thread;
+    pthread_t encoder_reactor_thread;
     pthread_t ws_thread;
-    pthread_t osd_thread;
+    int osd_timer = -1;
     pthread_t rtsp_thread;
     pthread_t motion_thread;
     pthread_t backchannel_thread;
+    pthread_t dvr_thread;
+    bool dvr_started = false;
+    pthread_t record_thread;
+    bool record_started = false;
 
     if (Logger::init(cfg->general.loglevel))
     {
@@ -111,16 +132,36 @@ int main(int argc, const char *argv[])
         return 1;
     }
 
-    global_video[0] = std::make_shared<video_stream>(0, &cfg->stream0, "stream0");
-    global_video[1] = std::make_shared<video_stream>(1, &cfg->stream1, "stream1");
+    for (int chn = 0; chn < MAX_VIDEO_STREAMS; chn++)
+        global_video[chn] = std::make_shared<video_stream>(videoEncChn(chn), &cfg->streams[chn], CFG::streamName(chn));
     global_jpeg[0] = std::make_shared<jpeg_stream>(2, &cfg->stream2);
+    global_jpeg[1] = std::make_shared<jpeg_stream>(3, &cfg->stream2);
+    global_snapshots = std::make_shared<SnapshotCache>();
+    global_tuning = std::make_shared<ImageTuning>();
+    global_tuning->start();
 
 #if defined(AUDIO_SUPPORT)
     global_audio[0] = std::make_shared<audio_stream>(1, 0, 0);
     global_backchannel = std::make_shared<backchannel_stream>();
 #endif
+    global_dvr = std::make_shared<DVR>();
+    global_recorder = std::make_shared<Recorder>();
+    global_live = std::make_shared<WSLive>();
+    global_events = std::make_shared<EventBus>();
+    global_events->start();
+
+    // housekeeping (config watching) runs on one event loop, the OSD updates
+    // call into the SDK and can block, they get a loop of their own. The
+    // encoder fds of all workers share a third one, kept clear of both.
+    global_reactor = std::make_shared<Reactor>();
+    pthread_create(&reactor_thread, nullptr, Reactor::thread_entry, global_reactor.get());
+    global_imp_reactor = std::make_shared<Reactor>();
+    pthread_create(&imp_reactor_thread, nullptr, Reactor::thread_entry, global_imp_reactor.get());
+    global_encoder_reactor = std::make_shared<Reactor>();
+    pthread_create(&encoder_reactor_thread, nullptr, Reactor::thread_entry, global_encoder_reactor.get());
+    ConfigWatcher config_watcher;
+    config_watcher.attach(*global_reactor);
 
-    pthread_create(&cw_thread, nullptr, ConfigWatcher::thread_entry, nullptr);
     pthread_create(&ws_thread, nullptr, WS::run, &ws);
 
     while (true)
@@ -154,6 +195,22 @@ int main(int argc, const char *argv[])
                 start_video(1);
             }
 
+            // derived streams register into the encoder group of their source
+            for (int chn = NUM_SOURCE_STREAMS; chn < MAX_VIDEO_STREAMS; chn++)
+            {
+                if (!cfg->streams[chn].enabled)
+                    continue;
+
+                int source = cfg->streams[chn].source;
+                if (!global_video[source]->imp_encoder)
+                {
+                    LOG_WARN(CFG::streamName(chn) << " not started, its source " << CFG::streamName(source)
+                                                  << " is not running");
+                    continue;
+                }
+                start_video(chn);
+            }
+
             if (cfg->stream2.enabled)
             {
                 StartHelper sh{2};
@@ -163,10 +220,20 @@ int main(int argc, const char *argv[])
                 sh.has_started.acquire();
             }
 
+            if (JPEGWorker::thumbnailSource() >= 0)
+            {
+                StartHelper sh{3};
+                int ret = pthread_create(&global_jpeg[1]->thread, nullptr, JPEGWorker::thread_entry, static_cast<void *>(&sh));
+                LOG_DEBUG_OR_ERROR(ret, "create thumbnail thread");
+                // wait for initialization done
+                sh.has_started.acquire();
+            }
+
             if (cfg->stream0.osd.enabled || cfg->stream1.osd.enabled)
             {
-                int ret = pthread_create(&osd_thread, nullptr, OSD::thread_entry, NULL);
-                LOG_DEBUG_OR_ERROR(ret, "create osd thread");
+                osd_timer = global_imp_reactor->addTimer(THREAD_SLEEP / 1000, THREAD_SLEEP / 1000,
+                                                         Reactor::Priority::Normal, OSD::tick);
+                LOG_DEBUG_OR_ERROR(osd_timer < 0, "create osd timer");
             }
 
             if (cfg->motion.enabled)
@@ -174,6 +241,20 @@ int main(int argc, const char *argv[])
                 int ret = pthread_create(&motion_thread, nullptr, Motion::run, &motion);
                 LOG_DEBUG_OR_ERROR(ret, "create motion thread");
             }
+
+            if (cfg->dvr.enabled)
+            {
+                int ret = pthread_create(&dvr_thread, nullptr, DVR::thread_entry, global_dvr.get());
+                LOG_DEBUG_OR_ERROR(ret, "create dvr thread");
+                dvr_started = (ret == 0);
+            }
+
+            if (cfg->record.enabled)
+            {
+                int ret = pthread_create(&record_thread, nullptr, Recorder::thread_entry, global_recorder.get());
+                LOG_DEBUG_OR_ERROR(ret, "create recorder thread");
+                record_started = (ret == 0);
+            }
         }
 
         // start rtsp server
@@ -243,15 +324,39 @@ int main(int argc, const char *argv[])
                 LOG_DEBUG_OR_ERROR(ret, "join motion thread");
             }
 
-            // stop osd thread
-            if (global_osd_thread_signal)
+            // stop dvr before its source stream
+            if (dvr_started)
+            {
+                global_dvr->stop();
+                int ret = pthread_join(dvr_thread, NULL);
+                LOG_DEBUG_OR_ERROR(ret, "join dvr thread");
+                dvr_started = false;
+            }
+
+            if (record_started)
+            {
+                global_recorder->stop();
+                int ret = pthread_join(record_thread, NULL);
+                LOG_DEBUG_OR_ERROR(ret, "join recorder thread");
+                record_started = false;
+            }
+
+            // stop osd updates, returns once a running update is done
+            if (osd_timer >= 0)
             {
-                global_osd_thread_signal = false;
-                int ret = pthread_join(osd_thread, NULL);
-                LOG_DEBUG_OR_ERROR(ret, "join osd thread");
+                global_imp_reactor->remove(osd_timer);
+                osd_timer = -1;
             }
 
             // stop jpeg
+            if (global_jpeg[1]->imp_encoder)
+            {
+                global_jpeg[1]->running = false;
+                global_jpeg[1]->should_grab_frames.notify_one();
+                int ret = pthread_join(global_jpeg[1]->thread, NULL);
+                LOG_DEBUG_OR_ERROR(ret, "join thumbnail thread");
+            }
+
             if (global_jpeg[0]->imp_encoder)
             {
                 global_jpeg[0]->running = false;
@@ -260,8 +365,20 @@ int main(int argc, const char *argv[])
                 LOG_DEBUG_OR_ERROR(ret, "join jpeg thread");
             }
 
-            // stop stream1
-            if (global_video[1]->imp_encoder)
+            // stop the derived streams before the encoder groups they are in
+            for (int chn = MAX_VIDEO_STREAMS - 1; chn >= NUM_SOURCE_STREAMS; chn--)
+            {
+                if (global_video[chn]->running)
+                {
+                    global_video[chn]->running = false;
+                    global_video[chn]->should_grab_frames.notify_one();
+                    int ret = pthread_join(global_video[chn]->thread, NULL);
+                    LOG_DEBUG_OR_ERROR(ret, "join " << global_video[chn]->name << " thread");
+                }
+            }
+
+            // stop stream1, a lazy stream may have no encoder at this point
+            if (global_video[1]->running)
             {
                 global_video[1]->running = false;
                 global_video[1]->should_grab_frames.notify_one();
@@ -269,8 +386,8 @@ int main(int argc, const char *argv[])
                 LOG_DEBUG_OR_ERROR(ret, "join stream1 thread");
             }
 
-            // stop stream0
-            if (global_video[0]->imp_encoder)
+            // stop stream0, a lazy stream may have no encoder at this point
+            if (global_video[0]->running)
             {
                 global_video[0]->running = false;
                 global_video[0]->should_grab_frames.notify_one();
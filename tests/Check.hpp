@@ -0,0 +1,33 @@
+#ifndef TESTS_CHECK_HPP
+#define TESTS_CHECK_HPP
+
+// Assertions of the host tests. A failed CHECK prints where and continues,
+// main() returns checkResult() so make stops on the first failing test.
+
+#include <cstdio>
+
+inline int checkFailures = 0;
+
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if (!(cond))                                                        \
+        {                                                                   \
+            printf("%s:%d: %s: CHECK(%s) failed\n", __FILE__, __LINE__,     \
+                   __func__, #cond);                                        \
+            checkFailures++;                                                \
+        }                                                                   \
+    } while (0)
+
+inline int checkResult(const char *test)
+{
+    if (checkFailures)
+    {
+        printf("%s: %d failed\n", test, checkFailures);
+        return 1;
+    }
+    printf("%s: passed\n", test);
+    return 0;
+}
+
+#endif // TESTS_CHECK_HPP
@@ -0,0 +1,154 @@
+// Resolves every key of res/prudynt.json through CFG::get, the way the
+// websocket handlers do, and compares it with the linear scan get/set did
+// before the key index: a std::string of the key per call, compared with
+// every item of the requested type.
+//
+//   make -C tests bench
+//   tests/bin/ConfigKeysBench [prudynt.json] [rounds]
+
+#include "Config.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+std::shared_ptr<CFG> cfg;
+
+namespace
+{
+
+struct Key
+{
+    std::string path;
+    CFG::ItemType type;
+    bool known;
+};
+
+volatile uint64_t sink;
+
+void collect(json_object *obj, std::string &path, std::vector<std::string> &out)
+{
+    json_object_object_foreach(obj, name, value)
+    {
+        size_t prefix = path.size();
+        if (prefix)
+            path += '.';
+        path += name;
+
+        // arrays (rois) are not items
+        if (json_object_is_type(value, json_type_object))
+            collect(value, path, out);
+        else if (!json_object_is_type(value, json_type_array))
+            out.push_back(path);
+
+        path.resize(prefix);
+    }
+}
+
+uint64_t lookup(CFG &config, const Key &key)
+{
+    switch (key.type)
+    {
+    case CFG::ItemType::Bool:
+        return config.get<bool>(key.path);
+    case CFG::ItemType::Char:
+        return reinterpret_cast<uintptr_t>(config.get<const char *>(key.path));
+    case CFG::ItemType::Int:
+        return config.get<int>(key.path);
+    case CFG::ItemType::Uint:
+        return config.get<unsigned int>(key.path);
+    case CFG::ItemType::Float:
+        return static_cast<uint64_t>(config.get<float>(key.path));
+    }
+    return 0;
+}
+
+// The old get(): the caller's literal became a std::string, then the items
+// of the type were compared one by one
+uint64_t scan(const std::vector<CFG::KeyInfo> &table, const char *name, CFG::ItemType type)
+{
+    const std::string key(name);
+    for (size_t i = 0; i < table.size(); i++)
+    {
+        if (table[i].type == type && key == table[i].path.data())
+            return i;
+    }
+    return table.size();
+}
+
+template <typename F>
+double nsPerLookup(size_t lookups, F &&run)
+{
+    auto start = std::chrono::steady_clock::now();
+    run();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / lookups;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const char *file = argc > 1 ? argv[1] : "../res/prudynt.json";
+    int rounds = argc > 2 ? atoi(argv[2]) : 2000;
+
+    json_object *root = json_object_from_file(file);
+    if (!root)
+    {
+        fprintf(stderr, "can't parse %s\n", file);
+        return 1;
+    }
+
+    std::vector<std::string> paths;
+    std::string path;
+    collect(root, path, paths);
+    json_object_put(root);
+
+    cfg = std::make_shared<CFG>();
+    const std::vector<CFG::KeyInfo> &table = cfg->keys();
+
+    std::vector<Key> keys;
+    int unknown = 0;
+    for (const std::string &p : paths)
+    {
+        Key key{p, CFG::ItemType::Int, false};
+        for (const CFG::KeyInfo &info : table)
+        {
+            if (info.path == p)
+            {
+                key.type = info.type;
+                key.known = true;
+                break;
+            }
+        }
+        if (!key.known)
+        {
+            printf("not a config key: %s\n", p.c_str());
+            unknown++;
+        }
+        keys.push_back(key);
+    }
+
+    size_t lookups = keys.size() * rounds;
+
+    double indexed = nsPerLookup(lookups, [&] {
+        for (int r = 0; r < rounds; r++)
+            for (const Key &key : keys)
+                sink = sink + lookup(*cfg, key);
+    });
+
+    double scanned = nsPerLookup(lookups, [&] {
+        for (int r = 0; r < rounds; r++)
+            for (const Key &key : keys)
+                sink = sink + scan(table, key.path.c_str(), key.type);
+    });
+
+    printf("%zu keys in %s (%d unknown), %zu items, %d rounds\n", keys.size(), file, unknown, table.size(),
+           rounds);
+    printf("index: %8.1f ns per lookup\n", indexed);
+    printf("scan:  %8.1f ns per lookup\n", scanned);
+
+    return 0;
+}
@@ -0,0 +1,231 @@
+// Host test of the software motion grid: the first frame, the threshold,
+// the cell areas and frame widths that are not a multiple of the subsampling
+// step.
+//
+//   make -C tests test
+
+#include "Check.hpp"
+#include "MotionGrid.hpp"
+
+#include <vector>
+
+namespace
+{
+
+struct Frame
+{
+    int width;
+    int height;
+    int stride;
+    std::vector<uint8_t> luma;
+
+    Frame(int width, int height, int stride, uint8_t value)
+        : width(width), height(height), stride(stride), luma(stride * height, value) {}
+
+    void fill(int x0, int y0, int x1, int y1, uint8_t value)
+    {
+        for (int y = y0; y < y1; y++)
+            for (int x = x0; x < x1; x++)
+                luma[y * stride + x] = value;
+    }
+
+    // Bytes between width and stride, never part of the picture
+    void padding(uint8_t value)
+    {
+        for (int y = 0; y < height; y++)
+            for (int x = width; x < stride; x++)
+                luma[y * stride + x] = value;
+    }
+};
+
+bool allCells(const MotionGrid &grid, int value)
+{
+    for (uint8_t cell : grid.heatmap())
+        if (cell != value)
+            return false;
+    return true;
+}
+
+void firstFrameOnlyLearns()
+{
+    MotionGrid grid;
+    grid.configure(320, 240, 320, 8, 6);
+
+    Frame frame(320, 240, 320, 0);
+    for (size_t i = 0; i < frame.luma.size(); i++)
+        frame.luma[i] = i * 37;
+
+    CHECK(grid.process(frame.luma.data(), 1) == 0);
+    CHECK(allCells(grid, 0));
+
+    // Same frame again: background matches, nothing moves
+    CHECK(grid.process(frame.luma.data(), 1) == 0);
+    CHECK(allCells(grid, 0));
+}
+
+void configureResetsBackground()
+{
+    MotionGrid grid;
+    grid.configure(160, 120, 160, 4, 3);
+
+    Frame dark(160, 120, 160, 10);
+    Frame bright(160, 120, 160, 200);
+    grid.process(dark.luma.data(), 1);
+    CHECK(grid.process(bright.luma.data(), 1) == 12);
+
+    grid.configure(160, 120, 160, 4, 3);
+    CHECK(grid.process(bright.luma.data(), 1) == 0);
+    CHECK(allCells(grid, 0));
+}
+
+void thresholdIsInclusive()
+{
+    Frame before(320, 240, 320, 100);
+    Frame after(320, 240, 320, 132);
+
+    MotionGrid at;
+    at.configure(320, 240, 320, 4, 3);
+    at.process(before.luma.data(), 32);
+    CHECK(at.process(after.luma.data(), 32) == 12);
+    CHECK(allCells(at, 32));
+
+    MotionGrid above;
+    above.configure(320, 240, 320, 4, 3);
+    above.process(before.luma.data(), 33);
+    CHECK(above.process(after.luma.data(), 33) == 0);
+    CHECK(allCells(above, 32));
+}
+
+void changeStaysInItsCell()
+{
+    // step 2: 160x120 samples, cells of 40x40 samples are 80x80 pixels
+    MotionGrid grid;
+    grid.configure(320, 240, 320, 4, 3);
+
+    Frame frame(320, 240, 320, 50);
+    grid.process(frame.luma.data(), 20);
+
+    frame.fill(80, 160, 160, 240, 90);
+    CHECK(grid.process(frame.luma.data(), 20) == 1);
+
+    const std::vector<uint8_t> &cells = grid.heatmap();
+    for (int r = 0; r < grid.rows(); r++)
+        for (int c = 0; c < grid.columns(); c++)
+            CHECK(cells[r * grid.columns() + c] == (r == 2 && c == 1 ? 40 : 0));
+}
+
+// A uniform change gives every cell the same mean only if the areas the sums
+// are divided by match the samples that went into them
+void unevenCells(int width, int height, int stride, int cols, int rows)
+{
+    MotionGrid grid;
+    grid.configure(width, height, stride, cols, rows);
+    CHECK(grid.columns() == cols);
+    CHECK(grid.rows() == rows);
+
+    Frame before(width, height, stride, 60);
+    Frame after(width, height, stride, 160);
+    grid.process(before.luma.data(), 100);
+    CHECK(grid.process(after.luma.data(), 100) == cols * rows);
+    CHECK(allCells(grid, 100));
+}
+
+void cellAreas()
+{
+    unevenCells(320, 240, 320, 7, 5);
+    unevenCells(161, 90, 161, 7, 5);    // step 2, the last column is dropped
+    unevenCells(170, 97, 176, 9, 4);    // step 2, odd height, padded rows
+    unevenCells(481, 271, 512, 11, 13); // step 4
+    unevenCells(1920, 1080, 1920, 16, 9);
+}
+
+void paddingIsIgnored()
+{
+    MotionGrid grid;
+    grid.configure(170, 96, 192, 5, 3);
+
+    Frame frame(170, 96, 192, 80);
+    frame.padding(0);
+    grid.process(frame.luma.data(), 1);
+
+    frame.padding(255);
+    CHECK(grid.process(frame.luma.data(), 1) == 0);
+    CHECK(allCells(grid, 0));
+}
+
+void lastColumnsOfWideFrames()
+{
+    // 161 wide: step 2, 80 samples, pixel 160 is never read. A change in the
+    // last sampled column lands in the last grid column.
+    MotionGrid grid;
+    grid.configure(161, 8, 161, 4, 1);
+
+    Frame frame(161, 8, 161, 0);
+    grid.process(frame.luma.data(), 1);
+
+    frame.fill(160, 0, 161, 8, 255);
+    CHECK(grid.process(frame.luma.data(), 1) == 0);
+
+    frame.fill(158, 0, 159, 8, 255);
+    CHECK(grid.process(frame.luma.data(), 1) == 1);
+    CHECK(grid.heatmap()[3] > 0);
+    CHECK(grid.heatmap()[0] == 0);
+}
+
+void gridIsClampedToSamples()
+{
+    MotionGrid grid;
+    grid.configure(6, 3, 6, 16, 16);
+    CHECK(grid.columns() == 6);
+    CHECK(grid.rows() == 3);
+
+    MotionGrid tiny;
+    tiny.configure(1, 1, 1, 0, 0);
+    CHECK(tiny.columns() == 1);
+    CHECK(tiny.rows() == 1);
+
+    uint8_t pixel = 0;
+    tiny.process(&pixel, 1);
+    pixel = 255;
+    CHECK(tiny.process(&pixel, 1) == 1);
+    CHECK(tiny.heatmap()[0] == 255);
+}
+
+void backgroundAdapts()
+{
+    MotionGrid grid;
+    grid.configure(160, 120, 160, 2, 2);
+
+    Frame before(160, 120, 160, 0);
+    Frame after(160, 120, 160, 160);
+    grid.process(before.luma.data(), 1);
+
+    // Learns 1/16 of the difference per frame, the mean falls until the
+    // change is part of the background
+    int last = 256;
+    for (int i = 0; i < 200; i++)
+    {
+        grid.process(after.luma.data(), 1);
+        int mean = grid.heatmap()[0];
+        CHECK(mean <= last);
+        last = mean;
+    }
+    CHECK(grid.process(after.luma.data(), 1) == 0);
+}
+
+} // namespace
+
+int main()
+{
+    firstFrameOnlyLearns();
+    configureResetsBackground();
+    thresholdIsInclusive();
+    changeStaysInItsCell();
+    cellAreas();
+    paddingIsIgnored();
+    lastColumnsOfWideFrames();
+    gridIsClampedToSamples();
+    backgroundAdapts();
+
+    return checkResult("MotionGridTest");
+}
@@ -0,0 +1,717 @@
+// Replays a video stream (and audio frames) through TSMuxer, cut into
+// segments the way Recorder::collect cuts them, and demuxes the segments
+// again: packet framing, continuity counters, PAT/PMT and their CRCs, one PES
+// per access unit with the NALs that went in, PTS/PCR, random access flags
+// on keyframes and the ADTS/Opus framing of the audio.
+//
+// Without arguments synthetic H.264 and H.265 streams are replayed. A raw
+// Annex-B file from the camera can be replayed too, its segments are kept
+// for ffprobe when an output prefix is given:
+//
+//   make -C tests test
+//   tests/bin/TSMuxerTest [--h265] [--fps N] [--segment S] stream.h264 [out-prefix]
+
+#include "Check.hpp"
+#include "TSMuxer.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+using Bytes = std::vector<uint8_t>;
+using Codec = TSMuxer::VideoCodec;
+using AudioCodec = TSMuxer::AudioCodec;
+
+struct AccessUnit
+{
+    int64_t us;
+    bool keyframe;
+    std::vector<Bytes> nals;
+};
+
+struct AudioPacket
+{
+    int64_t us;
+    Bytes data;
+};
+
+// What went into one segment, in the order it was written
+struct Segment
+{
+    int64_t baseUs = -1;   // first timestamp the muxer saw, PTS 90000
+    std::vector<AccessUnit> video;
+    std::vector<AudioPacket> audio;
+    Bytes ts;
+};
+
+// Recorder::collect without the queues and the writer thread: NALs are
+// grouped into access units by timestamp, a segment ends at the first GOP
+// start after segmentUs or segmentMaxBytes.
+class Replay
+{
+public:
+    Replay(Codec codec, AudioCodec audioCodec, int64_t segmentUs, size_t segmentMaxBytes)
+        : codec(codec), audioCodec(audioCodec), segmentUs(segmentUs), segmentMaxBytes(segmentMaxBytes) {}
+
+    void video(const Bytes &nal, int64_t us)
+    {
+        bool gopStart = TSMuxer::isGopStart(codec, nal[0], prevNalType);
+        if (waitKeyframe && !gopStart)
+        {
+            skippedNals++;
+            return;
+        }
+        waitKeyframe = false;
+
+        if (!au.nals.empty() && au.us != us)
+            flushAccessUnit();
+
+        if (gopStart && muxer
+            && (us - segmentStartUs >= segmentUs || segments.back().ts.size() >= segmentMaxBytes))
+        {
+            finishSegment();
+        }
+
+        if (!muxer)
+            startSegment(us);
+
+        if (au.nals.empty())
+        {
+            au.us = us;
+            au.keyframe = false;
+        }
+        au.keyframe |= gopStart;
+        au.nals.push_back(nal);
+    }
+
+    void audio(const Bytes &frame, int64_t us)
+    {
+        if (!muxer || waitKeyframe)
+            return;
+        noteTimestamp(us);
+        muxer->writeAudio(frame.data(), frame.size(), us, segments.back().ts);
+        segments.back().audio.push_back({us, frame});
+    }
+
+    void finish()
+    {
+        finishSegment();
+    }
+
+    std::vector<Segment> segments;
+    int skippedNals = 0;
+
+private:
+    void startSegment(int64_t us)
+    {
+        muxer = std::make_unique<TSMuxer>(codec, audioCodec, 16000, 1);
+        segmentStartUs = us;
+        segments.emplace_back();
+        muxer->writeTables(segments.back().ts);
+    }
+
+    void flushAccessUnit()
+    {
+        if (au.nals.empty() || !muxer)
+            return;
+
+        std::vector<const Bytes *> nals;
+        for (const Bytes &nal : au.nals)
+            nals.push_back(&nal);
+        noteTimestamp(au.us);
+        muxer->writeVideo(nals, au.us, au.keyframe, segments.back().ts);
+        segments.back().video.push_back(std::move(au));
+        au = AccessUnit{};
+    }
+
+    void finishSegment()
+    {
+        if (!muxer)
+            return;
+        flushAccessUnit();
+        muxer.reset();
+    }
+
+    void noteTimestamp(int64_t us)
+    {
+        if (segments.back().baseUs < 0)
+            segments.back().baseUs = us;
+    }
+
+    Codec codec;
+    AudioCodec audioCodec;
+    int64_t segmentUs;
+    size_t segmentMaxBytes;
+    std::unique_ptr<TSMuxer> muxer;
+    int64_t segmentStartUs = 0;
+    bool waitKeyframe = true;
+    int prevNalType = -1;
+    AccessUnit au{};
+};
+
+// ---------------------------------------------------------------------------
+// Demuxer
+
+uint32_t crc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= static_cast<uint32_t>(data[i]) << 24;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+    }
+    return crc;
+}
+
+struct Pes
+{
+    uint16_t pid;
+    size_t packet;          // index of its first TS packet
+    bool randomAccess;
+    bool hasPcr;
+    uint64_t pcr;
+    Bytes data;             // PES header and payload
+};
+
+struct Demuxed
+{
+    std::vector<Pes> video;
+    std::vector<Pes> audio;
+    std::vector<uint16_t> pids;     // of every packet
+    int pats = 0;
+    int pmts = 0;
+    uint8_t videoType = 0;
+    uint8_t audioType = 0;
+};
+
+void checkSection(const uint8_t *payload, size_t len, uint8_t tableId)
+{
+    CHECK(len >= 1 && payload[0] == 0); // pointer field
+    const uint8_t *section = payload + 1;
+    CHECK(section[0] == tableId);
+    size_t sectionLength = ((section[1] & 0x0F) << 8) | section[2];
+    CHECK(3 + sectionLength <= len - 1);
+    // The CRC over a section including its CRC is 0
+    CHECK(crc32(section, 3 + sectionLength) == 0);
+}
+
+Demuxed demux(const Bytes &ts)
+{
+    Demuxed out;
+    std::map<uint16_t, int> cc;
+    std::map<uint16_t, bool> started;
+
+    CHECK(ts.size() % 188 == 0);
+    for (size_t pos = 0; pos + 188 <= ts.size(); pos += 188)
+    {
+        const uint8_t *pkt = &ts[pos];
+        size_t index = pos / 188;
+        CHECK(pkt[0] == 0x47);
+        CHECK((pkt[1] & 0x80) == 0); // no transport error
+
+        bool pusi = pkt[1] & 0x40;
+        uint16_t pid = ((pkt[1] & 0x1F) << 8) | pkt[2];
+        int afc = (pkt[3] >> 4) & 0x03;
+        int counter = pkt[3] & 0x0F;
+        out.pids.push_back(pid);
+
+        // Every packet carries payload, the counter advances on each
+        CHECK(afc == 1 || afc == 3);
+        if (cc.count(pid))
+            CHECK(counter == ((cc[pid] + 1) & 0x0F));
+        cc[pid] = counter;
+
+        const uint8_t *p = pkt + 4;
+        bool randomAccess = false;
+        bool hasPcr = false;
+        uint64_t pcr = 0;
+        if (afc == 3)
+        {
+            size_t adaptLen = *p++;
+            CHECK(adaptLen <= 183);
+            if (adaptLen > 0)
+            {
+                randomAccess = p[0] & 0x40;
+                hasPcr = p[0] & 0x10;
+                if (hasPcr)
+                {
+                    pcr = (static_cast<uint64_t>(p[1]) << 25) | (p[2] << 17) | (p[3] << 9) | (p[4] << 1)
+                          | (p[5] >> 7);
+                }
+            }
+            p += adaptLen;
+        }
+        size_t len = pkt + 188 - p;
+
+        if (pid == 0x0000)
+        {
+            CHECK(pusi);
+            checkSection(p, len, 0x00);
+            // program 1 on the PMT PID
+            CHECK(p[9] == 0x00 && p[10] == 0x01);
+            CHECK((((p[11] & 0x1F) << 8) | p[12]) == 0x1000);
+            out.pats++;
+        }
+        else if (pid == 0x1000)
+        {
+            CHECK(pusi);
+            checkSection(p, len, 0x02);
+            const uint8_t *section = p + 1;
+            size_t sectionLength = ((section[1] & 0x0F) << 8) | section[2];
+            CHECK((((section[8] & 0x1F) << 8) | section[9]) == 0x0100); // PCR PID
+            size_t infoLength = ((section[10] & 0x0F) << 8) | section[11];
+            size_t at = 12 + infoLength;
+            while (at + 5 <= 3 + sectionLength - 4)
+            {
+                uint16_t esPid = ((section[at + 1] & 0x1F) << 8) | section[at + 2];
+                if (esPid == 0x0100)
+                    out.videoType = section[at];
+                else if (esPid == 0x0101)
+                    out.audioType = section[at];
+                at += 5 + (((section[at + 3] & 0x0F) << 8) | section[at + 4]);
+            }
+            out.pmts++;
+        }
+        else if (pid == 0x0100 || pid == 0x0101)
+        {
+            std::vector<Pes> &list = pid == 0x0100 ? out.video : out.audio;
+            if (pusi)
+            {
+                list.push_back({pid, index, randomAccess, hasPcr, pcr, {}});
+                started[pid] = true;
+            }
+            else
+            {
+                // Flags only belong in front of a PES
+                CHECK(!randomAccess && !hasPcr);
+            }
+            // Continuation packets belong to the last PES of their PID
+            CHECK(started[pid]);
+            if (started[pid])
+                list.back().data.insert(list.back().data.end(), p, p + len);
+        }
+        else
+        {
+            CHECK(pid == 0x0000 || pid == 0x1000 || pid == 0x0100 || pid == 0x0101);
+        }
+    }
+    return out;
+}
+
+// Header of a PES, returns the payload. Checks the length field and the PTS
+// markers.
+Bytes pesPayload(const Pes &pes, uint8_t streamId, uint64_t &pts)
+{
+    const Bytes &d = pes.data;
+    pts = 0;
+    if (d.size() < 14)
+    {
+        CHECK(d.size() >= 14);
+        return {};
+    }
+    CHECK(d[0] == 0x00 && d[1] == 0x00 && d[2] == 0x01);
+    CHECK(d[3] == streamId);
+    size_t length = (d[4] << 8) | d[5];
+    // 0 (unbounded) only for video PES over 64 KiB
+    if (length == 0)
+        CHECK(streamId == 0xE0 && d.size() - 6 > 0xFFFF);
+    else
+        CHECK(length == d.size() - 6);
+    CHECK(d[6] == 0x80);
+    CHECK(d[7] == 0x80);
+    CHECK(d[8] == 0x05);
+    CHECK((d[9] & 0xF1) == 0x21);
+    CHECK((d[11] & 0x01) && (d[13] & 0x01));
+    pts = (static_cast<uint64_t>(d[9] & 0x0E) << 29) | (d[10] << 22) | ((d[11] & 0xFE) << 14) | (d[12] << 7)
+          | (d[13] >> 1);
+    return Bytes(d.begin() + 14, d.end());
+}
+
+// Annex-B to NALs, trailing zeros (the first byte of a 4 byte start code)
+// are dropped
+std::vector<Bytes> splitNals(const uint8_t *data, size_t len)
+{
+    std::vector<Bytes> nals;
+    size_t i = 0;
+    size_t start = std::string::npos;
+    auto close = [&](size_t end) {
+        while (end > start && data[end - 1] == 0)
+            end--;
+        if (end > start)
+            nals.emplace_back(data + start, data + end);
+    };
+    while (i + 3 <= len)
+    {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1)
+        {
+            if (start != std::string::npos)
+                close(i);
+            i += 3;
+            start = i;
+        }
+        else
+        {
+            i++;
+        }
+    }
+    if (start != std::string::npos)
+        close(len);
+    return nals;
+}
+
+uint64_t expectedPts(const Segment &segment, int64_t us)
+{
+    return static_cast<uint64_t>((us - segment.baseUs) * 9 / 100 + 90000);
+}
+
+void checkVideo(Codec codec, const Segment &segment, const Demuxed &d)
+{
+    CHECK(d.videoType == (codec == Codec::H265 ? 0x24 : 0x1B));
+    CHECK(d.video.size() == segment.video.size());
+    if (d.video.empty() || d.video.size() != segment.video.size())
+        return;
+
+    // A segment starts with the tables and a keyframe
+    CHECK(d.pids.size() >= 2 && d.pids[0] == 0x0000 && d.pids[1] == 0x1000);
+    CHECK(segment.video[0].keyframe);
+
+    uint64_t lastPts = 0;
+    for (size_t i = 0; i < d.video.size(); i++)
+    {
+        const Pes &pes = d.video[i];
+        const AccessUnit &au = segment.video[i];
+
+        uint64_t pts;
+        Bytes payload = pesPayload(pes, 0xE0, pts);
+        CHECK(pts == expectedPts(segment, au.us));
+        CHECK(i == 0 || pts > lastPts);
+        lastPts = pts;
+
+        CHECK(pes.hasPcr);
+        CHECK(pes.pcr <= pts);
+        CHECK(pes.randomAccess == au.keyframe);
+        // Keyframes repeat the tables right in front of them
+        if (au.keyframe)
+        {
+            CHECK(pes.packet >= 2 && d.pids[pes.packet - 2] == 0x0000 && d.pids[pes.packet - 1] == 0x1000);
+        }
+
+        // An access unit delimiter, then the NALs as they came
+        std::vector<Bytes> nals = splitNals(payload.data(), payload.size());
+        CHECK(nals.size() == au.nals.size() + 1);
+        if (nals.size() != au.nals.size() + 1)
+            continue;
+        if (codec == Codec::H265)
+            CHECK(((nals[0][0] >> 1) & 0x3F) == 35);
+        else
+            CHECK((nals[0][0] & 0x1F) == 9);
+        for (size_t n = 0; n < au.nals.size(); n++)
+            CHECK(nals[n + 1] == au.nals[n]);
+    }
+}
+
+void checkAudio(AudioCodec codec, const Segment &segment, const Demuxed &d)
+{
+    if (codec == AudioCodec::None)
+    {
+        CHECK(d.audio.empty());
+        CHECK(d.audioType == 0);
+        return;
+    }
+
+    CHECK(d.audioType == (codec == AudioCodec::AAC ? 0x0F : 0x06));
+    CHECK(d.audio.size() == segment.audio.size());
+    if (d.audio.size() != segment.audio.size())
+        return;
+
+    for (size_t i = 0; i < d.audio.size(); i++)
+    {
+        const AudioPacket &frame = segment.audio[i];
+        uint64_t pts;
+        Bytes payload = pesPayload(d.audio[i], codec == AudioCodec::AAC ? 0xC0 : 0xBD, pts);
+        CHECK(pts == expectedPts(segment, frame.us));
+        CHECK(!d.audio[i].hasPcr && !d.audio[i].randomAccess);
+
+        size_t header;
+        if (codec == AudioCodec::AAC)
+        {
+            // ADTS: MPEG-4 AAC LC, no CRC, 16 kHz, one channel
+            CHECK(payload.size() >= 7);
+            CHECK(payload[0] == 0xFF && (payload[1] & 0xF6) == 0xF0 && (payload[1] & 0x01));
+            CHECK(((payload[2] >> 6) & 0x03) == 1);
+            CHECK(((payload[2] >> 2) & 0x0F) == 8);
+            CHECK((((payload[2] & 0x01) << 2) | (payload[3] >> 6)) == 1);
+            size_t frameLength = ((payload[3] & 0x03) << 11) | (payload[4] << 3) | (payload[5] >> 5);
+            CHECK(frameLength == frame.data.size() + 7);
+            header = 7;
+        }
+        else
+        {
+            // Opus control header, the size as a run of 255s
+            CHECK(payload.size() >= 3);
+            CHECK(payload[0] == 0x7F && (payload[1] & 0xE0) == 0xE0);
+            size_t size = 0;
+            header = 2;
+            while (header < payload.size() && payload[header] == 0xFF)
+                size += payload[header++];
+            size += payload[header++];
+            CHECK(size == frame.data.size());
+        }
+        CHECK(Bytes(payload.begin() + header, payload.end()) == frame.data);
+    }
+}
+
+// Cuts only at GOP starts, and only once a segment is long enough
+void checkSegments(const Replay &replay, int64_t segmentUs, size_t segmentMaxBytes, size_t accessUnits)
+{
+    size_t total = 0;
+    for (size_t s = 0; s < replay.segments.size(); s++)
+    {
+        const Segment &segment = replay.segments[s];
+        total += segment.video.size();
+        if (s + 1 < replay.segments.size() && !segment.video.empty())
+        {
+            int64_t duration = replay.segments[s + 1].video[0].us - segment.video[0].us;
+            CHECK(duration >= segmentUs || segment.ts.size() >= segmentMaxBytes);
+        }
+    }
+    CHECK(total == accessUnits);
+}
+
+// ---------------------------------------------------------------------------
+// Sources
+
+uint32_t seed = 12345;
+
+uint8_t noise()
+{
+    // Never 0, the payload can't look like a start code
+    seed = seed * 1103515245 + 12345;
+    return 1 + (seed >> 16) % 255;
+}
+
+Bytes nal(std::initializer_list<uint8_t> header, size_t size)
+{
+    Bytes out(header);
+    while (out.size() < size)
+        out.push_back(noise());
+    return out;
+}
+
+// Frame sizes around the packet boundaries and past the 16 bit PES length
+size_t frameSize(int frame)
+{
+    static const size_t sizes[] = {1, 2, 150, 169, 170, 171, 183, 184, 185, 350, 366, 367, 368,
+                                   1000, 4096, 65515, 65536, 70000, 200000};
+    return sizes[frame % (sizeof(sizes) / sizeof(sizes[0]))];
+}
+
+std::vector<AccessUnit> synthetic(Codec codec, int frames, int gop, int64_t frameUs)
+{
+    std::vector<AccessUnit> out;
+    for (int f = 0; f < frames; f++)
+    {
+        AccessUnit au{f * frameUs, f % gop == 0, {}};
+        size_t size = frameSize(f);
+        if (codec == Codec::H265)
+        {
+            if (au.keyframe)
+            {
+                au.nals.push_back(nal({0x40, 0x01}, 24)); // VPS
+                au.nals.push_back(nal({0x42, 0x01}, 40)); // SPS
+                au.nals.push_back(nal({0x44, 0x01}, 8));  // PPS
+                au.nals.push_back(nal({0x26, 0x01}, std::max<size_t>(size, 3))); // IDR_W_RADL
+            }
+            else
+            {
+                au.nals.push_back(nal({0x02, 0x01}, std::max<size_t>(size, 3))); // TRAIL_R
+            }
+        }
+        else
+        {
+            if (au.keyframe && f / gop % 2 == 0)
+            {
+                au.nals.push_back(nal({0x67}, 20)); // SPS
+                au.nals.push_back(nal({0x68}, 4));  // PPS
+            }
+            // Every other GOP starts with a bare IDR
+            au.nals.push_back(nal({static_cast<uint8_t>(au.keyframe ? 0x65 : 0x41)}, size));
+            // Frames of two slices now and then
+            if (f % 7 == 3)
+                au.nals.push_back(nal({static_cast<uint8_t>(au.keyframe ? 0x65 : 0x41)}, 300));
+        }
+        out.push_back(std::move(au));
+    }
+    return out;
+}
+
+// A raw encoder dump split into access units: a new one starts with the
+// first slice of a picture or with the parameter sets and SEI in front of it
+std::vector<AccessUnit> fromFile(const char *path, Codec codec, int fps)
+{
+    std::vector<AccessUnit> out;
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        printf("can't open %s\n", path);
+        return out;
+    }
+    Bytes data;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        data.insert(data.end(), buf, buf + n);
+    fclose(f);
+
+    bool haveSlice = false;
+    int prevNalType = -1;
+    for (Bytes &unit : splitNals(data.data(), data.size()))
+    {
+        int type;
+        bool vcl;
+        bool firstSlice;
+        bool prefix;
+        if (codec == Codec::H265)
+        {
+            type = (unit[0] >> 1) & 0x3F;
+            vcl = type < 32;
+            firstSlice = vcl && unit.size() > 2 && (unit[2] & 0x80);
+            prefix = (type >= 32 && type <= 34) || type == 39;
+            if (type == 35)
+                continue; // the muxer writes its own delimiters
+        }
+        else
+        {
+            type = unit[0] & 0x1F;
+            vcl = type >= 1 && type <= 5;
+            firstSlice = vcl && unit.size() > 1 && (unit[1] & 0x80); // first_mb_in_slice 0
+            prefix = type == 6 || type == 7 || type == 8;
+            if (type == 9)
+                continue;
+        }
+
+        if (out.empty() || (haveSlice && (firstSlice || prefix)))
+        {
+            int64_t us = static_cast<int64_t>(out.size()) * 1000000 / fps;
+            out.push_back({us, false, {}});
+            haveSlice = false;
+        }
+        out.back().keyframe |= TSMuxer::isGopStart(codec, unit[0], prevNalType);
+        haveSlice |= vcl;
+        out.back().nals.push_back(std::move(unit));
+    }
+    return out;
+}
+
+// ---------------------------------------------------------------------------
+
+void replay(const char *name, Codec codec, AudioCodec audioCodec, const std::vector<AccessUnit> &input,
+            int64_t segmentUs, size_t segmentMaxBytes, const char *outPrefix = nullptr)
+{
+    Replay replay(codec, audioCodec, segmentUs, segmentMaxBytes);
+
+    // 1024 samples at 16 kHz, sizes around the 255 steps of the Opus size
+    static const size_t audioSizes[] = {1, 7, 254, 255, 256, 300, 509, 510, 511, 600};
+    const int64_t audioUs = 64000;
+    int64_t nextAudio = 0;
+    int audioFrames = 0;
+    for (const AccessUnit &au : input)
+    {
+        while (audioCodec != AudioCodec::None && nextAudio <= au.us)
+        {
+            replay.audio(nal({}, audioSizes[audioFrames % (sizeof(audioSizes) / sizeof(audioSizes[0]))]), nextAudio);
+            nextAudio += audioUs;
+            audioFrames++;
+        }
+        for (const Bytes &n : au.nals)
+            replay.video(n, au.us);
+    }
+    replay.finish();
+
+    size_t skipped = 0;
+    while (skipped < input.size() && !input[skipped].keyframe)
+        skipped++;
+
+    int before = checkFailures;
+    for (size_t s = 0; s < replay.segments.size(); s++)
+    {
+        const Segment &segment = replay.segments[s];
+        Demuxed d = demux(segment.ts);
+        CHECK(d.pats >= 1 && d.pmts == d.pats);
+        checkVideo(codec, segment, d);
+        checkAudio(audioCodec, segment, d);
+
+        if (outPrefix)
+        {
+            std::string path = std::string(outPrefix) + "-" + std::to_string(s) + ".ts";
+            FILE *f = fopen(path.c_str(), "wb");
+            if (f)
+            {
+                fwrite(segment.ts.data(), 1, segment.ts.size(), f);
+                fclose(f);
+            }
+        }
+    }
+    checkSegments(replay, segmentUs, segmentMaxBytes, input.size() - skipped);
+
+    size_t bytes = 0;
+    for (const Segment &segment : replay.segments)
+        bytes += segment.ts.size();
+    printf("%s: %zu access units, %zu segments, %zu bytes%s\n", name, input.size() - skipped,
+           replay.segments.size(), bytes, checkFailures != before ? " FAILED" : "");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Codec codec = Codec::H264;
+    int fps = 25;
+    int64_t segmentUs = 2000000;
+    const char *file = nullptr;
+    const char *outPrefix = nullptr;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--h265"))
+            codec = Codec::H265;
+        else if (!strcmp(argv[i], "--fps") && i + 1 < argc)
+            fps = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--segment") && i + 1 < argc)
+            segmentUs = static_cast<int64_t>(atof(argv[++i]) * 1000000);
+        else if (!file)
+            file = argv[i];
+        else
+            outPrefix = argv[i];
+    }
+
+    if (file)
+    {
+        std::vector<AccessUnit> input = fromFile(file, codec, fps > 0 ? fps : 25);
+        CHECK(!input.empty());
+        replay(file, codec, AudioCodec::None, input, segmentUs, SIZE_MAX, outPrefix);
+        return checkResult("TSMuxerTest");
+    }
+
+    // 25 fps, GOP of 1s, segments of 2s: cuts at frames 50, 100, ...
+    replay("h264", Codec::H264, AudioCodec::None, synthetic(Codec::H264, 240, 25, 40000), 2000000, SIZE_MAX);
+    replay("h264+aac", Codec::H264, AudioCodec::AAC, synthetic(Codec::H264, 240, 25, 40000), 2000000, SIZE_MAX);
+    replay("h265+opus", Codec::H265, AudioCodec::Opus, synthetic(Codec::H265, 240, 30, 33333), 1500000, SIZE_MAX);
+    // Size limit reached before the time limit
+    replay("h264 1 MiB", Codec::H264, AudioCodec::AAC, synthetic(Codec::H264, 240, 10, 40000), 60000000, 1 << 20);
+
+    // A stream that starts in the middle of a GOP waits for the next keyframe
+    std::vector<AccessUnit> late = synthetic(Codec::H264, 120, 25, 40000);
+    late.erase(late.begin(), late.begin() + 7);
+    replay("h264 joined late", Codec::H264, AudioCodec::AAC, late, 2000000, SIZE_MAX);
+
+    return checkResult("TSMuxerTest");
+}
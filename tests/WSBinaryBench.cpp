@@ -0,0 +1,191 @@
+// Parses and applies the same slider changes as a JSON request and as a
+// binary batch (WSBinary::run) and builds the answer of each. The websocket
+// handler parses JSON with lejp from libwebsockets, which the host lacks,
+// json-c stands in for it: both walk the request once and set every value by
+// its path.
+//
+//   make -C tests bench
+//   tests/bin/WSBinaryBench [rounds]
+
+#include "Config.hpp"
+#include "WSBinary.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+std::shared_ptr<CFG> cfg;
+
+namespace
+{
+
+// What a drag of the image sliders sends, then a bitrate and gop change
+const char *const changedKeys[] = {"image.brightness", "image.contrast", "image.saturation",
+                                   "image.sharpness",  "image.hue",      "stream0.bitrate",
+                                   "stream0.gop",      "stream0.fps"};
+
+volatile uint64_t sink;
+
+void put16(std::string &out, uint16_t value)
+{
+    out += static_cast<char>(value >> 8);
+    out += static_cast<char>(value & 0xff);
+}
+
+void put32(std::string &out, uint32_t value)
+{
+    put16(out, value >> 16);
+    put16(out, value & 0xffff);
+}
+
+int keyId(const char *path)
+{
+    const std::vector<CFG::KeyInfo> &keys = cfg->keys();
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        if (keys[i].path == path)
+            return keys[i].type == CFG::ItemType::Int ? static_cast<int>(i) : -1;
+    }
+    return -1;
+}
+
+// {"image":{"brightness":100,...},"stream0":{"bitrate":100,...}}
+std::string jsonRequest(size_t count, int value)
+{
+    std::string json = "{";
+    std::string section;
+    for (size_t i = 0; i < count; i++)
+    {
+        std::string path = changedKeys[i];
+        size_t dot = path.find('.');
+        if (path.substr(0, dot) != section)
+        {
+            if (!section.empty())
+                json += "},";
+            section = path.substr(0, dot);
+            json += "\"" + section + "\":{";
+        }
+        else
+        {
+            json += ",";
+        }
+        json += "\"" + path.substr(dot + 1) + "\":" + std::to_string(value);
+    }
+    return json + "}}";
+}
+
+std::string binaryRequest(size_t count, int value)
+{
+    std::string request;
+    request += static_cast<char>(WS_BINARY_VERSION);
+    request += '\0';
+    put16(request, 1);
+    for (size_t i = 0; i < count; i++)
+    {
+        request += static_cast<char>(2); // set
+        put16(request, keyId(changedKeys[i]));
+        put16(request, 4);
+        put32(request, value);
+    }
+    return request;
+}
+
+// Sets every number of the request by its path and answers with the values
+// the keys have afterwards, the way the JSON handler does
+size_t applyJson(json_object *obj, std::string &path, std::string &answer)
+{
+    size_t sets = 0;
+    answer += '{';
+    bool separator = false;
+    json_object_object_foreach(obj, name, value)
+    {
+        size_t prefix = path.size();
+        if (prefix)
+            path += '.';
+        path += name;
+
+        if (separator)
+            answer += ',';
+        separator = true;
+        answer += '"';
+        answer += name;
+        answer += "\":";
+
+        if (json_object_is_type(value, json_type_object))
+        {
+            sets += applyJson(value, path, answer);
+        }
+        else
+        {
+            cfg->set<int>(path, json_object_get_int(value));
+            answer += std::to_string(cfg->get<int>(path));
+            sets++;
+        }
+        path.resize(prefix);
+    }
+    answer += '}';
+    return sets;
+}
+
+template <typename F>
+double usPerRequest(int rounds, F &&run)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        run(r);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::micro>(elapsed).count() / rounds;
+}
+
+void compare(size_t count, int rounds)
+{
+    // two values in turn, every set changes its key
+    const std::string json[2] = {jsonRequest(count, 100), jsonRequest(count, 101)};
+    const std::string binary[2] = {binaryRequest(count, 100), binaryRequest(count, 101)};
+
+    std::string path;
+    std::string jsonAnswer;
+    double jsonUs = usPerRequest(rounds, [&](int r) {
+        json_object *root = json_tokener_parse(json[r & 1].c_str());
+        jsonAnswer.clear();
+        sink = sink + applyJson(root, path, jsonAnswer);
+        json_object_put(root);
+    });
+
+    std::vector<uint8_t> binaryAnswer;
+    double binaryUs = usPerRequest(rounds, [&](int r) {
+        binaryAnswer.clear();
+        sink = sink + WSBinary::run(binary[r & 1], binaryAnswer).size();
+    });
+
+    printf("%zu %s: json %6.2f us (%3zu bytes, answer %3zu)  binary %6.2f us (%3zu bytes, answer %3zu)\n", count,
+           count == 1 ? "key " : "keys", jsonUs, json[0].size(), jsonAnswer.size(), binaryUs, binary[0].size(),
+           binaryAnswer.size());
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 20000;
+
+    cfg = std::make_shared<CFG>();
+    for (const char *key : changedKeys)
+    {
+        if (keyId(key) < 0)
+        {
+            fprintf(stderr, "not an int config key: %s\n", key);
+            return 1;
+        }
+    }
+
+    printf("%d requests per size, parse, set and answer\n", rounds);
+    compare(1, rounds);
+    compare(4, rounds);
+    compare(sizeof(changedKeys) / sizeof(changedKeys[0]), rounds);
+
+    return 0;
+}